@@ -20,6 +20,8 @@ extern "C" {
   */
 
   static EVMod *addModule(EVRoot *root, char *name);
+  static void busTimerCB(EVMod *mod, EVTimer *timer, void *magic);
+  static void busTimerArm(EVBus *bus);
 
   EVMod *EVInit(void *data) {
     EVRoot *root = (EVRoot *)my_calloc(sizeof(EVRoot));
@@ -61,7 +63,6 @@ extern "C" {
 	bus->events = UTHASH_NEW(EVEvent, name, UTHASH_SKEY);
 	bus->eventList = UTArrayNew(UTARRAY_DFLT);
 	bus->sockets = UTArrayNew(UTARRAY_PACK);
-	bus->sockets_run = UTArrayNew(UTARRAY_DFLT);
 	bus->sockets_del = UTArrayNew(UTARRAY_DFLT);
 	if(pipe(bus->pipe) == -1) {
 	  myLog(LOG_ERR, "pipe() failed : %s", strerror(errno));
@@ -73,7 +74,39 @@ extern "C" {
 	// indicate some sort of rare meltdown and losing events
 	// to EWOULDBLOCK could make things worse.
 
-	bus->select_mS = EVBUS_SELECT_MS_TICK;
+	// events from other bus threads arrive on lock-free rings,
+	// with an eventfd to wake us up when one becomes non-empty.
+	bus->rings_in = UTArrayNew(UTARRAY_DFLT);
+	bus->rings_run = UTArrayNew(UTARRAY_DFLT);
+	bus->rings_out = UTArrayNew(UTARRAY_DFLT);
+	bus->ringbuf = (char *)my_calloc(EVBUS_RING_BYTES + 1);
+	if((bus->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+	  myLog(LOG_ERR, "eventfd() failed : %s", strerror(errno));
+	  abort();
+	}
+
+	// each bus has it's own epoll set. Sockets are registered once
+	// when they are added and removed again when they are closed,
+	// so the cost of a wakeup does not grow with the number of
+	// (mostly idle) sockets on the bus.  The pipe is registered
+	// (and the eventfd) with pointers into the bus struct to tell
+	// them apart from the sockets.
+	if((bus->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+	  myLog(LOG_ERR, "epoll_create1() failed : %s", strerror(errno));
+	  abort();
+	}
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = bus->pipe };
+	if(epoll_ctl(bus->epoll_fd, EPOLL_CTL_ADD, bus->pipe[0], &ev) == -1) {
+	  myLog(LOG_ERR, "epoll_ctl(ADD pipe) failed : %s", strerror(errno));
+	  abort();
+	}
+	ev.data.ptr = &bus->evfd;
+	if(epoll_ctl(bus->epoll_fd, EPOLL_CTL_ADD, bus->evfd, &ev) == -1) {
+	  myLog(LOG_ERR, "epoll_ctl(ADD eventfd) failed : %s", strerror(errno));
+	  abort();
+	}
+
+	bus->timer_mS = EVBUS_TIMER_MS_TICK;
 	bus->stop = NO;
       }
     }
@@ -81,6 +114,11 @@ extern "C" {
     if(new_bus) {
       EVEvent *handshake = EVGetEvent(bus, EVEVENT_HANDSHAKE);
       EVEventRx(mod, handshake, evt_handshake);
+      // heartbeat timer drives tick/tock/deci. It is armed
+      // when the bus starts running.
+      bus->timer = EVBusAddTimer(mod->root->rootModule, bus, busTimerCB, NULL);
+      if(bus->timer == NULL)
+	abort();
     }
 
     return bus;
@@ -123,9 +161,17 @@ extern "C" {
 	sock->readCB = readCB;
 	sock->module = mod;
 	sock->magic = magic;
-	UTHashAdd(mod->root->sockets, sock);
-	UTArrayAdd(bus->sockets, sock);
-	bus->socketsChanged = YES;
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = sock };
+	if(epoll_ctl(bus->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+	  myLog(LOG_ERR, "epoll_ctl(ADD fd=%d) failed : %s", fd, strerror(errno));
+	  my_free(sock);
+	  sock = NULL;
+	}
+	else {
+	  UTHashAdd(mod->root->sockets, sock);
+	  UTArrayAdd(bus->sockets, sock);
+	  bus->socketsChanged = YES;
+	}
       }
     }
     return sock;
@@ -138,6 +184,10 @@ extern "C" {
       deleted = UTHashDelKey(mod->root->sockets, &search);
       assert(deleted == sock);
       if(sock->fd > 0) {
+	// deregister explicitly - close() only removes it from the
+	// epoll set if there are no other references to the file.
+	if(epoll_ctl(sock->bus->epoll_fd, EPOLL_CTL_DEL, sock->fd, NULL) == -1)
+	  myDebug(1, "epoll_ctl(DEL fd=%d) failed : %s", sock->fd, strerror(errno));
 	while(close(sock->fd) == -1 && errno == EINTR);
 	sock->fd = 0;
       }
@@ -155,6 +205,92 @@ extern "C" {
     return (deleted != NULL);
   }
 
+  /*_________________---------------------------__________________
+    _________________     timers                __________________
+    -----------------___________________________------------------
+    Each timer is a timerfd registered as a socket on the bus, so
+    it fires in the bus thread just like any other read callback
+    and an idle bus can sleep until the next deadline.  A timer is
+    created disarmed. Use EVTimerSet() to start it (first_mS == 0
+    means "use period_mS", period_mS == 0 means one-shot) and
+    EVTimerSet(timer, 0, 0) to stop it again.  EVTimerCancel()
+    frees the timer, so it should only be called from the thread
+    that runs the bus (e.g. from the timer callback itself).
+  */
+
+  static void timerReadCB(EVMod *mod, EVSocket *sock, void *magic) {
+    EVTimer *timer = (EVTimer *)magic;
+    uint64_t expirations;
+    int cc = read(sock->fd, &expirations, sizeof(expirations));
+    if(cc != sizeof(expirations)) {
+      // EAGAIN if it was disarmed or re-armed in the meantime
+      if(cc < 0
+	 && errno != EAGAIN
+	 && errno != EINTR)
+	myLog(LOG_ERR, "timerfd read() failed : %s", strerror(errno));
+      return;
+    }
+    (*timer->timerCB)(timer->module, timer, timer->magic);
+  }
+
+  EVTimer *EVBusAddTimer(EVMod *mod, EVBus *bus, EVTimerCB timerCB, void *magic) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(fd == -1) {
+      myLog(LOG_ERR, "timerfd_create() failed : %s", strerror(errno));
+      return NULL;
+    }
+    EVTimer *timer = (EVTimer *)my_calloc(sizeof(EVTimer));
+    timer->module = mod;
+    timer->timerCB = timerCB;
+    timer->magic = magic;
+    timer->sock = EVBusAddSocket(mod, bus, fd, timerReadCB, timer);
+    if(timer->sock == NULL) {
+      while(close(fd) == -1 && errno == EINTR);
+      my_free(timer);
+      return NULL;
+    }
+    return timer;
+  }
+
+  bool EVTimerSet(EVTimer *timer, uint32_t first_mS, uint32_t period_mS) {
+    if(first_mS == 0)
+      first_mS = period_mS;
+    struct itimerspec its = {
+      .it_value = { first_mS / 1000, (first_mS % 1000) * 1000000 },
+      .it_interval = { period_mS / 1000, (period_mS % 1000) * 1000000 }
+    };
+    if(timerfd_settime(timer->sock->fd, 0, &its, NULL) == -1) {
+      myLog(LOG_ERR, "timerfd_settime() failed : %s", strerror(errno));
+      return NO;
+    }
+    return YES;
+  }
+
+  void EVTimerCancel(EVMod *mod, EVTimer *timer) {
+    // closing the socket also closes the timerfd
+    EVSocketClose(mod, timer->sock);
+    my_free(timer);
+  }
+
+  static void busTimerArm(EVBus *bus) {
+    EVTimerSet(bus->timer, bus->timer_mS, bus->timer_mS);
+  }
+
+  static void busTimerCB(EVMod *mod, EVTimer *timer, void *magic) {
+    EVBus *bus = timer->sock->bus;
+    // These tick/tock/deci events can still skip if something
+    // blocks for too long in this thread,  so it's advisable
+    // to implement timeouts by comparing with a target time.
+    if(bus->timer_mS == EVBUS_TIMER_MS_DECI) {
+      EVEventTx(mod, EVGetEvent(bus, EVEVENT_DECI), NULL, 0);
+      if(++bus->deciCount < (EVBUS_TIMER_MS_TICK / EVBUS_TIMER_MS_DECI))
+	return;
+      bus->deciCount = 0;
+    }
+    EVEventTx(mod, EVGetEvent(bus, EVEVENT_TICK), NULL, 0);
+    EVEventTx(mod, EVGetEvent(bus, EVEVENT_TOCK), NULL, 0);
+  }
+
   void EVEventRx(EVMod *mod, EVEvent *evt, EVActionCB cb) {
     EVAction *act = (EVAction *)my_calloc(sizeof(EVAction));
     act->module = mod;
@@ -165,9 +301,12 @@ extern "C" {
       UTArrayAdd(evt->actions, act);
       evt->actionsChanged = YES;
     }
-    if(my_strequal(evt->name, EVEVENT_DECI)) {
-      // shorten select timeout so we can deliver deciTicks
-      evt->bus->select_mS = EVBUS_SELECT_MS_DECI;
+    if(my_strequal(evt->name, EVEVENT_DECI)
+       && evt->bus->timer_mS != EVBUS_TIMER_MS_DECI) {
+      // speed up the heartbeat so we can deliver deciTicks
+      evt->bus->timer_mS = EVBUS_TIMER_MS_DECI;
+      if(evt->bus->running)
+	busTimerArm(evt->bus);
     }
   }
 
@@ -306,6 +445,143 @@ extern "C" {
     return NO;
   }
 
+  /*_________________---------------------------__________________
+    _________________     inter-bus rings       __________________
+    -----------------___________________________------------------
+    One ring for each (src,dst) pair, created on first use by the
+    sending thread.  Each record is an EVEventHdr followed by the
+    data, and may wrap around the end of the buffer.  The producer
+    only rings the doorbell when it finds that the consumer had
+    already caught up (seq_cst on both sides so that one of them
+    always sees the other's update and no wakeup is lost).
+  */
+
+  static EVRing *getRing(EVBus *src, EVBus *dst) {
+    EVRing *ring;
+    // rings_out is only ever touched by the src thread
+    UTARRAY_WALK(src->rings_out, ring) {
+      if(ring->dst == dst)
+	return ring;
+    }
+    ring = (EVRing *)my_calloc(sizeof(EVRing));
+    ring->src = src;
+    ring->dst = dst;
+    ring->size = EVBUS_RING_BYTES;
+    ring->buf = (char *)my_calloc(ring->size);
+    UTArrayAdd(src->rings_out, ring);
+    SEMLOCK_DO(dst->root->sync) {
+      UTArrayAdd(dst->rings_in, ring);
+      dst->ringsChanged = YES;
+    }
+    return ring;
+  }
+
+  static void ringCopyIn(EVRing *ring, uint32_t at, void *from, uint32_t len) {
+    uint32_t off = at & (ring->size - 1);
+    uint32_t len1 = ring->size - off;
+    if(len1 > len) len1 = len;
+    memcpy(ring->buf + off, from, len1);
+    if(len > len1)
+      memcpy(ring->buf, (char *)from + len1, len - len1);
+  }
+
+  static void ringCopyOut(EVRing *ring, uint32_t at, void *to, uint32_t len) {
+    uint32_t off = at & (ring->size - 1);
+    uint32_t len1 = ring->size - off;
+    if(len1 > len) len1 = len;
+    memcpy(to, ring->buf + off, len1);
+    if(len > len1)
+      memcpy((char *)to + len1, ring->buf, len - len1);
+  }
+
+  static void busDoorbell(EVBus *bus) {
+    uint64_t one = 1;
+    while(write(bus->evfd, &one, sizeof(one)) == -1 && errno == EINTR);
+  }
+
+  static bool eventTxRing(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    if(dataLen > EV_MAX_RING_EVT_DATALEN) {
+      myLog(LOG_ERR, "event from mod %s to bus %s : msg too long(%u)",
+	    mod->name,
+	    evt->bus->name,
+	    dataLen);
+      return NO;
+    }
+    EVRing *ring = getRing(threadBus, evt->bus);
+    EVEventHdr hdr = { .modId = mod->id,
+		       .eventId = evt->id,
+		       .dataLen = dataLen };
+    uint32_t len = sizeof(hdr) + dataLen;
+    uint32_t head = ring->head;
+    // wait for space. Like a full pipe,  this should only happen
+    // if the other thread is stuck.  Keep prodding it.
+    for(int waits = 0; (ring->size - (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))) < len; waits++) {
+      if(waits == 0)
+	myDebug(1, "bus %s: ring to bus %s full", ring->src->name, ring->dst->name);
+      busDoorbell(ring->dst);
+      usleep(100);
+    }
+    ringCopyIn(ring, head, &hdr, sizeof(hdr));
+    if(dataLen)
+      ringCopyIn(ring, head + sizeof(hdr), data, dataLen);
+    __atomic_store_n(&ring->head, head + len, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == head)
+      busDoorbell(ring->dst);
+    return YES;
+  }
+
+  static int busRxRing(EVBus *bus, EVRing *ring) {
+    int batch = 0;
+    uint32_t tail = ring->tail;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+    while(tail != head) {
+      if(batch++ == EVBUS_RING_BATCH) {
+	// let the sockets have a turn, but make sure we come back
+	busDoorbell(bus);
+	break;
+      }
+      EVEventHdr hdr;
+      ringCopyOut(ring, tail, &hdr, sizeof(hdr));
+      char *data = bus->ringbuf;
+      if(hdr.dataLen)
+	ringCopyOut(ring, tail + sizeof(hdr), data, hdr.dataLen);
+      data[hdr.dataLen] = '\0'; // NULL-terminate (convenient if string msg)
+      // release the space before we dispatch
+      tail += sizeof(hdr) + hdr.dataLen;
+      __atomic_store_n(&ring->tail, tail, __ATOMIC_SEQ_CST);
+      EVMod *mod;
+      EVEvent *evt;
+      SEMLOCK_DO(bus->root->sync) {
+	mod = UTArrayAt(bus->root->moduleList, hdr.modId);
+	evt = UTArrayAt(bus->eventList, hdr.eventId);
+      }
+      EVEventTx(mod, evt, (hdr.dataLen ? data : NULL), hdr.dataLen);
+      head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+    }
+    return batch;
+  }
+
+  static void busRxRings(EVBus *bus) {
+    uint64_t count;
+    // clear the doorbell first, so that anything added after
+    // this point will ring it again.
+    if(read(bus->evfd, &count, sizeof(count)) == -1
+       && errno != EAGAIN
+       && errno != EINTR)
+      myLog(LOG_ERR, "bus %s eventfd read() failed : %s", bus->name, strerror(errno));
+    if(bus->ringsChanged) {
+      SEMLOCK_DO(bus->root->sync) {
+	UTArrayReset(bus->rings_run);
+	UTArrayAddAll(bus->rings_run, bus->rings_in);
+	bus->ringsChanged = NO;
+      }
+    }
+    EVRing *ring;
+    UTARRAY_WALK(bus->rings_run, ring) {
+      busRxRing(bus, ring);
+    }
+  }
+
   static void EVSocketFree(EVSocket *sock) {
     assert(sock->fd <= 0);
     if(sock->iobuf)
@@ -332,8 +608,14 @@ extern "C" {
 	sent++;
       }
     }
+    else if(threadBus) {
+      // inter-bus event goes on the ring for that pair of buses.
+      if(eventTxRing(mod, evt, data, dataLen))
+	sent++;
+    }
     else {
-      // inter-bus event goes on pipe for simple select() sync.
+      // not sent from a bus thread (so may have more than one
+      // sender) - use the pipe.
       if(eventTxPipe(mod, evt, data, dataLen))
   	sent++;
     }
@@ -366,38 +648,24 @@ extern "C" {
 
   static void busRead(EVBus *bus) {
     EVSocket *sock;
-    fd_set readfds;
-    FD_ZERO(&readfds);
     sigset_t emptyset;
     sigemptyset(&emptyset);
-    int max_fd = 0;
-    // the input pipe
-    FD_SET(bus->pipe[0], &readfds);
-    max_fd = bus->pipe[0];
-    // and other registered sockets
+    // sockets closed since last time can be freed now - they are
+    // no longer in the epoll set so they cannot appear below.
     if(bus->socketsChanged) {
       SEMLOCK_DO(bus->root->sync) {
-	UTArrayReset(bus->sockets_run);
-	UTArrayAddAll(bus->sockets_run, bus->sockets);
 	UTARRAY_WALK(bus->sockets_del, sock) EVSocketFree(sock);
 	UTArrayReset(bus->sockets_del);
 	bus->socketsChanged = NO;
       }
     }
-    UTARRAY_WALK(bus->sockets_run, sock) {
-      FD_SET(sock->fd, &readfds);
-      if(sock->fd > max_fd)
-	max_fd = sock->fd;
-    }
-    struct timespec timeout;
-    timeout.tv_sec = 0;
-    timeout.tv_nsec = bus->select_mS * 1000000;
-    int nfds = pselect(max_fd + 1,
-		       &readfds,
-		       (fd_set *)NULL,
-		       (fd_set *)NULL,
-		       &timeout,
-		       &emptyset);
+    struct epoll_event events[EVBUS_EPOLL_MAX_EVENTS];
+    // no timeout needed - the heartbeat timer is one of the sockets
+    int nfds = epoll_pwait(bus->epoll_fd,
+			   events,
+			   EVBUS_EPOLL_MAX_EVENTS,
+			   -1,
+			   &emptyset);
 
     // update clock - monotonic so that it is
     // safe to set timeouts in the future...
@@ -405,18 +673,23 @@ extern "C" {
 
     // see if we got anything
     if(nfds > 0) {
-      if(FD_ISSET(bus->pipe[0], &readfds))
-	busRxPipe(bus, bus->pipe[0]);
-      UTARRAY_WALK(bus->sockets_run, sock) {
-	if(FD_ISSET(sock->fd, &readfds))
+      for(int ii = 0; ii < nfds; ii++) {
+	void *ptr = events[ii].data.ptr;
+	if(ptr == &bus->evfd)
+	  busRxRings(bus);
+	else if(ptr == bus->pipe)
+	  busRxPipe(bus, bus->pipe[0]);
+	else if((sock = (EVSocket *)ptr)->fd > 0) {
+	  // (an earlier callback in this batch may have closed it)
 	  (*sock->readCB)(sock->module, sock, sock->magic);
+	}
       }
     }
     else if(nfds < 0) {
       // may return prematurely if a signal was caught, in which case nfds will be
       // -1 and errno will be set to EINTR.  If we get any other error, abort.
       if(errno != EINTR) {
-	myLog(LOG_ERR, "bus %s select() returned %d : %s", bus->name, nfds, strerror(errno));
+	myLog(LOG_ERR, "bus %s epoll_pwait() returned %d : %s", bus->name, nfds, strerror(errno));
 	abort();
       }
     }
@@ -445,13 +718,12 @@ extern "C" {
     threadBus = bus; // assign to thread-local var
     bus->running = YES;
     EVEvent *start = EVGetEvent(bus, EVEVENT_START);
-    EVEvent *tick = EVGetEvent(bus, EVEVENT_TICK);
-    EVEvent *tock = EVGetEvent(bus, EVEVENT_TOCK);
-    EVEvent *deci = EVGetEvent(bus, EVEVENT_DECI);
     EVEvent *final = EVGetEvent(bus, EVEVENT_FINAL);
     EVEvent *end = EVGetEvent(bus, EVEVENT_END);
 
+    EVClockMono(&bus->now);
     EVEventTx(mod, start, NULL, 0);
+    busTimerArm(bus);
 
     for(;;) {
 
@@ -461,23 +733,9 @@ extern "C" {
 	break;
       }
 
+      // tick/tock/deci are delivered from here too,
+      // via the heartbeat timer.
       busRead(bus);
-
-      // Detect tick/deci boundaries.
-      // These tick/tock/deci events can skip if something
-      // blocks for too long in this thread,  so it's advisable
-      // to implement timeouts by comparing with a target time.
-      // We can do that more safely now that we are using a
-      // monotonic clock.
-      if(EVTimeDiff_nS(&bus->now_deci, &bus->now) > 100000000) {
-	bus->now_deci = bus->now;
-	EVEventTx(mod, deci, NULL, 0);
-	if(EVTimeDiff_nS(&bus->now_tick, &bus->now) > 1000000000) {
-	  bus->now_tick = bus->now;
-	  EVEventTx(mod, tick, NULL, 0);
-	  EVEventTx(mod, tock, NULL, 0);
-	}
-      }
     }
     return NULL;
   }
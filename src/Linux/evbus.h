@@ -20,6 +20,9 @@ extern "C" {
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
 #include <pthread.h>
 #include <dlfcn.h>
@@ -53,6 +56,23 @@ extern "C" {
 #define EVROOTDATA(m) (m)->root->rootModule->data
 
   struct _EVSocket; // fwd decl
+  struct _EVTimer; // fwd decl
+  struct _EVBus; // fwd decl
+
+  // lock-free single-producer/single-consumer ring carrying
+  // events from one bus thread to another.  head and tail are
+  // free-running byte counters (size must be a power of 2).
+  typedef struct _EVRing {
+    struct _EVBus *src;
+    struct _EVBus *dst;
+    uint32_t size;
+    char *buf;
+    uint32_t head; // written by src thread only
+    uint32_t tail; // written by dst thread only
+  } EVRing;
+
+#define EVBUS_RING_BYTES 262144
+#define EVBUS_RING_BATCH 256
 
   typedef struct _EVBus {
     EVRoot *root;
@@ -60,18 +80,25 @@ extern "C" {
     UTHash *events;
     UTArray *eventList;
     int pipe[2];
+    int evfd; // doorbell for rings_in
+    UTArray *rings_in;
+    UTArray *rings_run;
+    UTArray *rings_out;
+    char *ringbuf;
+    int epoll_fd;
+#define EVBUS_EPOLL_MAX_EVENTS 64
     UTArray *sockets;
-    UTArray *sockets_run;
     UTArray *sockets_del;
-    int select_mS;
-#define EVBUS_SELECT_MS_TICK 599
-#define EVBUS_SELECT_MS_DECI 59
+    struct _EVTimer *timer;
+    int timer_mS;
+#define EVBUS_TIMER_MS_TICK 1000
+#define EVBUS_TIMER_MS_DECI 100
+    uint32_t deciCount;
     struct timespec now;
-    struct timespec now_tick;
-    struct timespec now_deci;
     pthread_t *thread;
     int childCount;
     bool socketsChanged:1;
+    bool ringsChanged:1;
     bool running:1;
     bool stop:1;
   } EVBus;
@@ -91,6 +118,15 @@ extern "C" {
     bool errOut;
   } EVSocket;
 
+  typedef void (*EVTimerCB)(EVMod *mod, struct _EVTimer *timer, void *magic);
+
+  typedef struct _EVTimer {
+    EVSocket *sock; // wraps the timerfd
+    EVMod *module;
+    EVTimerCB timerCB;
+    void *magic;
+  } EVTimer;
+
   struct _EVAction; // fwd decl
 
   typedef struct _EVEvent {
@@ -123,7 +159,11 @@ extern "C" {
     uint32_t dataLen;
   } EVEventHdr;
 
+  // Limit for events sent from a thread that is not running a bus,
+  // since those still go through the pipe and must be atomic.
 #define EV_MAX_EVT_DATALEN (PIPE_BUF - sizeof(EVEventHdr))
+  // Limit for events sent from one bus to another.
+#define EV_MAX_RING_EVT_DATALEN ((EVBUS_RING_BYTES / 4) - sizeof(EVEventHdr))
 
   EVMod *EVInit(void *data);
   EVMod *EVLoadModule(EVMod *mod, char *name, char *mod_dir);
@@ -137,6 +177,9 @@ extern "C" {
   int EVEventTxAll(EVMod *mod, char *evt_name, void *data, size_t dataLen);
   EVSocket *EVBusAddSocket(EVMod *mod, EVBus *bus, int fd, EVReadCB readCB, void *magic);
   bool EVSocketClose(EVMod *mod, EVSocket *sock);
+  EVTimer *EVBusAddTimer(EVMod *mod, EVBus *bus, EVTimerCB timerCB, void *magic);
+  bool EVTimerSet(EVTimer *timer, uint32_t first_mS, uint32_t period_mS);
+  void EVTimerCancel(EVMod *mod, EVTimer *timer);
   void EVClockMono(struct timespec *ts);
 
 #define EVSOCKETREADLINE_INCBYTES EV_MAX_EVT_DATALEN
@@ -58,6 +58,7 @@ extern "C" {
     HSPOBJ_ULOG,
     HSPOBJ_NFLOG,
     HSPOBJ_PCAP,
+    HSPOBJ_EBPF,
     HSPOBJ_TCP,
     HSPOBJ_CUMULUS,
     HSPOBJ_NVML,
@@ -81,11 +82,14 @@ extern "C" {
     "ulog",
     "nflog",
     "pcap",
+    "ebpf",
     "tcp",
     "cumulus",
     "nvml",
     "ovs",
     "os10",
+    "dbus",
+    "systemd",
     "eapi",
     "port"
   };
@@ -481,6 +485,13 @@ extern "C" {
     return col;
   }
 
+  static HSPEBPF *newEBPF(HSP *sp) {
+    HSPEBPF *eb = (HSPEBPF *)my_calloc(sizeof(HSPEBPF));
+    ADD_TO_LIST(sp->ebpf.ebpfs, eb);
+    sp->ebpf.numEBPFs++;
+    return eb;
+  }
+
   static HSPPort *newOS10Port(HSP *sp) {
     HSPPort *prt = (HSPPort *)my_calloc(sizeof(HSPPort));
     ADD_TO_LIST(sp->os10.ports, prt);
@@ -1201,6 +1212,7 @@ extern "C" {
 	  case HSPTOKEN_KVM:
 	    if((tok = expectToken(sp, tok, HSPTOKEN_STARTOBJ)) == NULL) return NO;
 	    sp->kvm.kvm = YES;
+	    sp->kvm.bulkStats = YES;
 	    level[++depth] = HSPOBJ_KVM;
 	    break;
 	  case HSPTOKEN_XEN:
@@ -1229,6 +1241,12 @@ extern "C" {
 	    newPcap(sp);
 	    level[++depth] = HSPOBJ_PCAP;
 	    break;
+	  case HSPTOKEN_EBPF:
+	    if((tok = expectToken(sp, tok, HSPTOKEN_STARTOBJ)) == NULL) return NO;
+	    sp->ebpf.ebpf = YES;
+	    newEBPF(sp);
+	    level[++depth] = HSPOBJ_EBPF;
+	    break;
 	  case HSPTOKEN_TCP:
 	    if((tok = expectToken(sp, tok, HSPTOKEN_STARTOBJ)) == NULL) return NO;
 	    sp->tcp.tcp = YES;
@@ -1278,6 +1296,12 @@ extern "C" {
 	  case HSPTOKEN_PACKETSAMPLINGRATE:
 	    if((tok = expectInteger32(sp, tok, &sp->sFlowSettings_file->samplingRate, 0, 65535)) == NULL) return NO;
 	    break;
+	  case HSPTOKEN_SAMPLINGBUDGET:
+	    if((tok = expectInteger32(sp, tok, &sp->samplingBudget, 0, 0xFFFFFFFF)) == NULL) return NO;
+	    break;
+	  case HSPTOKEN_PORTSAMPLINGBUDGET:
+	    if((tok = expectInteger32(sp, tok, &sp->portSamplingBudget, 0, 0xFFFFFFFF)) == NULL) return NO;
+	    break;
 	  case HSPTOKEN_POLLING:
 	  case HSPTOKEN_COUNTERPOLLINGINTERVAL:
 	    if((tok = expectInteger32(sp, tok, &sp->sFlowSettings_file->pollingInterval, 0, 300)) == NULL) return NO;
@@ -1307,6 +1331,15 @@ extern "C" {
 	  case HSPTOKEN_DATAGRAMBYTES:
 	    if((tok = expectInteger32(sp, tok, &sp->sFlowSettings_file->datagramBytes, SFL_MIN_DATAGRAM_SIZE, SFL_MAX_DATAGRAM_SIZE)) == NULL) return NO;
 	    break;
+	  case HSPTOKEN_UDPGSO:
+	    if((tok = expectONOFF(sp, tok, &sp->udpGSO)) == NULL) return NO;
+	    break;
+	  case HSPTOKEN_WORKERSHARDS:
+	    if((tok = expectONOFF(sp, tok, &sp->workerShards)) == NULL) return NO;
+	    break;
+	  case HSPTOKEN_ETHTOOLNETLINK:
+	    if((tok = expectONOFF(sp, tok, &sp->ethtoolNetlink)) == NULL) return NO;
+	    break;
 	  case HSPTOKEN_XEN_UPDATE_DOMINFO:
 	    if((tok = expectONOFF(sp, tok, &sp->xen.update_dominfo)) == NULL) return NO;
 	    break;
@@ -1399,6 +1432,9 @@ extern "C" {
 	    case HSPTOKEN_FORGET_VMS:
 	      if((tok = expectInteger32(sp, tok, &sp->kvm.forgetVMSecs, 60, 0xFFFFFFFF)) == NULL) return NO;
 	      break;
+	    case HSPTOKEN_BULKSTATS:
+	      if((tok = expectONOFF(sp, tok, &sp->kvm.bulkStats)) == NULL) return NO;
+	      break;
 	    default:
 	      unexpectedToken(sp, tok, level[depth]);
 	      return NO;
@@ -1487,6 +1523,9 @@ extern "C" {
 	    case HSPTOKEN_NFLOGPROBABILITY:
 	      if((tok = expectDouble(sp, tok, &sp->nflog.probability, 0.0, 1.0)) == NULL) return NO;
 	      break;
+	    case HSPTOKEN_WORKERS:
+	      if((tok = expectInteger32(sp, tok, &sp->nflog.workers, 1, HSP_NFLOG_MAX_WORKERS)) == NULL) return NO;
+	      break;
 	    default:
 	      unexpectedToken(sp, tok, level[depth]);
 	      return NO;
@@ -1509,6 +1548,12 @@ extern "C" {
 	      if((tok = expectONOFF(sp, tok, &pc->vport)) == NULL) return NO;
 	      pc->vport_set = YES;
 	      break;
+	    case HSPTOKEN_MMAP:
+	      if((tok = expectONOFF(sp, tok, &pc->mmap)) == NULL) return NO;
+	      break;
+	    case HSPTOKEN_WORKERS:
+	      if((tok = expectInteger32(sp, tok, &pc->workers, 1, HSP_PCAP_MAX_WORKERS)) == NULL) return NO;
+	      break;
 	    case HSPTOKEN_SPEED:
 	      if((tok = expectIntegerRange64(sp, tok, &pc->speed_min, &pc->speed_max, 0, LLONG_MAX)) == NULL) return NO;
 	      pc->speed_set = YES;
@@ -1521,6 +1566,32 @@ extern "C" {
 	  }
 	  break;
 
+	case HSPOBJ_EBPF:
+	  {
+	    HSPEBPF *eb = sp->ebpf.ebpfs;
+	    switch(tok->stok) {
+	    case HSPTOKEN_DEV:
+	      if((tok = expectDevice(sp, tok, &eb->dev)) == NULL) return NO;
+	      break;
+	    case HSPTOKEN_VPORT:
+	      if((tok = expectONOFF(sp, tok, &eb->vport)) == NULL) return NO;
+	      eb->vport_set = YES;
+	      break;
+	    case HSPTOKEN_XDP:
+	      if((tok = expectONOFF(sp, tok, &eb->xdp)) == NULL) return NO;
+	      break;
+	    case HSPTOKEN_SPEED:
+	      if((tok = expectIntegerRange64(sp, tok, &eb->speed_min, &eb->speed_max, 0, LLONG_MAX)) == NULL) return NO;
+	      eb->speed_set = YES;
+	      break;
+	    default:
+	      unexpectedToken(sp, tok, level[depth]);
+	      return NO;
+	      break;
+	    }
+	  }
+	  break;
+
 	case HSPOBJ_TCP:
 	  {
 	    switch(tok->stok) {
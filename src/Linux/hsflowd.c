@@ -39,63 +39,299 @@ extern "C" {
     myLog(LOG_ERR, "sflow agent error: %s", msg);
   }
 
-  static void agentCB_sendPkt(void *magic, SFLAgent *agent, SFLReceiver *receiver, u_char *pkt, uint32_t pktLen)
-  {
-    HSP *sp = (HSP *)magic;
-    size_t socklen = 0;
-    int fd = 0;
-
-    // note that we are relying on any new settings being installed atomically from the DNS-SD
-    // thread (it's just a pointer move,  so it should be atomic).  Otherwise we would want to
-    // grab sp->sync whenever we call sfl_sampler_writeFlowSample(),  because that can
-    // bring us here where we read the list of collectors.
-
-    if(sp->sFlowSettings == NULL)
-      return;
+  /*_________________---------------------------__________________
+    _________________     collector send        __________________
+    -----------------___________________________------------------
+    Finished datagrams are copied into a send queue, and then sent to
+    every collector with one sendmmsg() call per socket.  That happens on
+    tock (deci for a shard), or whenever the queue fills up.  If udpGSO is on, each run of
+    equal-sized datagrams for a collector goes out as one UDP_SEGMENT
+    message.  The main receiver's queue (sp->txq) is only touched with
+    sp->sync_agent held.  A shard's queue is only touched by its thread.
+  */
 
-    sp->telemetry[HSP_TELEMETRY_DATAGRAMS]++;
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
 
-    for(HSPCollector *coll = sp->sFlowSettings->collectors; coll; coll=coll->nxt) {
+#define HSP_GSO_CTRL_BYTES CMSG_SPACE(sizeof(uint16_t))
 
+  static void collectorsResolve(HSPSFlowSettings *settings)
+  {
+    // called before the settings are installed, so the send path
+    // can read the sockaddrs without a lock.
+    for(HSPCollector *coll = settings->collectors; coll; coll=coll->nxt) {
+      if(coll->sendSocketLen)
+	continue;
       switch(coll->ipAddr.type) {
-      case SFLADDRESSTYPE_UNDEFINED:
-	// skip over it if the forward lookup failed
-	break;
       case SFLADDRESSTYPE_IP_V4:
 	{
 	  struct sockaddr_in *sa = (struct sockaddr_in *)&(coll->sendSocketAddr);
-	  socklen = sizeof(struct sockaddr_in);
 	  sa->sin_family = AF_INET;
 	  sa->sin_port = htons(coll->udpPort);
-	  fd = sp->socket4;
+	  coll->sendSocketLen = sizeof(struct sockaddr_in);
 	}
 	break;
       case SFLADDRESSTYPE_IP_V6:
 	{
 	  struct sockaddr_in6 *sa6 = (struct sockaddr_in6 *)&(coll->sendSocketAddr);
-	  socklen = sizeof(struct sockaddr_in6);
 	  sa6->sin6_family = AF_INET6;
 	  sa6->sin6_port = htons(coll->udpPort);
-	  fd = sp->socket6;
+	  coll->sendSocketLen = sizeof(struct sockaddr_in6);
 	}
 	break;
+      default:
+	// forward lookup failed - leave sendSocketLen at 0 so it is skipped
+	break;
       }
+    }
+  }
 
-      if(socklen && fd > 0) {
-	int result = sendto(fd,
-			    pkt,
-			    pktLen,
-			    0,
-			    (struct sockaddr *)&coll->sendSocketAddr,
-			    socklen);
-	if(result == -1 && errno != EINTR) {
-	  myLog(LOG_ERR, "socket sendto error: %s", strerror(errno));
-	}
-	else if(result == 0) {
-	  myLog(LOG_ERR, "socket sendto returned 0: %s", strerror(errno));
+  static bool collectorSockAddr(HSP *sp, HSPCollector *coll, int *p_fd)
+  {
+    if(coll->sendSocketLen == 0)
+      return NO;
+    *p_fd = (coll->ipAddr.type == SFLADDRESSTYPE_IP_V4) ? sp->socket4 : sp->socket6;
+    return (*p_fd > 0);
+  }
+
+  static void txqScratch(HSPTxQueue *txq, uint32_t numCollectors)
+  {
+    uint32_t need = numCollectors * HSP_SFLOW_TXQ_DATAGRAMS;
+    if(need > txq->scratchN) {
+      if(txq->msgs) {
+	my_free(txq->msgs);
+	my_free(txq->iov);
+	my_free(txq->ctrl);
+	my_free(txq->first);
+      }
+      txq->msgs = (struct mmsghdr *)my_calloc(need * sizeof(struct mmsghdr));
+      txq->iov = (struct iovec *)my_calloc(need * sizeof(struct iovec));
+      txq->ctrl = (u_char *)my_calloc(need * HSP_GSO_CTRL_BYTES);
+      txq->first = (uint8_t *)my_calloc(need);
+      txq->scratchN = need;
+    }
+  }
+
+  static void txqMarkSent(HSPTxQueue *txq, uint32_t msg)
+  {
+    uint32_t segs = txq->msgs[msg].msg_hdr.msg_iovlen;
+    for(uint32_t ss = 0; ss < segs; ss++)
+      txq->sentMask |= (1U << (txq->first[msg] + ss));
+  }
+
+  static void txqSendSegments(HSP *sp, HSPTxQueue *txq, int fd, uint32_t msg)
+  {
+    // send the segments of a failed UDP_SEGMENT message one at a time
+    struct msghdr *gso = &txq->msgs[msg].msg_hdr;
+    for(uint32_t ss = 0; ss < gso->msg_iovlen; ss++) {
+      struct msghdr mh = { .msg_name = gso->msg_name,
+			   .msg_namelen = gso->msg_namelen,
+			   .msg_iov = &gso->msg_iov[ss],
+			   .msg_iovlen = 1 };
+      int result;
+      do {
+	result = sendmsg(fd, &mh, 0);
+      } while(result == -1 && errno == EINTR);
+      HSP_TELEMETRY_ADD(sp, HSP_TELEMETRY_SEND_CALLS, 1);
+      if(result == -1)
+	myLog(LOG_ERR, "socket sendmsg error: %s", strerror(errno));
+      else
+	txq->sentMask |= (1U << (txq->first[msg] + ss));
+    }
+  }
+
+  static void txqSendMsgs(HSP *sp, HSPTxQueue *txq, int fd, uint32_t nMsgs)
+  {
+    uint32_t sent = 0;
+    while(sent < nMsgs) {
+      int batch = nMsgs - sent;
+      if(batch > UIO_MAXIOV)
+	batch = UIO_MAXIOV;
+      int result = sendmmsg(fd, txq->msgs + sent, batch, 0);
+      HSP_TELEMETRY_ADD(sp, HSP_TELEMETRY_SEND_CALLS, 1);
+      if(result > 0) {
+	for(int mm = 0; mm < result; mm++)
+	  txqMarkSent(txq, sent + mm);
+	sent += result;
+	continue;
+      }
+      if(result == -1 && errno == EINTR)
+	continue;
+      if(txq->msgs[sent].msg_hdr.msg_controllen
+	 && (errno == EIO
+	     || errno == EINVAL
+	     || errno == ENOPROTOOPT)) {
+	// e.g. no checksum offload on the egress device.  This queue
+	// belongs to one thread,  so it is safe to turn GSO off here.
+	myLog(LOG_ERR, "UDP_SEGMENT send failed (%s) - sending without udpGSO", strerror(errno));
+	txq->noGSO = YES;
+	txqSendSegments(sp, txq, fd, sent);
+      }
+      else
+	myLog(LOG_ERR, "socket sendmmsg error: %s", strerror(errno));
+      // move past the message that failed
+      sent++;
+    }
+  }
+
+  static void sendDatagrams(HSP *sp, HSPTxQueue *txq)
+  {
+    HSPSFlowSettings *settings = sp->sFlowSettings;
+    if(txq->n == 0)
+      return;
+    txq->sentMask = 0;
+    if(settings
+       && settings->numCollectors) {
+      bool gso = (settings->udpGSO && !txq->noGSO);
+      txqScratch(txq, settings->numCollectors);
+      // one sendmmsg() batch for each socket
+      int fds[2] = { sp->socket4, sp->socket6 };
+      for(int ff = 0; ff < 2; ff++) {
+	if(fds[ff] <= 0)
+	  continue;
+	uint32_t nMsgs = 0;
+	uint32_t nIov = 0;
+	for(HSPCollector *coll = settings->collectors; coll; coll=coll->nxt) {
+	  int fd;
+	  if(!collectorSockAddr(sp, coll, &fd)
+	     || fd != fds[ff])
+	    continue;
+	  for(uint32_t dd = 0; dd < txq->n; ) {
+	    struct mmsghdr *mm = &txq->msgs[nMsgs];
+	    memset(mm, 0, sizeof(*mm));
+	    mm->msg_hdr.msg_name = &coll->sendSocketAddr;
+	    mm->msg_hdr.msg_namelen = coll->sendSocketLen;
+	    mm->msg_hdr.msg_iov = &txq->iov[nIov];
+	    txq->first[nMsgs] = dd;
+	    uint32_t segLen = txq->len[dd];
+	    uint32_t bytes = 0;
+	    uint32_t segs = 0;
+	    do {
+	      txq->iov[nIov].iov_base = txq->buf[dd];
+	      txq->iov[nIov].iov_len = txq->len[dd];
+	      nIov++;
+	      segs++;
+	      bytes += txq->len[dd];
+	      // only the last segment may be shorter than the rest
+	      if(txq->len[dd++] < segLen)
+		break;
+	    } while(gso
+		    && dd < txq->n
+		    && segs < HSP_SFLOW_GSO_MAX_SEGS
+		    && txq->len[dd] <= segLen
+		    && (bytes + txq->len[dd]) <= HSP_SFLOW_GSO_MAX_BYTES);
+	    mm->msg_hdr.msg_iovlen = segs;
+	    if(segs > 1) {
+	      u_char *ctrl = txq->ctrl + (nMsgs * HSP_GSO_CTRL_BYTES);
+	      memset(ctrl, 0, HSP_GSO_CTRL_BYTES);
+	      mm->msg_hdr.msg_control = ctrl;
+	      mm->msg_hdr.msg_controllen = HSP_GSO_CTRL_BYTES;
+	      struct cmsghdr *cm = CMSG_FIRSTHDR(&mm->msg_hdr);
+	      cm->cmsg_level = SOL_UDP;
+	      cm->cmsg_type = UDP_SEGMENT;
+	      cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+	      uint16_t gso_size = segLen;
+	      memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+	    }
+	    nMsgs++;
+	  }
 	}
+	if(nMsgs)
+	  txqSendMsgs(sp, txq, fds[ff], nMsgs);
       }
     }
+    // count each datagram once,  however many collectors it went to
+    HSP_TELEMETRY_ADD(sp, HSP_TELEMETRY_DATAGRAMS, __builtin_popcount(txq->sentMask));
+    txq->n = 0;
+  }
+
+  static void agentCB_sendPkt(void *magic, SFLAgent *agent, SFLReceiver *receiver, u_char *pkt, uint32_t pktLen)
+  {
+    HSP *sp = (HSP *)magic;
+    HSPTxQueue *txq = receiver->userData ?: &sp->txq;
+
+    // note that we are relying on any new settings being installed atomically from the DNS-SD
+    // thread (it's just a pointer move,  so it should be atomic).  Otherwise we would want to
+    // grab sp->sync whenever we call sfl_sampler_writeFlowSample(),  because that can
+    // bring us here where we read the list of collectors.
+
+    if(sp->sFlowSettings == NULL
+       || pktLen > SFL_MAX_DATAGRAM_SIZE)
+      return;
+
+    if(txq->buf[txq->n] == NULL)
+      txq->buf[txq->n] = (u_char *)my_calloc(SFL_MAX_DATAGRAM_SIZE);
+    memcpy(txq->buf[txq->n], pkt, pktLen);
+    txq->len[txq->n++] = pktLen;
+    if(txq->n == HSP_SFLOW_TXQ_DATAGRAMS)
+      sendDatagrams(sp, txq);
+  }
+
+  /*_________________---------------------------__________________
+    _________________      shard receivers      __________________
+    -----------------___________________________------------------
+    With workerShards=on each packet worker bus gets its own receiver
+    when it starts (see HSPShard).  It is flushed on that thread's deci
+    tick,  so samples wait at most 100mS.  The samplers are still
+    shared, but their sequence numbers and sample pools are updated
+    atomically.
+  */
+
+  static __thread HSPShard *myShard;
+
+  static void flushShard(HSP *sp)
+  {
+    if(myShard) {
+      sfl_receiver_flush(&myShard->receiver);
+      sendDatagrams(sp, &myShard->txq);
+    }
+  }
+
+  static void syncShard(HSP *sp)
+  {
+    // follow the main receiver's datagram size
+    SEMLOCK_DO(sp->sync_agent) {
+      SFLReceiver *mainRcv = sp->agent->receivers;
+      sfl_receiver_set_sFlowRcvrMaximumDatagramSize(&myShard->receiver, mainRcv->sFlowRcvrMaximumDatagramSize);
+    }
+  }
+
+  static void evt_shard_deci(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    flushShard((HSP *)EVROOTDATA(mod));
+  }
+
+  static void evt_shard_config_changed(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    // anything already encoded goes out at the old size
+    flushShard(sp);
+    syncShard(sp);
+  }
+
+  HSPShard *getShard(HSP *sp)
+  {
+    return myShard;
+  }
+
+  void startShard(HSP *sp, uint32_t shardId)
+  {
+    if(myShard
+       || shardId == 0)
+      return;
+    HSPShard *shard = (HSPShard *)my_calloc(sizeof(HSPShard));
+    sfl_receiver_init_shard(&shard->receiver, sp->agent, shardId);
+    shard->receiver.userData = &shard->txq;
+    myShard = shard;
+    syncShard(sp);
+    EVBus *bus = EVCurrentBus();
+    myDebug(1, "bus %s: flow samples sent as sub-agent %u",
+	    bus->name,
+	    sp->subAgentId + shardId);
+    EVEventRx(sp->rootModule, EVGetEvent(bus, EVEVENT_DECI), evt_shard_deci);
+    EVEventRx(sp->rootModule, EVGetEvent(bus, HSPEVENT_CONFIG_CHANGED), evt_shard_config_changed);
   }
 
   /*_________________---------------------------__________________
@@ -175,8 +411,12 @@ extern "C" {
     deleteAdaptorFromHT(sp->adaptorsByMac, ad, "byMac");
     if(ad->peer_ifIndex)
       deleteAdaptorFromHT(sp->adaptorsByPeerIndex, ad, "byPeerIndex");
-    if(freeFlag)
+    if(freeFlag) {
+      HSPAdaptorNIO *nio = ADAPTOR_NIO(ad);
+      if(nio && nio->et_stats)
+	my_free(nio->et_stats);
       adaptorFree(ad);
+    }
   }
 
   int deleteMarkedAdaptors(HSP *sp, UTHash *adaptorHT, int freeFlag) {
@@ -341,14 +581,24 @@ extern "C" {
     myAdaptors.adaptors = adaptors;
     myAdaptors.capacity = HSP_MAX_PHYSICAL_ADAPTORS;
     myAdaptors.num_adaptors = 0;
+    myAdaptors.byName = myAdaptors.byIndex = NULL;
     adaptorsElem.counterBlock.adaptors = host_adaptors(sp, &myAdaptors, HSP_MAX_PHYSICAL_ADAPTORS);
     SFLADD_ELEMENT(cs, &adaptorsElem);
+    // the list can change without an interface change too (e.g. when
+    // a VM or container claims an adaptor) so check for that here.
+    if(myAdaptors.num_adaptors != sp->hostAdaptorsLastN
+       || memcmp(adaptors, sp->hostAdaptorsLast, myAdaptors.num_adaptors * sizeof(SFLAdaptor *))) {
+      memcpy(sp->hostAdaptorsLast, adaptors, myAdaptors.num_adaptors * sizeof(SFLAdaptor *));
+      sp->hostAdaptorsLastN = myAdaptors.num_adaptors;
+      sp->staticRevision++;
+    }
 
     // send the cs out to be annotated by other modules such as docker, xen, vrt and NVML
     EVEvent *evt_host_cs = EVGetEvent(sp->pollBus, HSPEVENT_HOST_COUNTER_SAMPLE);
     EVEventTx(sp->rootModule, evt_host_cs, &cs, sizeof(cs));
 
     SEMLOCK_DO(sp->sync_agent) {
+      sfl_poller_set_staticRevision(poller, sp->staticRevision);
       sfl_poller_writeCountersSample(poller, cs);
       sp->counterSampleQueued = YES;
       sp->telemetry[HSP_TELEMETRY_COUNTER_SAMPLES]++;
@@ -439,7 +689,7 @@ extern "C" {
 	state->vmType = vmType;
 	state->volumes = strArrayNew();
 	state->disks = strArrayNew();
-	state->interfaces = adaptorListNew();
+	state->interfaces = adaptorListNewIndexed();
 	sp->refreshAdaptorList = YES;
 	SFLDataSource_instance dsi;
 	// ds_class = <virtualEntity>, ds_index = offset + <assigned>, ds_instance = 0
@@ -501,6 +751,41 @@ extern "C" {
     UTTruncateOpenFile(sp->f_out);
   }
 
+  /*_________________---------------------------__________________
+    _________________    interfacesChanged      __________________
+    -----------------___________________________------------------
+    Follow-up to a full readInterfaces() or to an incremental update
+    from rtnetlink.  If the affected ifIndex list is known it is passed
+    on with HSPEVENT_INTFS_CHANGED,  otherwise the event has no data
+    and any interface may have changed.
+  */
+
+  void interfacesChanged(HSP *sp, bool announce, uint32_t *ifIndices, uint32_t nIndices) {
+    int agentAddressChanged=NO;
+    // adaptor lists and port names need to be encoded again
+    sp->staticRevision++;
+    if(selectAgentAddress(sp, &agentAddressChanged) == NO) {
+	myLog(LOG_ERR, "failed to re-select agent address\n");
+	// TODO: what should we do in this case?
+    }
+    myDebug(1, "agentAddressChanged=%s", agentAddressChanged ? "YES" : "NO");
+    if(agentAddressChanged) {
+      SEMLOCK_DO(sp->sync_agent) {
+	sfl_agent_set_address(sp->agent, &sp->agentIP);
+      }
+      // this incs the revision No so it causes the
+      // output file to be rewritten on the next tock.
+      installSFlowSettings(sp, sp->sFlowSettings);
+    }
+
+    if(announce) {
+      // test for switch ports
+      configSwitchPorts(sp); // in readPackets.c
+      // announce (e.g. to adjust sampling rates if ifSpeeds changed)
+      EVEventTxAll(sp->rootModule, HSPEVENT_INTFS_CHANGED, ifIndices, nIndices * sizeof(uint32_t));
+    }
+  }
+
   /*_________________---------------------------__________________
     _________________       tick                __________________
     -----------------___________________________------------------
@@ -509,6 +794,8 @@ extern "C" {
   static void evt_poll_tick(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
     HSP *sp = (HSP *)EVROOTDATA(mod);
     time_t clk = evt->bus->now.tv_sec;
+    struct timespec t0, t1;
+    uint64_t poll_nS = 0;
 
     // reset the pollActions
     UTArrayReset(sp->pollActions);
@@ -523,19 +810,31 @@ extern "C" {
     // sync_receiver lock,  which is needed when the final
     // counter sample is submitted for XDR serialization.
     SEMLOCK_DO(sp->sync_agent) {
-      // only run the poller_tick()s here,  not the full agent_tick()
+      // only run the pollers here,  not the full agent_tick()
       // we'll call receiver_flush at the end of this tick/tock cycle,
-      // and skip the sampler_tick() altogether.
+      // and skip the sampler_tick() altogether. The agent's timer
+      // wheel only visits the pollers that are due.
       // sfl_agent_tick(sp->agent, clk);
-      for(SFLPoller *pl = sp->agent->pollers; pl; pl = pl->nxt)
-	sfl_poller_tick(pl, clk);
-    }
+      uint32_t interval = sp->actualPollingInterval ?: 1;
+      sfl_agent_set_pollBudget(sp->agent, HSP_POLL_BUDGET_MIN
+			       + (HSP_POLL_BUDGET_FACTOR * sp->agent->numPollers / interval));
+      uint64_t carryOvers = sp->agent->pollCarryOvers;
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      sfl_agent_tickPollers(sp->agent);
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+      poll_nS += EVTimeDiff_nS(&t0, &t1);
+      sp->telemetry[HSP_TELEMETRY_POLL_CARRYOVER] += (sp->agent->pollCarryOvers - carryOvers);
+    }
+
+    // adjust adaptive sampling rates
+    samplingCtlTick(sp);
     // We can only get away with this scheme because the poller
     // objects are only ever removed and free by this thread.
     // So we don't need to worry about them being freed under
     // our feet below.
 
     // now we can execute them without holding on to the semaphore
+    clock_gettime(CLOCK_MONOTONIC, &t0);
     for(uint32_t ii = 0; ii < UTArrayN(sp->pollActions); ii += 2) {
       SFLPoller *poller = (SFLPoller *)UTArrayAt(sp->pollActions, ii);
       getCountersFn_t cb = (getCountersFn_t)UTArrayAt(sp->pollActions, ii+1);
@@ -543,6 +842,18 @@ extern "C" {
       memset(&cs, 0, sizeof(cs));
       (cb)((void *)sp, poller, &cs);
     }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    poll_nS += EVTimeDiff_nS(&t0, &t1);
+
+    // histogram of the time spent in the pollers and their poll
+    // actions - not the rest of the tick/tock cycle.
+    uint64_t poll_uS = poll_nS / 1000;
+    int bin = (poll_uS < 1000) ? HSP_TELEMETRY_POLL_LT1MS
+      : (poll_uS < 10000) ? HSP_TELEMETRY_POLL_LT10MS
+      : (poll_uS < 100000) ? HSP_TELEMETRY_POLL_LT100MS
+      : (poll_uS < 1000000) ? HSP_TELEMETRY_POLL_LT1S
+      : HSP_TELEMETRY_POLL_GE1S;
+    sp->telemetry[bin]++;
 
     // possibly poll the nio counters to avoid 32-bit rollover
     if(sp->nio_polling_secs &&
@@ -552,8 +863,10 @@ extern "C" {
     }
 
     // check for interface changes (relatively frequently)
-    // and request a full refresh if we find anything
-    if(clk >= sp->next_checkAdaptorList) {
+    // and request a full refresh if we find anything. Not
+    // needed if rtnetlink is telling us about changes.
+    if(sp->rtnl_sock <= 0
+       && clk >= sp->next_checkAdaptorList) {
       sp->next_checkAdaptorList = clk + sp->checkAdaptorListSecs;
       if(detectInterfaceChange(sp))
 	sp->refreshAdaptorList = YES;
@@ -573,27 +886,7 @@ extern "C" {
 		ad_added, ad_removed, ad_cameup, ad_wentdown, ad_changed);
       }
 
-      int agentAddressChanged=NO;
-      if(selectAgentAddress(sp, &agentAddressChanged) == NO) {
-	  myLog(LOG_ERR, "failed to re-select agent address\n");
-	  // TODO: what should we do in this case?
-      }
-      myDebug(1, "agentAddressChanged=%s", agentAddressChanged ? "YES" : "NO");
-      if(agentAddressChanged) {
-	SEMLOCK_DO(sp->sync_agent) {
-	  sfl_agent_set_address(sp->agent, &sp->agentIP);
-	}
-	// this incs the revision No so it causes the
-	// output file to be rewritten below too.
-	installSFlowSettings(sp, sp->sFlowSettings);
-      }
-
-      if(ad_added || ad_cameup || ad_wentdown || ad_changed) {
-	// test for switch ports
-	configSwitchPorts(sp); // in readPackets.c
-	// announce (e.g. to adjust sampling rates if ifSpeeds changed)
-	EVEventTxAll(sp->rootModule, HSPEVENT_INTFS_CHANGED, NULL, 0);
-      }
+      interfacesChanged(sp, (ad_added || ad_cameup || ad_wentdown || ad_changed), NULL, 0);
     }
 
     // rewrite the output if the config has changed
@@ -622,6 +915,7 @@ extern "C" {
       SEMLOCK_DO(sp->sync_agent) {
 	if(sp->counterSampleQueued) {
 	  sfl_receiver_flush(sp->agent->receivers);
+	  sendDatagrams(sp, &sp->txq);
 	  sp->counterSampleQueued = NO;
 	}
       }
@@ -647,6 +941,8 @@ extern "C" {
       // and the receiver flush happens at the end.
       sfl_receiver_flush(sp->agent->receivers);
       sp->counterSampleQueued = NO;
+      // and send everything that is queued up
+      sendDatagrams(sp, &sp->txq);
     }
   }
 
@@ -700,6 +996,17 @@ extern "C" {
       }
     }
 
+    // check that the kernel knows about UDP GSO (added in 4.18)
+    if(sp->udpGSO) {
+      int gso_size = 0;
+      socklen_t optlen = sizeof(gso_size);
+      int fd = (sp->socket4 > 0) ? sp->socket4 : sp->socket6;
+      if(getsockopt(fd, SOL_UDP, UDP_SEGMENT, &gso_size, &optlen) < 0) {
+	myLog(LOG_ERR, "UDP_SEGMENT not supported (%s) - turning off udpGSO", strerror(errno));
+	sp->udpGSO = NO;
+      }
+    }
+
     SEMLOCK_DO(sp->sync_agent) {
       struct timespec ts;
       EVClockMono(&ts);
@@ -898,7 +1205,9 @@ extern "C" {
     
     // before we do anything else,  read the interfaces again - this time with a full discovery
     // so that modules can weigh in if required,  and, for example, sampling-rates can be set
-    // correctly.
+    // correctly.  Subscribe to rtnetlink first so that nothing that
+    // changes after this read is missed.
+    rtnlTrackInterfaces(sp);
     readInterfaces(sp, YES, NULL, NULL, NULL, NULL, NULL);
     
     // print some stats to help us size HSP_RLIMIT_MEMLOCK etc.
@@ -940,6 +1249,12 @@ extern "C" {
       }
       sp->sFlowSettings_str = settingsStr;
       sp->revisionNo++;
+      // fill in everything the send path needs before the settings go
+      // live,  so no other thread has to write to them.
+      if(settings) {
+	collectorsResolve(settings);
+	settings->udpGSO = sp->udpGSO;
+      }
       // atomic pointer-switch.  No need for lock.  At least
       // not on the  platforms we expect to run on.
       sp->sFlowSettings = settings;
@@ -1442,6 +1757,12 @@ extern "C" {
     // and XDR datagram encoding)
     sp->sync_agent = (pthread_mutex_t *)my_calloc(sizeof(pthread_mutex_t));
     pthread_mutex_init(sp->sync_agent, NULL);
+    sp->staticRevision = 1;
+
+    // adaptive sampling controls,  registered by the packet threads
+    sp->sync_sampling = (pthread_mutex_t *)my_calloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(sp->sync_sampling, NULL);
+    sp->samplingCtls = UTArrayNew(UTARRAY_DFLT);
 
     // poll actions array
     sp->pollActions = UTArrayNew(UTARRAY_DFLT);
@@ -1600,6 +1921,8 @@ extern "C" {
       EVLoadModule(sp->rootModule, "mod_docker", sp->modulesPath);
     if(sp->pcap.pcap)
       EVLoadModule(sp->rootModule, "mod_pcap", sp->modulesPath);
+    if(sp->ebpf.ebpf)
+      EVLoadModule(sp->rootModule, "mod_ebpf", sp->modulesPath);
     if(sp->tcp.tcp)
       EVLoadModule(sp->rootModule, "mod_tcp", sp->modulesPath);
     if(sp->ulog.ulog)
@@ -1621,6 +1944,9 @@ extern "C" {
     if(sp->eapi.eapi)
       EVLoadModule(sp->rootModule, "mod_eapi", sp->modulesPath);
 
+    // flow samples on the packet bus are written a read-batch at a time
+    packetBusStart(sp);
+
     EVEventRx(sp->rootModule, EVGetEvent(sp->pollBus, EVEVENT_TICK), evt_poll_tick);
     EVEventRx(sp->rootModule, EVGetEvent(sp->pollBus, EVEVENT_TOCK), evt_poll_tock);
 
@@ -116,6 +116,11 @@ extern "C" {
 // list for a physical host
 #define HSP_MAX_PHYSICAL_ADAPTORS 32
 
+  // poller budget per tick: the even share (pollers / interval) times
+  // this factor, plus a minimum. Anything over is carried over.
+#define HSP_POLL_BUDGET_FACTOR 2
+#define HSP_POLL_BUDGET_MIN 8
+
   // For when a switch-port is configured using the default
   // (calculated) sampling-rate (based on link speed)
 #define HSP_SPEED_SAMPLING_RATIO 1000000
@@ -126,6 +131,7 @@ extern "C" {
     SFLAddress ipAddr;
     uint32_t udpPort;
     struct sockaddr_in6 sendSocketAddr;
+    socklen_t sendSocketLen; // set by installSFlowSettings()
   } HSPCollector;
 
   typedef struct _HSPPcap {
@@ -137,8 +143,22 @@ extern "C" {
     uint64_t speed_min;
     uint64_t speed_max;
     bool speed_set;
+    bool mmap; // TPACKET_V3 ring instead of libpcap
+    uint32_t workers; // PACKET_FANOUT over this many threads
+#define HSP_PCAP_MAX_WORKERS 64
   } HSPPcap;
 
+  typedef struct _HSPEBPF {
+    struct _HSPEBPF *nxt;
+    char *dev;
+    bool vport;
+    bool vport_set;
+    uint64_t speed_min;
+    uint64_t speed_max;
+    bool speed_set;
+    bool xdp; // ingress via XDP instead of tc
+  } HSPEBPF;
+
   typedef struct _HSPPort {
     struct _HSPPort *nxt;
     char *dev;
@@ -183,6 +203,8 @@ extern "C" {
     HSPCIDR *agentCIDRs;
     SFLAddress agentIP;
     char *agentDevice;
+    // sp->udpGSO, fixed when these settings are installed
+    bool udpGSO;
   } HSPSFlowSettings;
 
   // userData structure to store state for VM data-sources
@@ -273,8 +295,15 @@ extern "C" {
 #define HSP_MAX_NIO_DELTA32 0x7FFFFFFF
 #define HSP_MAX_NIO_DELTA64 (uint64_t)(1.0e13)
     time_t last_update;
+    // counters latched from the last netlink stats dump
+    SFLHost_nio_counters nl_ctrs;
+    time_t nl_snapshot;
     uint32_t et_nctrs; // how many in total
     ETCTRFlags et_found; // bitmask of the ones we wanted
+    // persistent ETHTOOL_GSTATS buffer (sized for et_stats_n counters)
+    struct ethtool_stats *et_stats;
+    uint32_t et_stats_n;
+    bool et_nl_unsupported; // no standard eth-mac stats via ethtool-netlink
     // offsets within the ethtool stats block
     uint8_t et_idx_mcasts_in;
     uint8_t et_idx_mcasts_out;
@@ -322,10 +351,12 @@ extern "C" {
 #define HSPBUS_POLL "poll" // main thread
 #define HSPBUS_CONFIG "config" // DNS-SD
 #define HSPBUS_PACKET "packet" // pcap,ulog,nflog,json,tcp packet processing
+// packet worker buses (workers=N) are "packet.1" ... "packet.N-1"
 
 // The generic start,tick,tock,final,end events are defined in evbus.h
 #define HSPEVENT_HOST_COUNTER_SAMPLE "csample"   // (csample *) building counter-sample
 #define HSPEVENT_FLOW_SAMPLE "flow_sample"       // (HSPPendingSample *) building flow-sample
+#define HSPEVENT_FLOW_SAMPLE_HANDOFF "flow_sample_handoff" // (HSPPendingSample **) from a packet worker bus
 #define HSPEVENT_CONFIG_START "config_start"     // begin config lines
 #define HSPEVENT_CONFIG_LINE "config_line"       // (line)...next config line
 #define HSPEVENT_CONFIG_END "config_end"         // (n_servers *) end config lines
@@ -335,15 +366,29 @@ extern "C" {
 #define HSPEVENT_CONFIG_DONE "config_done"       // after new config
 #define HSPEVENT_INTF_READ "intf_read"           // (adaptor *) reading interface
 #define HSPEVENT_INTF_SPEED "intf_speed"         // (adaptor *) interface speed change
-#define HSPEVENT_INTFS_CHANGED "intfs_changed"   // some interface(s) changed
+#define HSPEVENT_INTFS_CHANGED "intfs_changed"   // some interface(s) changed (uint32_t ifIndex[], or none => any)
 #define HSPEVENT_UPDATE_NIO "update_nio"         // (adaptor *) nio counter refresh
 
 
+  // Pending samples are recycled through a per-thread pool. Each one
+  // carries its own flow-sample, header element and header buffer, plus
+  // a small arena for pendingSample_calloc(). Only when the arena runs
+  // out does it fall back to the heap (ptrsToFree).
+#define HSP_PENDINGSAMPLE_ARENA (4 * sizeof(SFLFlow_sample_element))
+#define HSP_PENDINGSAMPLE_POOL_MAX 1024
+
   typedef struct _HSPPendingSample {
+    struct _HSPPendingSample *nxt; // pool free-list
+    struct _HSPPendingPool *pool;  // of the thread that took it
     SFL_FLOW_SAMPLE_TYPE *fs;
     SFLSampler *sampler;
     int refCount;
     UTArray *ptrsToFree;
+    SFL_FLOW_SAMPLE_TYPE fs_mem;
+    SFLFlow_sample_element hdrElem;
+    u_char hdrBytes[HSP_MAX_HEADER_BYTES];
+    uint32_t arenaUsed;
+    uint64_t arena[HSP_PENDINGSAMPLE_ARENA / sizeof(uint64_t)];
   } HSPPendingSample;
 
   typedef enum {
@@ -353,9 +398,45 @@ extern "C" {
     HSP_TELEMETRY_RTFLOW_SAMPLES,
     HSP_TELEMETRY_DATAGRAMS,
     HSP_TELEMETRY_DROPPED_SAMPLES,
+    HSP_TELEMETRY_SEND_CALLS,
+    HSP_TELEMETRY_ETHTOOL_US,
+    // histogram of pollBus time in the pollers and their poll actions
+    HSP_TELEMETRY_POLL_LT1MS,
+    HSP_TELEMETRY_POLL_LT10MS,
+    HSP_TELEMETRY_POLL_LT100MS,
+    HSP_TELEMETRY_POLL_LT1S,
+    HSP_TELEMETRY_POLL_GE1S,
+    HSP_TELEMETRY_POLL_CARRYOVER,
+    HSP_TELEMETRY_SAMPLING_CHANGES,
+    // mod_tcp tcp_info lookups
+    HSP_TELEMETRY_TCP_CACHE_HITS,
+    HSP_TELEMETRY_TCP_CACHE_MISSES,
+    HSP_TELEMETRY_TCP_HELD_US,
+    HSP_TELEMETRY_TCP_DUMPS,
+    HSP_TELEMETRY_TCP_DUMP_US,
+    // recvmmsg() sockets,  UT_RECVBATCH_NUM_COUNTERS each (see UTRecvBatchTelemetry)
+    HSP_TELEMETRY_RX_JSON_CALLS,
+    HSP_TELEMETRY_RX_JSON_MSGS,
+    HSP_TELEMETRY_RX_JSON_RXQ_DROPS,
+    HSP_TELEMETRY_RX_JSON_ENOBUFS,
+    HSP_TELEMETRY_RX_NFLOG_CALLS,
+    HSP_TELEMETRY_RX_NFLOG_MSGS,
+    HSP_TELEMETRY_RX_NFLOG_RXQ_DROPS,
+    HSP_TELEMETRY_RX_NFLOG_ENOBUFS,
+    HSP_TELEMETRY_RX_INET_DIAG_CALLS,
+    HSP_TELEMETRY_RX_INET_DIAG_MSGS,
+    HSP_TELEMETRY_RX_INET_DIAG_RXQ_DROPS,
+    HSP_TELEMETRY_RX_INET_DIAG_ENOBUFS,
+    HSP_TELEMETRY_RX_RTNL_CALLS,
+    HSP_TELEMETRY_RX_RTNL_MSGS,
+    HSP_TELEMETRY_RX_RTNL_RXQ_DROPS,
+    HSP_TELEMETRY_RX_RTNL_ENOBUFS,
     HSP_TELEMETRY_NUM_COUNTERS
   } EnumHSPTelemetry;
 
+  // for counters that more than one thread can bump
+#define HSP_TELEMETRY_ADD(sp, ctr, n) __atomic_add_fetch(&(sp)->telemetry[(ctr)], (n), __ATOMIC_RELAXED)
+
 #ifdef HSP_TELEMETRY_NAMES
   static const char *HSPTelemetryNames[] = {
     "flow_samples",
@@ -363,10 +444,90 @@ extern "C" {
     "rtmetric_samples",
     "rtflow_samples",
     "datagrams",
-    "dropped_samples"
+    "dropped_samples",
+    "send_calls",
+    "ethtool_uS",
+    "poll_lt1mS",
+    "poll_lt10mS",
+    "poll_lt100mS",
+    "poll_lt1S",
+    "poll_ge1S",
+    "poll_carryover",
+    "sampling_changes",
+    "tcp_cache_hits",
+    "tcp_cache_misses",
+    "tcp_held_uS",
+    "tcp_dumps",
+    "tcp_dump_uS",
+    "rx_json_calls",
+    "rx_json_msgs",
+    "rx_json_rxq_drops",
+    "rx_json_enobufs",
+    "rx_nflog_calls",
+    "rx_nflog_msgs",
+    "rx_nflog_rxq_drops",
+    "rx_nflog_enobufs",
+    "rx_inet_diag_calls",
+    "rx_inet_diag_msgs",
+    "rx_inet_diag_rxq_drops",
+    "rx_inet_diag_enobufs",
+    "rx_rtnetlink_calls",
+    "rx_rtnetlink_msgs",
+    "rx_rtnetlink_rxq_drops",
+    "rx_rtnetlink_enobufs"
   };
 #endif
 
+  // Datagrams are queued and sent to all collectors together,
+  // either on tock or when the queue is full.
+#define HSP_SFLOW_TXQ_DATAGRAMS 32
+#define HSP_SFLOW_GSO_MAX_SEGS 64
+#define HSP_SFLOW_GSO_MAX_BYTES 65000
+  typedef struct _HSPTxQueue {
+    uint32_t n;
+    u_char *buf[HSP_SFLOW_TXQ_DATAGRAMS];
+    uint32_t len[HSP_SFLOW_TXQ_DATAGRAMS];
+    // sendmmsg() scratch, grown to numCollectors * HSP_SFLOW_TXQ_DATAGRAMS
+    uint32_t scratchN;
+    struct mmsghdr *msgs;
+    struct iovec *iov;
+    u_char *ctrl;
+    uint8_t *first; // index of the first datagram in each message
+    // datagrams that reached at least one collector (one bit each)
+    uint32_t sentMask;
+    // a UDP_SEGMENT send failed - send this queue without GSO
+    bool noGSO;
+  } HSPTxQueue;
+
+  // With sflow { workerShards=on } each packet worker bus "packet.N"
+  // writes its flow samples into a receiver of its own, with its own
+  // send queue,  so it does not need sp->sync_agent on the packet path.
+  // That shard sends as sub-agent (subAgentId + N).  Everything else,
+  // the packet bus included,  uses the main receiver.
+  typedef struct _HSPShard {
+    SFLReceiver receiver;
+    HSPTxQueue txq;
+  } HSPShard;
+
+  // Adaptive sampling (samplingBudget=, portSamplingBudget=).  Each packet
+  // source that can change its own sampling rate registers one of these.
+  // The source counts the samples it takes,  and picks up a new rate on
+  // its own thread whenever the controller (on the pollBus) changes it.
+#define HSP_SAMPLING_CTL_HEADROOM 80 // settle at 80% of budget after backing off
+#define HSP_SAMPLING_CTL_LOWATER 40 // speed up again only when under 40% of budget...
+#define HSP_SAMPLING_CTL_QUIET_TICKS 10 // ...for this many ticks in a row
+#define HSP_SAMPLING_CTL_SETTLE_TICKS 2 // ignore measurements just after a change
+#define HSP_SAMPLING_CTL_MAX_RATE 0x1000000
+  typedef struct _HSPSamplingCtl {
+    char *name;
+    uint32_t baseRate; // configured rate - never sample finer than this
+    uint32_t rate; // rate the source should apply
+    uint32_t samples; // samples taken since the last controller tick
+    uint64_t pkts; // estimated packets/sec
+    uint32_t quietTicks;
+    uint32_t settleTicks;
+  } HSPSamplingCtl;
+
   typedef enum {
     HSP_VNODE_PRIORITY_SYSTEMD=1,
     HSP_VNODE_PRIORITY_DOCKER,
@@ -378,7 +539,6 @@ extern "C" {
     char *modulesPath;
     EVMod *rootModule;
     EVBus *pollBus;
-    EVEvent *evt_flow_sample;
 
     // agent
     SFLAgent *agent;
@@ -419,6 +579,7 @@ extern "C" {
       bool kvm;
       uint32_t refreshVMListSecs;
       uint32_t forgetVMSecs;
+      bool bulkStats;
     } kvm;
     struct {
       bool xen;
@@ -464,6 +625,8 @@ extern "C" {
     struct {
       bool nflog;
       uint32_t group;
+      uint32_t workers; // groups group ... group+workers-1, one thread each
+#define HSP_NFLOG_MAX_WORKERS 64
       double probability;
       uint32_t samplingRate;
       uint32_t ds_options;
@@ -473,6 +636,11 @@ extern "C" {
       HSPPcap *pcaps;
       uint32_t numPcaps;
     } pcap;
+    struct {
+      bool ebpf;
+      HSPEBPF *ebpfs;
+      uint32_t numEBPFs;
+    } ebpf;
     struct {
       bool tcp;
     } tcp;
@@ -493,6 +661,12 @@ extern "C" {
     // hardware sampling flag
     bool hardwareSampling;
 
+    // adaptive sampling: samples/sec targets (0 == off)
+    uint32_t samplingBudget;
+    uint32_t portSamplingBudget;
+    UTArray *samplingCtls;
+    pthread_mutex_t *sync_sampling;
+
     // daemon setup
     char *configFile;
     bool configOK;
@@ -530,6 +704,20 @@ extern "C" {
     time_t nio_polling_secs;
 #define HSP_NIO_POLLING_SECS_32BIT 3
     time_t next_nio_poll;
+    // one RTM_GETSTATS dump per second serves every adaptor
+    int nio_nl_sock;
+    uint32_t nio_nl_seq;
+    u_char *nio_nl_buf;
+    bool nio_nl_unsupported;
+    time_t nio_snapshot;
+    // long-lived socket for ethtool/SFP ioctls
+    int nio_ctl_sock;
+    // optional ethtool-netlink (ETHTOOL_MSG_STATS_GET) path
+    bool ethtoolNetlink;
+    int ethtool_nl_sock;
+    uint16_t ethtool_nl_family;
+    uint32_t ethtool_nl_seq;
+    u_char *ethtool_nl_buf;
 
     // setting to allow bond counters to be sythesized from their components
     bool synthesizeBondCounters;
@@ -541,6 +729,7 @@ extern "C" {
 
     uint32_t checkAdaptorListSecs; // poll interval
     time_t next_checkAdaptorList; // deadline
+    int rtnl_sock; // link/address notifications
 
     bool refreshVMList; // request flag
     uint32_t refreshVMListSecs; // poll interval (default)
@@ -552,6 +741,11 @@ extern "C" {
     // UDP send sockets
     int socket4;
     int socket6;
+    bool udpGSO;
+    // finished datagrams waiting for sendmmsg() (under sync_agent)
+    HSPTxQueue txq;
+    // receivers for the packet worker buses (see HSPShard)
+    bool workerShards;
 
     // physical host / hypervisor vnode characteristics
     uint32_t cpu_mhz;
@@ -573,6 +767,12 @@ extern "C" {
 
     uint64_t telemetry[HSP_TELEMETRY_NUM_COUNTERS];
 
+    // bumped whenever host_hid, adaptors or portName counter elements
+    // may have changed,  so pollers can reuse their pre-encoded XDR
+    uint32_t staticRevision;
+    SFLAdaptor *hostAdaptorsLast[HSP_MAX_PHYSICAL_ADAPTORS];
+    uint32_t hostAdaptorsLastN;
+
   } HSP;
 
   // expose some config parser fns
@@ -596,6 +796,8 @@ extern "C" {
   // read functions
   bool detectInterfaceChange(HSP *sp);
   int readInterfaces(HSP *sp, bool full_discovery, uint32_t *p_added, uint32_t *p_removed, uint32_t *p_cameup, uint32_t *p_wentdown, uint32_t *p_changed);
+  bool rtnlTrackInterfaces(HSP *sp);
+  void interfacesChanged(HSP *sp, bool announce, uint32_t *ifIndices, uint32_t nIndices);
   const char *devTypeName(EnumHSPDevType devType);
   int readCpuCounters(SFLHost_cpu_counters *cpu);
   int readMemoryCounters(SFLHost_mem_counters *mem);
@@ -608,10 +810,20 @@ extern "C" {
   void syncBondPolling(HSP *sp);
   bool accumulateNioCounters(HSP *sp, SFLAdaptor *adaptor, SFLHost_nio_counters *ctrs, HSP_ethtool_counters *et_ctrs);
   void updateNioCounters(HSP *sp, SFLAdaptor *adaptor);
+  bool parseProcNetDevLine(char *line, char **p_devName, SFLHost_nio_counters *ctrs);
+  int parseNioStatsDump(HSP *sp, u_char *buf, int len, time_t clk, uint32_t *links);
   int readHidCounters(HSP *sp, SFLHost_hid_counters *hid, char *hbuf, int hbufLen, char *rbuf, int rbufLen);
   int configSwitchPorts(HSP *sp);
+  HSPSamplingCtl *samplingCtlNew(HSP *sp, char *name, uint32_t baseRate);
+  void samplingCtlFree(HSP *sp, HSPSamplingCtl *ctl);
+  void samplingCtlSetBase(HSPSamplingCtl *ctl, uint32_t baseRate);
+#define samplingCtlRate(ctl) __atomic_load_n(&(ctl)->rate, __ATOMIC_RELAXED)
+#define samplingCtlCount(ctl) __atomic_add_fetch(&(ctl)->samples, 1, __ATOMIC_RELAXED)
+  void samplingCtlTick(HSP *sp);
   int readTcpipCounters(HSP *sp, SFLHost_ip_counters *c_ip, SFLHost_icmp_counters *c_icmp, SFLHost_tcp_counters *c_tcp, SFLHost_udp_counters *c_udp);
   void flushCounters(EVMod *mod);
+  HSPShard *getShard(HSP *sp);
+  void startShard(HSP *sp, uint32_t shardId);
 
   // sum bond counters from their components
   void setSynthesizeBondCounters(EVMod *mod, bool val);
@@ -656,9 +868,15 @@ extern "C" {
 #define HSP_SAMPLEOPT_ASIC        0x2000
 
   void takeSample(HSP *sp, SFLAdaptor *ad_in, SFLAdaptor *ad_out, SFLAdaptor *ad_tap, uint32_t options, uint32_t hook, const u_char *mac_hdr, uint32_t mac_len, const u_char *cap_hdr, uint32_t cap_len, uint32_t pkt_len, uint32_t drops, uint32_t sampling_n);
+  HSPPendingSample *pendingSampleNew(SFLSampler *sampler);
+  void pendingSampleFree(HSPPendingSample *ps);
   void *pendingSample_calloc(HSPPendingSample *ps, size_t len);
   void holdPendingSample(HSPPendingSample *ps);
   void releasePendingSample(HSP *sp, HSPPendingSample *ps);
+  void pendingSampleBatchStart(void);
+  void pendingSampleBatchFlush(HSP *sp);
+  EVBus *packetWorkerBus(EVMod *mod, uint32_t index);
+  void packetBusStart(HSP *sp);
   SFLPoller *forceCounterPolling(HSP *sp, SFLAdaptor *adaptor);
 
   // VM lifecycle
@@ -0,0 +1,809 @@
+/* This software is distributed under the following license:
+ * http://sflow.net/license.html
+ */
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "hsflowd.h"
+#include "cJSON.h"
+#include "hsflowd_bench.h"
+
+  /*
+    Offline benchmark of the packet-sampling path.  Replays a pcap file
+    through the same steps a packet takes in hsflowd:
+
+      classify: MAC -> adaptor lookups and takeSample(),  up to the point
+                where the flow-sample is offered to the annotators
+      annotate: the HSPEVENT_FLOW_SAMPLE receivers.  mod_tcp is stood in
+                for by a stub that decodes the header and adds a tcp_info
+                element to every TCP sample (as if the diag reply were
+                already cached)
+      encode:   releasePendingSample() -> sfl_receiver_writeFlowSample()
+                on the main receiver,  as the packet bus does
+      send:     a capturing agentCB_sendPkt() that copies each datagram
+                out as hsflowd would,  but does not send it
+
+    Every packet becomes a sample,  so the numbers are per sample.  -s
+    only sets the sampling_rate written into each sample,  it does not
+    thin out the packets.  The whole file is read into memory first.
+    Results go to stdout as one JSON object.  Build with "make bench"
+    (and run it too if BENCH_PCAP is set).  hsflowd.c is linked in with
+    its main() renamed.
+
+    With -w 1,2,4,8 the file is then replayed again through that many
+    packet worker threads at a time,  split by flow hash the way
+    PACKET_FANOUT_HASH would split it.  Worker 0 stands in for the
+    packet bus and writes each sample under sp->sync_agent.  The others
+    either batch their samples under the lock (the default) or write to
+    shard receivers of their own (workerShards=on),  and both are run.
+    There are no annotators in that run,  so nothing is handed over to
+    the packet bus,  and only the overall packet rate is reported.
+
+    With -m the micro-benchmarks in hsflowd_bench_micro.c are run
+    instead (or as well,  if -r is also given).
+  */
+
+#define HSP_BENCH_MAX_ADAPTORS 4096
+#define HSP_BENCH_MAX_WORKERS 64
+  // samples per pendingSampleBatchFlush() on a worker,  about what
+  // one tpacket block holds at a moderate packet rate
+#define HSP_BENCH_READ_BATCH 64
+#define HSP_BENCH_TAP_IFINDEX 1
+
+  // classic pcap file format
+#define HSP_PCAP_MAGIC_US 0xa1b2c3d4
+#define HSP_PCAP_MAGIC_NS 0xa1b23c4d
+#define HSP_LINKTYPE_ETHERNET 1
+#define HSP_LINKTYPE_RAW 101
+#define HSP_LINKTYPE_IPV4 228
+#define HSP_LINKTYPE_IPV6 229
+
+  typedef struct _HSPBenchPkt {
+    u_char *buf;
+    uint32_t caplen;
+    uint32_t len;
+    uint32_t flowHash;
+  } HSPBenchPkt;
+
+  typedef struct _HSPBenchWorker {
+    uint32_t index;
+    uint32_t numWorkers;
+    EVBus *bus;
+    uint64_t packets;
+  } HSPBenchWorker;
+
+  typedef struct _HSPBench {
+    HSP *sp;
+    EVBus *packetBus;
+    char *pcapFile;
+    uint32_t loops;
+    uint32_t samplingRate;
+    uint32_t maxAdaptors;
+    // pcap contents
+    u_char *fileBuf;
+    HSPBenchPkt *pkts;
+    uint32_t numPkts;
+    uint32_t linkType;
+    SFLAdaptor *tap;
+    uint32_t numAdaptors;
+    char *workerCounts;
+    cJSON *workerResults;
+    HSPBenchWorker *workers;
+    uint32_t numWorkers;
+    bool shards;
+    uint32_t workersReady;
+    uint32_t workersDone;
+    bool workersGo;
+    // results
+    uint64_t packets;
+    uint64_t samples;
+    uint64_t datagrams;
+    uint64_t datagramBytes;
+    uint64_t tcpAnnotated;
+    uint64_t nS_classify;
+    uint64_t nS_annotate;
+    uint64_t nS_encode;
+    uint64_t nS_send;
+    uint64_t nS_total;
+    uint64_t allocs;
+    uint64_t osAllocs;
+    // per-sample marks
+    struct timespec annotateStart;
+    struct timespec annotateEnd;
+    bool annotated;
+    uint64_t sendSoFar;
+  } HSPBench;
+
+  static HSPBench bench;
+  // the worker runs send from several threads at once
+  static __thread u_char capture[SFL_MAX_DATAGRAM_SIZE];
+
+  uint64_t benchNowNS(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+  }
+#define nowNS benchNowNS
+
+  static uint64_t tsNS(struct timespec *ts) {
+    return ((uint64_t)ts->tv_sec * 1000000000) + ts->tv_nsec;
+  }
+
+  /*_________________---------------------------__________________
+    _________________      readPcapFile         __________________
+    -----------------___________________________------------------
+  */
+
+  static uint32_t pcap32(u_char *p, bool swap) {
+    uint32_t val;
+    memcpy(&val, p, 4);
+    return swap ? __builtin_bswap32(val) : val;
+  }
+
+  // Stands in for the kernel's flow hash in PACKET_FANOUT_HASH:  the
+  // same for both directions of an IPv4/IPv6 conversation,  and falls
+  // back to the MAC pair for anything else.
+  static uint32_t flowHash(HSPBench *bm, HSPBenchPkt *pkt) {
+    u_char *hdr = pkt->buf;
+    uint32_t caplen = pkt->caplen;
+    uint32_t l3 = 0, addrOff = 0, addrLen = 0;
+    uint16_t type_len = 0;
+    if(bm->linkType == HSP_LINKTYPE_ETHERNET) {
+      if(caplen < 14)
+	return 0;
+      type_len = (hdr[12] << 8) + hdr[13];
+      l3 = 14;
+    }
+    else if(caplen)
+      type_len = ((hdr[0] >> 4) == 6) ? 0x86DD : 0x0800;
+    if(type_len == 0x0800) {
+      addrOff = l3 + 12;
+      addrLen = 4;
+    }
+    else if(type_len == 0x86DD) {
+      addrOff = l3 + 8;
+      addrLen = 16;
+    }
+    else {
+      addrLen = 6; // MACs
+    }
+    if(addrOff + (2 * addrLen) > caplen)
+      return 0;
+    uint32_t h1 = 0, h2 = 0;
+    for(uint32_t ii = 0; ii < addrLen; ii++) {
+      h1 = (h1 * 31) + hdr[addrOff + ii];
+      h2 = (h2 * 31) + hdr[addrOff + addrLen + ii];
+    }
+    uint32_t h = h1 ^ h2;
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return h;
+  }
+
+  static bool readPcapFile(HSPBench *bm) {
+    FILE *ff = fopen(bm->pcapFile, "r");
+    if(ff == NULL) {
+      fprintf(stderr, "cannot open %s : %s\n", bm->pcapFile, strerror(errno));
+      return NO;
+    }
+    fseek(ff, 0, SEEK_END);
+    long fileLen = ftell(ff);
+    rewind(ff);
+    bm->fileBuf = (u_char *)my_os_calloc(fileLen + 1);
+    if(fileLen < 24
+       || fread(bm->fileBuf, 1, fileLen, ff) != fileLen) {
+      fprintf(stderr, "cannot read %s\n", bm->pcapFile);
+      fclose(ff);
+      return NO;
+    }
+    fclose(ff);
+    uint32_t magic = pcap32(bm->fileBuf, NO);
+    bool swap = NO;
+    if(magic != HSP_PCAP_MAGIC_US
+       && magic != HSP_PCAP_MAGIC_NS) {
+      swap = YES;
+      magic = pcap32(bm->fileBuf, YES);
+      if(magic != HSP_PCAP_MAGIC_US
+	 && magic != HSP_PCAP_MAGIC_NS) {
+	fprintf(stderr, "%s: not a pcap file (pcapng is not supported)\n", bm->pcapFile);
+	return NO;
+      }
+    }
+    bm->linkType = pcap32(bm->fileBuf + 20, swap);
+    switch(bm->linkType) {
+    case HSP_LINKTYPE_ETHERNET:
+    case HSP_LINKTYPE_RAW:
+    case HSP_LINKTYPE_IPV4:
+    case HSP_LINKTYPE_IPV6:
+      break;
+    default:
+      fprintf(stderr, "%s: unsupported linktype %u\n", bm->pcapFile, bm->linkType);
+      return NO;
+    }
+    // count, then index
+    for(int pass = 0; pass < 2; pass++) {
+      uint32_t n = 0;
+      for(long off = 24; off + 16 <= fileLen; ) {
+	uint32_t caplen = pcap32(bm->fileBuf + off + 8, swap);
+	uint32_t len = pcap32(bm->fileBuf + off + 12, swap);
+	if(off + 16 + caplen > fileLen)
+	  break; // truncated
+	if(pass == 1) {
+	  bm->pkts[n].buf = bm->fileBuf + off + 16;
+	  bm->pkts[n].caplen = caplen;
+	  bm->pkts[n].len = len;
+	  bm->pkts[n].flowHash = flowHash(bm, &bm->pkts[n]);
+	}
+	n++;
+	off += 16 + caplen;
+      }
+      if(pass == 0)
+	bm->pkts = (HSPBenchPkt *)my_os_calloc((n + 1) * sizeof(HSPBenchPkt));
+      bm->numPkts = n;
+    }
+    return YES;
+  }
+
+  /*_________________---------------------------__________________
+    _________________      adaptor table        __________________
+    -----------------___________________________------------------
+    A tap device,  plus one adaptor for each distinct source MAC in
+    the file (up to a limit) so that the MAC lookups hit the way they
+    would on a busy bridge.
+  */
+
+  static SFLAdaptor *benchAdaptor(HSP *sp, u_char *mac, uint32_t ifIndex) {
+    char name[32];
+    snprintf(name, sizeof(name), "bench%u", ifIndex);
+    SFLAdaptor *ad = nioAdaptorNew(name, mac, ifIndex);
+    ADAPTOR_NIO(ad)->devType = HSPDEV_PHYSICAL;
+    ad->ifSpeed = 10000000000LL;
+    adaptorAddOrReplace(sp->adaptorsByName, ad);
+    adaptorAddOrReplace(sp->adaptorsByIndex, ad);
+    if(mac)
+      adaptorAddOrReplace(sp->adaptorsByMac, ad);
+    return ad;
+  }
+
+  static void buildAdaptors(HSPBench *bm) {
+    HSP *sp = bm->sp;
+    bm->tap = benchAdaptor(sp, NULL, HSP_BENCH_TAP_IFINDEX);
+    if(bm->linkType != HSP_LINKTYPE_ETHERNET)
+      return;
+    for(uint32_t ii = 0; ii < bm->numPkts; ii++) {
+      if(bm->numAdaptors >= bm->maxAdaptors)
+	break;
+      HSPBenchPkt *pkt = &bm->pkts[ii];
+      if(pkt->caplen < 14)
+	continue;
+      SFLMacAddress mac;
+      memset(&mac, 0, sizeof(mac));
+      memcpy(mac.mac, pkt->buf + 6, 6);
+      if(adaptorByMac(sp, &mac) == NULL) {
+	benchAdaptor(sp, mac.mac, HSP_BENCH_TAP_IFINDEX + 1 + bm->numAdaptors);
+	bm->numAdaptors++;
+      }
+    }
+  }
+
+  /*_________________---------------------------__________________
+    _________________    annotator stub         __________________
+    -----------------___________________________------------------
+  */
+
+  static void evt_flow_sample(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    HSPPendingSample *ps = (HSPPendingSample *)data;
+    clock_gettime(CLOCK_MONOTONIC, &bench.annotateStart);
+    for(SFLFlow_sample_element *elem = ps->fs->elements; elem != NULL; elem = elem->nxt) {
+      if(elem->tag != SFLFLOW_HEADER)
+	continue;
+      SFLSampled_header *header = &elem->flowType.header;
+      u_char *hdr = header->header_bytes;
+      uint32_t l3 = 0;
+      uint16_t type_len = 0;
+      if(header->header_protocol == SFLHEADER_ETHERNET_ISO8023) {
+	if(header->header_length < 14)
+	  break;
+	type_len = (hdr[12] << 8) + hdr[13];
+	l3 = 14;
+	if(type_len == 0x8100
+	   && header->header_length >= 18) {
+	  type_len = (hdr[16] << 8) + hdr[17];
+	  l3 = 18;
+	}
+      }
+      else if(header->header_protocol == SFLHEADER_IPv4)
+	type_len = 0x0800;
+      else if(header->header_protocol == SFLHEADER_IPv6)
+	type_len = 0x86DD;
+      uint8_t ipproto = 0;
+      if(type_len == 0x0800
+	 && header->header_length >= l3 + 20)
+	ipproto = hdr[l3 + 9];
+      else if(type_len == 0x86DD
+	      && header->header_length >= l3 + 40)
+	ipproto = hdr[l3 + 6];
+      if(ipproto == IPPROTO_TCP) {
+	SFLFlow_sample_element *tcpElem = pendingSample_calloc(ps, sizeof(SFLFlow_sample_element));
+	tcpElem->tag = SFLFLOW_EX_TCP_INFO;
+	tcpElem->flowType.tcp_info.dirn = PKTDIR_received;
+	tcpElem->flowType.tcp_info.snd_mss = 1448;
+	tcpElem->flowType.tcp_info.rcv_mss = 1448;
+	tcpElem->flowType.tcp_info.pmtu = 1500;
+	tcpElem->flowType.tcp_info.rtt = 1000;
+	tcpElem->flowType.tcp_info.rttvar = 500;
+	tcpElem->flowType.tcp_info.snd_cwnd = 10;
+	tcpElem->flowType.tcp_info.min_rtt = 800;
+	SFLADD_ELEMENT(ps->fs, tcpElem);
+	bench.tcpAnnotated++;
+      }
+      break;
+    }
+    bench.samples++;
+    bench.annotated = YES;
+    clock_gettime(CLOCK_MONOTONIC, &bench.annotateEnd);
+  }
+
+  /*_________________---------------------------__________________
+    _________________    capturing sendPkt      __________________
+    -----------------___________________________------------------
+  */
+
+  static void *benchCB_alloc(void *magic, SFLAgent *agent, size_t bytes) {
+    return my_calloc(bytes);
+  }
+
+  static int benchCB_free(void *magic, SFLAgent *agent, void *obj) {
+    my_free(obj);
+    return 0;
+  }
+
+  static void benchCB_error(void *magic, SFLAgent *agent, char *msg) {
+    fprintf(stderr, "sflow agent error: %s\n", msg);
+  }
+
+  static void benchCB_sendPkt(void *magic, SFLAgent *agent, SFLReceiver *receiver, u_char *pkt, uint32_t pktLen) {
+    uint64_t t0 = nowNS();
+    if(pktLen <= SFL_MAX_DATAGRAM_SIZE)
+      memcpy(capture, pkt, pktLen);
+    __atomic_add_fetch(&bench.datagrams, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&bench.datagramBytes, pktLen, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&bench.nS_send, nowNS() - t0, __ATOMIC_RELAXED);
+  }
+
+  /*_________________---------------------------__________________
+    _________________       replay              __________________
+    -----------------___________________________------------------
+    Runs as the packet bus starts,  so that EVCurrentBus() is the one
+    a packet thread would use.
+  */
+
+  static void replayPacket(HSPBench *bm, HSPBenchPkt *pkt) {
+    HSP *sp = bm->sp;
+    uint64_t t0 = nowNS();
+    uint64_t send0 = bm->nS_send;
+    bm->annotated = NO;
+    if(bm->linkType == HSP_LINKTYPE_ETHERNET) {
+      if(pkt->caplen < 14)
+	return;
+      SFLMacAddress macdst, macsrc;
+      memset(&macdst, 0, sizeof(macdst));
+      memset(&macsrc, 0, sizeof(macsrc));
+      memcpy(macdst.mac, pkt->buf, 6);
+      memcpy(macsrc.mac, pkt->buf + 6, 6);
+      SFLAdaptor *srcdev = adaptorByMac(sp, &macsrc);
+      SFLAdaptor *dstdev = adaptorByMac(sp, &macdst);
+      takeSample(sp,
+		 srcdev,
+		 dstdev,
+		 bm->tap,
+		 HSP_SAMPLEOPT_DEV_SAMPLER | HSP_SAMPLEOPT_DEV_POLLER,
+		 0 /*hook*/,
+		 pkt->buf /* mac hdr*/,
+		 14 /* mac len */,
+		 pkt->buf + 14 /* payload */,
+		 pkt->caplen - 14,
+		 pkt->len,
+		 0 /* drops */,
+		 bm->samplingRate);
+    }
+    else {
+      if(pkt->caplen == 0)
+	return;
+      takeSample(sp,
+		 NULL,
+		 NULL,
+		 bm->tap,
+		 HSP_SAMPLEOPT_DEV_SAMPLER | HSP_SAMPLEOPT_DEV_POLLER,
+		 0 /*hook*/,
+		 NULL,
+		 0,
+		 pkt->buf,
+		 pkt->caplen,
+		 pkt->len,
+		 0 /* drops */,
+		 bm->samplingRate);
+    }
+    uint64_t t3 = nowNS();
+    uint64_t send = bm->nS_send - send0;
+    bm->packets++;
+    if(bm->annotated) {
+      uint64_t t1 = tsNS(&bm->annotateStart);
+      uint64_t t2 = tsNS(&bm->annotateEnd);
+      bm->nS_classify += t1 - t0;
+      bm->nS_annotate += t2 - t1;
+      bm->nS_encode += (t3 - t2) - send;
+    }
+    else
+      bm->nS_classify += (t3 - t0) - send;
+  }
+
+  static void evt_replay(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    HSPBench *bm = &bench;
+    HSP *sp = bm->sp;
+    // warm up: creates the samplers and pollers
+    // and fills the allocator free-lists
+    for(uint32_t ii = 0; ii < bm->numPkts && ii < 1000; ii++)
+      replayPacket(bm, &bm->pkts[ii]);
+    SEMLOCK_DO(sp->sync_agent) {
+      sfl_receiver_flush(sp->agent->receivers);
+    }
+    bm->packets = bm->samples = bm->datagrams = bm->datagramBytes = bm->tcpAnnotated = 0;
+    bm->nS_classify = bm->nS_annotate = bm->nS_encode = bm->nS_send = 0;
+
+    uint64_t allocs0, osAllocs0, allocs1, osAllocs1;
+    UTHeapQStats(&allocs0, &osAllocs0);
+    uint64_t t0 = nowNS();
+    for(uint32_t loop = 0; loop < bm->loops; loop++) {
+      for(uint32_t ii = 0; ii < bm->numPkts; ii++)
+	replayPacket(bm, &bm->pkts[ii]);
+    }
+    SEMLOCK_DO(sp->sync_agent) {
+      sfl_receiver_flush(sp->agent->receivers);
+    }
+    bm->nS_total = nowNS() - t0;
+    UTHeapQStats(&allocs1, &osAllocs1);
+    bm->allocs = allocs1 - allocs0;
+    bm->osAllocs = osAllocs1 - osAllocs0;
+    EVBusStop(evt->bus);
+  }
+
+  /*_________________---------------------------__________________
+    _________________   packet worker threads   __________________
+    -----------------___________________________------------------
+    Each worker is a bus of its own,  replaying its share of the
+    packets from that bus's start event as a pcap worker would.  The
+    main thread waits for them all to warm up,  starts the clock and
+    lets them go together.
+  */
+
+  static void worker_replay(HSPBench *bm, HSPBenchWorker *wk, uint32_t maxPkts) {
+    HSP *sp = bm->sp;
+    uint32_t sent = 0;
+    for(uint32_t ii = 0; ii < bm->numPkts && sent < maxPkts; ii++) {
+      HSPBenchPkt *pkt = &bm->pkts[ii];
+      if((pkt->flowHash % wk->numWorkers) != wk->index)
+	continue;
+      sent++;
+      if(bm->linkType == HSP_LINKTYPE_ETHERNET) {
+	if(pkt->caplen < 14)
+	  continue;
+	SFLMacAddress macdst, macsrc;
+	memset(&macdst, 0, sizeof(macdst));
+	memset(&macsrc, 0, sizeof(macsrc));
+	memcpy(macdst.mac, pkt->buf, 6);
+	memcpy(macsrc.mac, pkt->buf + 6, 6);
+	takeSample(sp,
+		   adaptorByMac(sp, &macsrc),
+		   adaptorByMac(sp, &macdst),
+		   bm->tap,
+		   HSP_SAMPLEOPT_DEV_SAMPLER | HSP_SAMPLEOPT_DEV_POLLER,
+		   0 /*hook*/,
+		   pkt->buf,
+		   14,
+		   pkt->buf + 14,
+		   pkt->caplen - 14,
+		   pkt->len,
+		   0 /* drops */,
+		   bm->samplingRate);
+      }
+      else if(pkt->caplen) {
+	takeSample(sp,
+		   NULL,
+		   NULL,
+		   bm->tap,
+		   HSP_SAMPLEOPT_DEV_SAMPLER | HSP_SAMPLEOPT_DEV_POLLER,
+		   0 /*hook*/,
+		   NULL,
+		   0,
+		   pkt->buf,
+		   pkt->caplen,
+		   pkt->len,
+		   0 /* drops */,
+		   bm->samplingRate);
+      }
+      wk->packets++;
+      if((wk->packets % HSP_BENCH_READ_BATCH) == 0)
+	pendingSampleBatchFlush(sp);
+    }
+    pendingSampleBatchFlush(sp);
+  }
+
+  static void worker_flush(HSP *sp) {
+    HSPShard *shard = getShard(sp);
+    if(shard)
+      sfl_receiver_flush(&shard->receiver);
+    else {
+      SEMLOCK_DO(sp->sync_agent) {
+	sfl_receiver_flush(sp->agent->receivers);
+      }
+    }
+  }
+
+  static void evt_worker_start(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    HSPBench *bm = &bench;
+    HSPBenchWorker *wk = NULL;
+    for(uint32_t ii = 0; ii < bm->numWorkers; ii++) {
+      if(bm->workers[ii].bus == evt->bus)
+	wk = &bm->workers[ii];
+    }
+    // worker 0 is the packet bus,  which never batches or shards
+    if(wk->index) {
+      if(bm->shards)
+	startShard(bm->sp, wk->index);
+      else
+	pendingSampleBatchStart();
+    }
+    worker_replay(bm, wk, 1000); // warm up
+    worker_flush(bm->sp);
+    wk->packets = 0;
+    __atomic_add_fetch(&bm->workersReady, 1, __ATOMIC_RELEASE);
+    while(!__atomic_load_n(&bm->workersGo, __ATOMIC_ACQUIRE))
+      sched_yield();
+    for(uint32_t loop = 0; loop < bm->loops; loop++)
+      worker_replay(bm, wk, UINT32_MAX);
+    worker_flush(bm->sp);
+    __atomic_add_fetch(&bm->workersDone, 1, __ATOMIC_RELEASE);
+    // EVBusStop() would try to join this thread,  so just flag
+    // it and let the main thread do the join.
+    evt->bus->stop = YES;
+  }
+
+  static void runWorkers(HSPBench *bm, uint32_t numWorkers, bool shards) {
+    HSP *sp = bm->sp;
+    bm->numWorkers = numWorkers;
+    bm->shards = shards;
+    bm->workers = (HSPBenchWorker *)my_calloc(numWorkers * sizeof(HSPBenchWorker));
+    bm->workersReady = bm->workersDone = 0;
+    bm->workersGo = NO;
+    for(uint32_t ii = 0; ii < numWorkers; ii++) {
+      HSPBenchWorker *wk = &bm->workers[ii];
+      char busName[32];
+      snprintf(busName, sizeof(busName), "bench_%u_%u%s", numWorkers, ii, shards ? "s" : "");
+      wk->index = ii;
+      wk->numWorkers = numWorkers;
+      wk->bus = EVGetBus(sp->rootModule, busName, YES);
+      EVEventRx(sp->rootModule, EVGetEvent(wk->bus, EVEVENT_START), evt_worker_start);
+    }
+    for(uint32_t ii = 0; ii < numWorkers; ii++)
+      EVBusRunThread(bm->workers[ii].bus, EV_BUS_STACKSIZE);
+    while(__atomic_load_n(&bm->workersReady, __ATOMIC_ACQUIRE) < numWorkers)
+      usleep(100);
+    uint64_t datagrams0 = __atomic_load_n(&bm->datagrams, __ATOMIC_ACQUIRE);
+    uint64_t t0 = nowNS();
+    __atomic_store_n(&bm->workersGo, YES, __ATOMIC_RELEASE);
+    while(__atomic_load_n(&bm->workersDone, __ATOMIC_ACQUIRE) < numWorkers)
+      usleep(100);
+    uint64_t nS = nowNS() - t0;
+    uint64_t packets = 0;
+    for(uint32_t ii = 0; ii < numWorkers; ii++) {
+      EVBusStop(bm->workers[ii].bus);
+      packets += bm->workers[ii].packets;
+    }
+    cJSON *result = cJSON_CreateObject();
+    cJSON_AddNumberToObject(result, "workers", numWorkers);
+    cJSON_AddStringToObject(result, "mode", shards ? "shards" : "batched");
+    cJSON_AddNumberToObject(result, "packets", packets);
+    cJSON_AddNumberToObject(result, "elapsed_s", nS / 1.0e9);
+    cJSON_AddNumberToObject(result, "packets_per_sec", nS ? (packets * 1.0e9) / nS : 0.0);
+    cJSON_AddNumberToObject(result, "datagrams", __atomic_load_n(&bm->datagrams, __ATOMIC_ACQUIRE) - datagrams0);
+    cJSON_AddItemToArray(bm->workerResults, result);
+    my_free(bm->workers);
+    bm->workers = NULL;
+  }
+
+  static bool benchWorkers(HSPBench *bm) {
+    char buf[16];
+    char *p = bm->workerCounts;
+    bm->workerResults = cJSON_CreateArray();
+    while(parseNextTok(&p, ",", NO, 0, NO, buf, sizeof(buf))) {
+      uint32_t numWorkers = strtoul(buf, NULL, 0);
+      if(numWorkers == 0
+	 || numWorkers > HSP_BENCH_MAX_WORKERS) {
+	fprintf(stderr, "workers must be 1-%u\n", HSP_BENCH_MAX_WORKERS);
+	return NO;
+      }
+      runWorkers(bm, numWorkers, NO);
+      runWorkers(bm, numWorkers, YES);
+    }
+    return YES;
+  }
+
+  /*_________________---------------------------__________________
+    _________________       report              __________________
+    -----------------___________________________------------------
+  */
+
+  static double perSample(HSPBench *bm, uint64_t val) {
+    return bm->samples ? (double)val / (double)bm->samples : 0.0;
+  }
+
+  static void report(HSPBench *bm) {
+    cJSON *top = cJSON_CreateObject();
+    cJSON_AddStringToObject(top, "version", STRINGIFY_DEF(HSP_VERSION));
+    cJSON_AddStringToObject(top, "pcap", bm->pcapFile);
+    cJSON_AddNumberToObject(top, "loops", bm->loops);
+    cJSON_AddNumberToObject(top, "adaptors", bm->numAdaptors + 1);
+    cJSON_AddNumberToObject(top, "packets", bm->packets);
+    cJSON_AddNumberToObject(top, "samples", bm->samples);
+    cJSON_AddNumberToObject(top, "tcp_annotated", bm->tcpAnnotated);
+    cJSON_AddNumberToObject(top, "elapsed_s", bm->nS_total / 1.0e9);
+    cJSON_AddNumberToObject(top, "packets_per_sec", bm->nS_total ? (bm->packets * 1.0e9) / bm->nS_total : 0.0);
+    cJSON *stages = cJSON_CreateObject();
+    cJSON_AddNumberToObject(stages, "classify", perSample(bm, bm->nS_classify));
+    cJSON_AddNumberToObject(stages, "annotate", perSample(bm, bm->nS_annotate));
+    cJSON_AddNumberToObject(stages, "encode", perSample(bm, bm->nS_encode));
+    cJSON_AddNumberToObject(stages, "send", perSample(bm, bm->nS_send));
+    cJSON_AddNumberToObject(stages, "total", perSample(bm, bm->nS_total));
+    cJSON_AddItemToObject(top, "ns_per_sample", stages);
+    cJSON_AddNumberToObject(top, "allocs_per_sample", perSample(bm, bm->allocs));
+    cJSON_AddNumberToObject(top, "os_allocs_per_sample", perSample(bm, bm->osAllocs));
+    cJSON_AddNumberToObject(top, "datagrams", bm->datagrams);
+    cJSON_AddNumberToObject(top, "datagram_bytes", bm->datagramBytes);
+    cJSON_AddNumberToObject(top, "samples_per_datagram", bm->datagrams ? (double)bm->samples / bm->datagrams : 0.0);
+    if(bm->workerResults)
+      cJSON_AddItemToObject(top, "packet_workers", bm->workerResults);
+    char *str = cJSON_PrintUnformatted(top);
+    printf("%s\n", str);
+    my_free(str);
+    cJSON_Delete(top);
+  }
+
+  /*_________________---------------------------__________________
+    _________________         main              __________________
+    -----------------___________________________------------------
+  */
+
+  static void instructions(char *command) {
+    fprintf(stderr, "Usage: %s [-r PCAPFile] [-l loops] [-s samplingRateLabel] [-H headerBytes] [-a maxAdaptors] [-w workers,...] [-m all|case,...]\n", command);
+    fprintf(stderr, "micro-benchmark cases:");
+    microBenchList(stderr);
+    fprintf(stderr, "\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // just enough of main() in hsflowd.c for the packet path
+  static void benchInitHSP(HSP *sp, uint32_t headerBytes) {
+    sp->sync_agent = (pthread_mutex_t *)my_calloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(sp->sync_agent, NULL);
+    sp->sync_sampling = (pthread_mutex_t *)my_calloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(sp->sync_sampling, NULL);
+    sp->samplingCtls = UTArrayNew(UTARRAY_DFLT);
+    sp->pollActions = UTArrayNew(UTARRAY_DFLT);
+    sp->adaptorsByName = UTHASH_NEW(SFLAdaptor, deviceName, UTHASH_SYNC | UTHASH_SKEY);
+    sp->adaptorsByIndex = UTHASH_NEW(SFLAdaptor, ifIndex, UTHASH_SYNC);
+    sp->adaptorsByPeerIndex = UTHASH_NEW(SFLAdaptor, peer_ifIndex, UTHASH_SYNC);
+    sp->adaptorsByMac = UTHASH_NEW(SFLAdaptor, macs[0], UTHASH_SYNC);
+    sp->localIP = UTHASH_NEW(SFLAddress, address.ip_v4, UTHASH_DFLT);
+    sp->localIP6 = UTHASH_NEW(SFLAddress, address.ip_v6, UTHASH_DFLT);
+    sp->sFlowSettings_file = newSFlowSettings();
+    sp->sFlowSettings_file->headerBytes = headerBytes;
+    sp->sFlowSettings = sp->sFlowSettings_file;
+    sp->actualPollingInterval = SFL_DEFAULT_POLLING_INTERVAL;
+    sp->staticRevision = 1;
+    sp->agentIP.type = SFLADDRESSTYPE_IP_V4;
+    sp->agentIP.address.ip_v4.addr = htonl(0x7F000001);
+    sp->rootModule = EVInit(sp);
+  }
+
+  int main(int argc, char *argv[]) {
+    HSPBench *bm = &bench;
+    HSP *sp = (HSP *)my_os_calloc(sizeof(HSP));
+    bm->sp = sp;
+    bm->loops = 1;
+    bm->samplingRate = 1;
+    bm->maxAdaptors = HSP_BENCH_MAX_ADAPTORS;
+    uint32_t headerBytes = SFL_DEFAULT_HEADER_SIZE;
+    char *microCases = NULL;
+    int in;
+    while((in = getopt(argc, argv, "r:l:s:H:a:w:m:h?")) != -1) {
+      switch(in) {
+      case 'r': bm->pcapFile = optarg; break;
+      case 'l': bm->loops = strtoul(optarg, NULL, 0); break;
+      case 's': bm->samplingRate = strtoul(optarg, NULL, 0); break;
+      case 'H': headerBytes = strtoul(optarg, NULL, 0); break;
+      case 'a': bm->maxAdaptors = strtoul(optarg, NULL, 0); break;
+      case 'w': bm->workerCounts = optarg; break;
+      case 'm': microCases = optarg; break;
+      default: instructions(*argv);
+      }
+    }
+    if((bm->pcapFile == NULL && microCases == NULL)
+       || bm->loops == 0
+       || headerBytes > HSP_MAX_HEADER_BYTES)
+      instructions(*argv);
+
+#ifdef UTHEAP
+    UTHeapInit();
+#endif
+    cJSON_Hooks hooks;
+    hooks.malloc_fn = my_calloc;
+    hooks.free_fn = my_free;
+    cJSON_InitHooks(&hooks);
+    sfl_random_init(1);
+
+    benchInitHSP(sp, headerBytes);
+
+    if(microCases) {
+      cJSON *top = cJSON_CreateObject();
+      cJSON_AddStringToObject(top, "version", STRINGIFY_DEF(HSP_VERSION));
+      cJSON *micro = cJSON_CreateObject();
+      cJSON_AddItemToObject(top, "micro", micro);
+      bool ok = microBench(sp, microCases, micro);
+      char *str = cJSON_PrintUnformatted(top);
+      printf("%s\n", str);
+      my_free(str);
+      cJSON_Delete(top);
+      if(!ok)
+	instructions(*argv);
+      if(bm->pcapFile == NULL)
+	return EXIT_SUCCESS;
+    }
+
+    if(!readPcapFile(bm))
+      exit(EXIT_FAILURE);
+
+    sp->agent = (SFLAgent *)my_calloc(sizeof(SFLAgent));
+    sfl_agent_init(sp->agent,
+		   &sp->agentIP,
+		   sp->subAgentId,
+		   0,
+		   0,
+		   sp,
+		   benchCB_alloc,
+		   benchCB_free,
+		   benchCB_error,
+		   benchCB_sendPkt);
+    SFLReceiver *receiver = sfl_agent_addReceiver(sp->agent);
+    sfl_receiver_set_sFlowRcvrOwner(receiver, "hsflowd_bench");
+    sfl_receiver_set_sFlowRcvrTimeout(receiver, 0xFFFFFFFF);
+
+    buildAdaptors(bm);
+
+    sp->pollBus = EVGetBus(sp->rootModule, HSPBUS_POLL, YES);
+    bm->packetBus = EVGetBus(sp->rootModule, HSPBUS_PACKET, YES);
+    EVEventRx(sp->rootModule, EVGetEvent(bm->packetBus, HSPEVENT_FLOW_SAMPLE), evt_flow_sample);
+    EVEventRx(sp->rootModule, EVGetEvent(bm->packetBus, EVEVENT_START), evt_replay);
+    EVBusRun(bm->packetBus);
+
+    // the single-thread results are reported as they were left
+    uint64_t datagrams = bm->datagrams;
+    uint64_t datagramBytes = bm->datagramBytes;
+    uint64_t nS_send = bm->nS_send;
+    if(bm->workerCounts
+       && !benchWorkers(bm))
+      instructions(*argv);
+    bm->datagrams = datagrams;
+    bm->datagramBytes = datagramBytes;
+    bm->nS_send = nS_send;
+
+    report(bm);
+    return EXIT_SUCCESS;
+  }
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif
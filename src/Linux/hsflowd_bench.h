@@ -0,0 +1,27 @@
+/* This software is distributed under the following license:
+ * http://sflow.net/license.html
+ */
+
+#ifndef HSFLOWD_BENCH_H
+#define HSFLOWD_BENCH_H 1
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "hsflowd.h"
+#include "cJSON.h"
+
+  // shared by the pcap replay (hsflowd_bench.c) and the
+  // micro-benchmarks (hsflowd_bench_micro.c)
+  uint64_t benchNowNS(void);
+  bool microBench(HSP *sp, char *cases, cJSON *results);
+  void microBenchList(FILE *out);
+  // from mod_json.c,  compiled with -DHSP_BENCH
+  void mod_json_bench(EVMod *mod, char *buf, bool fast);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif
+
+#endif /* HSFLOWD_BENCH_H */
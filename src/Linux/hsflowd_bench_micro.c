@@ -0,0 +1,1103 @@
+/* This software is distributed under the following license:
+ * http://sflow.net/license.html
+ */
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "hsflowd_bench.h"
+#include <sys/select.h>
+#include <sys/statvfs.h>
+#include <sys/sysinfo.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+
+  /*
+    Micro-benchmarks for individual pieces of hsflowd,  run with
+    "hsflowd_bench -m all" (or -m case1,case2).  Where there was an
+    older way of doing the same thing,  it is timed alongside so the
+    two numbers can be compared on the same machine.  Each case adds
+    one object to the JSON results.
+  */
+
+  typedef void (*HSPMicroBenchCB)(HSP *sp, cJSON *result);
+
+  typedef struct _HSPMicroBenchCase {
+    char *name;
+    HSPMicroBenchCB benchCB;
+    char *descr;
+  } HSPMicroBenchCase;
+
+  static void addNumber(cJSON *obj, char *name, uint32_t key, double val) {
+    char keyName[64];
+    snprintf(keyName, sizeof(keyName), "%s_%u", name, key);
+    cJSON_AddNumberToObject(obj, keyName, val);
+  }
+
+  // make room for the case that wants a few thousand sockets
+  static void raiseFileLimit(rlim_t want) {
+    struct rlimit rlim;
+    if(getrlimit(RLIMIT_NOFILE, &rlim) == 0
+       && rlim.rlim_cur < want) {
+      rlim.rlim_cur = (rlim.rlim_max < want) ? rlim.rlim_max : want;
+      setrlimit(RLIMIT_NOFILE, &rlim);
+    }
+  }
+
+  /*_________________---------------------------__________________
+    _________________     fanin (evbus)         __________________
+    -----------------___________________________------------------
+    Cost of one bus wakeup when one socket is busy and the rest are
+    idle.  "epoll" runs a real bus.  "pselect" is the loop the bus
+    used before:  rebuild the fd_set,  pselect(),  then FD_ISSET()
+    every socket.  It cannot be run once an fd goes past FD_SETSIZE.
+  */
+
+#define HSP_BENCH_FANIN_WAKEUPS 100000
+
+  static struct {
+    int busy[2];
+    uint32_t wakeups;
+  } fanin;
+
+  static void fanin_idleCB(EVMod *mod, EVSocket *sock, void *magic) {
+    uint64_t val;
+    if(read(sock->fd, &val, sizeof(val)) < 0) {}
+  }
+
+  static void fanin_busyCB(EVMod *mod, EVSocket *sock, void *magic) {
+    char ch;
+    if(read(sock->fd, &ch, 1) != 1)
+      return;
+    if(++fanin.wakeups >= HSP_BENCH_FANIN_WAKEUPS) {
+      EVBusStop(sock->bus);
+      return;
+    }
+    if(write(fanin.busy[1], &ch, 1) != 1) {}
+  }
+
+  static double fanin_pselect(int *idle, uint32_t nIdle) {
+    sigset_t emptyset;
+    sigemptyset(&emptyset);
+    char ch = 'x';
+    if(write(fanin.busy[1], &ch, 1) != 1)
+      return 0.0;
+    uint64_t t0 = benchNowNS();
+    for(uint32_t ii = 0; ii < HSP_BENCH_FANIN_WAKEUPS; ii++) {
+      fd_set readfds;
+      FD_ZERO(&readfds);
+      int max_fd = fanin.busy[0];
+      FD_SET(fanin.busy[0], &readfds);
+      for(uint32_t jj = 0; jj < nIdle; jj++) {
+	FD_SET(idle[jj], &readfds);
+	if(idle[jj] > max_fd)
+	  max_fd = idle[jj];
+      }
+      if(pselect(max_fd + 1, &readfds, NULL, NULL, NULL, &emptyset) <= 0)
+	return 0.0;
+      for(uint32_t jj = 0; jj < nIdle; jj++) {
+	if(FD_ISSET(idle[jj], &readfds))
+	  return 0.0;
+      }
+      if(FD_ISSET(fanin.busy[0], &readfds)) {
+	if(read(fanin.busy[0], &ch, 1) != 1
+	   || write(fanin.busy[1], &ch, 1) != 1)
+	  return 0.0;
+      }
+    }
+    uint64_t nS = benchNowNS() - t0;
+    // drain the last one
+    if(read(fanin.busy[0], &ch, 1) != 1) {}
+    return (double)nS / HSP_BENCH_FANIN_WAKEUPS;
+  }
+
+  static void bench_fanin(HSP *sp, cJSON *result) {
+    static const uint32_t idleCounts[] = { 10, 100, 2000 };
+    EVMod *mod = sp->rootModule;
+    raiseFileLimit(4096 + 64);
+    for(uint32_t cc = 0; cc < sizeof(idleCounts) / sizeof(idleCounts[0]); cc++) {
+      uint32_t nIdle = idleCounts[cc];
+      char busName[32];
+      snprintf(busName, sizeof(busName), "bench_fanin_%u", nIdle);
+      EVBus *bus = EVGetBus(mod, busName, YES);
+      int *idle = (int *)my_calloc(nIdle * sizeof(int));
+      EVSocket **idleSocks = (EVSocket **)my_calloc(nIdle * sizeof(EVSocket *));
+      uint32_t nOpen = 0;
+      for(; nOpen < nIdle; nOpen++) {
+	if((idle[nOpen] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+	  break;
+	idleSocks[nOpen] = EVBusAddSocket(mod, bus, idle[nOpen], fanin_idleCB, NULL);
+      }
+      if(nOpen < nIdle
+	 || pipe(fanin.busy) == -1) {
+	fprintf(stderr, "fanin: could not open %u sockets : %s\n", nIdle + 2, strerror(errno));
+	addNumber(result, "epoll_ns", nIdle, 0.0);
+      }
+      else {
+	// pselect first,  while the bus is not looking at the pipe
+	bool fits = YES;
+	for(uint32_t ii = 0; ii < nIdle; ii++) {
+	  if(idle[ii] >= FD_SETSIZE)
+	    fits = NO;
+	}
+	if(fanin.busy[0] >= FD_SETSIZE)
+	  fits = NO;
+	if(fits)
+	  addNumber(result, "pselect_ns", nIdle, fanin_pselect(idle, nIdle));
+	EVSocket *busySock = EVBusAddSocket(mod, bus, fanin.busy[0], fanin_busyCB, NULL);
+	fanin.wakeups = 0;
+	char ch = 'x';
+	if(write(fanin.busy[1], &ch, 1) == 1) {
+	  uint64_t t0 = benchNowNS();
+	  EVBusRun(bus);
+	  addNumber(result, "epoll_ns", nIdle, (double)(benchNowNS() - t0) / HSP_BENCH_FANIN_WAKEUPS);
+	}
+	EVSocketClose(mod, busySock);
+	while(close(fanin.busy[1]) == -1 && errno == EINTR);
+      }
+      for(uint32_t ii = 0; ii < nOpen; ii++) {
+	if(idleSocks[ii])
+	  EVSocketClose(mod, idleSocks[ii]);
+      }
+      my_free(idle);
+      my_free(idleSocks);
+    }
+  }
+
+  /*_________________---------------------------__________________
+    _________________     ring (evbus)          __________________
+    -----------------___________________________------------------
+    Events/sec from one thread to a bus running in another.  "ring"
+    sends from a bus thread,  so the events go on the lock-free ring
+    for that pair of buses.  "pipe" sends the same events from a
+    plain thread,  which still goes through the bus pipe - the only
+    path there was before the rings.
+  */
+
+#define HSP_BENCH_RING_EVENTS 500000
+#define HSP_BENCH_RING_EVT "bench_ring_evt"
+
+  static struct {
+    EVMod *mod;
+    EVEvent *rxEvt;
+    char payload[1024];
+    size_t len;
+    uint32_t count;
+    uint32_t target;
+  } ringb;
+
+  static void ring_rx(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    if(__atomic_add_fetch(&ringb.count, 1, __ATOMIC_RELEASE) == ringb.target) {
+      // EVBusStop() would try to join this thread, so
+      // just flag it and let the main thread do the join.
+      evt->bus->stop = YES;
+    }
+  }
+
+  static void ring_tx_start(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    for(uint32_t ii = 0; ii < ringb.target; ii++)
+      EVEventTx(ringb.mod, ringb.rxEvt, ringb.payload, ringb.len);
+    EVBusStop(evt->bus);
+  }
+
+  static void *ring_tx_thread(void *magic) {
+    for(uint32_t ii = 0; ii < ringb.target; ii++)
+      EVEventTx(ringb.mod, ringb.rxEvt, ringb.payload, ringb.len);
+    return NULL;
+  }
+
+  static double ring_run(HSP *sp, bool useRing, size_t len) {
+    char busName[64];
+    snprintf(busName, sizeof(busName), "bench_%s_rx_%u", useRing ? "ring" : "pipe", (uint32_t)len);
+    EVBus *rxBus = EVGetBus(sp->rootModule, busName, YES);
+    ringb.mod = sp->rootModule;
+    ringb.rxEvt = EVGetEvent(rxBus, HSP_BENCH_RING_EVT);
+    EVEventRx(sp->rootModule, ringb.rxEvt, ring_rx);
+    ringb.len = len;
+    ringb.count = 0;
+    ringb.target = HSP_BENCH_RING_EVENTS;
+    EVBusRunThread(rxBus, EV_BUS_STACKSIZE);
+    uint64_t t0 = benchNowNS();
+    if(useRing) {
+      snprintf(busName, sizeof(busName), "bench_ring_tx_%u", (uint32_t)len);
+      EVBus *txBus = EVGetBus(sp->rootModule, busName, YES);
+      EVEventRx(sp->rootModule, EVGetEvent(txBus, EVEVENT_START), ring_tx_start);
+      EVBusRun(txBus);
+    }
+    else {
+      pthread_t tx;
+      if(pthread_create(&tx, NULL, ring_tx_thread, NULL) != 0)
+	return 0.0;
+      pthread_join(tx, NULL);
+    }
+    while(__atomic_load_n(&ringb.count, __ATOMIC_ACQUIRE) < ringb.target)
+      usleep(100);
+    uint64_t nS = benchNowNS() - t0;
+    EVBusStop(rxBus);
+    return nS ? (ringb.target * 1.0e9) / nS : 0.0;
+  }
+
+  static void bench_ring(HSP *sp, cJSON *result) {
+    static const uint32_t sizes[] = { 64, 1024 };
+    for(uint32_t ii = 0; ii < sizeof(sizes) / sizeof(sizes[0]); ii++) {
+      addNumber(result, "ring_events_per_sec", sizes[ii], ring_run(sp, YES, sizes[ii]));
+      addNumber(result, "pipe_events_per_sec", sizes[ii], ring_run(sp, NO, sizes[ii]));
+    }
+  }
+
+  /*_________________---------------------------__________________
+    _________________     pool (readPackets)    __________________
+    -----------------___________________________------------------
+    Cost of the pending-sample memory for one sample:  take it,  fill
+    in a header,  add one annotation (as mod_tcp does) and give it
+    back.  "pool" is the per-thread free-list.  "heap" makes the five
+    allocations per sample that takeSample() used to make:  wrapper,
+    flow sample,  ptrsToFree array,  header element and header buffer,
+    plus one for the annotation.
+  */
+
+#define HSP_BENCH_POOL_SAMPLES 1000000
+
+  static void pool_fill(SFL_FLOW_SAMPLE_TYPE *fs, SFLFlow_sample_element *hdrElem, u_char *hdrBytes, SFLFlow_sample_element *tcpElem) {
+    static u_char pkt[SFL_DEFAULT_HEADER_SIZE];
+    hdrElem->tag = SFLFLOW_HEADER;
+    hdrElem->flowType.header.header_bytes = hdrBytes;
+    hdrElem->flowType.header.header_length = SFL_DEFAULT_HEADER_SIZE;
+    memcpy(hdrBytes, pkt, SFL_DEFAULT_HEADER_SIZE);
+    SFLADD_ELEMENT(fs, hdrElem);
+    tcpElem->tag = SFLFLOW_EX_TCP_INFO;
+    SFLADD_ELEMENT(fs, tcpElem);
+  }
+
+  static void pool_run(bool usePool, cJSON *result) {
+    uint64_t allocs0, allocs1;
+    UTHeapQStats(&allocs0, NULL);
+    uint64_t t0 = benchNowNS();
+    for(uint32_t ii = 0; ii < HSP_BENCH_POOL_SAMPLES; ii++) {
+      if(usePool) {
+	HSPPendingSample *ps = pendingSampleNew(NULL);
+	SFLFlow_sample_element *tcpElem = pendingSample_calloc(ps, sizeof(SFLFlow_sample_element));
+	pool_fill(ps->fs, &ps->hdrElem, ps->hdrBytes, tcpElem);
+	pendingSampleFree(ps);
+      }
+      else {
+	void *wrapper = my_calloc(sizeof(void *) * 4);
+	SFL_FLOW_SAMPLE_TYPE *fs = my_calloc(sizeof(SFL_FLOW_SAMPLE_TYPE));
+	UTArray *ptrsToFree = UTArrayNew(UTARRAY_DFLT);
+	SFLFlow_sample_element *hdrElem = my_calloc(sizeof(SFLFlow_sample_element));
+	UTArrayAdd(ptrsToFree, hdrElem);
+	u_char *hdrBytes = my_calloc(SFL_DEFAULT_HEADER_SIZE);
+	UTArrayAdd(ptrsToFree, hdrBytes);
+	SFLFlow_sample_element *tcpElem = my_calloc(sizeof(SFLFlow_sample_element));
+	UTArrayAdd(ptrsToFree, tcpElem);
+	pool_fill(fs, hdrElem, hdrBytes, tcpElem);
+	void *ptr;
+	UTARRAY_WALK(ptrsToFree, ptr) my_free(ptr);
+	UTArrayFree(ptrsToFree);
+	my_free(fs);
+	my_free(wrapper);
+      }
+    }
+    uint64_t nS = benchNowNS() - t0;
+    UTHeapQStats(&allocs1, NULL);
+    char *name = usePool ? "pool" : "heap";
+    char key[32];
+    snprintf(key, sizeof(key), "%s_ns", name);
+    cJSON_AddNumberToObject(result, key, (double)nS / HSP_BENCH_POOL_SAMPLES);
+    snprintf(key, sizeof(key), "%s_allocs", name);
+    cJSON_AddNumberToObject(result, key, (double)(allocs1 - allocs0) / HSP_BENCH_POOL_SAMPLES);
+  }
+
+  static void bench_pool(HSP *sp, cJSON *result) {
+    // warm the free-list first
+    HSPPendingSample *ps = pendingSampleNew(NULL);
+    pendingSampleFree(ps);
+    pool_run(YES, result);
+    pool_run(NO, result);
+  }
+
+  /*_________________---------------------------__________________
+    _________________     lock (sync_agent)     __________________
+    -----------------___________________________------------------
+    Wait and hold time on sp->sync_agent while 1, 2 or 4 packet
+    threads write flow samples and a poll thread writes a counter
+    sample every 100uS.  "per_sample" takes the lock for each sample,
+    as the packet bus does.  "batched" takes it once per 64 samples,
+    as a packet worker bus does.  "shards" writes to a receiver per
+    thread (workerShards=on),  so only the poll thread takes the lock.
+    Times are per acquisition,  summed over all threads.
+  */
+
+#define HSP_BENCH_LOCK_SAMPLES 200000
+#define HSP_BENCH_LOCK_BATCH 64
+
+  typedef enum { LOCK_PER_SAMPLE=0, LOCK_BATCHED, LOCK_SHARDS } EnumLockMode;
+  static char *lockModeNames[] = { "per_sample", "batched", "shards" };
+
+  typedef struct _HSPLockStats {
+    uint64_t acquired;
+    uint64_t nS_wait;
+    uint64_t nS_hold;
+  } HSPLockStats;
+
+  static struct {
+    HSP *sp;
+    SFLAgent agent;
+    SFLSampler *sampler;
+    SFLPoller *poller;
+    EnumLockMode mode;
+    uint32_t writersDone;
+    HSPLockStats stats;
+  } lockb;
+
+  typedef struct _HSPLockWriter {
+    pthread_t thread;
+    uint32_t index;
+    SFLReceiver shard;
+    HSPLockStats stats;
+  } HSPLockWriter;
+
+  static void lock_sendPkt(void *magic, SFLAgent *agent, SFLReceiver *receiver, u_char *pkt, uint32_t pktLen) {
+    // datagrams are thrown away
+  }
+
+  static void *lock_alloc(void *magic, SFLAgent *agent, size_t bytes) {
+    return my_calloc(bytes);
+  }
+
+  static int lock_free(void *magic, SFLAgent *agent, void *obj) {
+    my_free(obj);
+    return 0;
+  }
+
+  static void lock_error(void *magic, SFLAgent *agent, char *msg) {
+    fprintf(stderr, "lock: sflow agent error: %s\n", msg);
+  }
+
+  // the caller's work is timed as hold time
+#define LOCK_TIMED(stats) \
+  for(uint64_t _t0 = benchNowNS(), _t1 = (pthread_mutex_lock(lockb.sp->sync_agent), benchNowNS()), _done = 0; \
+      !_done; \
+      (stats)->nS_wait += _t1 - _t0, \
+	(stats)->nS_hold += benchNowNS() - _t1, \
+	(stats)->acquired++, \
+	pthread_mutex_unlock(lockb.sp->sync_agent), \
+	_done = 1)
+
+  static void lock_writeFlow(HSPLockWriter *wr) {
+    static u_char pkt[SFL_DEFAULT_HEADER_SIZE];
+    SFL_FLOW_SAMPLE_TYPE fs = { 0 };
+    SFLFlow_sample_element hdrElem = { 0 };
+    hdrElem.tag = SFLFLOW_HEADER;
+    hdrElem.flowType.header.header_protocol = SFLHEADER_ETHERNET_ISO8023;
+    hdrElem.flowType.header.frame_length = 1500;
+    hdrElem.flowType.header.header_bytes = pkt;
+    hdrElem.flowType.header.header_length = sizeof(pkt);
+    SFLADD_ELEMENT(&fs, &hdrElem);
+    fs.sampling_rate = 1;
+    if(lockb.mode == LOCK_SHARDS)
+      sfl_sampler_writeFlowSampleTo(lockb.sampler, &wr->shard, &fs);
+    else
+      sfl_sampler_writeFlowSample(lockb.sampler, &fs);
+  }
+
+  static void *lock_writer(void *magic) {
+    HSPLockWriter *wr = (HSPLockWriter *)magic;
+    uint32_t batch = (lockb.mode == LOCK_BATCHED) ? HSP_BENCH_LOCK_BATCH : 1;
+    for(uint32_t ii = 0; ii < HSP_BENCH_LOCK_SAMPLES; ii += batch) {
+      if(lockb.mode == LOCK_SHARDS)
+	lock_writeFlow(wr);
+      else {
+	LOCK_TIMED(&wr->stats) {
+	  for(uint32_t bb = 0; bb < batch; bb++)
+	    lock_writeFlow(wr);
+	}
+      }
+    }
+    __atomic_add_fetch(&lockb.writersDone, 1, __ATOMIC_RELEASE);
+    return NULL;
+  }
+
+  static void *lock_poller(void *magic) {
+    uint32_t nWriters = *(uint32_t *)magic;
+    SFL_COUNTERS_SAMPLE_TYPE cs = { 0 };
+    SFLCounters_sample_element genElem = { 0 };
+    genElem.tag = SFLCOUNTERS_GENERIC;
+    SFLADD_ELEMENT(&cs, &genElem);
+    while(__atomic_load_n(&lockb.writersDone, __ATOMIC_ACQUIRE) < nWriters) {
+      LOCK_TIMED(&lockb.stats) {
+	sfl_poller_writeCountersSample(lockb.poller, &cs);
+      }
+      usleep(100);
+    }
+    return NULL;
+  }
+
+  static void lock_run(EnumLockMode mode, uint32_t nWriters, cJSON *result) {
+    lockb.mode = mode;
+    lockb.writersDone = 0;
+    memset(&lockb.stats, 0, sizeof(lockb.stats));
+    HSPLockWriter *writers = (HSPLockWriter *)my_calloc(nWriters * sizeof(HSPLockWriter));
+    pthread_t poll;
+    if(pthread_create(&poll, NULL, lock_poller, &nWriters) != 0) {
+      my_free(writers);
+      return;
+    }
+    uint64_t t0 = benchNowNS();
+    for(uint32_t ii = 0; ii < nWriters; ii++) {
+      HSPLockWriter *wr = &writers[ii];
+      wr->index = ii;
+      sfl_receiver_init_shard(&wr->shard, &lockb.agent, ii + 1);
+      if(pthread_create(&wr->thread, NULL, lock_writer, wr) != 0)
+	__atomic_add_fetch(&lockb.writersDone, 1, __ATOMIC_RELEASE);
+    }
+    for(uint32_t ii = 0; ii < nWriters; ii++) {
+      HSPLockWriter *wr = &writers[ii];
+      if(wr->thread)
+	pthread_join(wr->thread, NULL);
+    }
+    uint64_t nS = benchNowNS() - t0;
+    pthread_join(poll, NULL);
+    HSPLockStats total = lockb.stats;
+    for(uint32_t ii = 0; ii < nWriters; ii++) {
+      total.acquired += writers[ii].stats.acquired;
+      total.nS_wait += writers[ii].stats.nS_wait;
+      total.nS_hold += writers[ii].stats.nS_hold;
+    }
+    my_free(writers);
+    char key[32];
+    snprintf(key, sizeof(key), "%s_samples_per_sec", lockModeNames[mode]);
+    addNumber(result, key, nWriters, nS ? (nWriters * HSP_BENCH_LOCK_SAMPLES * 1.0e9) / nS : 0.0);
+    snprintf(key, sizeof(key), "%s_acquired", lockModeNames[mode]);
+    addNumber(result, key, nWriters, total.acquired);
+    snprintf(key, sizeof(key), "%s_wait_ns", lockModeNames[mode]);
+    addNumber(result, key, nWriters, total.acquired ? (double)total.nS_wait / total.acquired : 0.0);
+    snprintf(key, sizeof(key), "%s_hold_ns", lockModeNames[mode]);
+    addNumber(result, key, nWriters, total.acquired ? (double)total.nS_hold / total.acquired : 0.0);
+  }
+
+  static void bench_lock(HSP *sp, cJSON *result) {
+    static const uint32_t writerCounts[] = { 1, 2, 4 };
+    lockb.sp = sp;
+    sfl_agent_init(&lockb.agent,
+		   &sp->agentIP,
+		   sp->subAgentId,
+		   0,
+		   0,
+		   sp,
+		   lock_alloc,
+		   lock_free,
+		   lock_error,
+		   lock_sendPkt);
+    SFLReceiver *receiver = sfl_agent_addReceiver(&lockb.agent);
+    sfl_receiver_set_sFlowRcvrOwner(receiver, "hsflowd_bench");
+    sfl_receiver_set_sFlowRcvrTimeout(receiver, 0xFFFFFFFF);
+    SFLDataSource_instance dsi;
+    SFL_DS_SET(dsi, SFL_DSCLASS_IFINDEX, 1, 0);
+    lockb.sampler = sfl_agent_addSampler(&lockb.agent, &dsi);
+    sfl_sampler_set_sFlowFsReceiver(lockb.sampler, HSP_SFLOW_RECEIVER_INDEX);
+    lockb.poller = sfl_agent_addPoller(&lockb.agent, &dsi, NULL, NULL);
+    sfl_poller_set_sFlowCpReceiver(lockb.poller, HSP_SFLOW_RECEIVER_INDEX);
+    for(uint32_t ww = 0; ww < sizeof(writerCounts) / sizeof(writerCounts[0]); ww++) {
+      for(EnumLockMode mode = LOCK_PER_SAMPLE; mode <= LOCK_SHARDS; mode++)
+	lock_run(mode, writerCounts[ww], result);
+    }
+    sfl_agent_release(&lockb.agent);
+  }
+
+  /*_________________---------------------------__________________
+    _________________     nio (counters)        __________________
+    -----------------___________________________------------------
+    One polling round in which each of 10, 1000 or 10000 links asks
+    for its own counters.  "procnetdev" is what a filtered
+    updateNioCounters() used to do:  parse every line of /proc/net/dev
+    (synthesized here) to find one adaptor.  Only a sample of those
+    requests is timed,  and the round is scaled up from it.  "netlink"
+    parses one RTM_GETSTATS dump (also synthesized,  in recv()-sized
+    pieces) with parseNioStatsDump() and then serves every link from
+    the snapshot.  The links are removed again afterwards.
+  */
+
+#define HSP_BENCH_NIO_IFINDEX 100000
+#define HSP_BENCH_NIO_REQUESTS 1000
+#define HSP_BENCH_NIO_LOOKUPS 1000000
+#define HSP_BENCH_NIO_READ 65536
+
+  static int nio_msg(u_char *buf, uint32_t seq, uint32_t ifIndex) {
+    struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+    struct if_stats_msg *ifsm = (struct if_stats_msg *)NLMSG_DATA(nlh);
+    struct rtattr *rta = (struct rtattr *)((char *)ifsm + NLMSG_ALIGN(sizeof(*ifsm)));
+    rta->rta_type = IFLA_STATS_LINK_64;
+    rta->rta_len = RTA_LENGTH(sizeof(struct rtnl_link_stats64));
+    struct rtnl_link_stats64 *st = (struct rtnl_link_stats64 *)RTA_DATA(rta);
+    memset(st, 0, sizeof(*st));
+    st->rx_bytes = 1000000 + ifIndex;
+    st->rx_packets = 1000 + ifIndex;
+    st->tx_bytes = 2000000 + ifIndex;
+    st->tx_packets = 2000 + ifIndex;
+    ifsm->family = AF_UNSPEC;
+    ifsm->ifindex = ifIndex;
+    ifsm->filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+    nlh->nlmsg_type = RTM_NEWSTATS;
+    nlh->nlmsg_flags = NLM_F_MULTI;
+    nlh->nlmsg_seq = seq;
+    nlh->nlmsg_len = NLMSG_LENGTH(NLMSG_ALIGN(sizeof(*ifsm)) + rta->rta_len);
+    return NLMSG_ALIGN(nlh->nlmsg_len);
+  }
+
+  static void nio_run(HSP *sp, uint32_t nLinks, cJSON *result) {
+    SFLAdaptor **ads = (SFLAdaptor **)my_calloc(nLinks * sizeof(SFLAdaptor *));
+    for(uint32_t ii = 0; ii < nLinks; ii++) {
+      char name[32];
+      snprintf(name, sizeof(name), "nio%u", ii);
+      ads[ii] = nioAdaptorNew(name, NULL, HSP_BENCH_NIO_IFINDEX + ii);
+      adaptorAddOrReplace(sp->adaptorsByName, ads[ii]);
+      adaptorAddOrReplace(sp->adaptorsByIndex, ads[ii]);
+    }
+
+    // /proc/net/dev,  as the kernel prints it
+    size_t textLen = 256 + (nLinks * 128);
+    char *text = (char *)my_calloc(textLen);
+    char *work = (char *)my_calloc(textLen);
+    size_t used = snprintf(text, textLen,
+			   "Inter-|   Receive                                                |  Transmit\n"
+			   " face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed\n");
+    for(uint32_t ii = 0; ii < nLinks; ii++) {
+      uint32_t ifIndex = HSP_BENCH_NIO_IFINDEX + ii;
+      used += snprintf(text + used, textLen - used,
+		       "%6s: %8u %7u    0    0    0     0          0         0 %8u %7u    0    0    0     0       0          0\n",
+		       ads[ii]->deviceName, 1000000 + ifIndex, 1000 + ifIndex, 2000000 + ifIndex, 2000 + ifIndex);
+    }
+    uint32_t nRequests = (nLinks < HSP_BENCH_NIO_REQUESTS) ? nLinks : HSP_BENCH_NIO_REQUESTS;
+    uint64_t found = 0;
+    uint64_t t0 = benchNowNS();
+    for(uint32_t rr = 0; rr < nRequests; rr++) {
+      SFLAdaptor *filter = ads[((uint64_t)rr * nLinks) / nRequests];
+      // read() copies the whole file every time
+      memcpy(work, text, used + 1);
+      char *line = work;
+      for(char *nl; line && *line; line = nl) {
+	if((nl = strchr(line, '\n')) != NULL)
+	  *nl++ = '\0';
+	char *deviceName;
+	SFLHost_nio_counters ctrs = { 0 };
+	if(parseProcNetDevLine(line, &deviceName, &ctrs)
+	   && adaptorByName(sp, deviceName) == filter)
+	  found += ctrs.pkts_in;
+      }
+    }
+    uint64_t nS_procnetdev = benchNowNS() - t0;
+
+    // the same counters as an RTM_GETSTATS dump
+    uint32_t msgLen = NLMSG_ALIGN(NLMSG_LENGTH(NLMSG_ALIGN(sizeof(struct if_stats_msg))
+					       + RTA_LENGTH(sizeof(struct rtnl_link_stats64))));
+    uint32_t perRead = (HSP_BENCH_NIO_READ - NLMSG_LENGTH(sizeof(int))) / msgLen;
+    uint32_t nReads = (nLinks / perRead) + 1;
+    u_char *dump = (u_char *)my_calloc(nReads * HSP_BENCH_NIO_READ);
+    int *readLen = (int *)my_calloc(nReads * sizeof(int));
+    uint32_t seq = ++sp->nio_nl_seq;
+    for(uint32_t ii = 0; ii < nLinks; ii++) {
+      uint32_t rd = ii / perRead;
+      readLen[rd] += nio_msg(dump + (rd * HSP_BENCH_NIO_READ) + readLen[rd], seq, HSP_BENCH_NIO_IFINDEX + ii);
+    }
+    struct nlmsghdr *done = (struct nlmsghdr *)(dump + ((nReads - 1) * HSP_BENCH_NIO_READ) + readLen[nReads - 1]);
+    done->nlmsg_type = NLMSG_DONE;
+    done->nlmsg_flags = NLM_F_MULTI;
+    done->nlmsg_seq = seq;
+    done->nlmsg_len = NLMSG_LENGTH(sizeof(int));
+    readLen[nReads - 1] += NLMSG_ALIGN(done->nlmsg_len);
+    uint32_t rounds = (HSP_BENCH_NIO_LOOKUPS / nLinks) + 1;
+    t0 = benchNowNS();
+    for(uint32_t rr = 0; rr < rounds; rr++) {
+      time_t clk = rr + 1;
+      uint32_t links = 0;
+      for(uint32_t rd = 0; rd < nReads; rd++) {
+	if(parseNioStatsDump(sp, dump + (rd * HSP_BENCH_NIO_READ), readLen[rd], clk, &links) != 0)
+	  break;
+      }
+      for(uint32_t ii = 0; ii < nLinks; ii++) {
+	HSPAdaptorNIO *niostate = ADAPTOR_NIO(ads[ii]);
+	if(niostate->nl_snapshot == clk)
+	  found += niostate->nl_ctrs.pkts_in;
+      }
+    }
+    uint64_t nS_netlink = benchNowNS() - t0;
+    myDebug(1, "nio bench checksum %"PRIu64, found);
+
+    addNumber(result, "procnetdev_round_ms", nLinks, (nS_procnetdev * (double)nLinks) / (nRequests * 1.0e6));
+    addNumber(result, "netlink_round_ms", nLinks, nS_netlink / (rounds * 1.0e6));
+
+    for(uint32_t ii = 0; ii < nLinks; ii++)
+      deleteAdaptor(sp, ads[ii], YES);
+    my_free(ads);
+    my_free(text);
+    my_free(work);
+    my_free(dump);
+    my_free(readLen);
+  }
+
+  static void bench_nio(HSP *sp, cJSON *result) {
+    static const uint32_t linkCounts[] = { 10, 1000, 10000 };
+    for(uint32_t ii = 0; ii < sizeof(linkCounts) / sizeof(linkCounts[0]); ii++)
+      nio_run(sp, linkCounts[ii], result);
+  }
+
+  /*_________________---------------------------__________________
+    _________________     vms (adaptor lists)   __________________
+    -----------------___________________________------------------
+    One round of VM interface counters with 5000 host adaptors and
+    500 VMs of 10 interfaces each.  "indexed" calls readNioCounters()
+    with each VM's (indexed) interface list,  as the VM pollers do now.
+    "scan" is the loop it used to run:  every host adaptor,  looked up
+    in an unindexed copy of the VM's list with adaptorListGet().  This
+    runs on the poll bus because updateNioCounters() insists on it.
+  */
+
+#define HSP_BENCH_VM_ADAPTORS 5000
+#define HSP_BENCH_VMS 500
+#define HSP_BENCH_VM_IFINDEX 200000
+#define HSP_BENCH_VM_ROUNDS 100
+
+  static struct {
+    cJSON *result;
+  } vmb;
+
+  static void vms_start(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    uint32_t perVM = HSP_BENCH_VM_ADAPTORS / HSP_BENCH_VMS;
+    SFLAdaptor **ads = (SFLAdaptor **)my_calloc(HSP_BENCH_VM_ADAPTORS * sizeof(SFLAdaptor *));
+    for(uint32_t ii = 0; ii < HSP_BENCH_VM_ADAPTORS; ii++) {
+      char name[32];
+      snprintf(name, sizeof(name), "vnet%u", ii);
+      ads[ii] = nioAdaptorNew(name, NULL, HSP_BENCH_VM_IFINDEX + ii);
+      ADAPTOR_NIO(ads[ii])->up = YES;
+      adaptorAddOrReplace(sp->adaptorsByName, ads[ii]);
+      adaptorAddOrReplace(sp->adaptorsByIndex, ads[ii]);
+    }
+    SFLAdaptorList **indexed = (SFLAdaptorList **)my_calloc(HSP_BENCH_VMS * sizeof(SFLAdaptorList *));
+    SFLAdaptorList **plain = (SFLAdaptorList **)my_calloc(HSP_BENCH_VMS * sizeof(SFLAdaptorList *));
+    for(uint32_t vm = 0; vm < HSP_BENCH_VMS; vm++) {
+      indexed[vm] = adaptorListNewIndexed();
+      plain[vm] = adaptorListNew();
+      for(uint32_t ii = vm * perVM; ii < (vm + 1) * perVM; ii++) {
+	adaptorListAdd(indexed[vm], adaptorNew(ads[ii]->deviceName, NULL, 0, ads[ii]->ifIndex));
+	adaptorListAdd(plain[vm], adaptorNew(ads[ii]->deviceName, NULL, 0, ads[ii]->ifIndex));
+      }
+    }
+    // keep updateNioCounters() from trying to poll these devices
+    sp->nio_last_update = evt->bus->now.tv_sec;
+
+    uint64_t found = 0;
+    uint64_t t0 = benchNowNS();
+    for(uint32_t rr = 0; rr < HSP_BENCH_VM_ROUNDS; rr++) {
+      for(uint32_t vm = 0; vm < HSP_BENCH_VMS; vm++) {
+	SFLHost_nio_counters nio = { 0 };
+	found += readNioCounters(sp, &nio, NULL, indexed[vm]);
+      }
+    }
+    uint64_t nS_indexed = benchNowNS() - t0;
+
+    t0 = benchNowNS();
+    for(uint32_t vm = 0; vm < HSP_BENCH_VMS; vm++) {
+      updateNioCounters(sp, NULL);
+      SFLAdaptor *adaptor;
+      UTHASH_WALK(sp->adaptorsByName, adaptor) {
+	if(adaptorListGet(plain[vm], adaptor->deviceName))
+	  found++;
+      }
+    }
+    uint64_t nS_scan = benchNowNS() - t0;
+    myDebug(1, "vms bench found %"PRIu64, found);
+    cJSON_AddNumberToObject(vmb.result, "indexed_round_ms", nS_indexed / (HSP_BENCH_VM_ROUNDS * 1.0e6));
+    cJSON_AddNumberToObject(vmb.result, "scan_round_ms", nS_scan / 1.0e6);
+
+    for(uint32_t vm = 0; vm < HSP_BENCH_VMS; vm++) {
+      adaptorListFree(indexed[vm]);
+      adaptorListFree(plain[vm]);
+    }
+    for(uint32_t ii = 0; ii < HSP_BENCH_VM_ADAPTORS; ii++)
+      deleteAdaptor(sp, ads[ii], YES);
+    my_free(indexed);
+    my_free(plain);
+    my_free(ads);
+    sp->nio_last_update = 0;
+    EVBusStop(evt->bus);
+  }
+
+  static void bench_vms(HSP *sp, cJSON *result) {
+    vmb.result = result;
+    if(sp->pollBus == NULL)
+      sp->pollBus = EVGetBus(sp->rootModule, HSPBUS_POLL, YES);
+    EVEventRx(sp->rootModule, EVGetEvent(sp->pollBus, EVEVENT_START), vms_start);
+    EVBusRun(sp->pollBus);
+  }
+
+  /*_________________---------------------------__________________
+    _________________     proc (host counters)  __________________
+    -----------------___________________________------------------
+    uS to read the /proc part of one host counter sample:  cpu,
+    memory,  disk and tcpip.  "pread" is the readers as they are now
+    (UTProcFile on cached descriptors).  "stdio" is the same files read
+    the way those readers used to:  fopen(),  fgets(),  sscanf() and
+    fclose() every time.  Both do the statvfs() calls for the local
+    mounts,  which cost the same either way.
+  */
+
+#define HSP_BENCH_PROC_SAMPLES 2000
+#define HSP_BENCH_PROC_LINE 240
+
+  static void stdio_cpu(SFLHost_cpu_counters *cpu) {
+    char line[HSP_BENCH_PROC_LINE];
+    FILE *procFile = fopen("/proc/loadavg", "r");
+    if(procFile) {
+      if(fscanf(procFile, "%f %f %f %"SCNu32"/%"SCNu32"",
+		&cpu->load_one, &cpu->load_five, &cpu->load_fifteen,
+		&cpu->proc_run, &cpu->proc_total) == 5
+	 && cpu->proc_run > 0)
+	cpu->proc_run--;
+      fclose(procFile);
+    }
+    procFile = fopen("/proc/stat", "r");
+    if(procFile) {
+      uint64_t ctr[10] = { 0 }, val = 0;
+      uint32_t lineNo = 0;
+      while(fgets(line, sizeof(line), procFile)) {
+	if(++lineNo == 1) {
+	  if(sscanf(line, "cpu %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64"",
+		    &ctr[0], &ctr[1], &ctr[2], &ctr[3], &ctr[4], &ctr[5], &ctr[6], &ctr[7], &ctr[8], &ctr[9]) >= 4) {
+	    cpu->cpu_user = (uint32_t)ctr[0];
+	    cpu->cpu_idle = (uint32_t)ctr[3];
+	  }
+	}
+	else if(!strncmp(line, "cpu", 3) && line[3] >= '0' && line[3] <= '9')
+	  cpu->cpu_num++;
+	else if(!strncmp(line, "intr", 4) && sscanf(line, "intr %"SCNu64"", &val) == 1)
+	  cpu->interrupts = (uint32_t)val;
+	else if(!strncmp(line, "ctxt", 4) && sscanf(line, "ctxt %"SCNu64"", &val) == 1)
+	  cpu->contexts = (uint32_t)val;
+      }
+      fclose(procFile);
+    }
+    procFile = fopen("/proc/uptime", "r");
+    if(procFile) {
+      float uptime = 0;
+      if(fscanf(procFile, "%f", &uptime) == 1)
+	cpu->uptime = (uint32_t)uptime;
+      fclose(procFile);
+    }
+    uint32_t cpus_avail = get_nprocs();
+    if(cpus_avail > cpu->cpu_num)
+      cpu->cpu_num = cpus_avail;
+    procFile = fopen("/proc/cpuinfo", "r");
+    if(procFile) {
+      while(fgets(line, 80, procFile)) {
+	double cpu_mhz = 0.0;
+	if(!strncmp(line, "cpu MHz", 7)
+	   && sscanf(line, "cpu MHz : %lf", &cpu_mhz) == 1) {
+	  cpu->cpu_speed = (uint32_t)cpu_mhz;
+	  break;
+	}
+      }
+      fclose(procFile);
+    }
+  }
+
+  static void stdio_mem(SFLHost_mem_counters *mem) {
+    char line[80], var[80];
+    uint64_t val64;
+    FILE *procFile = fopen("/proc/meminfo", "r");
+    if(procFile) {
+      while(fgets(line, sizeof(line), procFile)) {
+	if(sscanf(line, "%s %"SCNu64"", var, &val64) == 2) {
+	  if(!strcmp(var, "MemTotal:")) mem->mem_total += val64 * 1024;
+	  else if(!strcmp(var, "MemFree:")) mem->mem_free += val64 * 1024;
+	  else if(!strcmp(var, "Buffers:")) mem->mem_buffers += val64 * 1024;
+	  else if(!strcmp(var, "Cached:")) mem->mem_cached += val64 * 1024;
+	  else if(!strcmp(var, "SwapTotal:")) mem->swap_total += val64 * 1024;
+	  else if(!strcmp(var, "SwapFree:")) mem->swap_free += val64 * 1024;
+	  else if(!strcmp(var, "SReclaimable:")) mem->mem_cached += val64 * 1024;
+	}
+      }
+      fclose(procFile);
+    }
+    procFile = fopen("/proc/vmstat", "r");
+    if(procFile) {
+      while(fgets(line, sizeof(line), procFile)) {
+	if(sscanf(line, "%s %"SCNu64"", var, &val64) == 2) {
+	  if(!strcmp(var, "pgpgin")) mem->page_in += (uint32_t)val64;
+	  else if(!strcmp(var, "pgpgout")) mem->page_out += (uint32_t)val64;
+	  else if(!strcmp(var, "pswpin")) mem->swap_in += (uint32_t)val64;
+	  else if(!strcmp(var, "pswpout")) mem->swap_out += (uint32_t)val64;
+	}
+      }
+      fclose(procFile);
+    }
+  }
+
+  static void stdio_dsk(SFLHost_dsk_counters *dsk) {
+    char line[HSP_BENCH_PROC_LINE];
+    FILE *procFile = fopen("/proc/diskstats", "r");
+    if(procFile) {
+      char devName[HSP_BENCH_PROC_LINE];
+      uint32_t majorNo, minorNo;
+      uint64_t reads, sectors_read, read_time_ms, writes, sectors_written, write_time_ms;
+      while(fgets(line, sizeof(line), procFile)) {
+	if(sscanf(line, "%"SCNu32" %"SCNu32" %s %"SCNu64" %*u %"SCNu64" %"SCNu64" %"SCNu64" %*u %"SCNu64" %"SCNu64"",
+		  &majorNo, &minorNo, devName,
+		  &reads, &sectors_read, &read_time_ms,
+		  &writes, &sectors_written, &write_time_ms) == 9
+	   && majorNo != 9
+	   && majorNo != 253) {
+	  dsk->reads += reads;
+	  dsk->read_time += read_time_ms;
+	  dsk->writes += writes;
+	  dsk->write_time += write_time_ms;
+	}
+      }
+      fclose(procFile);
+    }
+    procFile = fopen("/proc/mounts", "r");
+    if(procFile) {
+      char device[HSP_BENCH_PROC_LINE], mount[HSP_BENCH_PROC_LINE];
+      char type[HSP_BENCH_PROC_LINE], mode[HSP_BENCH_PROC_LINE];
+      while(fgets(line, sizeof(line), procFile)) {
+	struct statvfs svfs;
+	if(sscanf(line, "%s %s %s %s", device, mount, type, mode) == 4
+	   && !strncmp(device, "/dev/", 5)
+	   && strncmp(mode, "ro", 2)
+	   && statvfs(mount, &svfs) == 0) {
+	  dsk->disk_total += (uint64_t)svfs.f_blocks * svfs.f_bsize;
+	  dsk->disk_free += (uint64_t)svfs.f_bavail * svfs.f_bsize;
+	}
+      }
+      fclose(procFile);
+    }
+  }
+
+  static void stdio_tcpip(uint32_t *ctrs, uint32_t maxCtrs) {
+    char line[HSP_BENCH_PROC_LINE];
+    FILE *procFile = fopen("/proc/net/snmp", "r");
+    if(procFile) {
+      while(fgets(line, sizeof(line), procFile)) {
+	char *save = NULL;
+	char *var = strtok_r(line, " \t", &save);
+	if(var == NULL
+	   || (strcmp(var, "Ip:") && strcmp(var, "Icmp:") && strcmp(var, "Tcp:") && strcmp(var, "Udp:")))
+	  continue;
+	uint32_t ff = 0;
+	for(char *tok; ff < maxCtrs && (tok = strtok_r(NULL, " \t", &save)) != NULL; ff++) {
+	  char *end = NULL;
+	  long val = strtol(tok, &end, 0);
+	  if(end == tok)
+	    break;
+	  ctrs[ff] = (uint32_t)val;
+	}
+      }
+      fclose(procFile);
+    }
+  }
+
+  static void bench_proc(HSP *sp, cJSON *result) {
+    for(int usePread = 1; usePread >= 0; usePread--) {
+      uint64_t t0 = benchNowNS();
+      for(uint32_t ii = 0; ii < HSP_BENCH_PROC_SAMPLES; ii++) {
+	SFLHost_cpu_counters cpu = { 0 };
+	SFLHost_mem_counters mem = { 0 };
+	SFLHost_dsk_counters dsk = { 0 };
+	SFLHost_ip_counters c_ip = { 0 };
+	SFLHost_icmp_counters c_icmp = { 0 };
+	SFLHost_tcp_counters c_tcp = { 0 };
+	SFLHost_udp_counters c_udp = { 0 };
+	if(usePread) {
+	  readCpuCounters(&cpu);
+	  readMemoryCounters(&mem);
+	  readDiskCounters(sp, &dsk);
+	  readTcpipCounters(sp, &c_ip, &c_icmp, &c_tcp, &c_udp);
+	}
+	else {
+	  stdio_cpu(&cpu);
+	  stdio_mem(&mem);
+	  stdio_dsk(&dsk);
+	  stdio_tcpip((uint32_t *)&c_tcp, SFLHOST_NUM_TCP_COUNTERS);
+	}
+      }
+      uint64_t nS = benchNowNS() - t0;
+      cJSON_AddNumberToObject(result, usePread ? "pread_us" : "stdio_us", nS / (HSP_BENCH_PROC_SAMPLES * 1000.0));
+    }
+  }
+
+  /*_________________---------------------------__________________
+    _________________     json (mod_json)       __________________
+    -----------------___________________________------------------
+    Cost per message of each kind the JSON API accepts,  read in place
+    by jsonFastPath() ("fast") or through cJSON_Parse() ("cjson").
+    mod_json is linked into hsflowd_bench (see mod_json_bench.o) and
+    writes to an agent whose datagrams are thrown away.
+  */
+
+#define HSP_BENCH_JSON_MSGS 100000
+
+  static struct {
+    char *name;
+    char *msg;
+  } jsonCorpus[] = {
+    { "rtmetric",
+      "{\"rtmetric\":{\"datasource\":\"web1\","
+      "\"sessions\":{\"type\":\"gauge32\",\"value\":24},"
+      "\"requests\":{\"type\":\"counter64\",\"value\":1234567},"
+      "\"load\":{\"type\":\"gaugeFloat\",\"value\":0.75},"
+      "\"state\":{\"type\":\"string\",\"value\":\"running\"}}}" },
+    { "rtflow",
+      "{\"rtflow\":{\"datasource\":\"http\",\"sampling_rate\":10,"
+      "\"method\":{\"type\":\"string\",\"value\":\"GET\"},"
+      "\"status\":{\"type\":\"int32\",\"value\":200},"
+      "\"bytes\":{\"type\":\"int64\",\"value\":4096},"
+      "\"client\":{\"type\":\"ip\",\"value\":\"10.0.0.2\"},"
+      "\"duration\":{\"type\":\"double\",\"value\":0.0012}}}" },
+    { "flow_sample",
+      "{\"flow_sample\":{\"app_name\":\"bench\",\"sampling_rate\":400,"
+      "\"app_operation\":{\"operation\":\"get.html\",\"attributes\":\"uri=/index.html\","
+      "\"status_descr\":\"OK\",\"status\":0,\"req_bytes\":512,\"resp_bytes\":4096,\"uS\":1200},"
+      "\"app_initiator\":{\"actor\":\"user1\"},"
+      "\"app_target\":{\"actor\":\"server1\"},"
+      "\"extended_socket_ipv4\":{\"protocol\":6,\"local_ip\":\"10.0.0.1\",\"remote_ip\":\"10.0.0.2\","
+      "\"local_port\":80,\"remote_port\":43210}}}" },
+    { "counter_sample",
+      "{\"counter_sample\":{\"app_name\":\"bench\","
+      "\"app_operations\":{\"success\":1000,\"other\":1,\"timeout\":2,\"internal_error\":3,"
+      "\"bad_request\":4,\"forbidden\":5,\"too_large\":6,\"not_implemented\":7,"
+      "\"not_found\":8,\"unavailable\":9,\"unauthorized\":10},"
+      "\"app_resources\":{\"user_time\":120,\"system_time\":30,\"mem_used\":1048576,"
+      "\"mem_max\":4194304,\"fd_open\":40,\"fd_max\":1024,\"conn_open\":12,\"conn_max\":512},"
+      "\"app_workers\":{\"workers_active\":4,\"workers_idle\":12,\"workers_max\":16,"
+      "\"req_delayed\":0,\"req_dropped\":0}}}" },
+  };
+
+#define HSP_BENCH_JSON_CORPUS (sizeof(jsonCorpus) / sizeof(jsonCorpus[0]))
+
+  static struct {
+    EVMod *mod;
+    cJSON *result;
+  } jsonb;
+
+  // sendAppSample() wants to be on a bus,  so run the messages from here
+  static void json_start(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    for(uint32_t cc = 0; cc < HSP_BENCH_JSON_CORPUS; cc++) {
+      char *msg = jsonCorpus[cc].msg;
+      char key[48];
+      for(int fast = 1; fast >= 0; fast--) {
+	uint64_t t0 = benchNowNS();
+	for(uint32_t ii = 0; ii < HSP_BENCH_JSON_MSGS; ii++)
+	  mod_json_bench(jsonb.mod, msg, fast);
+	uint64_t nS = benchNowNS() - t0;
+	snprintf(key, sizeof(key), "%s_%s_ns", jsonCorpus[cc].name, fast ? "fast" : "cjson");
+	cJSON_AddNumberToObject(jsonb.result, key, (double)nS / HSP_BENCH_JSON_MSGS);
+      }
+    }
+    EVBusStop(evt->bus);
+  }
+
+  static void bench_json(HSP *sp, cJSON *result) {
+    static SFLAgent agent;
+    sfl_agent_init(&agent,
+		   &sp->agentIP,
+		   sp->subAgentId,
+		   0,
+		   0,
+		   sp,
+		   lock_alloc,
+		   lock_free,
+		   lock_error,
+		   lock_sendPkt);
+    SFLReceiver *receiver = sfl_agent_addReceiver(&agent);
+    sfl_receiver_set_sFlowRcvrOwner(receiver, "hsflowd_bench");
+    sfl_receiver_set_sFlowRcvrTimeout(receiver, 0xFFFFFFFF);
+    // mod_json writes to sp->agent,  which the pcap replay sets up later
+    SFLAgent *saveAgent = sp->agent;
+    sp->agent = &agent;
+    jsonb.mod = EVLoadModule(sp->rootModule, "mod_json", NULL);
+    jsonb.result = result;
+    if(jsonb.mod
+       && jsonb.mod->data) {
+      EVBus *bus = EVGetBus(sp->rootModule, "bench_json", YES);
+      EVEventRx(sp->rootModule, EVGetEvent(bus, EVEVENT_START), json_start);
+      EVBusRun(bus);
+      SEMLOCK_DO(sp->sync_agent) {
+	sfl_receiver_flush(receiver);
+      }
+    }
+    // leave the agent in place:  mod_json still holds its pollers and samplers
+    sp->agent = saveAgent;
+  }
+
+  /*_________________---------------------------__________________
+    _________________     case table            __________________
+    -----------------___________________________------------------
+  */
+
+  static HSPMicroBenchCase benchCases[] = {
+    { "fanin", bench_fanin, "bus wakeup with 10/100/2000 idle sockets and one busy one (epoll vs pselect)" },
+    { "ring", bench_ring, "events/sec between two bus threads, 64 and 1024 byte payloads (ring vs pipe)" },
+    { "pool", bench_pool, "pending-sample memory per sample (free-list vs heap)" },
+    { "lock", bench_lock, "sync_agent wait/hold time with 1/2/4 packet threads (per-sample vs batched vs shards)" },
+    { "vms", bench_vms, "VM interface counters for 500 VMs over 5000 host adaptors (indexed list vs scan)" },
+    { "proc", bench_proc, "uS for the /proc part of one host counter sample (pread on cached fds vs stdio)" },
+    { "nio", bench_nio, "one counter poll of every link with 10/1000/10000 links (RTM_GETSTATS vs /proc/net/dev)" },
+    { "json", bench_json, "ns per JSON API message of each kind (jsonFastPath vs cJSON)" },
+  };
+
+#define HSP_MICROBENCH_CASES (sizeof(benchCases) / sizeof(benchCases[0]))
+
+  void microBenchList(FILE *out) {
+    for(uint32_t ii = 0; ii < HSP_MICROBENCH_CASES; ii++)
+      fprintf(out, "\n  %-12s %s", benchCases[ii].name, benchCases[ii].descr);
+  }
+
+  bool microBench(HSP *sp, char *cases, cJSON *results) {
+    bool all = my_strequal(cases, "all");
+    bool ok = YES;
+    if(!all) {
+      // check the names first so a typo doesn't waste a run
+      char *list = my_strdup(cases);
+      char *save = NULL;
+      for(char *tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+	bool found = NO;
+	for(uint32_t ii = 0; ii < HSP_MICROBENCH_CASES; ii++) {
+	  if(my_strequal(tok, benchCases[ii].name))
+	    found = YES;
+	}
+	if(!found) {
+	  fprintf(stderr, "unknown micro-benchmark: %s\n", tok);
+	  ok = NO;
+	}
+      }
+      my_free(list);
+      if(!ok)
+	return NO;
+    }
+    for(uint32_t ii = 0; ii < HSP_MICROBENCH_CASES; ii++) {
+      HSPMicroBenchCase *bc = &benchCases[ii];
+      if(!all) {
+	char *list = my_strdup(cases);
+	char *save = NULL;
+	bool want = NO;
+	for(char *tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+	  if(my_strequal(tok, bc->name))
+	    want = YES;
+	}
+	my_free(list);
+	if(!want)
+	  continue;
+      }
+      cJSON *result = cJSON_CreateObject();
+      (*bc->benchCB)(sp, result);
+      cJSON_AddItemToObject(results, bc->name, result);
+    }
+    return ok;
+  }
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif
@@ -12,16 +12,14 @@ extern "C" {
 #include <net/if.h>
 #include <linux/types.h>
 #include <sys/prctl.h>
+#include <sys/stat.h>
 #include <sched.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 
 #include "hsflowd.h"
 #include "cpu_utils.h"
 
-  // limit the number of chars we will read from each line
-  // in /proc/net/dev and /prov/net/vlan/config
-  // (there can be more than this - fgets will chop for us)
-#define MAX_PROC_LINE_CHARS 160
-
 #include "cJSON.h"
 
   typedef enum {
@@ -95,6 +93,9 @@ extern "C" {
     uint32_t inspect_tx:1;
     uint32_t inspect_rx:1;
     uint64_t memoryLimit;
+    uint64_t netnsIno;
+    bool initialSample:1;
+    UTHash *procFiles; // cgroup and /proc files read on each poll
   } HSPVMState_DOCKER;
 
   typedef void (*HSPDockerCB)(EVMod *mod, UTStrBuf *buf, cJSON *obj);
@@ -131,12 +132,53 @@ extern "C" {
 #define HSP_NETNS_DIR "/var/run/netns"
 #define HSP_IP_CMD "/usr/sbin/ip"
 #define HSP_DOCKER_MAX_FNAME_LEN 255
-#define HSP_DOCKER_MAX_LINELEN 512
 #define HSP_DOCKER_SHORTID_LEN 12
 
 #define HSP_DOCKER_WAIT_NOSOCKET 10
 #define HSP_DOCKER_WAIT_EVENTDROP 5
 #define HSP_DOCKER_WAIT_STARTUP 2
+
+  // container network namespaces are inspected on a separate
+  // bus (thread) so that setns() never blocks the pollBus
+#define HSPBUS_NETNS "netns"
+#define HSPEVENT_NETNS_REQ "netns_req"
+#define HSPEVENT_NETNS_LINKS "netns_links"
+  // reuse the links for a namespace (e.g. shared by several
+  // containers in a pod) for this long,  and forget it if not
+  // asked about for a while.
+#define HSP_DOCKER_NETNS_CACHE_S 30
+#define HSP_DOCKER_NETNS_FORGET_S 300
+#define HSP_DOCKER_NETNS_NL_BUF 16384
+
+  typedef struct _HSPNetnsLink {
+    uint32_t ifIndex;
+    u_char mac[6];
+    char devName[IFNAMSIZ];
+  } HSPNetnsLink;
+
+  // must fit in one inter-bus event
+#define HSP_DOCKER_NETNS_MAX_LINKS 128
+
+  typedef struct _HSPNetnsReq {
+    char uuid[16];
+    pid_t pid;
+  } HSPNetnsReq;
+
+  typedef struct _HSPNetnsLinks {
+    char uuid[16];
+    uint64_t nsIno;
+    bool ok;
+    uint32_t nLinks;
+    HSPNetnsLink links[HSP_DOCKER_NETNS_MAX_LINKS];
+  } HSPNetnsLinks;
+
+  typedef struct _HSPNetnsCache {
+    uint64_t nsIno;
+    time_t inspected;
+    time_t lastUsed;
+    uint32_t nLinks;
+    HSPNetnsLink links[HSP_DOCKER_NETNS_MAX_LINKS];
+  } HSPNetnsCache;
   
   typedef struct _HSP_mod_DOCKER {
     EVBus *pollBus;
@@ -152,10 +194,16 @@ extern "C" {
     regex_t *contentLengthPattern;
     uint32_t countdownToResync;
     int cgroupPathIdx;
+    EVBus *netnsBus;
+    EVEvent *netnsReqEvent;
+    EVEvent *netnsLinksEvent;
+    // only touched on the netnsBus:
+    int hostNetnsFd;
+    UTHash *netnsCache;
+    u_char *netnsNlBuf;
+    uint32_t netnsNlSeq;
   } HSP_mod_DOCKER;
 
-#define HSP_DOCKER_MAX_STATS_LINELEN 512
-
   static void dockerAPIRequest(EVMod *mod, HSPDockerRequest *req);
   static HSPDockerRequest *dockerRequest(EVMod *mod, UTStrBuf *cmd, HSPDockerCB jsonCB, bool eventFeed);
   static void  dockerRequestFree(EVMod *mod, HSPDockerRequest *req);
@@ -190,8 +238,9 @@ extern "C" {
     -----------------___________________________------------------
   */
 
-  static bool readCgroupCounters(EVMod *mod, char *cgroup, char *longId, char *fname, int nvals, HSPNameVal *nameVals, int multi) {
+  static bool readCgroupCounters(EVMod *mod, HSPVMState_DOCKER *container, char *cgroup, char *fname, int nvals, HSPNameVal *nameVals, int multi) {
     HSP_mod_DOCKER *mdata = (HSP_mod_DOCKER *)mod->data;
+    char *longId = container->id;
     
     int found = 0;
 
@@ -218,24 +267,29 @@ extern "C" {
 
     const char *fmt = HSP_CGROUP_PATHS[mdata->cgroupPathIdx];
     snprintf(statsFileName, HSP_DOCKER_MAX_FNAME_LEN, fmt, cgroup, longId, fname);
-    FILE *statsFile = fopen(statsFileName, "r");
-    if(statsFile == NULL) {
+    if(container->procFiles == NULL)
+      container->procFiles = UTProcFileCacheNew();
+    UTProcFile *statsFile = UTProcFileCacheGet(container->procFiles, statsFileName, NO);
+    if(UTProcFileRead(statsFile) < 0) {
       myDebug(2, "cannot open %s : %s", statsFileName, strerror(errno));
     }
     else {
-      char line[HSP_DOCKER_MAX_STATS_LINELEN];
-      char var[HSP_DOCKER_MAX_STATS_LINELEN];
-      uint64_t val64;
-      char *fmt = multi ?
-	"%*s %s %"SCNu64 :
-	"%s %"SCNu64 ;
-      while(fgets(line, HSP_DOCKER_MAX_STATS_LINELEN, statsFile)) {
+      char *line;
+      while((line = UTProcFileLine(statsFile)) != NULL) {
 	if(found == nvals && !multi) break;
-	if(sscanf(line, fmt, var, &val64) == 2) {
+	char *p = line;
+	char *var;
+	int varLen;
+	uint64_t val64;
+	if(multi)
+	  UTScanToken(&p, " \t", &varLen); // skip device id
+	if((var = UTScanToken(&p, " \t", &varLen)) != NULL
+	   && UTScanU64(&p, &val64)) {
 	  for(int ii = 0; ii < nvals; ii++) {
 	    char *nm = nameVals[ii].nv_name;
 	    if(nm == NULL) break; // null name is double-check
-	    if(strcmp(var, nm) == 0)  {
+	    if(my_strlen(nm) == varLen
+	       && memcmp(var, nm, varLen) == 0)  {
 	      nameVals[ii].nv_found = YES;
 	      nameVals[ii].nv_val64 += val64;
 	      found++;
@@ -243,7 +297,6 @@ extern "C" {
 	  }
         }
       }
-      fclose(statsFile);
     }
     return (found > 0);
   }
@@ -253,8 +306,8 @@ extern "C" {
     -----------------___________________________------------------
   */
 
-    static int readContainerCounters(EVMod *mod, char *cgroup, char *longId, char *fname, int nvals, HSPNameVal *nameVals) {
-      return readCgroupCounters(mod, cgroup, longId, fname, nvals, nameVals, 0);
+    static int readContainerCounters(EVMod *mod, HSPVMState_DOCKER *container, char *cgroup, char *fname, int nvals, HSPNameVal *nameVals) {
+      return readCgroupCounters(mod, container, cgroup, fname, nvals, nameVals, 0);
   }
 
   /*_________________-----------------------------__________________
@@ -264,56 +317,20 @@ extern "C" {
     The device id is assumed to be the first space-separated token on each line.
 */
 
-  static int readContainerCountersMulti(EVMod *mod, char *cgroup, char *longId, char *fname, int nvals, HSPNameVal *nameVals) {
-    return readCgroupCounters(mod, cgroup, longId, fname, nvals, nameVals, 1);
-  }
-
-  /*________________---------------------------__________________
-    ________________   containerLinkCB         __________________
-    ----------------___________________________------------------
-    
-    expecting lines of the form:
-    VNIC: <ifindex> <device> <mac>
-  */
-
-  static int containerLinkCB(HSP *sp, HSPVMState_DOCKER *container, char *line) {
-    myDebug(1, "containerLinkCB: line=<%s>", line);
-    char deviceName[HSP_DOCKER_MAX_LINELEN];
-    char macStr[HSP_DOCKER_MAX_LINELEN];
-    uint32_t ifIndex;
-    if(sscanf(line, "VNIC: %u %s %s", &ifIndex, deviceName, macStr) == 3) {
-      u_char mac[6];
-      if(hexToBinary((u_char *)macStr, mac, 6) == 6) {
-	SFLAdaptor *adaptor = adaptorListGet(container->vm.interfaces, deviceName);
-	if(adaptor == NULL) {
-	  adaptor = nioAdaptorNew(deviceName, mac, ifIndex);
-	  adaptorListAdd(container->vm.interfaces, adaptor);
-	  // add to "all namespaces" collections too - but only the ones where
-	  // the id is really global.  For example,  many containers can have
-	  // an "eth0" adaptor so we can't add it to sp->adaptorsByName.
-
-	  // And because the containers are likely to be ephemeral, don't
-	  // replace the global adaptor if it's already there.
-
-	  if(UTHashGet(sp->adaptorsByMac, adaptor) == NULL)
-	    if(UTHashAdd(sp->adaptorsByMac, adaptor) != NULL)
-	      myDebug(1, "Warning: container adaptor overwriting adaptorsByMac");
-
-	  if(UTHashGet(sp->adaptorsByIndex, adaptor) == NULL)
-	    if(UTHashAdd(sp->adaptorsByIndex, adaptor) != NULL)
-	      myDebug(1, "Warning: container adaptor overwriting adaptorsByIndex");
-
-	  // mark it as a vm/container device
-	  ADAPTOR_NIO(adaptor)->vm_or_container = YES;
-	}
-      }
-    }
-    return YES;
+  static int readContainerCountersMulti(EVMod *mod, HSPVMState_DOCKER *container, char *cgroup, char *fname, int nvals, HSPNameVal *nameVals) {
+    return readCgroupCounters(mod, container, cgroup, fname, nvals, nameVals, 1);
   }
 
 /*________________---------------------------__________________
-  ________________   readContainerInterfaces __________________
+  ________________   netns helper bus        __________________
   ----------------___________________________------------------
+  Runs on the netnsBus thread.  The thread joins the container's
+  network namespace with setns(),  dumps the links with RTM_GETLINK,
+  and switches back to the host namespace.  Only this thread changes
+  namespace,  so the rest of the process is not affected.  The result
+  goes back to the pollBus as one binary event.  Containers that share
+  a namespace (e.g. pods) are answered from the cache by namespace
+  inode number.
 */
 
 #include <linux/version.h>
@@ -327,140 +344,253 @@ extern "C" {
 #define MY_SETNS(fd, nstype) setns(fd, nstype)
 #endif
 
-  int readContainerInterfaces(EVMod *mod, HSPVMState_DOCKER *container)  {
-    HSP *sp = (HSP *)EVROOTDATA(mod);
-    pid_t nspid = container->pid;
-    myDebug(2, "readContainerInterfaces: pid=%u", nspid);
-    if(nspid == 0) return 0;
-
-    // do the dirty work after a fork, so we can just exit afterwards,
-    // same as they do in "ip netns exec"
-    int pfd[2];
-    if(pipe(pfd) == -1) {
-      myLog(LOG_ERR, "pipe() failed : %s", strerror(errno));
-      exit(EXIT_FAILURE);
+  static bool netnsDumpLinks(EVMod *mod, HSPNetnsLinks *res) {
+    HSP_mod_DOCKER *mdata = (HSP_mod_DOCKER *)mod->data;
+    // socket is created in the current (container) namespace
+    int nl_sock = socket(AF_NETLINK, SOCK_RAW|SOCK_CLOEXEC, NETLINK_ROUTE);
+    if(nl_sock < 0) {
+      myLog(LOG_ERR, "netns: netlink socket() failed: %s", strerror(errno));
+      return NO;
     }
-    pid_t cpid;
-    if((cpid = fork()) == -1) {
-      myLog(LOG_ERR, "fork() failed : %s", strerror(errno));
-      exit(EXIT_FAILURE);
+    struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+    setsockopt(nl_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    struct {
+      struct nlmsghdr nlh;
+      struct ifinfomsg ifi;
+    } req = { 0 };
+    req.nlh.nlmsg_len = sizeof(req);
+    req.nlh.nlmsg_type = RTM_GETLINK;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nlh.nlmsg_seq = ++mdata->netnsNlSeq;
+    req.ifi.ifi_family = AF_UNSPEC;
+    if(send(nl_sock, &req, sizeof(req), 0) < 0) {
+      myLog(LOG_ERR, "netns: send(RTM_GETLINK) failed: %s", strerror(errno));
+      close(nl_sock);
+      return NO;
     }
-    if(cpid == 0) {
-      // in child
-      close(pfd[0]);   // close read-end
-      dup2(pfd[1], 1); // stdout -> write-end
-      dup2(pfd[1], 2); // stderr -> write-end
-      close(pfd[1]);
-
-      // open /proc/<nspid>/ns/net
-      char topath[HSP_DOCKER_MAX_FNAME_LEN+1];
-      snprintf(topath, HSP_DOCKER_MAX_FNAME_LEN, "/proc/%u/ns/net", nspid);
-      int nsfd = open(topath, O_RDONLY | O_CLOEXEC);
-      if(nsfd < 0) {
-	fprintf(stderr, "cannot open %s : %s", topath, strerror(errno));
-	exit(EXIT_FAILURE);
+    bool done = NO;
+    while(!done) {
+      int len = recv(nl_sock, mdata->netnsNlBuf, HSP_DOCKER_NETNS_NL_BUF, 0);
+      if(len <= 0) {
+	myLog(LOG_ERR, "netns: recv() failed: %s", strerror(errno));
+	break;
       }
-
-      /* set network namespace
-	 CLONE_NEWNET means nsfd must refer to a network namespace
-      */
-      if(MY_SETNS(nsfd, CLONE_NEWNET) < 0) {
-	fprintf(stderr, "seting network namespace failed: %s", strerror(errno));
-	exit(EXIT_FAILURE);
+      for(struct nlmsghdr *nlh = (struct nlmsghdr *)mdata->netnsNlBuf;
+	  NLMSG_OK(nlh, len);
+	  nlh = NLMSG_NEXT(nlh, len)) {
+	if(nlh->nlmsg_seq != mdata->netnsNlSeq)
+	  continue;
+	if(nlh->nlmsg_type == NLMSG_DONE
+	   || nlh->nlmsg_type == NLMSG_ERROR) {
+	  done = YES;
+	  break;
+	}
+	if(nlh->nlmsg_type != RTM_NEWLINK)
+	  continue;
+	struct ifinfomsg *ifi = (struct ifinfomsg *)NLMSG_DATA(nlh);
+	// we only care about ifIndex and MAC for interfaces that
+	// are up and not loopback
+	if(!(ifi->ifi_flags & IFF_UP)
+	   || (ifi->ifi_flags & IFF_LOOPBACK))
+	  continue;
+	if(res->nLinks >= HSP_DOCKER_NETNS_MAX_LINKS)
+	  continue;
+	HSPNetnsLink *link = &res->links[res->nLinks];
+	memset(link, 0, sizeof(*link));
+	bool gotName = NO, gotMAC = NO;
+	int attrLen = IFLA_PAYLOAD(nlh);
+	for(struct rtattr *rta = IFLA_RTA(ifi);
+	    RTA_OK(rta, attrLen);
+	    rta = RTA_NEXT(rta, attrLen)) {
+	  switch(rta->rta_type) {
+	  case IFLA_IFNAME:
+	    strncpy(link->devName, (char *)RTA_DATA(rta), IFNAMSIZ - 1);
+	    link->devName[IFNAMSIZ - 1] = '\0';
+	    gotName = YES;
+	    break;
+	  case IFLA_ADDRESS:
+	    if(RTA_PAYLOAD(rta) == 6) {
+	      memcpy(link->mac, RTA_DATA(rta), 6);
+	      gotMAC = YES;
+	    }
+	    break;
+	  }
+	}
+	if(gotName && gotMAC) {
+	  link->ifIndex = ifi->ifi_index;
+	  res->nLinks++;
+	}
       }
+    }
+    close(nl_sock);
+    return done;
+  }
 
-      /* From "man 2 unshare":  This flag has the same effect as the clone(2)
-	 CLONE_NEWNS flag. Unshare the mount namespace, so that the calling
-	 process has a private copy of its namespace which is not shared with
-	 any other process. Specifying this flag automatically implies CLONE_FS
-	 as well. Use of CLONE_NEWNS requires the CAP_SYS_ADMIN capability. */
-      if(unshare(CLONE_NEWNS) < 0) {
-	fprintf(stderr, "seting network namespace failed: %s", strerror(errno));
-	exit(EXIT_FAILURE);
+  static void netnsInspect(EVMod *mod, HSPNetnsReq *req, HSPNetnsLinks *res) {
+    HSP_mod_DOCKER *mdata = (HSP_mod_DOCKER *)mod->data;
+    time_t now = mdata->netnsBus->now.tv_sec;
+    char topath[HSP_DOCKER_MAX_FNAME_LEN+1];
+    snprintf(topath, HSP_DOCKER_MAX_FNAME_LEN, "/proc/%u/ns/net", req->pid);
+    int nsfd = open(topath, O_RDONLY | O_CLOEXEC);
+    if(nsfd < 0) {
+      myDebug(1, "netns: cannot open %s : %s", topath, strerror(errno));
+      return;
+    }
+    struct stat st;
+    if(fstat(nsfd, &st) < 0) {
+      myLog(LOG_ERR, "netns: fstat(%s) failed : %s", topath, strerror(errno));
+      close(nsfd);
+      return;
+    }
+    res->nsIno = st.st_ino;
+    HSPNetnsCache search = { .nsIno = st.st_ino };
+    HSPNetnsCache *cached = UTHashGet(mdata->netnsCache, &search);
+    if(cached
+       && (now - cached->inspected) < HSP_DOCKER_NETNS_CACHE_S) {
+      myDebug(2, "netns: pid=%u ns=%"PRIu64" from cache", req->pid, res->nsIno);
+      close(nsfd);
+      cached->lastUsed = now;
+      res->nLinks = cached->nLinks;
+      memcpy(res->links, cached->links, cached->nLinks * sizeof(HSPNetnsLink));
+      res->ok = YES;
+      return;
+    }
+    if(MY_SETNS(nsfd, CLONE_NEWNET) < 0) {
+      myLog(LOG_ERR, "netns: setns(%s) failed: %s", topath, strerror(errno));
+      close(nsfd);
+      return;
+    }
+    close(nsfd);
+    res->ok = netnsDumpLinks(mod, res);
+    // and back to where we started
+    if(MY_SETNS(mdata->hostNetnsFd, CLONE_NEWNET) < 0) {
+      // should never happen, but we can't stay in the container
+      myLog(LOG_ERR, "netns: setns(host) failed: %s", strerror(errno));
+      abort();
+    }
+    myDebug(2, "netns: pid=%u ns=%"PRIu64" links=%u", req->pid, res->nsIno, res->nLinks);
+    if(res->ok) {
+      if(cached == NULL) {
+	cached = (HSPNetnsCache *)my_calloc(sizeof(HSPNetnsCache));
+	cached->nsIno = res->nsIno;
+	UTHashAdd(mdata->netnsCache, cached);
       }
+      cached->inspected = cached->lastUsed = now;
+      cached->nLinks = res->nLinks;
+      memcpy(cached->links, res->links, res->nLinks * sizeof(HSPNetnsLink));
+    }
+  }
 
-      int fd = socket(PF_INET, SOCK_DGRAM, 0);
-      if(fd < 0) {
-	fprintf(stderr, "error opening socket: %d (%s)\n", errno, strerror(errno));
-	return 0;
-      }
+  static void evt_netns_req(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    HSP_mod_DOCKER *mdata = (HSP_mod_DOCKER *)mod->data;
+    if(dataLen != sizeof(HSPNetnsReq))
+      return;
+    HSPNetnsReq *req = (HSPNetnsReq *)data;
+    HSPNetnsLinks res = { 0 };
+    memcpy(res.uuid, req->uuid, 16);
+    netnsInspect(mod, req, &res);
+    // only send the links that were filled in
+    size_t resLen = sizeof(res) - ((HSP_DOCKER_NETNS_MAX_LINKS - res.nLinks) * sizeof(HSPNetnsLink));
+    EVEventTx(mod, mdata->netnsLinksEvent, &res, resLen);
+  }
 
-      FILE *procFile = fopen("/proc/net/dev", "r");
-      if(procFile) {
-	struct ifreq ifr;
-	memset(&ifr, 0, sizeof(ifr));
-	char line[MAX_PROC_LINE_CHARS];
-	int lineNo = 0;
-	while(fgets(line, MAX_PROC_LINE_CHARS, procFile)) {
-	  if(lineNo++ < 2) continue; // skip headers
-	  char buf[MAX_PROC_LINE_CHARS];
-	  char *p = line;
-	  char *devName = parseNextTok(&p, " \t:", NO, '\0', NO, buf, MAX_PROC_LINE_CHARS);
-	  if(devName && my_strlen(devName) < IFNAMSIZ) {
-	    strncpy(ifr.ifr_name, devName, sizeof(ifr.ifr_name));
-	    // Get the flags for this interface
-	    if(ioctl(fd,SIOCGIFFLAGS, &ifr) < 0) {
-	      fprintf(stderr, "container device %s Get SIOCGIFFLAGS failed : %s",
-		      devName,
-		      strerror(errno));
-	    }
-	    else {
-	      int up = (ifr.ifr_flags & IFF_UP) ? YES : NO;
-	      int loopback = (ifr.ifr_flags & IFF_LOOPBACK) ? YES : NO;
-
-	      if(up && !loopback) {
-		// try to get ifIndex next, because we only care about
-		// ifIndex and MAC when looking at container interfaces
-		if(ioctl(fd,SIOCGIFINDEX, &ifr) < 0) {
-		  // only complain about this if we are debugging
-		  myDebug(1, "container device %s Get SIOCGIFINDEX failed : %s",
-			  devName,
-			  strerror(errno));
-		}
-		else {
-		  int ifIndex = ifr.ifr_ifindex;
-
-		  // Get the MAC Address for this interface
-		  if(ioctl(fd,SIOCGIFHWADDR, &ifr) < 0) {
-		    myDebug(1, "device %s Get SIOCGIFHWADDR failed : %s",
-			      devName,
-			      strerror(errno));
-		  }
-		  else {
-		    u_char macStr[13];
-		    printHex((u_char *)&ifr.ifr_hwaddr.sa_data, 6, macStr, 12, NO);
-		    // send this info back up the pipe to my my parent
-		    printf("VNIC: %u %s %s\n", ifIndex, devName, macStr);
-		  }
-		}
-	      }
-	    }
-	  }
-	}
+  static void evt_netns_tock(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    HSP_mod_DOCKER *mdata = (HSP_mod_DOCKER *)mod->data;
+    time_t now = mdata->netnsBus->now.tv_sec;
+    HSPNetnsCache *cached;
+    UTHASH_WALK(mdata->netnsCache, cached) {
+      if((now - cached->lastUsed) > HSP_DOCKER_NETNS_FORGET_S) {
+	UTHashDel(mdata->netnsCache, cached);
+	my_free(cached);
       }
+    }
+  }
 
-      // don't even bother to close file-descriptors,  just bail
-      exit(0);
+  /*________________---------------------------__________________
+    ________________   containerLinks          __________________
+    ----------------___________________________------------------
+    Runs on the pollBus when the netns helper answers.
+  */
 
+  static void containerLink(HSP *sp, HSPVMState_DOCKER *container, HSPNetnsLink *link) {
+    myDebug(1, "containerLink: ifIndex=%u device=%s", link->ifIndex, link->devName);
+    SFLAdaptor *adaptor = adaptorListGet(container->vm.interfaces, link->devName);
+    if(adaptor == NULL) {
+      adaptor = nioAdaptorNew(link->devName, link->mac, link->ifIndex);
+      adaptorListAdd(container->vm.interfaces, adaptor);
+      // add to "all namespaces" collections too - but only the ones where
+      // the id is really global.  For example,  many containers can have
+      // an "eth0" adaptor so we can't add it to sp->adaptorsByName.
+
+      // And because the containers are likely to be ephemeral, don't
+      // replace the global adaptor if it's already there.
+
+      if(UTHashGet(sp->adaptorsByMac, adaptor) == NULL)
+	if(UTHashAdd(sp->adaptorsByMac, adaptor) != NULL)
+	  myDebug(1, "Warning: container adaptor overwriting adaptorsByMac");
+
+      if(UTHashGet(sp->adaptorsByIndex, adaptor) == NULL)
+	if(UTHashAdd(sp->adaptorsByIndex, adaptor) != NULL)
+	  myDebug(1, "Warning: container adaptor overwriting adaptorsByIndex");
+
+      // mark it as a vm/container device
+      ADAPTOR_NIO(adaptor)->vm_or_container = YES;
     }
     else {
-      // in parent
-      close(pfd[1]); // close write-end
-      // read from read-end
-      FILE *ovs;
-      if((ovs = fdopen(pfd[0], "r")) == NULL) {
-	myLog(LOG_ERR, "readContainerInterfaces: fdopen() failed : %s", strerror(errno));
-	return 0;
-      }
-      char line[MAX_PROC_LINE_CHARS];
-      while(fgets(line, MAX_PROC_LINE_CHARS, ovs)) containerLinkCB(sp, container, line);
-      fclose(ovs);
-      wait(NULL); // block here until child is done
+      // still there
+      adaptor->marked = NO;
     }
+  }
 
-    return container->vm.interfaces->num_adaptors;
+  static void getCounters_DOCKER(EVMod *mod, HSPVMState_DOCKER *container);
+
+  static void evt_netns_links(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    HSP_mod_DOCKER *mdata = (HSP_mod_DOCKER *)mod->data;
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    HSPNetnsLinks *res = (HSPNetnsLinks *)data;
+    if(dataLen < offsetof(HSPNetnsLinks, links)
+       || dataLen < (offsetof(HSPNetnsLinks, links) + (res->nLinks * sizeof(HSPNetnsLink))))
+      return;
+    HSPVMState_DOCKER search;
+    memcpy(search.vm.uuid, res->uuid, 16);
+    HSPVMState_DOCKER *container = UTHashGet(mdata->vmsByUUID, &search);
+    if(container == NULL) {
+      // gone already
+      return;
+    }
+    if(res->ok) {
+      container->netnsIno = res->nsIno;
+      // reset the information that we are about to refresh
+      adaptorListMarkAll(container->vm.interfaces);
+      for(uint32_t ii = 0; ii < res->nLinks; ii++)
+	containerLink(sp, container, &res->links[ii]);
+      // and clean up
+      deleteMarkedAdaptors_adaptorList(sp, container->vm.interfaces);
+      adaptorListFreeMarked(container->vm.interfaces);
+    }
+    if(container->initialSample) {
+      // send initial counter-sample now that we know the adaptors
+      container->initialSample = NO;
+      getCounters_DOCKER(mod, container);
+    }
   }
 
+  /*________________---------------------------__________________
+    ________________   readContainerInterfaces __________________
+    ----------------___________________________------------------
+    Ask the netns helper for the links.  The answer arrives
+    as an HSPEVENT_NETNS_LINKS event.
+  */
+
+  static bool readContainerInterfaces(EVMod *mod, HSPVMState_DOCKER *container)  {
+    HSP_mod_DOCKER *mdata = (HSP_mod_DOCKER *)mod->data;
+    pid_t nspid = container->pid;
+    myDebug(2, "readContainerInterfaces: pid=%u", nspid);
+    if(nspid == 0) return NO;
+    HSPNetnsReq req = { .pid = nspid };
+    memcpy(req.uuid, container->vm.uuid, 16);
+    return (EVEventTx(mod, mdata->netnsReqEvent, &req, sizeof(req)) > 0);
+  }
 
   /*________________---------------------------__________________
     ________________   readContainerNIO        __________________
@@ -505,49 +635,28 @@ extern "C" {
     char statsFileName[HSP_DOCKER_MAX_FNAME_LEN+1];
     int interfaces = 0;
     snprintf(statsFileName, HSP_DOCKER_MAX_FNAME_LEN, "/proc/%u/net/dev", container->pid);
-    FILE *procFile = fopen(statsFileName, "r");
-    if(procFile) {
-      uint64_t bytes_in = 0;
-      uint64_t pkts_in = 0;
-      uint64_t errs_in = 0;
-      uint64_t drops_in = 0;
-      uint64_t bytes_out = 0;
-      uint64_t pkts_out = 0;
-      uint64_t errs_out = 0;
-      uint64_t drops_out = 0;
-      // limit the number of chars we will read from each line
-      // (there can be more than this - fgets will chop for us)
-#define MAX_PROCDEV_LINE_CHARS 240
-      char line[MAX_PROCDEV_LINE_CHARS];
-      while(fgets(line, MAX_PROCDEV_LINE_CHARS, procFile)) {
-	char deviceName[MAX_PROCDEV_LINE_CHARS];
-	// assume the format is:
-	// Inter-|   Receive                                                |  Transmit
-	//  face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed
-	if(sscanf(line, "%[^:]:%"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64" %*u %*u %*u %*u %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64"",
-		  deviceName,
-		  &bytes_in,
-		  &pkts_in,
-		  &errs_in,
-		  &drops_in,
-		  &bytes_out,
-		  &pkts_out,
-		  &errs_out,
-		  &drops_out) == 9) {
-	  if(my_strequal(trimWhitespace(deviceName), "lo") == NO) {
+    if(container->procFiles == NULL)
+      container->procFiles = UTProcFileCacheNew();
+    UTProcFile *procFile = UTProcFileCacheGet(container->procFiles, statsFileName, NO);
+    if(UTProcFileRead(procFile) > 0) {
+      char *line;
+      while((line = UTProcFileLine(procFile)) != NULL) {
+	char *deviceName;
+	SFLHost_nio_counters ctrs = { 0 };
+	if(parseProcNetDevLine(line, &deviceName, &ctrs)) {
+	  if(my_strequal(deviceName, "lo") == NO) {
 	    interfaces++;
-	    nio->bytes_in += bytes_in;
-	    nio->pkts_in += pkts_in;
-	    nio->errs_in += errs_in;
-	    nio->drops_in += drops_in;
-	    nio->bytes_out += bytes_out;
-	    nio->pkts_out += pkts_out;
-	    nio->errs_out += errs_out;
-	    nio->drops_out += drops_out;
+	    nio->bytes_in += ctrs.bytes_in;
+	    nio->pkts_in += ctrs.pkts_in;
+	    nio->errs_in += ctrs.errs_in;
+	    nio->drops_in += ctrs.drops_in;
+	    nio->bytes_out += ctrs.bytes_out;
+	    nio->pkts_out += ctrs.pkts_out;
+	    nio->errs_out += ctrs.errs_out;
+	    nio->drops_out += ctrs.drops_out;
 	  }
 	}
       }
-      fclose(procFile);
     }
     return interfaces;
   }
@@ -598,6 +707,7 @@ extern "C" {
     peerAdaptors.adaptors = adaptors;
     peerAdaptors.capacity = HSP_MAX_VIFS;
     peerAdaptors.num_adaptors = 0;
+    peerAdaptors.byName = peerAdaptors.byIndex = NULL;
     if(getContainerPeerAdaptors(sp, vm, &peerAdaptors, HSP_MAX_VIFS) > 0) {
       readNioCounters(sp, (SFLHost_nio_counters *)&nioElem.counterBlock.host_vrt_nio, NULL, &peerAdaptors);
       SFLADD_ELEMENT(&cs, &nioElem);
@@ -645,7 +755,7 @@ extern "C" {
       { "system",0,0},
       { NULL,0,0},
     };
-    if(readContainerCounters(mod, "cpuacct", container->id, "cpuacct.stat", 2, cpuVals)) {
+    if(readContainerCounters(mod, container, "cpuacct", "cpuacct.stat", 2, cpuVals)) {
       uint64_t cpu_total = 0;
       if(cpuVals[0].nv_found) cpu_total += cpuVals[0].nv_val64;
       if(cpuVals[1].nv_found) cpu_total += cpuVals[1].nv_val64;
@@ -661,7 +771,7 @@ extern "C" {
       { "hierarchical_memory_limit",0,0},
       { NULL,0,0},
     };
-    if(readContainerCounters(mod, "memory", container->id, "memory.stat", 2, memVals)) {
+    if(readContainerCounters(mod, container, "memory", "memory.stat", 2, memVals)) {
       if(memVals[0].nv_found) {
 	memElem.counterBlock.host_vrt_mem.memory = memVals[0].nv_val64;
       }
@@ -685,7 +795,7 @@ extern "C" {
       { "Write",0,0},
       { NULL,0,0},
     };
-    if(readContainerCountersMulti(mod, "blkio", container->id, "blkio.io_service_bytes_recursive", 2, dskValsB)) {
+    if(readContainerCountersMulti(mod, container, "blkio", "blkio.io_service_bytes_recursive", 2, dskValsB)) {
       if(dskValsB[0].nv_found) {
 	dskElem.counterBlock.host_vrt_dsk.rd_bytes += dskValsB[0].nv_val64;
       }
@@ -700,7 +810,7 @@ extern "C" {
       { NULL,0,0},
     };
 
-    if(readContainerCountersMulti(mod, "blkio", container->id, "blkio.io_serviced_recursive", 2, dskValsO)) {
+    if(readContainerCountersMulti(mod, container, "blkio", "blkio.io_serviced_recursive", 2, dskValsO)) {
       if(dskValsO[0].nv_found) {
 	dskElem.counterBlock.host_vrt_dsk.rd_req += dskValsO[0].nv_val64;
       }
@@ -757,6 +867,7 @@ extern "C" {
     if(container->id) my_free(container->id);
     if(container->name) my_free(container->name);
     if(container->hostname) my_free(container->hostname);
+    if(container->procFiles) UTProcFileCacheFree(container->procFiles);
     removeAndFreeVM(mod, &container->vm);
   }
 
@@ -785,25 +896,6 @@ extern "C" {
     return container;
   }
 
-  /*_________________---------------------------__________________
-    _________________  updateContainerAdaptors  __________________
-    -----------------___________________________------------------
-  */
-
-  static void updateContainerAdaptors(EVMod *mod, HSPVMState_DOCKER *container) {
-    HSP *sp = (HSP *)EVROOTDATA(mod);
-    HSPVMState *vm = &container->vm;
-    if(vm) {
-      // reset the information that we are about to refresh
-      adaptorListMarkAll(vm->interfaces);
-      // then refresh it
-      readContainerInterfaces(mod, container);
-      // and clean up
-      deleteMarkedAdaptors_adaptorList(sp, vm->interfaces);
-      adaptorListFreeMarked(vm->interfaces);
-    }
-  }
-
   /*_________________---------------------------__________________
     _________________    tick,tock              __________________
     -----------------___________________________------------------
@@ -935,9 +1027,12 @@ extern "C" {
 
     container->inspect_rx = YES;
     // now that we have the pid,  we can probe for the MAC and peer-ifIndex
-    updateContainerAdaptors(mod, container);
-    // send initial counter-sample immediately
-    getCounters_DOCKER(mod, container);
+    // and send the initial counter-sample when that comes back.
+    container->initialSample = YES;
+    if(!readContainerInterfaces(mod, container)) {
+      container->initialSample = NO;
+      getCounters_DOCKER(mod, container);
+    }
   }
 
   static void inspectContainer(EVMod *mod, HSPVMState_DOCKER *container) {
@@ -1341,6 +1436,17 @@ extern "C" {
     mdata->pollActions = UTHASH_NEW(HSPVMState_DOCKER, id, UTHASH_IDTY);
     mdata->eventQueue = UTArrayNew(UTARRAY_DFLT);
     mdata->cgroupPathIdx = -1;
+
+    // namespace helper thread
+    mdata->hostNetnsFd = open("/proc/self/ns/net", O_RDONLY | O_CLOEXEC);
+    if(mdata->hostNetnsFd < 0)
+      myLog(LOG_ERR, "mod_docker: cannot open /proc/self/ns/net : %s", strerror(errno));
+    mdata->netnsCache = UTHASH_NEW(HSPNetnsCache, nsIno, UTHASH_DFLT);
+    mdata->netnsNlBuf = (u_char *)my_calloc(HSP_DOCKER_NETNS_NL_BUF);
+    mdata->netnsBus = EVGetBus(mod, HSPBUS_NETNS, YES);
+    mdata->netnsReqEvent = EVGetEvent(mdata->netnsBus, HSPEVENT_NETNS_REQ);
+    EVEventRx(mod, mdata->netnsReqEvent, evt_netns_req);
+    EVEventRx(mod, EVGetEvent(mdata->netnsBus, EVEVENT_TOCK), evt_netns_tock);
     
     // register call-backs
     mdata->pollBus = EVGetBus(mod, HSPBUS_POLL, YES);
@@ -1348,6 +1454,8 @@ extern "C" {
     EVEventRx(mod, EVGetEvent(mdata->pollBus, EVEVENT_TOCK), evt_tock);
     EVEventRx(mod, EVGetEvent(mdata->pollBus, HSPEVENT_HOST_COUNTER_SAMPLE), evt_host_cs);
     EVEventRx(mod, EVGetEvent(mdata->pollBus, HSPEVENT_CONFIG_FIRST), evt_config_first);
+    mdata->netnsLinksEvent = EVGetEvent(mdata->pollBus, HSPEVENT_NETNS_LINKS);
+    EVEventRx(mod, mdata->netnsLinksEvent, evt_netns_links);
   }
 
 #if defined(__cplusplus)
@@ -0,0 +1,878 @@
+/* This software is distributed under the following license:
+ * http://sflow.net/license.html
+ */
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "hsflowd.h"
+
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <linux/types.h>
+#include <linux/if_ether.h>
+#include <linux/bpf.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/pkt_sched.h>
+#include <linux/pkt_cls.h>
+
+  /*
+    Packet sampling with a small eBPF program attached to each device
+    at the tc clsact hooks (ingress and egress), or at XDP for ingress
+    with ebpf { xdp=on }.  Only the sampled packets leave the kernel:
+    the program picks 1-in-N with bpf_get_prandom_u32(),  copies at most
+    headerBytes into a record in a BPF_MAP_TYPE_RINGBUF shared by all
+    devices,  and we read that ring in place on the packet bus.  If the
+    ring is full the program counts a drop in a per-CPU array instead.
+
+    There is no libbpf or clang here.  As with the classic-BPF filter
+    in mod_pcap,  the instructions are assembled by hand,  with the
+    sampling rate, header length and device slot written in as
+    immediates,  so a rate change means loading a new program and
+    swapping it in.
+  */
+
+#define HSP_EBPF_RING_BYTES (1 << 20)
+#define HSP_EBPF_MAX_DEVS 1024
+#define HSP_EBPF_MAX_INSNS 64
+#define HSP_EBPF_LOG_BYTES 65536
+#define HSP_READPACKET_BATCH_EBPF 10000
+  // well away from the priorities that tc assigns itself
+#define HSP_EBPF_TC_PRIO 0x5F10
+#define HSP_EBPF_TC_HANDLE 1
+#define HSP_EBPF_NL_BUF 4096
+
+#define HSP_EBPF_DIRN_INGRESS 0
+#define HSP_EBPF_DIRN_EGRESS 1
+
+  // one record in the ring,  written by the BPF program
+  typedef struct _HSPEBPFSample {
+    uint32_t slot;
+    uint32_t ifIndex;
+    uint32_t ingressIfIndex;
+    uint32_t direction;
+    uint32_t samplingRate;
+    uint32_t pktLen;
+    uint32_t capLen;
+    uint32_t vlanPresent;
+    uint32_t vlanTCI;
+    uint32_t vlanProto;
+    u_char hdr[];
+  } HSPEBPFSample;
+
+  typedef enum { EBPF_HOOK_INGRESS=0, EBPF_HOOK_EGRESS, EBPF_HOOK_XDP, EBPF_HOOK_N } EnumEBPFHook;
+
+  typedef struct _EBPFDev {
+    char *deviceName;
+    SFLAdaptor *adaptor;
+    uint32_t ifIndex;
+    uint32_t slot; // index into the drops map
+    uint32_t samplingRate;
+    int progFd[EBPF_HOOK_N];
+    HSPSamplingCtl *ctl;
+    uint64_t dropsTotal; // last sum read from the per-CPU map
+    uint32_t drops; // not yet reported
+    bool xdp:1;
+    bool vport:1;
+    bool vport_set:1;
+    bool open:1;
+  } EBPFDev;
+
+  typedef struct _HSP_mod_EBPF {
+    EVBus *packetBus;
+    UTArray *devs; // indexed by slot
+    int ringFd;
+    int dropsFd;
+    size_t pageBytes;
+    unsigned long *consumerPos;
+    unsigned long *producerPos;
+    u_char *ringData;
+    EVSocket *sock;
+    uint32_t nCPUs;
+    uint64_t *dropsBuf;
+    uint32_t recBytes;
+    int nlSock;
+    uint32_t nlSeq;
+    u_char *nlBuf;
+    u_char vlanbuf[HSP_MAX_HEADER_BYTES + 4];
+  } HSP_mod_EBPF;
+
+  /*_________________---------------------------__________________
+    _________________     bpf() syscall         __________________
+    -----------------___________________________------------------
+  */
+
+  static int sys_bpf(int cmd, union bpf_attr *attr) {
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+  }
+
+  static int mapCreate(uint32_t type, uint32_t keySize, uint32_t valSize, uint32_t maxEntries) {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = type;
+    attr.key_size = keySize;
+    attr.value_size = valSize;
+    attr.max_entries = maxEntries;
+    return sys_bpf(BPF_MAP_CREATE, &attr);
+  }
+
+  static uint32_t possibleCPUs(void) {
+    // per-CPU map values are sized by the possible CPUs, e.g. "0-63"
+    uint32_t ncpus = 0;
+    FILE *ff = fopen("/sys/devices/system/cpu/possible", "r");
+    if(ff) {
+      char line[128];
+      if(fgets(line, sizeof(line), ff)) {
+	char *last = strrchr(line, '-');
+	char *comma = strrchr(line, ',');
+	if(comma > last) last = comma;
+	ncpus = strtoul(last ? last + 1 : line, NULL, 0) + 1;
+      }
+      fclose(ff);
+    }
+    if(ncpus == 0)
+      ncpus = sysconf(_SC_NPROCESSORS_CONF);
+    return ncpus;
+  }
+
+  /*_________________---------------------------__________________
+    _________________    program assembly       __________________
+    -----------------___________________________------------------
+    Macros in the style of the kernel's include/linux/filter.h,
+    which is not exported to user-space.
+  */
+
+#define EBPF_INSN(CODE, DST, SRC, OFF, IMM)				\
+  ((struct bpf_insn){ .code = (CODE), .dst_reg = (DST), .src_reg = (SRC), .off = (OFF), .imm = (IMM) })
+#define EBPF_MOV64_REG(DST, SRC) EBPF_INSN(BPF_ALU64 | BPF_MOV | BPF_X, DST, SRC, 0, 0)
+#define EBPF_MOV64_IMM(DST, IMM) EBPF_INSN(BPF_ALU64 | BPF_MOV | BPF_K, DST, 0, 0, IMM)
+#define EBPF_ADD64_IMM(DST, IMM) EBPF_INSN(BPF_ALU64 | BPF_ADD | BPF_K, DST, 0, 0, IMM)
+#define EBPF_MOD32_IMM(DST, IMM) EBPF_INSN(BPF_ALU | BPF_MOD | BPF_K, DST, 0, 0, IMM)
+#define EBPF_LDX_W(DST, SRC, OFF) EBPF_INSN(BPF_LDX | BPF_W | BPF_MEM, DST, SRC, OFF, 0)
+#define EBPF_LDX_DW(DST, SRC, OFF) EBPF_INSN(BPF_LDX | BPF_DW | BPF_MEM, DST, SRC, OFF, 0)
+#define EBPF_STX_W(DST, SRC, OFF) EBPF_INSN(BPF_STX | BPF_W | BPF_MEM, DST, SRC, OFF, 0)
+#define EBPF_STX_DW(DST, SRC, OFF) EBPF_INSN(BPF_STX | BPF_DW | BPF_MEM, DST, SRC, OFF, 0)
+#define EBPF_ST_W(DST, OFF, IMM) EBPF_INSN(BPF_ST | BPF_W | BPF_MEM, DST, 0, OFF, IMM)
+#define EBPF_JMP_IMM(OP, DST, IMM, OFF) EBPF_INSN(BPF_JMP | (OP) | BPF_K, DST, 0, OFF, IMM)
+#define EBPF_JA(OFF) EBPF_INSN(BPF_JMP | BPF_JA, 0, 0, OFF, 0)
+#define EBPF_CALL(FN) EBPF_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, FN)
+#define EBPF_EXIT() EBPF_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+  // 16-byte load of a map reference
+#define EBPF_LD_MAP_FD(DST, FD)						\
+  EBPF_INSN(BPF_LD | BPF_DW | BPF_IMM, DST, BPF_PSEUDO_MAP_FD, 0, FD),	\
+    EBPF_INSN(0, 0, 0, 0, 0)
+
+#define EBPF_R0 0
+#define EBPF_R1 1
+#define EBPF_R2 2
+#define EBPF_R3 3
+#define EBPF_R4 4
+#define EBPF_R6 6
+#define EBPF_R7 7
+#define EBPF_R8 8
+#define EBPF_R10 10
+
+#define EBPF_REC(field) offsetof(HSPEBPFSample, field)
+#define EBPF_SKB(field) offsetof(struct __sk_buff, field)
+#define EBPF_XDP(field) offsetof(struct xdp_md, field)
+
+  // r6 = ctx, r7 = record, r8 = bytes to copy.  The jump offsets
+  // are relative to the next instruction, so take care when editing.
+  static int assembleTC(HSP_mod_EBPF *mdata, EBPFDev *dev, uint32_t dirn, uint32_t hdrBytes, struct bpf_insn *prog) {
+    struct bpf_insn code[] = {
+      /*  0 */ EBPF_MOV64_REG(EBPF_R6, EBPF_R1),
+      /*  1 */ EBPF_CALL(BPF_FUNC_get_prandom_u32),
+      /*  2 */ EBPF_MOD32_IMM(EBPF_R0, dev->samplingRate),
+      /*  3 */ EBPF_JMP_IMM(BPF_JNE, EBPF_R0, 0, 49), // -> 53 out
+      /*  4 */ EBPF_LD_MAP_FD(EBPF_R1, mdata->ringFd),
+      /*  6 */ EBPF_MOV64_IMM(EBPF_R2, mdata->recBytes),
+      /*  7 */ EBPF_MOV64_IMM(EBPF_R3, 0),
+      /*  8 */ EBPF_CALL(BPF_FUNC_ringbuf_reserve),
+      /*  9 */ EBPF_JMP_IMM(BPF_JEQ, EBPF_R0, 0, 33), // -> 43 ring full
+      /* 10 */ EBPF_MOV64_REG(EBPF_R7, EBPF_R0),
+      /* 11 */ EBPF_LDX_W(EBPF_R1, EBPF_R6, EBPF_SKB(len)),
+      /* 12 */ EBPF_STX_W(EBPF_R7, EBPF_R1, EBPF_REC(pktLen)),
+      /* 13 */ EBPF_MOV64_REG(EBPF_R8, EBPF_R1),
+      /* 14 */ EBPF_JMP_IMM(BPF_JLE, EBPF_R8, hdrBytes, 1),
+      /* 15 */ EBPF_MOV64_IMM(EBPF_R8, hdrBytes),
+      /* 16 */ EBPF_LDX_W(EBPF_R1, EBPF_R6, EBPF_SKB(ifindex)),
+      /* 17 */ EBPF_STX_W(EBPF_R7, EBPF_R1, EBPF_REC(ifIndex)),
+      /* 18 */ EBPF_LDX_W(EBPF_R1, EBPF_R6, EBPF_SKB(ingress_ifindex)),
+      /* 19 */ EBPF_STX_W(EBPF_R7, EBPF_R1, EBPF_REC(ingressIfIndex)),
+      /* 20 */ EBPF_LDX_W(EBPF_R1, EBPF_R6, EBPF_SKB(vlan_present)),
+      /* 21 */ EBPF_STX_W(EBPF_R7, EBPF_R1, EBPF_REC(vlanPresent)),
+      /* 22 */ EBPF_LDX_W(EBPF_R1, EBPF_R6, EBPF_SKB(vlan_tci)),
+      /* 23 */ EBPF_STX_W(EBPF_R7, EBPF_R1, EBPF_REC(vlanTCI)),
+      /* 24 */ EBPF_LDX_W(EBPF_R1, EBPF_R6, EBPF_SKB(vlan_proto)),
+      /* 25 */ EBPF_STX_W(EBPF_R7, EBPF_R1, EBPF_REC(vlanProto)),
+      /* 26 */ EBPF_ST_W(EBPF_R7, EBPF_REC(direction), dirn),
+      /* 27 */ EBPF_ST_W(EBPF_R7, EBPF_REC(samplingRate), dev->samplingRate),
+      /* 28 */ EBPF_ST_W(EBPF_R7, EBPF_REC(slot), dev->slot),
+      /* 29 */ EBPF_ST_W(EBPF_R7, EBPF_REC(capLen), 0),
+      /* 30 */ EBPF_JMP_IMM(BPF_JLT, EBPF_R8, 14, 8), // -> 39 submit
+      /* 31 */ EBPF_MOV64_REG(EBPF_R1, EBPF_R6),
+      /* 32 */ EBPF_MOV64_IMM(EBPF_R2, 0),
+      /* 33 */ EBPF_MOV64_REG(EBPF_R3, EBPF_R7),
+      /* 34 */ EBPF_ADD64_IMM(EBPF_R3, EBPF_REC(hdr)),
+      /* 35 */ EBPF_MOV64_REG(EBPF_R4, EBPF_R8),
+      /* 36 */ EBPF_CALL(BPF_FUNC_skb_load_bytes),
+      /* 37 */ EBPF_JMP_IMM(BPF_JNE, EBPF_R0, 0, 1), // -> 39 submit
+      /* 38 */ EBPF_STX_W(EBPF_R7, EBPF_R8, EBPF_REC(capLen)),
+      /* 39 */ EBPF_MOV64_REG(EBPF_R1, EBPF_R7),
+      /* 40 */ EBPF_MOV64_IMM(EBPF_R2, 0),
+      /* 41 */ EBPF_CALL(BPF_FUNC_ringbuf_submit),
+      /* 42 */ EBPF_JA(10), // -> 53 out
+      /* 43 */ EBPF_ST_W(EBPF_R10, -4, dev->slot),
+      /* 44 */ EBPF_MOV64_REG(EBPF_R2, EBPF_R10),
+      /* 45 */ EBPF_ADD64_IMM(EBPF_R2, -4),
+      /* 46 */ EBPF_LD_MAP_FD(EBPF_R1, mdata->dropsFd),
+      /* 48 */ EBPF_CALL(BPF_FUNC_map_lookup_elem),
+      /* 49 */ EBPF_JMP_IMM(BPF_JEQ, EBPF_R0, 0, 3), // -> 53 out
+      /* 50 */ EBPF_LDX_DW(EBPF_R1, EBPF_R0, 0),
+      /* 51 */ EBPF_ADD64_IMM(EBPF_R1, 1),
+      /* 52 */ EBPF_STX_DW(EBPF_R0, EBPF_R1, 0),
+      /* 53 */ EBPF_MOV64_IMM(EBPF_R0, TC_ACT_UNSPEC), // carry on to other filters
+      /* 54 */ EBPF_EXIT(),
+    };
+    int n = sizeof(code) / sizeof(code[0]);
+    memcpy(prog, code, sizeof(code));
+    return n;
+  }
+
+  static int assembleXDP(HSP_mod_EBPF *mdata, EBPFDev *dev, uint32_t hdrBytes, struct bpf_insn *prog) {
+    struct bpf_insn code[] = {
+      /*  0 */ EBPF_MOV64_REG(EBPF_R6, EBPF_R1),
+      /*  1 */ EBPF_CALL(BPF_FUNC_get_prandom_u32),
+      /*  2 */ EBPF_MOD32_IMM(EBPF_R0, dev->samplingRate),
+      /*  3 */ EBPF_JMP_IMM(BPF_JNE, EBPF_R0, 0, 44), // -> 48 out
+      /*  4 */ EBPF_LD_MAP_FD(EBPF_R1, mdata->ringFd),
+      /*  6 */ EBPF_MOV64_IMM(EBPF_R2, mdata->recBytes),
+      /*  7 */ EBPF_MOV64_IMM(EBPF_R3, 0),
+      /*  8 */ EBPF_CALL(BPF_FUNC_ringbuf_reserve),
+      /*  9 */ EBPF_JMP_IMM(BPF_JEQ, EBPF_R0, 0, 28), // -> 38 ring full
+      /* 10 */ EBPF_MOV64_REG(EBPF_R7, EBPF_R0),
+      /* 11 */ EBPF_MOV64_REG(EBPF_R1, EBPF_R6),
+      /* 12 */ EBPF_CALL(BPF_FUNC_xdp_get_buff_len),
+      /* 13 */ EBPF_STX_W(EBPF_R7, EBPF_R0, EBPF_REC(pktLen)),
+      /* 14 */ EBPF_MOV64_REG(EBPF_R8, EBPF_R0),
+      /* 15 */ EBPF_JMP_IMM(BPF_JLE, EBPF_R8, hdrBytes, 1),
+      /* 16 */ EBPF_MOV64_IMM(EBPF_R8, hdrBytes),
+      /* 17 */ EBPF_LDX_W(EBPF_R1, EBPF_R6, EBPF_XDP(ingress_ifindex)),
+      /* 18 */ EBPF_STX_W(EBPF_R7, EBPF_R1, EBPF_REC(ifIndex)),
+      /* 19 */ EBPF_STX_W(EBPF_R7, EBPF_R1, EBPF_REC(ingressIfIndex)),
+      /* 20 */ EBPF_ST_W(EBPF_R7, EBPF_REC(vlanPresent), 0),
+      /* 21 */ EBPF_ST_W(EBPF_R7, EBPF_REC(direction), HSP_EBPF_DIRN_INGRESS),
+      /* 22 */ EBPF_ST_W(EBPF_R7, EBPF_REC(samplingRate), dev->samplingRate),
+      /* 23 */ EBPF_ST_W(EBPF_R7, EBPF_REC(slot), dev->slot),
+      /* 24 */ EBPF_ST_W(EBPF_R7, EBPF_REC(capLen), 0),
+      /* 25 */ EBPF_JMP_IMM(BPF_JLT, EBPF_R8, 14, 8), // -> 34 submit
+      /* 26 */ EBPF_MOV64_REG(EBPF_R1, EBPF_R6),
+      /* 27 */ EBPF_MOV64_IMM(EBPF_R2, 0),
+      /* 28 */ EBPF_MOV64_REG(EBPF_R3, EBPF_R7),
+      /* 29 */ EBPF_ADD64_IMM(EBPF_R3, EBPF_REC(hdr)),
+      /* 30 */ EBPF_MOV64_REG(EBPF_R4, EBPF_R8),
+      /* 31 */ EBPF_CALL(BPF_FUNC_xdp_load_bytes),
+      /* 32 */ EBPF_JMP_IMM(BPF_JNE, EBPF_R0, 0, 1), // -> 34 submit
+      /* 33 */ EBPF_STX_W(EBPF_R7, EBPF_R8, EBPF_REC(capLen)),
+      /* 34 */ EBPF_MOV64_REG(EBPF_R1, EBPF_R7),
+      /* 35 */ EBPF_MOV64_IMM(EBPF_R2, 0),
+      /* 36 */ EBPF_CALL(BPF_FUNC_ringbuf_submit),
+      /* 37 */ EBPF_JA(10), // -> 48 out
+      /* 38 */ EBPF_ST_W(EBPF_R10, -4, dev->slot),
+      /* 39 */ EBPF_MOV64_REG(EBPF_R2, EBPF_R10),
+      /* 40 */ EBPF_ADD64_IMM(EBPF_R2, -4),
+      /* 41 */ EBPF_LD_MAP_FD(EBPF_R1, mdata->dropsFd),
+      /* 43 */ EBPF_CALL(BPF_FUNC_map_lookup_elem),
+      /* 44 */ EBPF_JMP_IMM(BPF_JEQ, EBPF_R0, 0, 3), // -> 48 out
+      /* 45 */ EBPF_LDX_DW(EBPF_R1, EBPF_R0, 0),
+      /* 46 */ EBPF_ADD64_IMM(EBPF_R1, 1),
+      /* 47 */ EBPF_STX_DW(EBPF_R0, EBPF_R1, 0),
+      /* 48 */ EBPF_MOV64_IMM(EBPF_R0, XDP_PASS),
+      /* 49 */ EBPF_EXIT(),
+    };
+    int n = sizeof(code) / sizeof(code[0]);
+    memcpy(prog, code, sizeof(code));
+    return n;
+  }
+
+  static int loadProgram(EVMod *mod, EBPFDev *dev, EnumEBPFHook hook) {
+    HSP_mod_EBPF *mdata = (HSP_mod_EBPF *)mod->data;
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    uint32_t hdrBytes = sp->sFlowSettings_file->headerBytes;
+    struct bpf_insn prog[HSP_EBPF_MAX_INSNS];
+    int n = (hook == EBPF_HOOK_XDP)
+      ? assembleXDP(mdata, dev, hdrBytes, prog)
+      : assembleTC(mdata, dev, (hook == EBPF_HOOK_EGRESS) ? HSP_EBPF_DIRN_EGRESS : HSP_EBPF_DIRN_INGRESS, hdrBytes, prog);
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = (hook == EBPF_HOOK_XDP) ? BPF_PROG_TYPE_XDP : BPF_PROG_TYPE_SCHED_CLS;
+    attr.insns = (uintptr_t)prog;
+    attr.insn_cnt = n;
+    attr.license = (uintptr_t)"Dual BSD/GPL";
+    strncpy(attr.prog_name, "hsflowd", sizeof(attr.prog_name) - 1);
+    int fd = sys_bpf(BPF_PROG_LOAD, &attr);
+    if(fd < 0) {
+      int err = errno;
+      myLog(LOG_ERR, "EBPF: dev=%s program load failed: %s", dev->deviceName, strerror(err));
+      if(debug(1)) {
+	// try again just to get the verifier's explanation
+	char *log = my_calloc(HSP_EBPF_LOG_BYTES);
+	attr.log_buf = (uintptr_t)log;
+	attr.log_size = HSP_EBPF_LOG_BYTES;
+	attr.log_level = 1;
+	if(sys_bpf(BPF_PROG_LOAD, &attr) < 0)
+	  myDebug(1, "EBPF: verifier log:\n%s", log);
+	my_free(log);
+      }
+    }
+    return fd;
+  }
+
+  /*_________________---------------------------__________________
+    _________________   rtnetlink attach        __________________
+    -----------------___________________________------------------
+  */
+
+  static struct nlattr *nlAttrPut(struct nlmsghdr *nlh, int type, const void *data, int len) {
+    struct nlattr *nla = (struct nlattr *)((char *)nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+    nla->nla_type = type;
+    nla->nla_len = NLA_HDRLEN + len;
+    if(len)
+      memcpy((char *)nla + NLA_HDRLEN, data, len);
+    nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + NLA_ALIGN(nla->nla_len);
+    return nla;
+  }
+
+  static void nlAttrNestEnd(struct nlmsghdr *nlh, struct nlattr *nest) {
+    nest->nla_len = (char *)nlh + nlh->nlmsg_len - (char *)nest;
+  }
+
+  // send a request and wait for the ACK. Returns 0 or an errno.
+  static int rtnlTxRx(EVMod *mod, struct nlmsghdr *req) {
+    HSP_mod_EBPF *mdata = (HSP_mod_EBPF *)mod->data;
+    if(mdata->nlSock <= 0) {
+      int nl_sock = socket(AF_NETLINK, SOCK_RAW|SOCK_CLOEXEC, NETLINK_ROUTE);
+      if(nl_sock < 0) {
+	myLog(LOG_ERR, "EBPF: rtnetlink socket() failed: %s", strerror(errno));
+	return errno;
+      }
+      struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+      setsockopt(nl_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+      mdata->nlSock = nl_sock;
+      mdata->nlBuf = (u_char *)my_calloc(HSP_EBPF_NL_BUF);
+    }
+    req->nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+    req->nlmsg_seq = ++mdata->nlSeq;
+    if(send(mdata->nlSock, req, req->nlmsg_len, 0) < 0)
+      return errno;
+    for(;;) {
+      int len = recv(mdata->nlSock, mdata->nlBuf, HSP_EBPF_NL_BUF, 0);
+      if(len <= 0)
+	return len < 0 ? errno : EIO;
+      for(struct nlmsghdr *nlh = (struct nlmsghdr *)mdata->nlBuf;
+	  NLMSG_OK(nlh, len);
+	  nlh = NLMSG_NEXT(nlh, len)) {
+	if(nlh->nlmsg_seq == mdata->nlSeq
+	   && nlh->nlmsg_type == NLMSG_ERROR) {
+	  struct nlmsgerr *err = (struct nlmsgerr *)NLMSG_DATA(nlh);
+	  return -err->error;
+	}
+      }
+      // stale reply from a request that timed out - keep reading
+    }
+  }
+
+  static void tcMsgInit(struct nlmsghdr *req, int type, uint32_t ifIndex, uint32_t parent) {
+    req->nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg));
+    req->nlmsg_type = type;
+    struct tcmsg *tcm = (struct tcmsg *)NLMSG_DATA(req);
+    tcm->tcm_family = AF_UNSPEC;
+    tcm->tcm_ifindex = ifIndex;
+    tcm->tcm_parent = parent;
+  }
+
+  static int addClsact(EVMod *mod, EBPFDev *dev) {
+    uint32_t reqbuf[64] = { 0 };
+    struct nlmsghdr *req = (struct nlmsghdr *)reqbuf;
+    tcMsgInit(req, RTM_NEWQDISC, dev->ifIndex, TC_H_CLSACT);
+    req->nlmsg_flags = NLM_F_CREATE | NLM_F_EXCL;
+    ((struct tcmsg *)NLMSG_DATA(req))->tcm_handle = TC_H_MAKE(TC_H_CLSACT, 0);
+    nlAttrPut(req, TCA_KIND, "clsact", sizeof("clsact"));
+    int err = rtnlTxRx(mod, req);
+    // may already be there, with other filters on it
+    return (err == EEXIST) ? 0 : err;
+  }
+
+  static uint32_t tcParent(EnumEBPFHook hook) {
+    return TC_H_MAKE(TC_H_CLSACT, (hook == EBPF_HOOK_EGRESS) ? TC_H_MIN_EGRESS : TC_H_MIN_INGRESS);
+  }
+
+  static int setFilter(EVMod *mod, EBPFDev *dev, EnumEBPFHook hook, int progFd) {
+    uint32_t reqbuf[128] = { 0 };
+    struct nlmsghdr *req = (struct nlmsghdr *)reqbuf;
+    tcMsgInit(req, RTM_NEWTFILTER, dev->ifIndex, tcParent(hook));
+    // this prio/handle is ours,  so replace whatever is there - including
+    // a filter left behind by an hsflowd that was killed
+    req->nlmsg_flags = NLM_F_CREATE | NLM_F_REPLACE;
+    struct tcmsg *tcm = (struct tcmsg *)NLMSG_DATA(req);
+    tcm->tcm_handle = HSP_EBPF_TC_HANDLE;
+    tcm->tcm_info = TC_H_MAKE(HSP_EBPF_TC_PRIO << 16, htons(ETH_P_ALL));
+    nlAttrPut(req, TCA_KIND, "bpf", sizeof("bpf"));
+    struct nlattr *opts = nlAttrPut(req, TCA_OPTIONS | NLA_F_NESTED, NULL, 0);
+    uint32_t fd32 = progFd;
+    nlAttrPut(req, TCA_BPF_FD, &fd32, sizeof(fd32));
+    nlAttrPut(req, TCA_BPF_NAME, "hsflowd", sizeof("hsflowd"));
+    uint32_t flags = TCA_BPF_FLAG_ACT_DIRECT;
+    nlAttrPut(req, TCA_BPF_FLAGS, &flags, sizeof(flags));
+    nlAttrNestEnd(req, opts);
+    return rtnlTxRx(mod, req);
+  }
+
+  static int delFilter(EVMod *mod, EBPFDev *dev, EnumEBPFHook hook) {
+    uint32_t reqbuf[64] = { 0 };
+    struct nlmsghdr *req = (struct nlmsghdr *)reqbuf;
+    tcMsgInit(req, RTM_DELTFILTER, dev->ifIndex, tcParent(hook));
+    struct tcmsg *tcm = (struct tcmsg *)NLMSG_DATA(req);
+    tcm->tcm_handle = HSP_EBPF_TC_HANDLE;
+    tcm->tcm_info = TC_H_MAKE(HSP_EBPF_TC_PRIO << 16, htons(ETH_P_ALL));
+    nlAttrPut(req, TCA_KIND, "bpf", sizeof("bpf"));
+    return rtnlTxRx(mod, req);
+  }
+
+  // progFd == -1 to detach
+  static int setXDP(EVMod *mod, EBPFDev *dev, int progFd) {
+    uint32_t reqbuf[64] = { 0 };
+    struct nlmsghdr *req = (struct nlmsghdr *)reqbuf;
+    req->nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    req->nlmsg_type = RTM_SETLINK;
+    struct ifinfomsg *ifi = (struct ifinfomsg *)NLMSG_DATA(req);
+    ifi->ifi_family = AF_UNSPEC;
+    ifi->ifi_index = dev->ifIndex;
+    struct nlattr *xdp = nlAttrPut(req, IFLA_XDP | NLA_F_NESTED, NULL, 0);
+    int32_t fd32 = progFd;
+    nlAttrPut(req, IFLA_XDP_FD, &fd32, sizeof(fd32));
+    nlAttrNestEnd(req, xdp);
+    return rtnlTxRx(mod, req);
+  }
+
+  /*_________________---------------------------__________________
+    _________________    attach, detach         __________________
+    -----------------___________________________------------------
+    Load a program for each hook and swap it in.  The old program
+    is released when we close its fd,  and since every record says
+    which sampling rate it was taken at there is no need to drain
+    the ring first.
+  */
+
+  static bool attachHook(EVMod *mod, EBPFDev *dev, EnumEBPFHook hook) {
+    int fd = loadProgram(mod, dev, hook);
+    if(fd < 0)
+      return NO;
+    bool replace = (dev->progFd[hook] >= 0);
+    int err = (hook == EBPF_HOOK_XDP)
+      ? setXDP(mod, dev, fd)
+      : setFilter(mod, dev, hook, fd);
+    if(err) {
+      myLog(LOG_ERR, "EBPF: dev=%s attach (hook=%u) failed: %s", dev->deviceName, hook, strerror(err));
+      close(fd);
+      return NO;
+    }
+    if(replace)
+      close(dev->progFd[hook]);
+    dev->progFd[hook] = fd;
+    return YES;
+  }
+
+  static void detachHook(EVMod *mod, EBPFDev *dev, EnumEBPFHook hook, bool devGone) {
+    if(dev->progFd[hook] < 0)
+      return;
+    if(!devGone) {
+      int err = (hook == EBPF_HOOK_XDP)
+	? setXDP(mod, dev, -1)
+	: delFilter(mod, dev, hook);
+      if(err)
+	myLog(LOG_ERR, "EBPF: dev=%s detach (hook=%u) failed: %s", dev->deviceName, hook, strerror(err));
+    }
+    close(dev->progFd[hook]);
+    dev->progFd[hook] = -1;
+  }
+
+  static void attachAll(EVMod *mod, EBPFDev *dev) {
+    for(EnumEBPFHook hook = 0; hook < EBPF_HOOK_N; hook++) {
+      if(hook == EBPF_HOOK_XDP && !dev->xdp)
+	continue;
+      if(hook == EBPF_HOOK_INGRESS && dev->xdp)
+	continue; // XDP sees the ingress packets instead
+      attachHook(mod, dev, hook);
+    }
+  }
+
+  /*_________________---------------------------__________________
+    _________________      readRing             __________________
+    -----------------___________________________------------------
+    The data pages are mapped twice in a row,  so a record that wraps
+    around the end of the ring can still be read in one piece.
+    Take at most HSP_READPACKET_BATCH_EBPF records at a time so the
+    rest of the packetBus gets a look in.  The ring fd stays readable
+    while records are left,  so we will be called again.
+  */
+
+  static void ebpfSample(EVMod *mod, HSPEBPFSample *rec, uint32_t len) {
+    HSP_mod_EBPF *mdata = (HSP_mod_EBPF *)mod->data;
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    if(len < sizeof(HSPEBPFSample)
+       || rec->slot >= UTArrayN(mdata->devs))
+      return;
+    EBPFDev *dev = UTArrayAt(mdata->devs, rec->slot);
+    if(dev->adaptor == NULL)
+      return;
+    if(dev->ctl)
+      samplingCtlCount(dev->ctl);
+    uint32_t caplen = rec->capLen;
+    if(caplen < 14
+       || caplen > len - sizeof(HSPEBPFSample))
+      return;
+
+    u_char *buf = rec->hdr;
+    uint32_t pktLen = rec->pktLen;
+    if(rec->vlanPresent) {
+      // the 802.1Q tag is in skb metadata, so put it back in the header
+      uint16_t tpid = ntohs(rec->vlanProto) ?: ETH_P_8021Q;
+      u_char *vbuf = mdata->vlanbuf;
+      memcpy(vbuf, buf, 12);
+      vbuf[12] = tpid >> 8;
+      vbuf[13] = tpid & 0xFF;
+      vbuf[14] = rec->vlanTCI >> 8;
+      vbuf[15] = rec->vlanTCI & 0xFF;
+      memcpy(vbuf + 16, buf + 12, caplen - 12);
+      buf = vbuf;
+      caplen += 4;
+      pktLen += 4;
+    }
+
+    // global MAC -> adaptor
+    SFLMacAddress macdst, macsrc;
+    memset(&macdst, 0, sizeof(macdst));
+    memset(&macsrc, 0, sizeof(macsrc));
+    memcpy(macdst.mac, buf, 6);
+    memcpy(macsrc.mac, buf+6, 6);
+    SFLAdaptor *srcdev = adaptorByMac(sp, &macsrc);
+    SFLAdaptor *dstdev = adaptorByMac(sp, &macdst);
+    if(srcdev == NULL
+       && rec->direction == HSP_EBPF_DIRN_EGRESS
+       && rec->ingressIfIndex) {
+      // forwarded: the kernel knows where it came in
+      srcdev = adaptorByIndex(sp, rec->ingressIfIndex);
+    }
+
+    uint32_t ds_options = (HSP_SAMPLEOPT_DEV_SAMPLER
+			   | HSP_SAMPLEOPT_DEV_POLLER);
+    ds_options |= (rec->direction == HSP_EBPF_DIRN_EGRESS)
+      ? HSP_SAMPLEOPT_EGRESS
+      : HSP_SAMPLEOPT_INGRESS;
+    bool isBridge = (ADAPTOR_NIO(dev->adaptor)->devType == HSPDEV_BRIDGE);
+    if(isBridge)
+      ds_options |= HSP_SAMPLEOPT_BRIDGE;
+    // same vport logic as mod_pcap
+    if(dev->vport
+       || (dev->vport_set == NO
+	   && isBridge))
+      ds_options |= HSP_SAMPLEOPT_IF_POLLER;
+
+    uint32_t drops = dev->drops;
+    dev->drops = 0;
+    takeSample(sp,
+	       srcdev,
+	       dstdev,
+	       dev->adaptor,
+	       ds_options,
+	       rec->direction /*hook*/,
+	       buf /* mac hdr*/,
+	       14 /* mac len */,
+	       buf + 14 /* payload */,
+	       caplen - 14, /* length of captured payload */
+	       pktLen, /* length of packet (pdu) */
+	       drops, /* droppedSamples */
+	       rec->samplingRate);
+  }
+
+  static void readRing(EVMod *mod, EVSocket *sock, void *magic) {
+    HSP_mod_EBPF *mdata = (HSP_mod_EBPF *)mod->data;
+    unsigned long cons = __atomic_load_n(mdata->consumerPos, __ATOMIC_ACQUIRE);
+    unsigned long prod = __atomic_load_n(mdata->producerPos, __ATOMIC_ACQUIRE);
+    for(int batch = 0; cons < prod && batch < HSP_READPACKET_BATCH_EBPF; batch++) {
+      uint32_t *hdr = (uint32_t *)(mdata->ringData + (cons & (HSP_EBPF_RING_BYTES - 1)));
+      uint32_t len = __atomic_load_n(hdr, __ATOMIC_ACQUIRE);
+      if(len & BPF_RINGBUF_BUSY_BIT)
+	break; // not committed yet - we will be woken again
+      cons += (((len & ~BPF_RINGBUF_DISCARD_BIT) + BPF_RINGBUF_HDR_SZ) + 7) & ~7;
+      if((len & BPF_RINGBUF_DISCARD_BIT) == 0)
+	ebpfSample(mod, (HSPEBPFSample *)((u_char *)hdr + BPF_RINGBUF_HDR_SZ), len);
+      // give the space back as we go
+      __atomic_store_n(mdata->consumerPos, cons, __ATOMIC_RELEASE);
+      prod = __atomic_load_n(mdata->producerPos, __ATOMIC_ACQUIRE);
+    }
+    pendingSampleBatchFlush((HSP *)EVROOTDATA(mod));
+  }
+
+  /*_________________---------------------------__________________
+    _________________      openRing             __________________
+    -----------------___________________________------------------
+  */
+
+  static bool openRing(EVMod *mod) {
+    HSP_mod_EBPF *mdata = (HSP_mod_EBPF *)mod->data;
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    mdata->pageBytes = sysconf(_SC_PAGESIZE);
+    mdata->recBytes = (sizeof(HSPEBPFSample) + sp->sFlowSettings_file->headerBytes + 7) & ~7;
+    mdata->nCPUs = possibleCPUs();
+    mdata->dropsBuf = (uint64_t *)my_calloc(mdata->nCPUs * sizeof(uint64_t));
+    mdata->ringFd = mapCreate(BPF_MAP_TYPE_RINGBUF, 0, 0, HSP_EBPF_RING_BYTES);
+    if(mdata->ringFd < 0) {
+      myLog(LOG_ERR, "EBPF: ringbuf map create failed: %s", strerror(errno));
+      return NO;
+    }
+    mdata->dropsFd = mapCreate(BPF_MAP_TYPE_PERCPU_ARRAY, sizeof(uint32_t), sizeof(uint64_t), HSP_EBPF_MAX_DEVS);
+    if(mdata->dropsFd < 0) {
+      myLog(LOG_ERR, "EBPF: drops map create failed: %s", strerror(errno));
+      return NO;
+    }
+    // consumer position is ours to write
+    void *cpage = mmap(NULL, mdata->pageBytes, PROT_READ | PROT_WRITE, MAP_SHARED, mdata->ringFd, 0);
+    if(cpage == MAP_FAILED) {
+      myLog(LOG_ERR, "EBPF: ringbuf mmap (consumer) failed: %s", strerror(errno));
+      return NO;
+    }
+    mdata->consumerPos = (unsigned long *)cpage;
+    // producer position page followed by the data (twice), read-only
+    void *ppage = mmap(NULL, mdata->pageBytes + (2 * HSP_EBPF_RING_BYTES), PROT_READ, MAP_SHARED, mdata->ringFd, mdata->pageBytes);
+    if(ppage == MAP_FAILED) {
+      myLog(LOG_ERR, "EBPF: ringbuf mmap (producer) failed: %s", strerror(errno));
+      return NO;
+    }
+    mdata->producerPos = (unsigned long *)ppage;
+    mdata->ringData = (u_char *)ppage + mdata->pageBytes;
+    // the ringbuf fd is pollable, so it can go on the bus like a socket
+    mdata->sock = EVBusAddSocket(mod, mdata->packetBus, mdata->ringFd, readRing, NULL);
+    myDebug(1, "EBPF: ring open (%u bytes, record=%u bytes, cpus=%u)", HSP_EBPF_RING_BYTES, mdata->recBytes, mdata->nCPUs);
+    return YES;
+  }
+
+  /*_________________---------------------------__________________
+    _________________    dev_open, dev_close    __________________
+    -----------------___________________________------------------
+  */
+
+  static void dev_open(EVMod *mod, EBPFDev *dev) {
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    dev->samplingRate = lookupPacketSamplingRate(dev->adaptor, sp->sFlowSettings);
+    if(dev->samplingRate == 0) {
+      myDebug(1, "EBPF: dev=%s sampling off", dev->deviceName);
+      return;
+    }
+    int err = addClsact(mod, dev);
+    if(err) {
+      myLog(LOG_ERR, "EBPF: dev=%s clsact qdisc failed: %s", dev->deviceName, strerror(err));
+      return;
+    }
+    attachAll(mod, dev);
+    dev->open = YES;
+    myDebug(1, "EBPF: dev=%s opened OK (slot=%u, rate=%u%s)",
+	    dev->deviceName,
+	    dev->slot,
+	    dev->samplingRate,
+	    dev->xdp ? ", xdp" : "");
+    dev->ctl = samplingCtlNew(sp, dev->deviceName, dev->samplingRate);
+    // assume we always want to get counters for anything we are tapping.
+    forceCounterPolling(sp, dev->adaptor);
+  }
+
+  static void dev_close(EVMod *mod, EBPFDev *dev, bool devGone) {
+    for(EnumEBPFHook hook = 0; hook < EBPF_HOOK_N; hook++)
+      detachHook(mod, dev, hook, devGone);
+    samplingCtlFree((HSP *)EVROOTDATA(mod), dev->ctl);
+    dev->ctl = NULL;
+    dev->adaptor = NULL;
+    dev->open = NO;
+  }
+
+  static void changeSamplingRate(EVMod *mod, EBPFDev *dev, uint32_t rate) {
+    myDebug(1, "EBPF: dev=%s sampling rate %u -> %u", dev->deviceName, dev->samplingRate, rate);
+    if(rate == 0)
+      return;
+    dev->samplingRate = rate;
+    for(EnumEBPFHook hook = 0; hook < EBPF_HOOK_N; hook++) {
+      if(dev->progFd[hook] >= 0)
+	attachHook(mod, dev, hook);
+    }
+  }
+
+  /*_________________---------------------------__________________
+    _________________    evt_tick               __________________
+    -----------------___________________________------------------
+    Sum the per-CPU drop counters for each device.  The increase goes
+    out with the next sample from that device.
+  */
+
+  static void evt_tick(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    HSP_mod_EBPF *mdata = (HSP_mod_EBPF *)mod->data;
+    EBPFDev *dev;
+    UTARRAY_WALK(mdata->devs, dev) {
+      if(!dev->open)
+	continue;
+      union bpf_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.map_fd = mdata->dropsFd;
+      attr.key = (uintptr_t)&dev->slot;
+      attr.value = (uintptr_t)mdata->dropsBuf;
+      if(sys_bpf(BPF_MAP_LOOKUP_ELEM, &attr) == 0) {
+	uint64_t total = 0;
+	for(uint32_t cpu = 0; cpu < mdata->nCPUs; cpu++)
+	  total += mdata->dropsBuf[cpu];
+	if(total > dev->dropsTotal) {
+	  myDebug(1, "EBPF: dev=%s ring full, drops +%"PRIu64, dev->deviceName, total - dev->dropsTotal);
+	  dev->drops += (uint32_t)(total - dev->dropsTotal);
+	  dev->dropsTotal = total;
+	}
+      }
+      // pick up any change from the adaptive sampling controller
+      if(dev->ctl) {
+	uint32_t rate = samplingCtlRate(dev->ctl);
+	if(rate != dev->samplingRate)
+	  changeSamplingRate(mod, dev, rate);
+      }
+    }
+  }
+
+  /*_________________---------------------------__________________
+    _________________     addEBPFDev            __________________
+    -----------------___________________________------------------
+  */
+
+  static void addEBPFDev(EVMod *mod, HSPEBPF *eb, SFLAdaptor *adaptor) {
+    HSP_mod_EBPF *mdata = (HSP_mod_EBPF *)mod->data;
+    myDebug(1, "EBPF addEBPFDev(%s) speed=%"PRIu64, adaptor->deviceName, adaptor->ifSpeed);
+    // slots are not re-used, so the drop counters stay with one device
+    if(UTArrayN(mdata->devs) >= HSP_EBPF_MAX_DEVS) {
+      myLog(LOG_ERR, "EBPF: too many devices (max=%u), not sampling %s", HSP_EBPF_MAX_DEVS, adaptor->deviceName);
+      return;
+    }
+    EBPFDev *dev = (EBPFDev *)my_calloc(sizeof(EBPFDev));
+    dev->slot = UTArrayAdd(mdata->devs, dev);
+    dev->adaptor = adaptor;
+    dev->deviceName = my_strdup(adaptor->deviceName);
+    dev->ifIndex = adaptor->ifIndex;
+    dev->xdp = eb->xdp;
+    dev->vport = eb->vport;
+    dev->vport_set = eb->vport_set;
+    for(EnumEBPFHook hook = 0; hook < EBPF_HOOK_N; hook++)
+      dev->progFd[hook] = -1;
+    dev_open(mod, dev);
+  }
+
+  /*_________________---------------------------__________________
+    _________________    evt_config_first        __________________
+    -----------------___________________________------------------
+  */
+
+  static void evt_config_first(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    if(!openRing(mod))
+      return;
+    for(HSPEBPF *eb = sp->ebpf.ebpfs; eb; eb = eb->nxt) {
+      if(eb->dev) {
+	SFLAdaptor *adaptor = adaptorByName(sp, eb->dev);
+	if(adaptor == NULL) {
+	  myLog(LOG_ERR, "EBPF: device %s not found", eb->dev);
+	  continue;
+	}
+	addEBPFDev(mod, eb, adaptor);
+      }
+      else if(eb->speed_set) {
+	SFLAdaptor *adaptor;
+	UTHASH_WALK(sp->adaptorsByName, adaptor) {
+	  if((adaptor->ifSpeed == eb->speed_min && eb->speed_max == 0)
+	     || (adaptor->ifSpeed >= eb->speed_min
+		 && adaptor->ifSpeed <= eb->speed_max)) {
+	    // same tests as mod_pcap
+	    HSPAdaptorNIO *nio = (HSPAdaptorNIO *)adaptor->userData;
+	    if(nio->bond_master) {
+	      myDebug(1, "not %s (bond_master)", adaptor->deviceName);
+	    }
+	    else if(nio->vlan != HSP_VLAN_ALL) {
+	      myDebug(1, "not %s (vlan=%u)", adaptor->deviceName, nio->vlan);
+	    }
+	    else if(nio->devType != HSPDEV_PHYSICAL
+		    && nio->devType != HSPDEV_OTHER) {
+	      myDebug(1, "not %s (devType=%s)",
+		      adaptor->deviceName,
+		      devTypeName(nio->devType));
+	    }
+	    else {
+	      addEBPFDev(mod, eb, adaptor);
+	    }
+	  }
+	}
+      }
+    }
+  }
+
+  /*_________________---------------------------__________________
+    _________________    evt_intfs_changed      __________________
+    -----------------___________________________------------------
+  */
+
+  static void evt_intfs_changed(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    HSP_mod_EBPF *mdata = (HSP_mod_EBPF *)mod->data;
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    EBPFDev *dev;
+    UTARRAY_WALK(mdata->devs, dev) {
+      if(dev->open
+	 && adaptorByName(sp, dev->deviceName) == NULL) {
+	// no longer found - the kernel took the programs off with it
+	dev_close(mod, dev, YES);
+      }
+    }
+  }
+
+  /*_________________---------------------------__________________
+    _________________    evt_final              __________________
+    -----------------___________________________------------------
+    Graceful shutdown - take our programs off the devices.
+  */
+
+  static void evt_final(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    HSP_mod_EBPF *mdata = (HSP_mod_EBPF *)mod->data;
+    EBPFDev *dev;
+    UTARRAY_WALK(mdata->devs, dev) {
+      if(dev->open)
+	dev_close(mod, dev, NO);
+    }
+  }
+
+  /*_________________---------------------------__________________
+    _________________    module init            __________________
+    -----------------___________________________------------------
+  */
+
+  void mod_ebpf(EVMod *mod) {
+    mod->data = my_calloc(sizeof(HSP_mod_EBPF));
+    HSP_mod_EBPF *mdata = (HSP_mod_EBPF *)mod->data;
+    mdata->packetBus = EVGetBus(mod, HSPBUS_PACKET, YES);
+    mdata->devs = UTArrayNew(UTARRAY_DFLT);
+    mdata->ringFd = -1;
+    mdata->dropsFd = -1;
+    retainRootRequest(mod, "needed by mod_ebpf to swap and detach tc/XDP programs");
+    // register call-backs
+    EVEventRx(mod, EVGetEvent(mdata->packetBus, HSPEVENT_CONFIG_FIRST), evt_config_first);
+    EVEventRx(mod, EVGetEvent(mdata->packetBus, HSPEVENT_INTFS_CHANGED), evt_intfs_changed);
+    EVEventRx(mod, EVGetEvent(mdata->packetBus, EVEVENT_TICK), evt_tick);
+    EVEventRx(mod, EVGetEvent(mdata->packetBus, EVEVENT_FINAL), evt_final);
+  }
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif
@@ -9,8 +9,10 @@ extern "C" {
 #include "hsflowd.h"
 
 #include "cJSON.h"
+#include <math.h> // for pow()
 #define HSP_MAX_JSON_MSG_BYTES 10000
 #define HSP_READJSON_BATCH 100
+#define HSP_JSON_RECVMMSG_MAX 32
 #define HSP_JSON_RCV_BUF 2000000
 
   typedef enum {
@@ -60,45 +62,93 @@ extern "C" {
     SFLCounters_sample_element counters;
   } HSPApplication;
 
+  // The fast path indexes each object it looks into,  and copies the
+  // strings it picks out of the message text,  '\0'-terminated.  Both
+  // last until the next message.  A member takes at least 4 bytes of
+  // text,  so neither can run out.
+#define HSP_JSON_MAX_MEMBERS (HSP_MAX_JSON_MSG_BYTES / 4)
+
+  typedef struct {
+    char *key;
+    uint32_t keyLen;
+    int type;
+    char *val;
+    char *str;
+    uint32_t len;
+    double num;
+  } HSPJSONMember;
+
+  typedef struct {
+    HSPJSONMember members[HSP_JSON_MAX_MEMBERS];
+    uint32_t membersUsed;
+    char strs[HSP_MAX_JSON_MSG_BYTES];
+    uint32_t strsUsed;
+  } HSPJSONScratch;
+
   typedef struct _HSP_mod_JSON {
     EVBus *pollBus;
     EVBus *packetBus;
     int json_soc;
     int json_soc6;
     int json_fifo;
+    UTRecvBatch *json_rb;
+    UTRecvBatch *json_rb6;
     UTHash *applicationHT;
     UTQ(HSPApplication) timeoutQ;
     UTArray *pollActions;
     time_t next_app_timeout_check;
+    HSPJSONScratch scratch;
   } HSP_mod_JSON;
 
+  /*_________________---------------------------__________________
+    _________________     JSON items            __________________
+    -----------------___________________________------------------
+    flow_sample and counter_sample messages are read through these,
+    so that the same code works on a cJSON tree or,  via jsonFastPath,
+    straight from the message text.  An item that was not found has
+    type 0.  As with cJSON,  str is NULL unless the item is a string.
+  */
+
+  typedef struct {
+    int type;       // cJSON_String, cJSON_Number, cJSON_Object ...
+    cJSON *cj;      // from cJSON_Parse(),  or
+    char *txt;      // the value in the message text
+    HSPJSONScratch *scratch;
+    HSPJSONMember *members;
+    uint32_t nMembers;
+    double num;
+    char *str;
+  } HSPJSONItem;
+
+  static bool json_item(HSPJSONItem *obj, const char *fieldName, HSPJSONItem *item, bool wantStr);
+
   /*_________________---------------------------__________________
     _________________  int counters and gauges  __________________
     -----------------___________________________------------------
     Avoid cJSON->valueint, because it is limited to INT_MAX in the
     cJSON library, which is only 2^31 on Linux,  even on 64-bit architectures.
   */
-  static uint16_t json_uint16(cJSON *cj, const char *fieldName) {
-    cJSON *field = cJSON_GetObjectItem(cj, fieldName);
-    return field ? (uint16_t)field->valuedouble : 0;
+  static uint16_t json_uint16(HSPJSONItem *obj, const char *fieldName) {
+    HSPJSONItem field;
+    return json_item(obj, fieldName, &field, NO) ? (uint16_t)field.num : 0;
   }
-  static uint32_t json_uint32(cJSON *cj, const char *fieldName) {
-    cJSON *field = cJSON_GetObjectItem(cj, fieldName);
-    return field ? (uint32_t)field->valuedouble : 0;
+  static uint32_t json_uint32(HSPJSONItem *obj, const char *fieldName) {
+    HSPJSONItem field;
+    return json_item(obj, fieldName, &field, NO) ? (uint32_t)field.num : 0;
   }
-  static uint64_t json_uint64(cJSON *cj, const char *fieldName) {
-    cJSON *field = cJSON_GetObjectItem(cj, fieldName);
-    return field ? (uint64_t)field->valuedouble : 0;
+  static uint64_t json_uint64(HSPJSONItem *obj, const char *fieldName) {
+    HSPJSONItem field;
+    return json_item(obj, fieldName, &field, NO) ? (uint64_t)field.num : 0;
   }
-  static uint32_t json_gauge32(cJSON *cj, const char *fieldName) {
-    return json_uint32(cj, fieldName);
+  static uint32_t json_gauge32(HSPJSONItem *obj, const char *fieldName) {
+    return json_uint32(obj, fieldName);
   }
-  static uint64_t json_gauge64(cJSON *cj, const char *fieldName) {
-    return json_uint64(cj, fieldName);
+  static uint64_t json_gauge64(HSPJSONItem *obj, const char *fieldName) {
+    return json_uint64(obj, fieldName);
   }
-  static uint32_t json_counter32(cJSON *cj, const char *fieldName) {
-    cJSON *field = cJSON_GetObjectItem(cj, fieldName);
-    return field ? (uint32_t)field->valuedouble : (uint32_t)-1;
+  static uint32_t json_counter32(HSPJSONItem *obj, const char *fieldName) {
+    HSPJSONItem field;
+    return json_item(obj, fieldName, &field, NO) ? (uint32_t)field.num : (uint32_t)-1;
   }
 
   /*_________________---------------------------__________________
@@ -432,30 +482,30 @@ extern "C" {
     -----------------___________________________------------------
   */
 
-static void readJSON_flowSample(EVMod *mod, cJSON *fs)
+static void readJSON_flowSample(EVMod *mod, HSPJSONItem *fs)
   {
     HSP_mod_JSON *mdata = (HSP_mod_JSON *)mod->data;
     HSP *sp = (HSP *)EVROOTDATA(mod);
 
-    if(getDebug() > 1) logJSON(fs, "got flow sample");
-    cJSON *app = cJSON_GetObjectItem(fs, "app_name");
+    if(getDebug() > 1 && fs->cj) logJSON(fs->cj, "got flow sample");
+    HSPJSONItem app, as_client;
+    json_item(fs, "app_name", &app, YES);
     uint16_t service_port = json_uint16(fs, "service_port");
-    cJSON *as_client = cJSON_GetObjectItem(fs, "client");
+    json_item(fs, "client", &as_client, NO);
     uint32_t sampling_n = json_uint32(fs, "sampling_rate");
     if(sampling_n == 0) sampling_n = 1;
 
-    if(app) {
-      HSPApplication *application = getApplication(mod, app->valuestring, service_port);
+    if(app.type) {
+      HSPApplication *application = getApplication(mod, app.str, service_port);
       if(application) {
 	// remember that we heard from this application
 	application->last_json = mdata->packetBus->now.tv_sec;
 
-	cJSON *opn = cJSON_GetObjectItem(fs, "app_operation");
-	if(opn) {
+	HSPJSONItem opn, sts;
+	if(json_item(fs, "app_operation", &opn, NO)) {
 	  EnumSFLAPPStatus status = SFLAPP_SUCCESS;
-	  cJSON *sts = cJSON_GetObjectItem(opn, "status");
-	  if(sts) {
-	    status = (EnumSFLAPPStatus)json_uint32(opn, "status");
+	  if(json_item(&opn, "status", &sts, NO)) {
+	    status = (EnumSFLAPPStatus)json_uint32(&opn, "status");
 	    if((u_int)status > (u_int)SFLAPP_UNAUTHORIZED) {
 	      status = SFLAPP_OTHER;
 	    }
@@ -479,82 +529,78 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
 	    // sample this one
 
 	    // extract operation fields
-	    cJSON *operation = cJSON_GetObjectItem(opn, "operation");
-	    cJSON *attributes = cJSON_GetObjectItem(opn, "attributes");
-	    cJSON *status_descr = cJSON_GetObjectItem(opn, "status_descr");
+	    HSPJSONItem operation, attributes, status_descr;
+	    json_item(&opn, "operation", &operation, YES);
+	    json_item(&opn, "attributes", &attributes, YES);
+	    json_item(&opn, "status_descr", &status_descr, YES);
 
-	    uint64_t req_bytes = json_gauge64(opn, "req_bytes");
-	    uint64_t resp_bytes = json_gauge64(opn, "resp_bytes");
-	    uint32_t uS = json_gauge32(opn, "uS");
+	    uint64_t req_bytes = json_gauge64(&opn, "req_bytes");
+	    uint64_t resp_bytes = json_gauge64(&opn, "resp_bytes");
+	    uint32_t uS = json_gauge32(&opn, "uS");
 
 	    // optional fields: parent context
 	    char *parent_app = NULL;
 	    char *parent_operation = NULL;
 	    char *parent_attributes = NULL;
-	    cJSON *parent_context = cJSON_GetObjectItem(fs, "app_parent_context");
-	    if(parent_context) {
-	      cJSON *p_app = cJSON_GetObjectItem(parent_context, "application");
-	      if(p_app) parent_app = p_app->valuestring;
-	      cJSON *p_op = cJSON_GetObjectItem(parent_context, "operation");
-	      if(p_op) parent_operation = p_op->valuestring;
-	      cJSON *p_attrib = cJSON_GetObjectItem(parent_context, "attributes");
-	      if(p_attrib) parent_attributes = p_attrib->valuestring;
+	    HSPJSONItem parent_context;
+	    if(json_item(fs, "app_parent_context", &parent_context, NO)) {
+	      HSPJSONItem p_app, p_op, p_attrib;
+	      if(json_item(&parent_context, "application", &p_app, YES)) parent_app = p_app.str;
+	      if(json_item(&parent_context, "operation", &p_op, YES)) parent_operation = p_op.str;
+	      if(json_item(&parent_context, "attributes", &p_attrib, YES)) parent_attributes = p_attrib.str;
 	    }
 
 	    // optional fields: actors
 	    char *actor_initiator = NULL;
 	    char *actor_target = NULL;
-	    cJSON *app_initiator = cJSON_GetObjectItem(fs, "app_initiator");
-	    if(app_initiator) {
-	      cJSON *ai = cJSON_GetObjectItem(app_initiator, "actor");
-	      if(ai) actor_initiator = ai->valuestring;
+	    HSPJSONItem app_initiator, app_target;
+	    if(json_item(fs, "app_initiator", &app_initiator, NO)) {
+	      HSPJSONItem ai;
+	      if(json_item(&app_initiator, "actor", &ai, YES)) actor_initiator = ai.str;
 	    }
-	    cJSON *app_target = cJSON_GetObjectItem(fs, "app_target");
-	    if(app_target) {
-	      cJSON *at = cJSON_GetObjectItem(app_target, "actor");
-	      if(at) actor_target = at->valuestring;
+	    if(json_item(fs, "app_target", &app_target, NO)) {
+	      HSPJSONItem at;
+	      if(json_item(&app_target, "actor", &at, YES)) actor_target = at.str;
 	    }
 
 	    // optional fields: sockets
 	    SFLExtended_socket_ipv4 soc4 = {  0 };
-	    cJSON *extended_socket_ipv4 = cJSON_GetObjectItem(fs, "extended_socket_ipv4");
-	    if(extended_socket_ipv4) {
-	      soc4.protocol = json_uint32(extended_socket_ipv4, "protocol");
-	      soc4.local_port = json_uint32(extended_socket_ipv4, "local_port");
-	      soc4.remote_port = json_uint32(extended_socket_ipv4, "remote_port");
-	      cJSON *local_ip = cJSON_GetObjectItem(extended_socket_ipv4, "local_ip");
-	      if(local_ip && my_strlen(local_ip->valuestring)) {
+	    HSPJSONItem extended_socket_ipv4;
+	    if(json_item(fs, "extended_socket_ipv4", &extended_socket_ipv4, NO)) {
+	      soc4.protocol = json_uint32(&extended_socket_ipv4, "protocol");
+	      soc4.local_port = json_uint32(&extended_socket_ipv4, "local_port");
+	      soc4.remote_port = json_uint32(&extended_socket_ipv4, "remote_port");
+	      HSPJSONItem local_ip, remote_ip;
+	      if(json_item(&extended_socket_ipv4, "local_ip", &local_ip, YES) && my_strlen(local_ip.str)) {
 		SFLAddress addr = { 0 };
-		if(parseNumericAddress(local_ip->valuestring, NULL, &addr, PF_INET)) {
+		if(parseNumericAddress(local_ip.str, NULL, &addr, PF_INET)) {
 		  soc4.local_ip = addr.address.ip_v4;
 		}
 	      }
-	      cJSON *remote_ip = cJSON_GetObjectItem(extended_socket_ipv4, "remote_ip");
-	      if(remote_ip && my_strlen(remote_ip->valuestring)) {
+	      if(json_item(&extended_socket_ipv4, "remote_ip", &remote_ip, YES) && my_strlen(remote_ip.str)) {
 		SFLAddress addr = { 0 };
-		if(parseNumericAddress(remote_ip->valuestring, NULL, &addr, PF_INET)) {
+		if(parseNumericAddress(remote_ip.str, NULL, &addr, PF_INET)) {
 		  soc4.remote_ip = addr.address.ip_v4;
 		}
 	      }
 	    }
 
 	    SFLExtended_socket_ipv6 soc6 = {  0 };
-	    cJSON *extended_socket_ipv6 = cJSON_GetObjectItem(fs, "extended_socket_ipv6");
-	    if(extended_socket_ipv6) {
-	      soc6.protocol = json_uint32(extended_socket_ipv6, "protocol");
-	      soc6.local_port = json_uint32(extended_socket_ipv6, "local_port");
-	      soc6.remote_port = json_uint32(extended_socket_ipv6, "remote_port");
-	      cJSON *local_ip = cJSON_GetObjectItem(extended_socket_ipv6, "local_ip");
-	      if(local_ip && my_strlen(local_ip->valuestring)) {
+	    HSPJSONItem extended_socket_ipv6;
+	    if(json_item(fs, "extended_socket_ipv6", &extended_socket_ipv6, NO)) {
+	      soc6.protocol = json_uint32(&extended_socket_ipv6, "protocol");
+	      soc6.local_port = json_uint32(&extended_socket_ipv6, "local_port");
+	      soc6.remote_port = json_uint32(&extended_socket_ipv6, "remote_port");
+	      HSPJSONItem local_ip, remote_ip;
+	      if(json_item(&extended_socket_ipv6, "local_ip", &local_ip, YES) && my_strlen(local_ip.str)) {
 		SFLAddress addr = { 0 };
-		if(parseNumericAddress(local_ip->valuestring, NULL, &addr, PF_INET6)) {
+		if(parseNumericAddress(local_ip.str, NULL, &addr, PF_INET6)) {
 		  soc6.local_ip = addr.address.ip_v6;
 		}
 	      }
-	      cJSON *remote_ip = cJSON_GetObjectItem(extended_socket_ipv6, "remote_ip");
-	      if(remote_ip && my_strlen(remote_ip->valuestring)) {
+	      if(json_item(&extended_socket_ipv6, "remote_ip", &remote_ip, YES) && my_strlen(remote_ip.str)) {
 		SFLAddress addr = { 0 };
-		if(parseNumericAddress(remote_ip->valuestring, NULL, &addr, PF_INET6)) {
+		if(parseNumericAddress(remote_ip.str, NULL, &addr, PF_INET6)) {
 		  soc6.remote_ip = addr.address.ip_v6;
 		}
 	      }
@@ -564,10 +610,10 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
 	    sendAppSample(sp,
 			  application,
 			  effective_sampling_n,
-			  as_client ? (as_client->type == cJSON_True) : NO,
-			  operation ? operation->valuestring : NULL,
-			  attributes ? attributes->valuestring : NULL,
-			  status_descr ? status_descr->valuestring : NULL,
+			  (as_client.type == cJSON_True),
+			  operation.str,
+			  attributes.str,
+			  status_descr.str,
 			  status,
 			  req_bytes,
 			  resp_bytes,
@@ -577,8 +623,8 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
 			  parent_attributes,
 			  actor_initiator,
 			  actor_target,
-			  extended_socket_ipv4 ? &soc4 : NULL,
-			  extended_socket_ipv6 ? &soc6 : NULL);
+			  extended_socket_ipv4.type ? &soc4 : NULL,
+			  extended_socket_ipv6.type ? &soc6 : NULL);
 	  }
 	}
       }
@@ -590,16 +636,17 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
     -----------------___________________________------------------
   */
 
-  static void readJSON_counterSample(EVMod *mod, cJSON *cs)
+  static void readJSON_counterSample(EVMod *mod, HSPJSONItem *cs)
   {
     HSP_mod_JSON *mdata = (HSP_mod_JSON *)mod->data;
     HSP *sp = (HSP *)EVROOTDATA(mod);
 
-    if(getDebug() > 1) logJSON(cs, "got counter sample");
-    cJSON *app_name = cJSON_GetObjectItem(cs, "app_name");
+    if(getDebug() > 1 && cs->cj) logJSON(cs->cj, "got counter sample");
+    HSPJSONItem app_name;
+    json_item(cs, "app_name", &app_name, YES);
     uint16_t service_port = json_uint16(cs, "service_port");
-    if(app_name) {
-      HSPApplication *application = getApplication(mod, app_name->valuestring, service_port);
+    if(app_name.type) {
+      HSPApplication *application = getApplication(mod, app_name.str, service_port);
       if(application) {
 	// remember that we heard from this application
 	application->last_json = mdata->packetBus->now.tv_sec;
@@ -609,8 +656,8 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
 	SFL_COUNTERS_SAMPLE_TYPE csample = { 0 };
 	// app_operations
 	SFLCounters_sample_element c_ops = { 0 };
-	cJSON *ops = cJSON_GetObjectItem(cs, "app_operations");
-	int json_ops = (ops != NULL);
+	HSPJSONItem ops;
+	int json_ops = json_item(cs, "app_operations", &ops, NO);
 	if(json_ops != application->json_ops_counters) {
 	  // policy transisition - reset seq nos
 	  sfl_poller_resetCountersSeqNo(application->poller);
@@ -619,19 +666,19 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
 
 	if(json_ops) {
 	  c_ops.tag = SFLCOUNTERS_APP;
-	  c_ops.counterBlock.app.application.str = app_name->valuestring;
-	  c_ops.counterBlock.app.application.len = my_strnlen(app_name->valuestring, SFLAPP_MAX_APPLICATION_LEN);
-	  c_ops.counterBlock.app.status_OK = json_counter32(ops, "success");
-	  c_ops.counterBlock.app.errors_OTHER = json_counter32(ops, "other");
-	  c_ops.counterBlock.app.errors_TIMEOUT = json_counter32(ops, "timeout");
-	  c_ops.counterBlock.app.errors_INTERNAL_ERROR = json_counter32(ops, "internal_error");
-	  c_ops.counterBlock.app.errors_BAD_REQUEST = json_counter32(ops, "bad_request");
-	  c_ops.counterBlock.app.errors_FORBIDDEN = json_counter32(ops, "forbidden");
-	  c_ops.counterBlock.app.errors_TOO_LARGE = json_counter32(ops, "too_large");
-	  c_ops.counterBlock.app.errors_NOT_IMPLEMENTED = json_counter32(ops, "not_implemented");
-	  c_ops.counterBlock.app.errors_NOT_FOUND = json_counter32(ops, "not_found");
-	  c_ops.counterBlock.app.errors_UNAVAILABLE = json_counter32(ops, "unavailable");
-	  c_ops.counterBlock.app.errors_UNAUTHORIZED = json_counter32(ops, "unauthorized");
+	  c_ops.counterBlock.app.application.str = app_name.str;
+	  c_ops.counterBlock.app.application.len = my_strnlen(app_name.str, SFLAPP_MAX_APPLICATION_LEN);
+	  c_ops.counterBlock.app.status_OK = json_counter32(&ops, "success");
+	  c_ops.counterBlock.app.errors_OTHER = json_counter32(&ops, "other");
+	  c_ops.counterBlock.app.errors_TIMEOUT = json_counter32(&ops, "timeout");
+	  c_ops.counterBlock.app.errors_INTERNAL_ERROR = json_counter32(&ops, "internal_error");
+	  c_ops.counterBlock.app.errors_BAD_REQUEST = json_counter32(&ops, "bad_request");
+	  c_ops.counterBlock.app.errors_FORBIDDEN = json_counter32(&ops, "forbidden");
+	  c_ops.counterBlock.app.errors_TOO_LARGE = json_counter32(&ops, "too_large");
+	  c_ops.counterBlock.app.errors_NOT_IMPLEMENTED = json_counter32(&ops, "not_implemented");
+	  c_ops.counterBlock.app.errors_NOT_FOUND = json_counter32(&ops, "not_found");
+	  c_ops.counterBlock.app.errors_UNAVAILABLE = json_counter32(&ops, "unavailable");
+	  c_ops.counterBlock.app.errors_UNAUTHORIZED = json_counter32(&ops, "unauthorized");
 	  SFLADD_ELEMENT(&csample, &c_ops);
 	}
 	else {
@@ -641,30 +688,30 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
 
 	// app_resources
 	SFLCounters_sample_element c_res = { 0 };
-	cJSON *res = cJSON_GetObjectItem(cs, "app_resources");
-	if(res) {
+	HSPJSONItem res;
+	if(json_item(cs, "app_resources", &res, NO)) {
 	  c_res.tag = SFLCOUNTERS_APP_RESOURCES;
-	  c_res.counterBlock.appResources.user_time = json_gauge32(res, "user_time");
-	  c_res.counterBlock.appResources.system_time = json_gauge32(res, "system_time");
-	  c_res.counterBlock.appResources.mem_used = json_gauge64(res, "mem_used");
-	  c_res.counterBlock.appResources.mem_max = json_gauge64(res, "mem_max");
-	  c_res.counterBlock.appResources.fd_open = json_gauge32(res, "fd_open");
-	  c_res.counterBlock.appResources.fd_max = json_gauge32(res, "fd_max");
-	  c_res.counterBlock.appResources.conn_open = json_gauge32(res, "conn_open");
-	  c_res.counterBlock.appResources.conn_max = json_gauge32(res, "conn_max");
+	  c_res.counterBlock.appResources.user_time = json_gauge32(&res, "user_time");
+	  c_res.counterBlock.appResources.system_time = json_gauge32(&res, "system_time");
+	  c_res.counterBlock.appResources.mem_used = json_gauge64(&res, "mem_used");
+	  c_res.counterBlock.appResources.mem_max = json_gauge64(&res, "mem_max");
+	  c_res.counterBlock.appResources.fd_open = json_gauge32(&res, "fd_open");
+	  c_res.counterBlock.appResources.fd_max = json_gauge32(&res, "fd_max");
+	  c_res.counterBlock.appResources.conn_open = json_gauge32(&res, "conn_open");
+	  c_res.counterBlock.appResources.conn_max = json_gauge32(&res, "conn_max");
 	  SFLADD_ELEMENT(&csample, &c_res);
 	}
 
 	// app_workers
 	SFLCounters_sample_element c_wrk = { 0 };
-	cJSON *wrk = cJSON_GetObjectItem(cs, "app_workers");
-	if(wrk) {
+	HSPJSONItem wrk;
+	if(json_item(cs, "app_workers", &wrk, NO)) {
 	  c_wrk.tag = SFLCOUNTERS_APP_WORKERS;
-	  c_wrk.counterBlock.appWorkers.workers_active = json_gauge32(wrk, "workers_active");
-	  c_wrk.counterBlock.appWorkers.workers_idle = json_gauge32(wrk, "workers_idle");
-	  c_wrk.counterBlock.appWorkers.workers_max = json_gauge32(wrk, "workers_max");
-	  c_wrk.counterBlock.appWorkers.req_delayed = json_counter32(wrk, "req_delayed");
-	  c_wrk.counterBlock.appWorkers.req_dropped = json_counter32(wrk, "req_dropped");
+	  c_wrk.counterBlock.appWorkers.workers_active = json_gauge32(&wrk, "workers_active");
+	  c_wrk.counterBlock.appWorkers.workers_idle = json_gauge32(&wrk, "workers_idle");
+	  c_wrk.counterBlock.appWorkers.workers_max = json_gauge32(&wrk, "workers_max");
+	  c_wrk.counterBlock.appWorkers.req_delayed = json_counter32(&wrk, "req_delayed");
+	  c_wrk.counterBlock.appWorkers.req_dropped = json_counter32(&wrk, "req_dropped");
 	  SFLADD_ELEMENT(&csample, &c_wrk);
 	}
 
@@ -739,6 +786,34 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
     xdr_enc_bytes(buf, (u_char *)str, len);
   }
 
+  /*_________________---------------------------__________________
+    _________________     JSON field values     __________________
+    -----------------___________________________------------------
+    A field value comes from either a cJSON node or directly from the
+    message text (see jsonFastPath).  In the second case the string is
+    not '\0'-terminated.
+  */
+
+  typedef struct {
+    int type; // cJSON_String, cJSON_Number or 0
+    char *str;
+    uint32_t len;
+    double num;
+  } HSPJSONVal;
+
+  static void cjson_val(cJSON *field, HSPJSONVal *val) {
+    memset(val, 0, sizeof(*val));
+    if(field->type == cJSON_String) {
+      val->type = cJSON_String;
+      val->str = field->valuestring;
+      val->len = my_strlen(field->valuestring);
+    }
+    else if(field->type == cJSON_Number) {
+      val->type = cJSON_Number;
+      val->num = field->valuedouble;
+    }
+  }
+
   /*_________________---------------------------__________________
     _________________    rtmetric types         __________________
     -----------------___________________________------------------
@@ -755,7 +830,7 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
     return -1;
   }
 
-  static void xdr_enc_metric(XDRBuf *buf, char *mname, uint32_t mname_len, int mtype, cJSON *field, uint32_t field_len)
+  static void xdr_enc_metric(XDRBuf *buf, char *mname, uint32_t mname_len, int mtype, HSPJSONVal *field)
   {
     xdr_enc_str(buf, mname, mname_len);
     xdr_enc_int32(buf, mtype);
@@ -766,7 +841,7 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
       uint64_t val64;
       float valf;
       double vald;
-      char *instr = field->valuestring;
+      char *instr = field->str;
       // string input
       switch(mtype) {
       case RTMetricType_counter32:
@@ -788,14 +863,14 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
 	xdr_enc_dbl(buf, vald);
       break;
       case RTMetricType_string:
-	xdr_enc_str(buf, instr, field_len);
+	xdr_enc_str(buf, instr, field->len);
       break;
       }
     }
     else if(field->type == cJSON_Number) {
       // numeric input - only certain types expressible
       // because JSON only offers number as type==double
-      double indbl = field->valuedouble;
+      double indbl = field->num;
       switch(mtype) {
       case RTMetricType_counter32:
       case RTMetricType_gauge32:
@@ -821,10 +896,11 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
    combine the length-test of the key with a test for validity
   */
 
-  static uint32_t rtmetric_len_ok(char *str) {
+  static uint32_t rtmetric_len_ok_n(char *str, uint32_t max) {
     uint32_t len = 0;
     int ch;
-    while((ch = str[len]) != '\0') {
+    while(len < max
+	  && (ch = str[len]) != '\0') {
       if(ch != '-' &&
 	 ch != '_' &&
 	 !isalnum(ch)) {
@@ -839,6 +915,10 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
     return len;
   }
 
+  static uint32_t rtmetric_len_ok(char *str) {
+    return rtmetric_len_ok_n(str, UINT_MAX);
+  }
+
   /*_________________---------------------------__________________
     _________________    dsname_len_ok          __________________
     -----------------___________________________------------------
@@ -846,10 +926,34 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
    with a digit (to distinguish it from numeric sFlow datasources).
   */
 
-  static uint32_t dsname_len_ok(char *str) {
-    if(isdigit(str[0]))
+  static uint32_t dsname_len_ok_n(char *str, uint32_t max) {
+    if(max == 0
+       || isdigit(str[0]))
       return 0;
-    return rtmetric_len_ok(str);
+    return rtmetric_len_ok_n(str, max);
+  }
+
+  static uint32_t dsname_len_ok(char *str) {
+    return dsname_len_ok_n(str, UINT_MAX);
+  }
+
+  /*_________________---------------------------__________________
+    _________________     writeEncoded          __________________
+    -----------------___________________________------------------
+    rtmetric and rtflow samples are already XDR-encoded.  They are not
+    tied to a sampler or poller, so they go straight to the receiver.
+  */
+
+  static void writeEncoded(EVMod *mod, XDRBuf *buf, EnumHSPTelemetry ctr)
+  {
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    SEMLOCK_DO(sp->sync_agent) {
+      sfl_receiver_writeEncoded(sp->agent->receivers,
+				1,
+				buf->xdr,
+				(buf->cursor << 2));
+    }
+    HSP_TELEMETRY_ADD(sp, ctr, 1);
   }
 
   /*_________________---------------------------__________________
@@ -868,15 +972,8 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
 
   static void readJSON_rtmetric(EVMod *mod, cJSON *rtmetric)
   {
-    // HSP_mod_JSON *mdata = (HSP_mod_JSON *)mod->data;
-    HSP *sp = (HSP *)EVROOTDATA(mod);
-
     if(getDebug() > 1) logJSON(rtmetric, "got rtmetric");
 
-    SFLReceiver *receiver = sp->agent->receivers;
-    if(receiver == NULL)
-      return;
-
     XDRBuf buf;
     xdr_init(&buf);
     uint32_t num_fields = 0;
@@ -923,21 +1020,18 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
       }
 
       cJSON *field = cJSON_GetObjectItem(rtm, "value");
-      uint32_t field_len = sizeof(double);
-
       if(field == NULL) {
 	myDebug(1, "rtmetric missing \"value\"");
 	return; // bail on missing value
       }
-      if(field->type == cJSON_String) {
-	field_len = my_strlen(field->valuestring);
-	if(field_len > HSP_MAX_RTMETRIC_VAL_LEN) {
-	  myDebug(1, "rtmetric field %s len(%u) > max(%u)",
+      HSPJSONVal val;
+      cjson_val(field, &val);
+      if(val.len > HSP_MAX_RTMETRIC_VAL_LEN) {
+	myDebug(1, "rtmetric field %s len(%u) > max(%u)",
 		rtm->string,
-		field_len,
-		  HSP_MAX_RTMETRIC_VAL_LEN);
-	  return; // bail on field len error
-	}
+		val.len,
+		HSP_MAX_RTMETRIC_VAL_LEN);
+	return; // bail on field len error
       }
 
       cJSON *field_type = cJSON_GetObjectItem(rtm, "type");
@@ -953,20 +1047,14 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
       }
 
       num_fields++;
-      xdr_enc_metric(&buf, rtm->string, mname_len, rtmType, field, field_len);
+      xdr_enc_metric(&buf, rtm->string, mname_len, rtmType, &val);
     }
 
     if(num_fields) {
       uint32_t len = (char *)xdr_ptr(&buf) - (char *)mstart - 4;
       mstart[0] = htonl(len);
       fstart[0] = htonl(num_fields);
-      SEMLOCK_DO(sp->sync_agent) {
-	sfl_receiver_writeEncoded(receiver,
-				  1,
-				  buf.xdr,
-				  (buf.cursor << 2));
-	sp->telemetry[HSP_TELEMETRY_RTMETRIC_SAMPLES]++;
-      }
+      writeEncoded(mod, &buf, HSP_TELEMETRY_RTMETRIC_SAMPLES);
     }
   }
 
@@ -987,7 +1075,7 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
     return -1;
   }
 
-  static void xdr_enc_flow_field(XDRBuf *buf, char *mname, uint32_t mname_len, int mtype, cJSON *field, uint32_t field_len)
+  static void xdr_enc_flow_field(XDRBuf *buf, char *mname, uint32_t mname_len, int mtype, HSPJSONVal *field)
   {
     xdr_enc_str(buf, mname, mname_len);
     xdr_enc_int32(buf, mtype);
@@ -1000,18 +1088,27 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
       double vald;
       u_char mac[6];
       SFLAddress addr;
-      char *instr = field->valuestring;
+      char *instr = field->str;
+      // the MAC and IP parsers need a terminated string
+      char cstr[HSP_MAX_RTMETRIC_VAL_LEN + 1];
+      if(mtype == RTFlowType_mac
+	 || mtype == RTFlowType_ip
+	 || mtype == RTFlowType_ip6) {
+	memcpy(cstr, instr, field->len);
+	cstr[field->len] = '\0';
+	instr = cstr;
+      }
       // string input
       switch(mtype) {
       case RTFlowType_string:
-	xdr_enc_str(buf, instr, field_len);
+	xdr_enc_str(buf, instr, field->len);
       break;
       case RTFlowType_mac:
 	if(hexToBinary((u_char *)instr, mac, 6) == 6) {
 	  xdr_enc_bytes(buf, mac, 6);
 	}
 	else {
-	  if(getDebug()) logJSON(field, "failed to parse MAC address");
+	  myDebug(1, "failed to parse MAC address <%s>", instr);
 	}
 	break;
       case RTFlowType_ip:
@@ -1019,7 +1116,7 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
 	  xdr_enc_bytes(buf, (u_char *)&addr.address.ip_v4.addr, 4);
 	}
 	else {
-	  if(getDebug()) logJSON(field, "failed to parse IP address");
+	  myDebug(1, "failed to parse IP address <%s>", instr);
 	}
 	break;
       case RTFlowType_ip6:
@@ -1027,7 +1124,7 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
 	  xdr_enc_bytes(buf, (u_char *)&addr.address.ip_v6.addr, 16);
 	}
 	else {
-	  if(getDebug()) logJSON(field, "failed to parse IP address");
+	  myDebug(1, "failed to parse IP address <%s>", instr);
 	}
 	break;
       case RTFlowType_int32:
@@ -1050,7 +1147,7 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
     }
     else if(field->type == cJSON_Number) {
       // numeric input - only certain types expressible
-      double indbl = field->valuedouble;
+      double indbl = field->num;
       switch(mtype) {
       case RTFlowType_int32:
 	xdr_enc_int32(buf, (uint32_t)indbl);
@@ -1086,13 +1183,7 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
   */
 
   static void readJSON_rtflow(EVMod *mod, cJSON *rtflow) {
-    // HSP_mod_JSON *mdata = (HSP_mod_JSON *)mod->data;
-    HSP *sp = (HSP *)EVROOTDATA(mod);
-
     if(getDebug() > 1) logJSON(rtflow, "got rtflow");
-    SFLReceiver *receiver = sp->agent->receivers;
-    if(receiver == NULL)
-      return;
 
     XDRBuf buf;
     xdr_init(&buf);
@@ -1155,22 +1246,18 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
       }
 
       cJSON *field = cJSON_GetObjectItem(rtf, "value");
-      uint32_t field_len = sizeof(double);
-
       if(field == NULL) {
 	myDebug(1, "rtflow missing \"value\"");
 	return; // bail on missing value
       }
-
-      if(field->type == cJSON_String) {
-	field_len = my_strlen(field->valuestring);
-	if(field_len > HSP_MAX_RTMETRIC_VAL_LEN) {
-	  myDebug(1, "rtflow field %s len(%u) > max(%u)",
-		  rtf->string,
-		  field_len,
-		  HSP_MAX_RTMETRIC_VAL_LEN);
-	  return; // bail on field len error
-	}
+      HSPJSONVal val;
+      cjson_val(field, &val);
+      if(val.len > HSP_MAX_RTMETRIC_VAL_LEN) {
+	myDebug(1, "rtflow field %s len(%u) > max(%u)",
+		rtf->string,
+		val.len,
+		HSP_MAX_RTMETRIC_VAL_LEN);
+	return; // bail on field len error
       }
 
       cJSON *field_type = cJSON_GetObjectItem(rtf, "type");
@@ -1186,21 +1273,464 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
       }
 
       num_fields++;
-      xdr_enc_flow_field(&buf, rtf->string, fname_len, rtfType, field, field_len);
+      xdr_enc_flow_field(&buf, rtf->string, fname_len, rtfType, &val);
     }
 
     if(num_fields) {
       uint32_t len = (char *)xdr_ptr(&buf) - (char *)mstart - 4;
       mstart[0] = htonl(len);
       fstart[0] = htonl(num_fields);
-      SEMLOCK_DO(sp->sync_agent) {
-	sfl_receiver_writeEncoded(receiver,
-				  1,
-				  buf.xdr,
-				  (buf.cursor << 2));
-	sp->telemetry[HSP_TELEMETRY_RTFLOW_SAMPLES]++;
+      writeEncoded(mod, &buf, HSP_TELEMETRY_RTFLOW_SAMPLES);
+    }
+  }
+
+  /*_________________---------------------------__________________
+    _________________     JSON scanner          __________________
+    -----------------___________________________------------------
+    Just enough of a JSON tokenizer to walk messages in place, with
+    no allocation.  It follows cJSON_Parse()
+    closely (same whitespace rule, same number arithmetic) so that the
+    fast path encodes exactly what the cJSON path would have encoded.
+    Anything it is not sure about (escaped strings, deep nesting,
+    syntax errors) makes jsonFastPath() return NO, and the message is
+    parsed with cJSON instead.
+  */
+
+#define HSP_JSON_SCAN_MAX_DEPTH 16
+
+  typedef struct {
+    char *p;
+    bool error;
+  } HSPJSONScan;
+
+  static char *js_ws(HSPJSONScan *js) {
+    while(*js->p && (u_char)*js->p <= 32)
+      js->p++;
+    return js->p;
+  }
+
+  static bool js_expect(HSPJSONScan *js, char ch) {
+    if(*js_ws(js) != ch) {
+      js->error = YES;
+      return NO;
+    }
+    js->p++;
+    return YES;
+  }
+
+  static bool js_string(HSPJSONScan *js, char **str, uint32_t *len) {
+    if(*js_ws(js) != '\"') {
+      js->error = YES;
+      return NO;
+    }
+    char *start = ++js->p;
+    for(;;) {
+      char ch = *js->p;
+      if(ch == '\"')
+	break;
+      if(ch == '\0' || ch == '\\') {
+	// unterminated, or needs unescaping
+	js->error = YES;
+	return NO;
+      }
+      js->p++;
+    }
+    *str = start;
+    *len = js->p - start;
+    js->p++;
+    return YES;
+  }
+
+  static double js_number(HSPJSONScan *js) {
+    // same arithmetic as parse_number() in cJSON.c
+    char *num = js->p;
+    double n=0,sign=1,scale=0;int subscale=0,signsubscale=1;
+    if (*num=='-') sign=-1,num++;
+    if (*num=='0') num++;
+    if (*num>='1' && *num<='9') do n=(n*10.0)+(*num++ -'0'); while (*num>='0' && *num<='9');
+    if (*num=='.' && num[1]>='0' && num[1]<='9') {num++; do n=(n*10.0)+(*num++ -'0'),scale--; while (*num>='0' && *num<='9');}
+    if (*num=='e' || *num=='E') {
+      num++;if (*num=='+') num++; else if (*num=='-') signsubscale=-1,num++;
+      while (*num>='0' && *num<='9') subscale=(subscale*10)+(*num++ - '0');
+    }
+    js->p = num;
+    return sign*n*pow(10.0,(scale+subscale*signsubscale));
+  }
+
+  // read a scalar, or skip over anything else.  Returns the cJSON type.
+  static int js_value(HSPJSONScan *js, HSPJSONVal *val, int depth) {
+    if(val)
+      memset(val, 0, sizeof(*val));
+    char ch = *js_ws(js);
+    if(ch == '\"') {
+      char *str;
+      uint32_t len;
+      if(!js_string(js, &str, &len))
+	return 0;
+      if(val) {
+	val->type = cJSON_String;
+	val->str = str;
+	val->len = len;
+      }
+      return cJSON_String;
+    }
+    if(ch == '-' || (ch >= '0' && ch <= '9')) {
+      double num = js_number(js);
+      if(val) {
+	val->type = cJSON_Number;
+	val->num = num;
+      }
+      return cJSON_Number;
+    }
+    if(!strncmp(js->p, "null", 4)) { js->p += 4; return cJSON_NULL; }
+    if(!strncmp(js->p, "false", 5)) { js->p += 5; return cJSON_False; }
+    if(!strncmp(js->p, "true", 4)) { js->p += 4; return cJSON_True; }
+    if((ch == '{' || ch == '[')
+       && depth < HSP_JSON_SCAN_MAX_DEPTH) {
+      char close = (ch == '{') ? '}' : ']';
+      js->p++;
+      if(*js_ws(js) == close) {
+	js->p++;
+      }
+      else {
+	do {
+	  if(ch == '{') {
+	    char *key;
+	    uint32_t keyLen;
+	    if(!js_string(js, &key, &keyLen)
+	       || !js_expect(js, ':'))
+	      return 0;
+	  }
+	  js_value(js, NULL, depth + 1);
+	  if(js->error)
+	    return 0;
+	} while(*js_ws(js) == ',' && js->p++);
+	if(!js_expect(js, close))
+	  return 0;
+      }
+      return (ch == '{') ? cJSON_Object : cJSON_Array;
+    }
+    js->error = YES;
+    return 0;
+  }
+
+  // iterate over the members of an object, leaving js->p at each value
+  static bool js_member(HSPJSONScan *js, bool first, char **key, uint32_t *keyLen) {
+    if(first) {
+      if(!js_expect(js, '{'))
+	return NO;
+      if(*js_ws(js) == '}') {
+	js->p++;
+	return NO;
+      }
+    }
+    else {
+      if(*js_ws(js) == ',')
+	js->p++;
+      else {
+	js_expect(js, '}');
+	return NO;
+      }
+    }
+    return (js_string(js, key, keyLen)
+	    && js_expect(js, ':'));
+  }
+
+#define JS_KEY_IS(k, kl, s) ((kl) == sizeof(s) - 1 && !memcmp((k), (s), (kl)))
+#define JS_KEY_IS_CI(k, kl, s) ((kl) == sizeof(s) - 1 && !strncasecmp((k), (s), (kl)))
+
+  /*_________________---------------------------__________________
+    _________________     json_item             __________________
+    -----------------___________________________------------------
+    Look up a member of an object item,  ignoring case and taking the
+    first match,  like cJSON_GetObjectItem().  In the message text the
+    object is indexed on the first lookup,  so the readers do not
+    rescan it for every field,  and a string is only copied out when
+    wantStr is set.  The text was checked by jsonFastPath() before we
+    got here,  so a scanner error is not expected.
+  */
+
+  static bool json_index(HSPJSONItem *obj)
+  {
+    HSPJSONScratch *scratch = obj->scratch;
+    uint32_t start = scratch->membersUsed;
+    HSPJSONScan js = { .p = obj->txt };
+    char *key;
+    uint32_t keyLen;
+    for(bool first = YES; js_member(&js, first, &key, &keyLen); first = NO) {
+      if(scratch->membersUsed == HSP_JSON_MAX_MEMBERS) {
+	js.error = YES;
+	break;
       }
+      HSPJSONMember *mem = &scratch->members[scratch->membersUsed++];
+      HSPJSONVal jv;
+      mem->key = key;
+      mem->keyLen = keyLen;
+      mem->val = js_ws(&js);
+      mem->type = js_value(&js, &jv, 1);
+      mem->str = jv.str;
+      mem->len = jv.len;
+      mem->num = jv.num;
+      if(js.error)
+	break;
+    }
+    if(js.error) {
+      scratch->membersUsed = start;
+      return NO;
     }
+    obj->members = scratch->members + start;
+    obj->nMembers = scratch->membersUsed - start;
+    return YES;
+  }
+
+  static bool json_item(HSPJSONItem *obj, const char *fieldName, HSPJSONItem *item, bool wantStr)
+  {
+    memset(item, 0, sizeof(*item));
+    if(obj->type != cJSON_Object)
+      return NO;
+    if(obj->cj) {
+      cJSON *field = cJSON_GetObjectItem(obj->cj, fieldName);
+      if(field) {
+	item->type = field->type;
+	item->cj = field;
+	item->num = field->valuedouble;
+	if(field->type == cJSON_String)
+	  item->str = field->valuestring;
+      }
+    }
+    else if(obj->txt) {
+      if(obj->members == NULL
+	 && !json_index(obj))
+	return NO;
+      uint32_t fieldLen = my_strlen(fieldName);
+      for(uint32_t ii = 0; ii < obj->nMembers; ii++) {
+	HSPJSONMember *mem = &obj->members[ii];
+	if(mem->keyLen == fieldLen
+	   && !strncasecmp(mem->key, fieldName, fieldLen)) {
+	  HSPJSONScratch *scratch = obj->scratch;
+	  item->type = mem->type;
+	  item->scratch = scratch;
+	  item->num = mem->num;
+	  if(mem->type == cJSON_Object
+	     || mem->type == cJSON_Array)
+	    item->txt = mem->val;
+	  else if(mem->type == cJSON_String
+		  && wantStr
+		  && (scratch->strsUsed + mem->len + 1) <= sizeof(scratch->strs)) {
+	    item->str = scratch->strs + scratch->strsUsed;
+	    memcpy(item->str, mem->str, mem->len);
+	    item->str[mem->len] = '\0';
+	    scratch->strsUsed += mem->len + 1;
+	  }
+	  break;
+	}
+      }
+    }
+    return (item->type != 0);
+  }
+
+  /*_________________---------------------------__________________
+    _________________   fast rtmetric/rtflow    __________________
+    -----------------___________________________------------------
+    Two passes over the object text - the first to pick up the
+    datasource (and sampling_rate) so they can be encoded ahead of the
+    fields, just as readJSON_rtmetric() and readJSON_rtflow() do.
+    Returns NO if the caller should fall back to cJSON.
+  */
+
+  static bool fast_rtfields(EVMod *mod, char *obj, bool isFlow)
+  {
+    HSPJSONScan js = { .p = obj };
+    char *key;
+    uint32_t keyLen;
+    char *dsname = NULL;
+    uint32_t dsname_len = 0;
+    uint32_t sampling_rate = 1;
+
+    // pass 1
+    for(bool first = YES; js_member(&js, first, &key, &keyLen); first = NO) {
+      HSPJSONVal val;
+      int vtype = js_value(&js, &val, 1);
+      if(js.error)
+	return NO;
+      if(isFlow
+	 && vtype == cJSON_Number
+	 && JS_KEY_IS(key, keyLen, "sampling_rate")) {
+	sampling_rate = (uint32_t)val.num;
+	if(sampling_rate == 0) sampling_rate = 1;
+      }
+      else if(vtype == cJSON_String
+	      && JS_KEY_IS(key, keyLen, "datasource")) {
+	dsname = val.str;
+	dsname_len = dsname_len_ok_n(dsname, val.len);
+	if(dsname_len != val.len)
+	  dsname_len = 0;
+	if(dsname_len == 0) {
+	  myDebug(1, "invalid datasource name");
+	  return YES; // bail completely on bad dsname
+	}
+      }
+    }
+    if(js.error)
+      return NO;
+
+    XDRBuf buf;
+    xdr_init(&buf);
+    uint32_t num_fields = 0;
+    xdr_enc_int32(&buf, isFlow ? TAG_RTFLOW : TAG_RTMETRIC);
+    uint32_t *mstart = xdr_ptr(&buf);
+    xdr_enc_int32(&buf, 0); // will be rtmetric/rtflow len
+    xdr_enc_str(&buf, dsname, dsname_len);
+    if(isFlow) {
+      xdr_enc_int32(&buf, sampling_rate); // sampling_rate
+      xdr_enc_int32(&buf, 0); // reserved (e.g. for sample_pool)
+    }
+    uint32_t *fstart = xdr_ptr(&buf);
+    xdr_enc_int32(&buf, 0); // will be num fields
+
+    // pass 2
+    js.p = obj;
+    for(bool first = YES; js_member(&js, first, &key, &keyLen); first = NO) {
+      if(*js_ws(&js) != '{') {
+	// only want named objects now
+	js_value(&js, NULL, 1);
+	if(js.error)
+	  return NO;
+	continue;
+      }
+      uint32_t fname_len = rtmetric_len_ok_n(key, keyLen);
+      if(fname_len != keyLen)
+	fname_len = 0;
+      // the first "value" and "type" win, ignoring case, like cJSON_GetObjectItem()
+      HSPJSONVal val = { 0 };
+      HSPJSONVal typ = { 0 };
+      bool got_val = NO, got_typ = NO;
+      char *fkey;
+      uint32_t fkeyLen;
+      for(bool ffirst = YES; js_member(&js, ffirst, &fkey, &fkeyLen); ffirst = NO) {
+	HSPJSONVal fv;
+	int vtype = js_value(&js, &fv, 2);
+	if(js.error)
+	  return NO;
+	if(!got_val
+	   && JS_KEY_IS_CI(fkey, fkeyLen, "value")) {
+	  if(vtype != cJSON_String
+	     && vtype != cJSON_Number)
+	    return NO; // unusual - let cJSON path handle it
+	  val = fv;
+	  got_val = YES;
+	}
+	else if(!got_typ
+		&& JS_KEY_IS_CI(fkey, fkeyLen, "type")) {
+	  typ = fv;
+	  got_typ = YES;
+	}
+      }
+      if(js.error)
+	return NO;
+      if(fname_len == 0) {
+	myDebug(1, "invalid %s key", isFlow ? "rtflow" : "rtmetric");
+	return YES; // bail on bad key
+      }
+      if(!got_val) {
+	myDebug(1, "%s missing \"value\"", isFlow ? "rtflow" : "rtmetric");
+	return YES; // bail on missing value
+      }
+      if(val.len > HSP_MAX_RTMETRIC_VAL_LEN) {
+	myDebug(1, "%s field len(%u) > max(%u)",
+		isFlow ? "rtflow" : "rtmetric",
+		val.len,
+		HSP_MAX_RTMETRIC_VAL_LEN);
+	return YES; // bail on field len error
+      }
+      if(!got_typ) {
+	myDebug(1, "%s missing \"type\"", isFlow ? "rtflow" : "rtmetric");
+	return YES; // bail on missing type
+      }
+      int ftype = -1;
+      char tname[16];
+      if(typ.type == cJSON_String
+	 && typ.len < sizeof(tname)) {
+	memcpy(tname, typ.str, typ.len);
+	tname[typ.len] = '\0';
+	ftype = isFlow ? rtflow_type(tname) : rtmetric_type(tname);
+      }
+      if(ftype == -1) {
+	myDebug(1, "%s bad type", isFlow ? "rtflow" : "rtmetric");
+	return YES; // bail on bad/missing type
+      }
+      num_fields++;
+      if(isFlow)
+	xdr_enc_flow_field(&buf, key, fname_len, ftype, &val);
+      else
+	xdr_enc_metric(&buf, key, fname_len, ftype, &val);
+    }
+    if(js.error)
+      return NO;
+
+    if(num_fields) {
+      uint32_t len = (char *)xdr_ptr(&buf) - (char *)mstart - 4;
+      mstart[0] = htonl(len);
+      fstart[0] = htonl(num_fields);
+      writeEncoded(mod, &buf, isFlow ? HSP_TELEMETRY_RTFLOW_SAMPLES : HSP_TELEMETRY_RTMETRIC_SAMPLES);
+    }
+    return YES;
+  }
+
+  /*_________________---------------------------__________________
+    _________________     jsonFastPath          __________________
+    -----------------___________________________------------------
+    Handle the common {"rtmetric":{...}}, {"rtflow":{...}},
+    {"flow_sample":{...}} and {"counter_sample":{...}} messages
+    without building a cJSON tree.  Returns NO if the message has any
+    other shape, or is one we would rather leave to cJSON.  The whole
+    message is scanned before anything is encoded,  so a NO never
+    follows a sample that was already sent.
+  */
+
+  typedef enum {
+    HSP_JSON_RTMETRIC=1,
+    HSP_JSON_RTFLOW,
+    HSP_JSON_FLOW_SAMPLE,
+    HSP_JSON_COUNTER_SAMPLE
+  } EnumHSPJSONMsg;
+
+  static bool jsonFastPath(EVMod *mod, char *msg)
+  {
+    HSP_mod_JSON *mdata = (HSP_mod_JSON *)mod->data;
+    HSPJSONScan js = { .p = msg };
+    char *key;
+    uint32_t keyLen;
+    if(!js_member(&js, YES, &key, &keyLen))
+      return NO;
+    EnumHSPJSONMsg msgType;
+    if(JS_KEY_IS_CI(key, keyLen, "rtmetric"))
+      msgType = HSP_JSON_RTMETRIC;
+    else if(JS_KEY_IS_CI(key, keyLen, "rtflow"))
+      msgType = HSP_JSON_RTFLOW;
+    else if(JS_KEY_IS_CI(key, keyLen, "flow_sample"))
+      msgType = HSP_JSON_FLOW_SAMPLE;
+    else if(JS_KEY_IS_CI(key, keyLen, "counter_sample"))
+      msgType = HSP_JSON_COUNTER_SAMPLE;
+    else
+      return NO;
+    char *obj = js_ws(&js);
+    if(*obj != '{'
+       || js_value(&js, NULL, 1) != cJSON_Object)
+      return NO;
+    // must be the only member
+    if(!js_expect(&js, '}'))
+      return NO;
+    HSPJSONItem item = { .type = cJSON_Object, .txt = obj, .scratch = &mdata->scratch };
+    mdata->scratch.membersUsed = 0;
+    mdata->scratch.strsUsed = 0;
+    switch(msgType) {
+    case HSP_JSON_RTMETRIC: return fast_rtfields(mod, obj, NO);
+    case HSP_JSON_RTFLOW: return fast_rtfields(mod, obj, YES);
+    case HSP_JSON_FLOW_SAMPLE: readJSON_flowSample(mod, &item); break;
+    case HSP_JSON_COUNTER_SAMPLE: readJSON_counterSample(mod, &item); break;
+    }
+    return YES;
   }
 
   /*_________________---------------------------__________________
@@ -1208,35 +1738,83 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
     -----------------___________________________------------------
   */
 
+  static void processJSON_cJSON(EVMod *mod, char *buf)
+  {
+    cJSON *top = cJSON_Parse(buf);
+    if(top) {
+      if(getDebug()) logJSON(top, "got JSON message");
+      HSPJSONItem msg = { .type = cJSON_Object, .cj = top };
+      HSPJSONItem fs, cs;
+      if(json_item(&msg, "flow_sample", &fs, NO)) readJSON_flowSample(mod, &fs);
+      if(json_item(&msg, "counter_sample", &cs, NO)) readJSON_counterSample(mod, &cs);
+      cJSON *rtmetric = cJSON_GetObjectItem(top, "rtmetric");
+      if(rtmetric) readJSON_rtmetric(mod, rtmetric);
+      cJSON *rtflow = cJSON_GetObjectItem(top, "rtflow");
+      if(rtflow) readJSON_rtflow(mod, rtflow);
+      cJSON_Delete(top);
+    }
+  }
+
+  static void processJSON(EVMod *mod, char *buf, int len)
+  {
+    myDebug(2, "got JSON msg: %u bytes", len);
+    // most messages have just one top-level object, and can be
+    // encoded without building a cJSON tree.
+    if(!getDebug()
+       && jsonFastPath(mod, buf))
+      return;
+    processJSON_cJSON(mod, buf);
+  }
+
+#ifdef HSP_BENCH
+  // for hsflowd_bench: one message,  either way
+  void mod_json_bench(EVMod *mod, char *buf, bool fast)
+  {
+    if(fast
+       && jsonFastPath(mod, buf))
+      return;
+    processJSON_cJSON(mod, buf);
+  }
+#endif
+
   static void readJSON(EVMod *mod, EVSocket *sock, void *magic)
   {
     HSP *sp = (HSP *)EVROOTDATA(mod);
+    UTRecvBatch *rb = (UTRecvBatch *)magic;
 
     if(sp->sFlowSettings == NULL) {
       // config was turned off
       return;
     }
     int batch = 0;
-    if(sock->fd) {
+    if(rb) {
+      // UDP socket: drain with recvmmsg()
+      while(batch < HSP_READJSON_BATCH) {
+	int want = rb->batch;
+	int n = UTRecvBatchRead(rb);
+	if(n <= 0) break;
+	for(int ii = 0; ii < n; ii++) {
+	  char *buf = (char *)UTRecvBatchBuf(rb, ii);
+	  int len = UTRecvBatchLen(rb, ii);
+	  if(len <= 0) continue;
+	  buf[len] = '\0';
+	  processJSON(mod, buf, len);
+	}
+	batch += n;
+	if(n < want) {
+	  // short read - socket is drained
+	  break;
+	}
+      }
+    }
+    else if(sock->fd) {
+      // FIFO: recvmmsg() does not apply, so read() one at a time
       for( ; batch < HSP_READJSON_BATCH; batch++) {
 	char buf[HSP_MAX_JSON_MSG_BYTES];
-	// use read() so that it works for both UDP and FIFO inputs
-	int len = read(sock->fd, buf, HSP_MAX_JSON_MSG_BYTES);
+	int len = read(sock->fd, buf, HSP_MAX_JSON_MSG_BYTES - 1);
 	if(len <= 0) break;
-	myDebug(2, "got JSON msg: %u bytes", len);
-	cJSON *top = cJSON_Parse(buf);
-	if(top) {
-	  if(getDebug()) logJSON(top, "got JSON message");
-	  cJSON *fs = cJSON_GetObjectItem(top, "flow_sample");
-	  if(fs) readJSON_flowSample(mod, fs);
-	  cJSON *cs = cJSON_GetObjectItem(top, "counter_sample");
-	  if(cs) readJSON_counterSample(mod, cs);
-	  cJSON *rtmetric = cJSON_GetObjectItem(top, "rtmetric");
-	  if(rtmetric) readJSON_rtmetric(mod, rtmetric);
-	  cJSON *rtflow = cJSON_GetObjectItem(top, "rtflow");
-	  if(rtflow) readJSON_rtflow(mod, rtflow);
-	  cJSON_Delete(top);
-	}
+	buf[len] = '\0';
+	processJSON(mod, buf, len);
       }
     }
     // may have queued one or more counter-samples during this read-batch.
@@ -1247,6 +1825,7 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
     // conditions (e.g. if the arrival rate is about 10 per second and each
     // one is read on a different pass through this function).
     flushCounters(mod);
+    pendingSampleBatchFlush(sp);
   }
 
   /*_________________---------------------------__________________
@@ -1254,6 +1833,11 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
     -----------------___________________________------------------
   */
 
+  static void appTimeout(EVMod *mod, EVTimer *timer, void *magic) {
+    json_app_timeout_check(mod);
+  }
+
+  // used instead of appTimeout if the timer could not be created
   static void evt_packet_tick(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
     HSP_mod_JSON *mdata = (HSP_mod_JSON *)mod->data;
     time_t clk = evt->bus->now.tv_sec;
@@ -1295,7 +1879,11 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
     mdata->packetBus = EVGetBus(mod, HSPBUS_PACKET, YES);
 
     // we time out applications on the packetBus
-    EVEventRx(mod, EVGetEvent(mdata->packetBus, EVEVENT_TICK), evt_packet_tick);
+    EVTimer *appTimer = EVBusAddTimer(mod, mdata->packetBus, appTimeout, NULL);
+    if(appTimer)
+      EVTimerSet(appTimer, 0, HSP_JSON_APP_TIMEOUT * 1000);
+    else
+      EVEventRx(mod, EVGetEvent(mdata->packetBus, EVEVENT_TICK), evt_packet_tick);
     // the poller callbacks come in on the pollBus
     // but we just capture them in the pollActions list and process
     // counters in the packetBus thread too.
@@ -1304,10 +1892,18 @@ static void readJSON_flowSample(EVMod *mod, cJSON *fs)
     if(sp->json.port) {
       // TODO: do we really need to bind to both "127.0.0.1" and "::1" ?
       mdata->json_soc = UTSocketUDP("127.0.0.1", PF_INET, sp->json.port, HSP_JSON_RCV_BUF);
-      EVBusAddSocket(mod, mdata->packetBus, mdata->json_soc, readJSON, NULL);
+      if(mdata->json_soc > 0) {
+	mdata->json_rb = UTRecvBatchNew(mdata->json_soc, "json", HSP_JSON_RECVMMSG_MAX, HSP_MAX_JSON_MSG_BYTES - 1);
+	UTRecvBatchTelemetry(mdata->json_rb, &sp->telemetry[HSP_TELEMETRY_RX_JSON_CALLS]);
+	EVBusAddSocket(mod, mdata->packetBus, mdata->json_soc, readJSON, mdata->json_rb);
+      }
 
       mdata->json_soc6 = UTSocketUDP("::1", PF_INET6, sp->json.port, HSP_JSON_RCV_BUF);
-      EVBusAddSocket(mod, mdata->packetBus, mdata->json_soc6, readJSON, NULL);
+      if(mdata->json_soc6 > 0) {
+	mdata->json_rb6 = UTRecvBatchNew(mdata->json_soc6, "json6", HSP_JSON_RECVMMSG_MAX, HSP_MAX_JSON_MSG_BYTES - 1);
+	UTRecvBatchTelemetry(mdata->json_rb6, &sp->telemetry[HSP_TELEMETRY_RX_JSON_CALLS]);
+	EVBusAddSocket(mod, mdata->packetBus, mdata->json_soc6, readJSON, mdata->json_rb6);
+      }
     }
 
     if(sp->json.FIFO) {
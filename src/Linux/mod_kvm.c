@@ -11,10 +11,32 @@ extern "C" {
 #include "libvirt.h"
 #include "libxml/xmlreader.h"
 
+  // virConnectGetAllDomainStats() arrived in libvirt 1.2.8
+#if (LIBVIR_VERSION_NUMBER >= 1002008)
+#define HSP_KVM_BULKSTATS 1
+#endif
+
+#define HSPEVENT_KVM_XML_STALE "kvm_xml_stale"
+
+  // one domain's counters,  read either with per-domain
+  // calls or from one bulk virConnectGetAllDomainStats()
+  typedef struct _HSPKVMStats {
+    bool ok;
+    int state;
+    uint64_t cpuTime_nS;
+    uint32_t nrVirtCpu;
+    uint64_t memory_KiB;
+    uint64_t maxMemory_KiB;
+    SFLHost_vrt_dsk_counters dsk;
+  } HSPKVMStats;
+
   typedef struct _HSPVMState_KVM {
     HSPVMState vm; // superclass: must come first
     int virDomainId;
     char nova_name[100];
+    char *name;
+    bool xmlStale:1;
+    HSPKVMStats stats; // from last bulk read
   } HSPVMState_KVM;
 
   typedef struct _HSP_mod_KVM {
@@ -26,8 +48,189 @@ extern "C" {
     uint32_t refreshVMListSecs;
     time_t next_refreshVMList;
     uint32_t forgetVMSecs;
+    bool bulkStats;
+    bool lifecycleEvents;
+    EVEvent *xmlStaleEvent;
+    pthread_t *eventThread;
   } HSP_mod_KVM;
 
+  /*_________________---------------------------__________________
+    _________________    readDomainStats        __________________
+    -----------------___________________________------------------
+    The per-domain way: several RPCs to libvirtd for each domain.
+  */
+
+  static bool readDomainStats(EVMod *mod, HSPVMState_KVM *state, virDomainPtr domainPtr, HSPKVMStats *st) {
+    HSP_mod_KVM *mdata = (HSP_mod_KVM *)mod->data;
+    HSPVMState *vm = (HSPVMState *)&state->vm;
+    memset(st, 0, sizeof(*st));
+    virDomainInfo domainInfo;
+    if(virDomainGetInfo(domainPtr, &domainInfo) != 0) {
+      myLog(LOG_ERR, "virDomainGetInfo() failed");
+    }
+    else {
+      st->ok = YES;
+      st->state = domainInfo.state;
+      st->cpuTime_nS = domainInfo.cpuTime;
+      st->nrVirtCpu = domainInfo.nrVirtCpu;
+      st->memory_KiB = domainInfo.memory;
+      st->maxMemory_KiB = (domainInfo.maxMem == UINT_MAX) ? (uint64_t)-1 : domainInfo.maxMem;
+    }
+
+    SFLHost_vrt_dsk_counters *dsk = &st->dsk;
+    for(int i = strArrayN(vm->disks); --i >= 0; ) {
+      /* vm->volumes and vm->disks are populated in lockstep
+       * so they always have the same number of elements
+       */
+      char *volPath = strArrayAt(vm->volumes, i);
+      char *dskPath = strArrayAt(vm->disks, i);
+      bool gotVolInfo = NO;
+
+#if (LIBVIR_VERSION_NUMBER >= 8001)
+      if(gotVolInfo == NO) {
+	/* try appealing directly to the disk path instead */
+	/* this call was only added in April 2010 (version 0.8.1).
+	 * See http://markmail.org/message/mjafgt47f5e5zzfc
+	 */
+	virDomainBlockInfo blkInfo;
+	if(virDomainGetBlockInfo(domainPtr, volPath, &blkInfo, 0) == -1) {
+	  myLog(LOG_ERR, "virDomainGetBlockInfo(%s) failed", dskPath);
+	}
+	else {
+	  dsk->capacity += blkInfo.capacity;
+	  dsk->allocation += blkInfo.allocation;
+	  dsk->available += (blkInfo.capacity - blkInfo.allocation);
+	  // don't need blkInfo.physical
+	  gotVolInfo = YES;
+	}
+      }
+#endif
+
+      if(gotVolInfo == NO) {
+	virStorageVolPtr volPtr = virStorageVolLookupByPath(mdata->virConn, volPath);
+	if(volPtr == NULL) {
+	  myLog(LOG_ERR, "virStorageLookupByPath(%s) failed", volPath);
+	}
+	else {
+	  virStorageVolInfo volInfo;
+	  if(virStorageVolGetInfo(volPtr, &volInfo) != 0) {
+	    myLog(LOG_ERR, "virStorageVolGetInfo(%s) failed", volPath);
+	  }
+	  else {
+	    gotVolInfo = YES;
+	    dsk->capacity += volInfo.capacity;
+	    dsk->allocation += volInfo.allocation;
+	    dsk->available += (volInfo.capacity - volInfo.allocation);
+	  }
+	}
+      }
+
+      /* we get reads, writes and errors from a different call */
+      virDomainBlockStatsStruct blkStats;
+      if(virDomainBlockStats(domainPtr, dskPath, &blkStats, sizeof(blkStats)) != -1) {
+	if(blkStats.rd_req != -1) dsk->rd_req += blkStats.rd_req;
+	if(blkStats.rd_bytes != -1) dsk->rd_bytes += blkStats.rd_bytes;
+	if(blkStats.wr_req != -1) dsk->wr_req += blkStats.wr_req;
+	if(blkStats.wr_bytes != -1) dsk->wr_bytes += blkStats.wr_bytes;
+	if(blkStats.errs != -1) dsk->errs += blkStats.errs;
+      }
+    }
+    return st->ok;
+  }
+
+  /*_________________---------------------------__________________
+    _________________    readAllDomainStats     __________________
+    -----------------___________________________------------------
+    The bulk way: one RPC for every active domain,  with the
+    results cached on each VM (looked up by UUID).
+  */
+
+#ifdef HSP_KVM_BULKSTATS
+
+  static uint64_t blockParam(virTypedParameterPtr params, int nparams, int blk, char *field) {
+    char name[VIR_TYPED_PARAM_FIELD_LENGTH];
+    snprintf(name, VIR_TYPED_PARAM_FIELD_LENGTH, "block.%d.%s", blk, field);
+    unsigned long long val = 0;
+    if(virTypedParamsGetULLong(params, nparams, name, &val) != 1)
+      return 0;
+    return val;
+  }
+
+  static void readAllDomainStats(EVMod *mod) {
+    HSP_mod_KVM *mdata = (HSP_mod_KVM *)mod->data;
+    HSPVMState_KVM *state;
+    UTHASH_WALK(mdata->vmsByUUID, state)
+      state->stats.ok = NO;
+
+    virDomainStatsRecordPtr *records = NULL;
+    unsigned int statsTypes = VIR_DOMAIN_STATS_STATE
+      | VIR_DOMAIN_STATS_CPU_TOTAL
+      | VIR_DOMAIN_STATS_BALLOON
+      | VIR_DOMAIN_STATS_VCPU
+      | VIR_DOMAIN_STATS_BLOCK;
+    int nrec = virConnectGetAllDomainStats(mdata->virConn, statsTypes, &records, VIR_CONNECT_GET_ALL_DOMAINS_STATS_ACTIVE);
+    if(nrec < 0) {
+      myLog(LOG_ERR, "virConnectGetAllDomainStats() failed");
+      return;
+    }
+    myDebug(2, "virConnectGetAllDomainStats: %d domains", nrec);
+    for(int ii = 0; ii < nrec; ii++) {
+      virDomainStatsRecordPtr rec = records[ii];
+      HSPVMState_KVM search;
+      memset(&search, 0, sizeof(search));
+      if(virDomainGetUUID(rec->dom, (u_char *)search.vm.uuid) != 0)
+	continue;
+      state = UTHashGet(mdata->vmsByUUID, &search);
+      if(state == NULL)
+	continue; // not configured yet
+      HSPKVMStats *st = &state->stats;
+      memset(st, 0, sizeof(*st));
+      int ival = 0;
+      unsigned int uval = 0;
+      unsigned long long ullval = 0;
+      if(virTypedParamsGetInt(rec->params, rec->nparams, "state.state", &ival) == 1)
+	st->state = ival;
+      if(virTypedParamsGetULLong(rec->params, rec->nparams, "cpu.time", &ullval) == 1)
+	st->cpuTime_nS = ullval;
+      if(virTypedParamsGetUInt(rec->params, rec->nparams, "vcpu.current", &uval) == 1)
+	st->nrVirtCpu = uval;
+      if(virTypedParamsGetULLong(rec->params, rec->nparams, "balloon.current", &ullval) == 1)
+	st->memory_KiB = ullval;
+      if(virTypedParamsGetULLong(rec->params, rec->nparams, "balloon.maximum", &ullval) == 1)
+	st->maxMemory_KiB = ullval;
+      unsigned int nblocks = 0;
+      virTypedParamsGetUInt(rec->params, rec->nparams, "block.count", &nblocks);
+      for(int blk = 0; blk < nblocks; blk++) {
+	// only count the disks we accepted from the domain XML
+	char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+	const char *blkName = NULL;
+	snprintf(field, VIR_TYPED_PARAM_FIELD_LENGTH, "block.%d.name", blk);
+	if(virTypedParamsGetString(rec->params, rec->nparams, field, &blkName) != 1
+	   || strArrayIndexOf(state->vm.disks, (char *)blkName) == -1)
+	  continue;
+	uint64_t capacity = blockParam(rec->params, rec->nparams, blk, "capacity");
+	uint64_t allocation = blockParam(rec->params, rec->nparams, blk, "allocation");
+	st->dsk.capacity += capacity;
+	st->dsk.allocation += allocation;
+	st->dsk.available += (capacity - allocation);
+	st->dsk.rd_req += blockParam(rec->params, rec->nparams, blk, "rd.reqs");
+	st->dsk.rd_bytes += blockParam(rec->params, rec->nparams, blk, "rd.bytes");
+	st->dsk.wr_req += blockParam(rec->params, rec->nparams, blk, "wr.reqs");
+	st->dsk.wr_bytes += blockParam(rec->params, rec->nparams, blk, "wr.bytes");
+	st->dsk.errs += blockParam(rec->params, rec->nparams, blk, "errors");
+      }
+      st->ok = YES;
+    }
+    virDomainStatsRecordListFree(records);
+  }
+
+#endif /* HSP_KVM_BULKSTATS */
+
+  /*_________________---------------------------__________________
+    _________________    getCounters_KVM        __________________
+    -----------------___________________________------------------
+  */
+
   static void agentCB_getCounters_KVM(void *magic, SFLPoller *poller, SFL_COUNTERS_SAMPLE_TYPE *cs)
   {
     EVMod *mod = (EVMod *)magic;
@@ -43,8 +246,21 @@ extern "C" {
     }
 
     if(mdata->virConn) {
-      virDomainPtr domainPtr = virDomainLookupByID(mdata->virConn, state->virDomainId);
-      if(domainPtr == NULL) {
+      HSPKVMStats domStats;
+      HSPKVMStats *st = &domStats;
+      virDomainPtr domainPtr = NULL;
+      if(mdata->bulkStats) {
+	// already read for all domains this tock
+	st = &state->stats;
+      }
+      else {
+	domainPtr = virDomainLookupByID(mdata->virConn, state->virDomainId);
+	if(domainPtr)
+	  readDomainStats(mod, state, domainPtr, st);
+	else
+	  st->ok = NO;
+      }
+      if(!st->ok) {
 	sp->refreshVMList = YES;
       }
       else {
@@ -56,15 +272,14 @@ extern "C" {
 	  hname = state->nova_name; // no need to free this one
           myDebug(1, "agentCB_getCounters_KVM: use nova_name: %s", hname);
         } else {
-	  hname = virDomainGetName(domainPtr); // no need to free this one
+	  hname = state->name;
           myDebug(1, "agentCB_getCounters_KVM: use instance name: %s", hname);
         }
 
 	if(hname) {
-	  // copy the name out here so we can free it straight away
 	  hidElem.counterBlock.host_hid.hostname.str = (char *)hname;
 	  hidElem.counterBlock.host_hid.hostname.len = strlen(hname);
-	  virDomainGetUUID(domainPtr, hidElem.counterBlock.host_hid.uuid);
+	  memcpy(hidElem.counterBlock.host_hid.uuid, vm->uuid, 16);
 
 	  // char *osType = virDomainGetOSType(domainPtr); $$$
 	  hidElem.counterBlock.host_hid.machine_type = SFLMT_unknown;//$$$
@@ -96,88 +311,22 @@ extern "C" {
 	// VM cpu counters [ref xenstat.c]
 	SFLCounters_sample_element cpuElem = { 0 };
 	cpuElem.tag = SFLCOUNTERS_HOST_VRT_CPU;
-	virDomainInfo domainInfo;
-	int domainInfoOK = NO;
-	if(virDomainGetInfo(domainPtr, &domainInfo) != 0) {
-	  myLog(LOG_ERR, "virDomainGetInfo() failed");
-	}
-	else {
-	  domainInfoOK = YES;
-	  // enum virDomainState really is the same as enum SFLVirDomainState
-	  cpuElem.counterBlock.host_vrt_cpu.state = domainInfo.state;
-	  cpuElem.counterBlock.host_vrt_cpu.cpuTime = (domainInfo.cpuTime / 1000000);
-	  cpuElem.counterBlock.host_vrt_cpu.nrVirtCpu = domainInfo.nrVirtCpu;
-	  SFLADD_ELEMENT(cs, &cpuElem);
-	}
+	// enum virDomainState really is the same as enum SFLVirDomainState
+	cpuElem.counterBlock.host_vrt_cpu.state = st->state;
+	cpuElem.counterBlock.host_vrt_cpu.cpuTime = (st->cpuTime_nS / 1000000);
+	cpuElem.counterBlock.host_vrt_cpu.nrVirtCpu = st->nrVirtCpu;
+	SFLADD_ELEMENT(cs, &cpuElem);
 
 	SFLCounters_sample_element memElem = { 0 };
 	memElem.tag = SFLCOUNTERS_HOST_VRT_MEM;
-	if(domainInfoOK) {
-	  memElem.counterBlock.host_vrt_mem.memory = domainInfo.memory * 1024;
-	  memElem.counterBlock.host_vrt_mem.maxMemory = (domainInfo.maxMem == UINT_MAX) ? -1 : (domainInfo.maxMem * 1024);
-	  SFLADD_ELEMENT(cs, &memElem);
-	}
+	memElem.counterBlock.host_vrt_mem.memory = st->memory_KiB * 1024;
+	memElem.counterBlock.host_vrt_mem.maxMemory = (st->maxMemory_KiB == (uint64_t)-1) ? -1 : (st->maxMemory_KiB * 1024);
+	SFLADD_ELEMENT(cs, &memElem);
 
 	// VM disk I/O counters
 	SFLCounters_sample_element dskElem = { 0 };
 	dskElem.tag = SFLCOUNTERS_HOST_VRT_DSK;
-	for(int i = strArrayN(vm->disks); --i >= 0; ) {
-	  /* vm->volumes and vm->disks are populated in lockstep
-	   * so they always have the same number of elements
-	   */
-	  char *volPath = strArrayAt(vm->volumes, i);
-	  char *dskPath = strArrayAt(vm->disks, i);
-	  bool gotVolInfo = NO;
-
-#if (LIBVIR_VERSION_NUMBER >= 8001)
-	  if(gotVolInfo == NO) {
-	    /* try appealing directly to the disk path instead */
-	    /* this call was only added in April 2010 (version 0.8.1).
-	     * See http://markmail.org/message/mjafgt47f5e5zzfc
-	     */
-	    virDomainBlockInfo blkInfo;
-	    if(virDomainGetBlockInfo(domainPtr, volPath, &blkInfo, 0) == -1) {
-	      myLog(LOG_ERR, "virDomainGetBlockInfo(%s) failed", dskPath);
-	    }
-	    else {
-	      dskElem.counterBlock.host_vrt_dsk.capacity += blkInfo.capacity;
-	      dskElem.counterBlock.host_vrt_dsk.allocation += blkInfo.allocation;
-	      dskElem.counterBlock.host_vrt_dsk.available += (blkInfo.capacity - blkInfo.allocation);
-	      // don't need blkInfo.physical
-	      gotVolInfo = YES;
-	    }
-	  }
-#endif
-
-	  if(gotVolInfo == NO) {
-	    virStorageVolPtr volPtr = virStorageVolLookupByPath(mdata->virConn, volPath);
-	    if(volPtr == NULL) {
-	      myLog(LOG_ERR, "virStorageLookupByPath(%s) failed", volPath);
-	    }
-	    else {
-	      virStorageVolInfo volInfo;
-	      if(virStorageVolGetInfo(volPtr, &volInfo) != 0) {
-		myLog(LOG_ERR, "virStorageVolGetInfo(%s) failed", volPath);
-	      }
-	      else {
-		gotVolInfo = YES;
-		dskElem.counterBlock.host_vrt_dsk.capacity += volInfo.capacity;
-		dskElem.counterBlock.host_vrt_dsk.allocation += volInfo.allocation;
-		dskElem.counterBlock.host_vrt_dsk.available += (volInfo.capacity - volInfo.allocation);
-	      }
-	    }
-	  }
-
-	  /* we get reads, writes and errors from a different call */
-	  virDomainBlockStatsStruct blkStats;
-	  if(virDomainBlockStats(domainPtr, dskPath, &blkStats, sizeof(blkStats)) != -1) {
-	    if(blkStats.rd_req != -1) dskElem.counterBlock.host_vrt_dsk.rd_req += blkStats.rd_req;
-	    if(blkStats.rd_bytes != -1) dskElem.counterBlock.host_vrt_dsk.rd_bytes += blkStats.rd_bytes;
-	    if(blkStats.wr_req != -1) dskElem.counterBlock.host_vrt_dsk.wr_req += blkStats.wr_req;
-	    if(blkStats.wr_bytes != -1) dskElem.counterBlock.host_vrt_dsk.wr_bytes += blkStats.wr_bytes;
-	    if(blkStats.errs != -1) dskElem.counterBlock.host_vrt_dsk.errs += blkStats.errs;
-	  }
-	}
+	dskElem.counterBlock.host_vrt_dsk = st->dsk;
 	SFLADD_ELEMENT(cs, &dskElem);
 
 	// include my slice of the adaptor list
@@ -187,13 +336,14 @@ extern "C" {
 	SFLADD_ELEMENT(cs, &adaptorsElem);
 
 	SEMLOCK_DO(sp->sync_agent) {
+	  sfl_poller_set_staticRevision(poller, sp->staticRevision);
 	  sfl_poller_writeCountersSample(poller, cs);
 	  sp->counterSampleQueued = YES;
 	  sp->telemetry[HSP_TELEMETRY_COUNTER_SAMPLES]++;
 	}
-
-	virDomainFree(domainPtr);
       }
+      if(domainPtr)
+	virDomainFree(domainPtr);
     }
   }
 
@@ -370,6 +520,7 @@ extern "C" {
       // new vm or container
       state = (HSPVMState_KVM *)getVM(mod, uuid, YES, sizeof(HSPVMState_KVM), VMTYPE_KVM, agentCB_getCounters_KVM_request);
       if(state) {
+	state->xmlStale = YES;
 	UTHashAdd(mdata->vmsByUUID, state);
       }
     }
@@ -382,6 +533,10 @@ extern "C" {
 	  state->vm.dsIndex,
 	  state->virDomainId);
     UTHashDel(mdata->vmsByUUID, state);
+    if(state->name) {
+      my_free(state->name);
+      state->name = NULL;
+    }
     HSPVMState *vm = &state->vm;
     removeAndFreeVM(mod, vm);
   }
@@ -420,6 +575,19 @@ extern "C" {
 	vm->created = NO;
 	// remember the domId, which might have changed (if vm rebooted)
 	state->virDomainId = domId;
+	if(mdata->lifecycleEvents
+	   && !state->xmlStale) {
+	  // nothing defined or started since we last parsed the XML
+	  virDomainFree(domainPtr);
+	  continue;
+	}
+	state->xmlStale = NO;
+	// name and adaptors may change
+	sp->staticRevision++;
+	const char *domName = virDomainGetName(domainPtr); // no need to free this one
+	if(state->name)
+	  my_free(state->name);
+	state->name = domName ? my_strdup((char *)domName) : NULL;
 	// reset the information that we are about to refresh
 	adaptorListMarkAll(vm->interfaces);
 	strArrayReset(vm->volumes);
@@ -454,6 +622,57 @@ extern "C" {
     my_free(domainIds);
   }
 
+  /*_________________---------------------------__________________
+    _________________   domain lifecycle events __________________
+    -----------------___________________________------------------
+    The libvirt event loop runs on its own thread, so the callback
+    only passes the UUID over to the poll bus. The domain XML is
+    then re-parsed at the next tick for that domain only.
+  */
+
+  static int lifecycleCB(virConnectPtr conn, virDomainPtr dom, int event, int detail, void *opaque) {
+    EVMod *mod = (EVMod *)opaque;
+    HSP_mod_KVM *mdata = (HSP_mod_KVM *)mod->data;
+    char uuid[16];
+    myDebug(1, "kvm lifecycle event=%d detail=%d", event, detail);
+    switch(event) {
+    case VIR_DOMAIN_EVENT_DEFINED:
+    case VIR_DOMAIN_EVENT_UNDEFINED:
+    case VIR_DOMAIN_EVENT_STARTED:
+    case VIR_DOMAIN_EVENT_STOPPED:
+      if(virDomainGetUUID(dom, (u_char *)uuid) == 0)
+	EVEventTx(mod, mdata->xmlStaleEvent, uuid, 16);
+      break;
+    default:
+      break;
+    }
+    return 0;
+  }
+
+  static void *eventLoop(void *magic) {
+    for(;;) {
+      if(virEventRunDefaultImpl() < 0) {
+	myLog(LOG_ERR, "virEventRunDefaultImpl() failed");
+	sleep(1);
+      }
+    }
+    return NULL;
+  }
+
+  static void evt_xml_stale(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    HSP_mod_KVM *mdata = (HSP_mod_KVM *)mod->data;
+    if(dataLen != 16)
+      return;
+    HSPVMState_KVM search;
+    memset(&search, 0, sizeof(search));
+    memcpy(search.vm.uuid, data, 16);
+    HSPVMState_KVM *state = UTHashGet(mdata->vmsByUUID, &search);
+    if(state)
+      state->xmlStale = YES;
+    // pick up the change (or the new/departed domain) at the next tick
+    mdata->next_refreshVMList = 0;
+  }
+
   /*_________________---------------------------__________________
     _________________     getConnection         __________________
     -----------------___________________________------------------
@@ -466,6 +685,19 @@ extern "C" {
       if(mdata->virConn == NULL) {
 	myLog(LOG_ERR, "virConnectOpenReadOnly() failed\n");
       }
+      else if(mdata->eventThread) {
+	if(virConnectDomainEventRegisterAny(mdata->virConn,
+					    NULL,
+					    VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+					    VIR_DOMAIN_EVENT_CALLBACK(lifecycleCB),
+					    mod,
+					    NULL) < 0) {
+	  myLog(LOG_ERR, "virConnectDomainEventRegisterAny() failed - parsing domain XML on every refresh");
+	}
+	else {
+	  mdata->lifecycleEvents = YES;
+	}
+      }
     }
     return mdata->virConn;
   }
@@ -512,6 +744,13 @@ extern "C" {
 
   static void evt_tock(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
     HSP_mod_KVM *mdata = (HSP_mod_KVM *)mod->data;
+#ifdef HSP_KVM_BULKSTATS
+    // one round-trip to libvirtd for every domain that is due
+    if(mdata->bulkStats
+       && mdata->virConn
+       && UTArrayN(mdata->pollActions))
+      readAllDomainStats(mod);
+#endif
     // now we can execute pollActions without holding on to the semaphore
     for(uint32_t ii = 0; ii < UTArrayN(mdata->pollActions); ii++) {
       SFLPoller *poller = (SFLPoller *)UTArrayAt(mdata->pollActions, ii);
@@ -572,6 +811,23 @@ extern "C" {
 
     mdata->refreshVMListSecs = sp->kvm.refreshVMListSecs ?: sp->refreshVMListSecs;
     mdata->forgetVMSecs = sp->kvm.forgetVMSecs ?: sp->forgetVMSecs;
+#ifdef HSP_KVM_BULKSTATS
+    mdata->bulkStats = sp->kvm.bulkStats;
+#endif
+
+    // the lifecycle event loop must be registered before the connection is opened
+    if(virEventRegisterDefaultImpl() < 0) {
+      myLog(LOG_ERR, "virEventRegisterDefaultImpl() failed");
+    }
+    else {
+      mdata->eventThread = (pthread_t *)my_calloc(sizeof(pthread_t));
+      int err = pthread_create(mdata->eventThread, NULL, eventLoop, mod);
+      if(err != 0) {
+	myLog(LOG_ERR, "pthread_create() failed: %s\n", strerror(err));
+	my_free(mdata->eventThread);
+	mdata->eventThread = NULL;
+      }
+    }
 
     // register call-backs
     EVBus *pollBus = EVGetBus(mod, HSPBUS_POLL, YES);
@@ -579,6 +835,8 @@ extern "C" {
     EVEventRx(mod, EVGetEvent(pollBus, EVEVENT_TOCK), evt_tock);
     EVEventRx(mod, EVGetEvent(pollBus, HSPEVENT_HOST_COUNTER_SAMPLE), evt_host_cs);
     EVEventRx(mod, EVGetEvent(pollBus, EVEVENT_FINAL), evt_final);
+    mdata->xmlStaleEvent = EVGetEvent(pollBus, HSPEVENT_KVM_XML_STALE);
+    EVEventRx(mod, mdata->xmlStaleEvent, evt_xml_stale);
   }
 
 #if defined(__cplusplus)
@@ -16,21 +16,46 @@ extern "C" {
    (ignoring MTU constraints). */
 #define HSP_MAX_NFLOG_MSG_BYTES 65536 + 128
 #define HSP_NFLOG_RCV_BUF 8000000
+#define HSP_NFLOG_RECVMMSG_MAX 16
 
 #include <linux/netfilter/nfnetlink_log.h>
 #include <libnfnetlink.h>
 
-  typedef struct _HSP_mod_NFLOG {
-    EVBus *packetBus;
-    bool nflog_configured;
-    // nflog packet sampling
+  // With nflog { workers=N } NFLOG groups group ... group+N-1 are
+  // each read by their own thread.  Worker 0 is the packet bus itself,
+  // the others are "packet.1" ... "packet.N-1".  The iptables rules
+  // decide which packets go to which group.  Each worker only touches
+  // its own HSPNflogWorker.  The sampling rate is shared.
+  typedef struct _HSPNflogWorker {
+    uint32_t index;
+    EVBus *bus;
+    uint32_t group;
     struct nfnl_handle *nfnl;
+    UTRecvBatch *recvBatch;
     uint32_t nflog_seqno;
     uint32_t nflog_drops;
+    uint32_t skipCount;
     uint32_t subSamplingRate;
     uint32_t actualSamplingRate;
+    uint32_t samplingRate; // as requested
+    bool nflog_configured;
+  } HSPNflogWorker;
+
+  typedef struct _HSP_mod_NFLOG {
+    EVBus *packetBus;
+    HSPNflogWorker *workers;
+    uint32_t numWorkers;
+    HSPSamplingCtl *ctl;
   } HSP_mod_NFLOG;
 
+  static HSPNflogWorker *getWorker(HSP_mod_NFLOG *mdata, EVBus *bus) {
+    for(uint32_t ii = 0; ii < mdata->numWorkers; ii++) {
+      if(mdata->workers[ii].bus == bus)
+	return &mdata->workers[ii];
+    }
+    return NULL;
+  }
+
   /*_________________---------------------------__________________
     _________________      readPackets          __________________
     -----------------___________________________------------------
@@ -39,26 +64,40 @@ extern "C" {
   static void readPackets_nflog(EVMod *mod, EVSocket *sock, void *magic)
   {
     HSP_mod_NFLOG *mdata = (HSP_mod_NFLOG *)mod->data;
+    HSPNflogWorker *worker = (HSPNflogWorker *)magic;
     HSP *sp = (HSP *)EVROOTDATA(mod);
     int batch = 0;
-    static uint32_t MySkipCount=1;
 
     if(sp->sFlowSettings == NULL) {
       // config was turned off
       return;
     }
 
-    if(mdata->subSamplingRate == 0) {
+    if(worker->subSamplingRate == 0) {
       // packet sampling was disabled by setting desired rate to 0
       return;
     }
 
+    // messages are pulled from the socket with recvmmsg(), a vector at a time
+    UTRecvBatch *rb = worker->recvBatch;
+    int rxN = 0, rxI = 0, rxWant = 0;
     for( ; batch < HSP_READPACKET_BATCH_NFLOG; batch++) {
-      u_char buf[HSP_MAX_NFLOG_MSG_BYTES];
-      int len = nfnl_recv(mdata->nfnl,
-			  buf,
-			  HSP_MAX_NFLOG_MSG_BYTES);
-      if(len <= 0) break;
+      if(rxI == rxN) {
+	if(rxN && rxN < rxWant) break; // drained
+	// don't take more than we will get through this time
+	rxWant = HSP_READPACKET_BATCH_NFLOG - batch;
+	if(rxWant > rb->batch) rxWant = rb->batch;
+	rxN = UTRecvBatchReadMax(rb, rxWant);
+	rxI = 0;
+	if(rxN <= 0) break;
+      }
+      u_char *buf = UTRecvBatchBuf(rb, rxI);
+      int len = UTRecvBatchLen(rb, rxI);
+      struct sockaddr_nl *peer = (struct sockaddr_nl *)UTRecvBatchPeer(rb, rxI);
+      rxI++;
+      // as nfnl_recv() does, only accept messages from the kernel
+      if(peer->nl_pid != 0) continue;
+      if(len <= 0) continue;
       if(getDebug() > 1) {
 	struct nlmsghdr *msg = (struct nlmsghdr *)buf;
 	myLog(LOG_INFO, "got NFLOG msg: bytes_read=%u nlmsg_len=%u nlmsg_type=%u OK=%s",
@@ -80,13 +119,13 @@ extern "C" {
 
 	// check for drops indicated by sequence no
 	uint32_t droppedSamples = 0;
-	if(mdata->nflog_seqno) {
-	  droppedSamples = msg->nlmsg_seq - mdata->nflog_seqno - 1;
+	if(worker->nflog_seqno) {
+	  droppedSamples = msg->nlmsg_seq - worker->nflog_seqno - 1;
 	  if(droppedSamples) {
-	    mdata->nflog_drops += droppedSamples;
+	    worker->nflog_drops += droppedSamples;
 	  }
 	}
-	mdata->nflog_seqno = msg->nlmsg_seq;
+	worker->nflog_seqno = msg->nlmsg_seq;
 
 	switch(msg->nlmsg_type) {
 	case NLMSG_NOOP:
@@ -98,7 +137,7 @@ extern "C" {
 	default:
 	  {
 	    struct nfgenmsg *genmsg;
-	    struct nfattr *attr = nfnl_parse_hdr(mdata->nfnl, msg, &genmsg);
+	    struct nfattr *attr = nfnl_parse_hdr(worker->nfnl, msg, &genmsg);
 	    if(attr == NULL) {
 	      continue;
 	    }
@@ -126,10 +165,12 @@ extern "C" {
 
 	    myDebug(3, "capture payload (cap_len)=%d\n", cap_len);
 
-	    if(--MySkipCount == 0) {
+	    if(--worker->skipCount == 0) {
 	      /* reached zero. Set the next skip */
-	      uint32_t sr = mdata->subSamplingRate;
-	      MySkipCount = sr == 1 ? 1 : sfl_random((2 * sr) - 1);
+	      uint32_t sr = worker->subSamplingRate;
+	      worker->skipCount = sr == 1 ? 1 : sfl_random((2 * sr) - 1);
+	      if(mdata->ctl)
+		samplingCtlCount(mdata->ctl);
 
 	      /* and take a sample */
 	      char *prefix = nfnl_get_pointer_to_data(tb, NFULA_PREFIX, char);
@@ -167,12 +208,13 @@ extern "C" {
 			 cap_len, /* length of captured payload */
 			 cap_len, /* length of packet (pdu) */
 			 droppedSamples,
-			 mdata->actualSamplingRate);
+			 worker->actualSamplingRate);
 	    }
 	  }
 	}
       }
     }
+    pendingSampleBatchFlush(sp);
   }
 
   /*_________________---------------------------__________________
@@ -207,30 +249,27 @@ extern "C" {
     return YES;
   }
 
-  static int openNFLOG(EVMod *mod)
+  static int openNFLOG(EVMod *mod, HSPNflogWorker *worker)
   {
-    HSP_mod_NFLOG *mdata = (HSP_mod_NFLOG *)mod->data;
-    HSP *sp = (HSP *)EVROOTDATA(mod);
-
     // open the netfilter socket to ULOG
-    mdata->nfnl = nfnl_open();
-    if(mdata->nfnl == NULL) {
+    worker->nfnl = nfnl_open();
+    if(worker->nfnl == NULL) {
       myLog(LOG_ERR, "nfnl_open() failed: %s\n", strerror(errno));
       return -1;
     }
 
     /* subscribe to group  */
-    if(!bind_group_nflog(mdata->nfnl, sp->nflog.group)) {
-      myLog(LOG_ERR, "bind_group_nflog() failed\n");
+    if(!bind_group_nflog(worker->nfnl, worker->group)) {
+      myLog(LOG_ERR, "bind_group_nflog(%u) failed\n", worker->group);
       return -1;
     }
 
     // increase receiver buffer size
-    nfnl_set_rcv_buffer_size(mdata->nfnl, HSP_NFLOG_RCV_BUF);
+    nfnl_set_rcv_buffer_size(worker->nfnl, HSP_NFLOG_RCV_BUF);
 
     // get the fd
-    int fd = nfnl_fd(mdata->nfnl);
-    myDebug(1, "NFLOG socket fd=%d", fd);
+    int fd = nfnl_fd(worker->nfnl);
+    myDebug(1, "NFLOG socket fd=%d group=%u worker=%u", fd, worker->group, worker->index);
 
     // set the socket to non-blocking
     int fdFlags = fcntl(fd, F_GETFL);
@@ -256,19 +295,17 @@ extern "C" {
     -----------------___________________________------------------
   */
 
-  static void setSamplingRate(EVMod *mod) {
-    HSP_mod_NFLOG *mdata = (HSP_mod_NFLOG *)mod->data;
+  static void setSamplingRate(EVMod *mod, HSPNflogWorker *worker, uint32_t samplingRate) {
     HSP *sp = (HSP *)EVROOTDATA(mod);
 
-    uint32_t samplingRate = sp->sFlowSettings->samplingRate;
-
+    worker->samplingRate = samplingRate;
     // set defaults assuming we will get 1:1 on ULOG or NFLOG and do our own sampling.
-    mdata->subSamplingRate = samplingRate;
-    mdata->actualSamplingRate = samplingRate;
+    worker->subSamplingRate = samplingRate;
+    worker->actualSamplingRate = samplingRate;
 
     if(sp->hardwareSampling) {
       // all sampling is done in the hardware
-      mdata->subSamplingRate = 1;
+      worker->subSamplingRate = 1;
       return;
     }
 
@@ -278,27 +315,33 @@ extern "C" {
     uint32_t nflogsr = sp->nflog.samplingRate;
     if(nflogsr > 1) {
       // use an integer divide to get the sub-sampling rate, but make sure we round up
-      mdata->subSamplingRate = (samplingRate + nflogsr - 1) / nflogsr;
+      worker->subSamplingRate = (samplingRate + nflogsr - 1) / nflogsr;
       // and pre-calculate the actual sampling rate that we will end up applying
-      mdata->actualSamplingRate = mdata->subSamplingRate * nflogsr;
+      worker->actualSamplingRate = worker->subSamplingRate * nflogsr;
     }
   }
 
   /*_________________---------------------------__________________
     _________________    evt_config_changed     __________________
     -----------------___________________________------------------
+    Runs on every worker bus.  Each one opens its own group.
   */
 
   static void evt_config_changed(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
     HSP_mod_NFLOG *mdata = (HSP_mod_NFLOG *)mod->data;
     HSP *sp = (HSP *)EVROOTDATA(mod);
+    HSPNflogWorker *worker = getWorker(mdata, evt->bus);
 
     if(sp->sFlowSettings == NULL)
       return; // no config (yet - may be waiting for DNS-SD)
 
-    setSamplingRate(mod);
+    setSamplingRate(mod, worker, sp->sFlowSettings->samplingRate);
+    if(worker->index == 0) {
+      // the controller stays out of it if sampling is done in hardware
+      samplingCtlSetBase(mdata->ctl, sp->hardwareSampling ? 0 : worker->actualSamplingRate);
+    }
 
-    if(mdata->nflog_configured) {
+    if(worker->nflog_configured) {
       // already configured from the first time (when we still had root privileges)
       return;
     }
@@ -306,12 +349,16 @@ extern "C" {
     if(sp->nflog.group != 0) {
       // NFLOG group is set, so open the netfilter
       // socket to NFLOG while we are still root
-      int fd = openNFLOG(mod);
-      if(fd > 0)
-	EVBusAddSocket(mod, mdata->packetBus, fd, readPackets_nflog, NULL);
+      worker->group = sp->nflog.group + worker->index;
+      int fd = openNFLOG(mod, worker);
+      if(fd > 0) {
+	worker->recvBatch = UTRecvBatchNew(fd, "nflog", HSP_NFLOG_RECVMMSG_MAX, HSP_MAX_NFLOG_MSG_BYTES);
+	UTRecvBatchTelemetry(worker->recvBatch, &sp->telemetry[HSP_TELEMETRY_RX_NFLOG_CALLS]);
+	EVBusAddSocket(mod, worker->bus, fd, readPackets_nflog, worker);
+      }
     }
 
-    mdata->nflog_configured = YES;
+    worker->nflog_configured = YES;
   }
 
   /*_________________---------------------------__________________
@@ -320,7 +367,35 @@ extern "C" {
   */
 
   static void evt_intfs_changed(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
-    setSamplingRate(mod);
+    HSP_mod_NFLOG *mdata = (HSP_mod_NFLOG *)mod->data;
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    HSPNflogWorker *worker = getWorker(mdata, evt->bus);
+    uint32_t rate = mdata->ctl ? samplingCtlRate(mdata->ctl) : 0;
+    setSamplingRate(mod, worker, rate ?: sp->sFlowSettings->samplingRate);
+  }
+
+  /*_________________---------------------------__________________
+    _________________    evt_tick               __________________
+    -----------------___________________________------------------
+    The NFLOG probability is set by the iptables rule,  so all the
+    adaptive sampling controller can change is our sub-sampling.
+  */
+
+  static void evt_tick(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    HSP_mod_NFLOG *mdata = (HSP_mod_NFLOG *)mod->data;
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    HSPNflogWorker *worker = getWorker(mdata, evt->bus);
+    if(mdata->ctl
+       && !sp->hardwareSampling) {
+      uint32_t rate = samplingCtlRate(mdata->ctl);
+      if(rate != worker->samplingRate) {
+	setSamplingRate(mod, worker, rate);
+	myDebug(1, "NFLOG: worker %u sampling rate %u (sub-sampling %u)",
+		worker->index,
+		worker->actualSamplingRate,
+		worker->subSamplingRate);
+      }
+    }
   }
 
   /*_________________---------------------------__________________
@@ -329,11 +404,25 @@ extern "C" {
   */
 
   void mod_nflog(EVMod *mod) {
+    HSP *sp = (HSP *)EVROOTDATA(mod);
     mod->data = my_calloc(sizeof(HSP_mod_NFLOG));
     HSP_mod_NFLOG *mdata = (HSP_mod_NFLOG *)mod->data;
     mdata->packetBus = EVGetBus(mod, HSPBUS_PACKET, YES);
-    EVEventRx(mod, EVGetEvent(mdata->packetBus, HSPEVENT_CONFIG_CHANGED), evt_config_changed);
-    EVEventRx(mod, EVGetEvent(mdata->packetBus, HSPEVENT_INTFS_CHANGED), evt_intfs_changed);
+    // one controller for all the groups,  created here so that
+    // every worker sees it from the start
+    if(sp->nflog.group != 0)
+      mdata->ctl = samplingCtlNew(sp, "nflog", 0);
+    mdata->numWorkers = sp->nflog.workers ?: 1;
+    mdata->workers = (HSPNflogWorker *)my_calloc(mdata->numWorkers * sizeof(HSPNflogWorker));
+    for(uint32_t ii = 0; ii < mdata->numWorkers; ii++) {
+      HSPNflogWorker *worker = &mdata->workers[ii];
+      worker->index = ii;
+      worker->skipCount = 1;
+      worker->bus = packetWorkerBus(mod, ii);
+      EVEventRx(mod, EVGetEvent(worker->bus, HSPEVENT_CONFIG_CHANGED), evt_config_changed);
+      EVEventRx(mod, EVGetEvent(worker->bus, HSPEVENT_INTFS_CHANGED), evt_intfs_changed);
+      EVEventRx(mod, EVGetEvent(worker->bus, EVEVENT_TICK), evt_tick);
+    }
   }
 
 #if defined(__cplusplus)
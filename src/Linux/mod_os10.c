@@ -205,6 +205,7 @@ extern "C" {
 		 droppedSamples,
 		 sp->sFlowSettings->samplingRate);
     }
+    pendingSampleBatchFlush(sp);
   }
 
   /*_________________---------------------------__________________
@@ -17,28 +17,79 @@ extern "C" {
 #include <linux/sockios.h>
 #include <linux/if_packet.h>
 #include <linux/filter.h>
+#include <sys/mman.h>
 
 #include <pcap.h>
 #define HSP_READPACKET_BATCH_PCAP 10000
 
+  // TPACKET_V3 ring.  With kernel sampling the ring only sees the
+  // sampled packets (truncated to headerBytes by the filter), so it
+  // does not need to be large.  Partly-filled blocks are handed over
+  // after HSP_TPACKET_BLOCK_TOV_MS.
+#define HSP_TPACKET_BLOCK_SIZE 262144
+#define HSP_TPACKET_BLOCK_NR 4
+#define HSP_TPACKET_FRAME_SIZE 2048
+#define HSP_TPACKET_BLOCK_TOV_MS 10
+
+  // With pcap { workers=N } each device gets N sockets (libpcap or,
+  // with mmap=on,  TPACKET_V3) in a PACKET_FANOUT_HASH group, one
+  // read by each worker thread.
+  // Worker 0 is the packet bus itself. The others have their own
+  // buses, and each worker only ever touches its own BPFSocs.
+  typedef struct _HSPPcapWorker {
+    uint32_t index;
+    EVBus *bus;
+    UTArray *bpf_socs;
+  } HSPPcapWorker;
+
+  // Shared by the worker sockets for one device (under mdata->sync).
+  typedef struct _HSPPcapDev {
+    char *deviceName;
+    uint32_t devNum;
+    uint32_t fanoutSocks;
+    uint16_t fanoutId;
+    bool fanoutIdSet:1;
+    // one adaptive-sampling budget for the device,  however
+    // many sockets it is spread over
+    HSPSamplingCtl *ctl;
+    uint32_t ctlSocks;
+  } HSPPcapDev;
+
   typedef struct _BPFSoc {
     EVMod *module;
+    HSPPcapWorker *worker;
+    HSPPcapDev *dev;
     char *deviceName;
     SFLAdaptor *adaptor;
     EVSocket *sock;
     uint32_t samplingRate;
     uint32_t subSamplingRate;
+    uint32_t skipCount;
     uint32_t drops;
+    uint32_t fanout;
+    bool fanoutJoined;
+    HSPSamplingCtl *ctl;
+    bool kernelSampling:1;
     bool promisc:1;
     bool vport:1;
     bool vport_set:1;
+    bool mmap:1;
     pcap_t *pcap;
     char pcap_err[PCAP_ERRBUF_SIZE];
+    // TPACKET_V3 ring
+    u_char *ring;
+    size_t ringLen;
+    uint32_t blockIdx;
+    uint32_t snaplen;
+    u_char *vlanbuf;
   } BPFSoc;
 
   typedef struct _HSP_mod_PCAP {
-    UTArray *bpf_socs;
     EVBus *packetBus;
+    HSPPcapWorker *workers;
+    uint32_t numWorkers;
+    pthread_mutex_t *sync;
+    UTHash *devs;
   } HSP_mod_PCAP;
 
   static void tap_close(EVMod *mod, BPFSoc *bpfs);
@@ -48,12 +99,8 @@ extern "C" {
     -----------------___________________________------------------
   */
 
-  // function of type pcap_handler
-
-  static void readPackets_pcap_cb(u_char *user, const struct pcap_pkthdr *hdr, const u_char *buf)
+  static void bpfSample(BPFSoc *bpfs, const u_char *buf, uint32_t caplen, uint32_t len)
   {
-    static uint32_t MySkipCount=1;
-    BPFSoc *bpfs = (BPFSoc *)user;
     uint32_t sr = bpfs->subSamplingRate;
 
     if(sr == 0) {
@@ -61,9 +108,11 @@ extern "C" {
       return;
     }
 
-    if(--MySkipCount == 0) {
+    if(--bpfs->skipCount == 0) {
       /* reached zero. Set the next skip */
-      MySkipCount = sr == 1 ? 1 : sfl_random((2 * sr) - 1);
+      bpfs->skipCount = sr == 1 ? 1 : sfl_random((2 * sr) - 1);
+      if(bpfs->ctl)
+	samplingCtlCount(bpfs->ctl);
 
       EVMod *mod = bpfs->module;
       HSP *sp = (HSP *)EVROOTDATA(mod);
@@ -118,13 +167,20 @@ extern "C" {
 		 buf /* mac hdr*/,
 		 14 /* mac len */,
 		 buf + 14 /* payload */,
-		 hdr->caplen - 14, /* length of captured payload */
-		 hdr->len, /* length of packet (pdu) */
+		 caplen - 14, /* length of captured payload */
+		 len, /* length of packet (pdu) */
 		 bpfs->drops, /* droppedSamples */
 		 bpfs->samplingRate);
     }
   }
 
+  // function of type pcap_handler
+
+  static void readPackets_pcap_cb(u_char *user, const struct pcap_pkthdr *hdr, const u_char *buf)
+  {
+    bpfSample((BPFSoc *)user, buf, hdr->caplen, hdr->len);
+  }
+
   static void readPackets_pcap(EVMod *mod, EVSocket *sock, void *magic)
   {
     BPFSoc *bpfs = (BPFSoc *)magic;
@@ -137,6 +193,77 @@ extern "C" {
       // may get here if the interface was removed
       tap_close(mod, bpfs);
     }
+    pendingSampleBatchFlush((HSP *)EVROOTDATA(mod));
+  }
+
+  /*_________________---------------------------__________________
+    _________________    readPackets_tpacket    __________________
+    -----------------___________________________------------------
+    Walk the blocks that the kernel has handed over to us and
+    sample each frame in place, then give the block back.
+  */
+
+  static void tpacket_drops(BPFSoc *bpfs) {
+    // counters are reset each time they are read, so accumulate
+    struct tpacket_stats_v3 stats;
+    socklen_t len = sizeof(stats);
+    if(bpfs->sock
+       && getsockopt(bpfs->sock->fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len) == 0) {
+      bpfs->drops += stats.tp_drops;
+    }
+  }
+
+  static void tpacket_frame(BPFSoc *bpfs, struct tpacket3_hdr *hdr) {
+    u_char *buf = (u_char *)hdr + hdr->tp_mac;
+    uint32_t caplen = hdr->tp_snaplen;
+    if(caplen > bpfs->snaplen)
+      caplen = bpfs->snaplen;
+    if(caplen < 14)
+      return;
+    if(hdr->tp_status & TP_STATUS_VLAN_VALID) {
+      // the kernel took the 802.1Q tag out, so put it back
+      // the way libpcap would have done.
+      uint16_t tpid = (hdr->tp_status & TP_STATUS_VLAN_TPID_VALID) ? hdr->hv1.tp_vlan_tpid : ETH_P_8021Q;
+      uint16_t tci = hdr->hv1.tp_vlan_tci;
+      u_char *vbuf = bpfs->vlanbuf;
+      memcpy(vbuf, buf, 12);
+      vbuf[12] = tpid >> 8;
+      vbuf[13] = tpid & 0xFF;
+      vbuf[14] = tci >> 8;
+      vbuf[15] = tci & 0xFF;
+      memcpy(vbuf + 16, buf + 12, caplen - 12);
+      bpfSample(bpfs, vbuf, caplen + 4, hdr->tp_len + 4);
+    }
+    else {
+      bpfSample(bpfs, buf, caplen, hdr->tp_len);
+    }
+  }
+
+  static void readPackets_tpacket(EVMod *mod, EVSocket *sock, void *magic)
+  {
+    BPFSoc *bpfs = (BPFSoc *)magic;
+    for(int batch = 0; batch < HSP_TPACKET_BLOCK_NR; batch++) {
+      struct tpacket_block_desc *blk = (struct tpacket_block_desc *)(bpfs->ring + (bpfs->blockIdx * HSP_TPACKET_BLOCK_SIZE));
+      if((blk->hdr.bh1.block_status & TP_STATUS_USER) == 0)
+	break;
+      // make sure we see the frames the kernel wrote
+      __sync_synchronize();
+      struct tpacket3_hdr *hdr = (struct tpacket3_hdr *)((u_char *)blk + blk->hdr.bh1.offset_to_first_pkt);
+      bool losing = NO;
+      for(uint32_t ii = 0; ii < blk->hdr.bh1.num_pkts; ii++) {
+	if(hdr->tp_status & TP_STATUS_LOSING)
+	  losing = YES;
+	tpacket_frame(bpfs, hdr);
+	hdr = (struct tpacket3_hdr *)((u_char *)hdr + hdr->tp_next_offset);
+      }
+      if(losing)
+	tpacket_drops(bpfs);
+      // hand the block back to the kernel
+      __sync_synchronize();
+      blk->hdr.bh1.block_status = TP_STATUS_KERNEL;
+      bpfs->blockIdx = (bpfs->blockIdx + 1) % HSP_TPACKET_BLOCK_NR;
+    }
+    pendingSampleBatchFlush((HSP *)EVROOTDATA(mod));
   }
 
   /*_________________---------------------------__________________
@@ -206,6 +333,9 @@ extern "C" {
 
     // overwrite the sampling-rate
     code[1].k = bpfs->samplingRate;
+    // and truncate in the kernel if we are reading our own ring
+    if(bpfs->snaplen)
+      code[3].k = bpfs->snaplen;
     myDebug(1, "PCAP: sampling rate set to %u for dev=%s", code[1].k, bpfs->deviceName);
     struct sock_fprog bpf = {
       .len = 5, // ARRAY_SIZE(code),
@@ -222,27 +352,272 @@ extern "C" {
 
     // success - now we don't need to sub-sample in user-space
     bpfs->subSamplingRate = 1;
+    bpfs->kernelSampling = YES;
     myDebug(1, "PCAP: kernel sampling OK");
     return YES;
   }
 
+  /*_________________---------------------------__________________
+    _________________   changeSamplingRate      __________________
+    -----------------___________________________------------------
+    Called when the adaptive sampling controller has picked a new
+    rate.  Anything already sitting in the socket was sampled at the
+    old rate,  so read that first.  Then re-attach the filter with
+    the new rate (SO_ATTACH_FILTER replaces the old one) or just
+    change the user-space sub-sampling rate.
+  */
+
+  static void changeSamplingRate(EVMod *mod, BPFSoc *bpfs, uint32_t rate) {
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    myDebug(1, "PCAP: dev=%s sampling rate %u -> %u", bpfs->deviceName, bpfs->samplingRate, rate);
+    if(bpfs->ring)
+      readPackets_tpacket(mod, bpfs->sock, bpfs);
+    else if(bpfs->pcap) {
+      if(pcap_setnonblock(bpfs->pcap, 1, bpfs->pcap_err) == 0) {
+	readPackets_pcap(mod, bpfs->sock, bpfs);
+	if(bpfs->pcap)
+	  pcap_setnonblock(bpfs->pcap, 0, bpfs->pcap_err);
+      }
+    }
+    if(bpfs->sock == NULL)
+      return; // closed while draining
+    bpfs->samplingRate = rate;
+    if(rate == 0
+       || bpfs->kernelSampling == NO
+       || setKernelSampling(sp, bpfs, bpfs->sock->fd) == NO) {
+      bpfs->subSamplingRate = rate;
+      bpfs->skipCount = 1;
+    }
+  }
+
   /*_________________---------------------------__________________
     _________________    evt_tick               __________________
     -----------------___________________________------------------
   */
 
+  static HSPPcapWorker *getWorker(HSP_mod_PCAP *mdata, EVBus *bus) {
+    for(uint32_t ii = 0; ii < mdata->numWorkers; ii++) {
+      if(mdata->workers[ii].bus == bus)
+	return &mdata->workers[ii];
+    }
+    return NULL;
+  }
+
   static void evt_tick(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
     HSP_mod_PCAP *mdata = (HSP_mod_PCAP *)mod->data;
+    HSPPcapWorker *worker = getWorker(mdata, evt->bus);
     // read pcap stats to get drops - will go out with
     // packet samples sent from readPackets.c
     BPFSoc *bpfs;
-    UTARRAY_WALK(mdata->bpf_socs, bpfs) {
+    UTARRAY_WALK(worker->bpf_socs, bpfs) {
       struct pcap_stat stats;
-      if(bpfs->pcap
-	 && pcap_stats(bpfs->pcap, &stats) == 0) {
+      if(bpfs->ring)
+	tpacket_drops(bpfs);
+      else if(bpfs->pcap
+	      && pcap_stats(bpfs->pcap, &stats) == 0) {
 	bpfs->drops = stats.ps_drop;
       }
+      // pick up any change from the adaptive sampling controller
+      if(bpfs->ctl
+	 && bpfs->sock) {
+	uint32_t rate = samplingCtlRate(bpfs->ctl);
+	if(rate != bpfs->samplingRate)
+	  changeSamplingRate(mod, bpfs, rate);
+      }
+    }
+  }
+
+  /*_________________---------------------------__________________
+    _________________     fanout_join           __________________
+    -----------------___________________________------------------
+    With workers=N the device is opened once per worker,  and the
+    sockets share the packets through a PACKET_FANOUT_HASH group.
+    Works for our own TPACKET_V3 socket and for the one that libpcap
+    opened,  as long as it is already bound to the device.
+  */
+
+#ifndef PACKET_FANOUT_FLAG_UNIQUEID
+#define PACKET_FANOUT_FLAG_UNIQUEID 0x2000
+#endif
+
+  static bool fanout_join_locked(BPFSoc *bpfs, int fd) {
+    HSPPcapDev *dev = bpfs->dev;
+    if(!dev->fanoutIdSet) {
+      // first socket for this device: let the kernel pick an id
+      // that no other group in this namespace is using
+      int fanout_arg = (PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_UNIQUEID) << 16;
+      socklen_t len = sizeof(fanout_arg);
+      if(setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &fanout_arg, sizeof(fanout_arg)) == 0) {
+	if(getsockopt(fd, SOL_PACKET, PACKET_FANOUT, &fanout_arg, &len) == -1) {
+	  myLog(LOG_ERR, "PCAP: device %s PACKET_FANOUT id not found: %s", bpfs->deviceName, strerror(errno));
+	  return NO;
+	}
+	dev->fanoutId = fanout_arg & 0xFFFF;
+	dev->fanoutIdSet = YES;
+	myDebug(1, "PCAP: device %s fanout group %u", bpfs->deviceName, dev->fanoutId);
+	return YES;
+      }
+      if(errno != EINVAL) {
+	myLog(LOG_ERR, "PCAP: device %s PACKET_FANOUT failed: %s", bpfs->deviceName, strerror(errno));
+	return NO;
+      }
+      // kernel before 4.3: at least keep our own devices apart
+      dev->fanoutId = (getpid() + dev->devNum) & 0xFFFF;
+      dev->fanoutIdSet = YES;
+      myDebug(1, "PCAP: device %s fanout group %u (no PACKET_FANOUT_FLAG_UNIQUEID)", bpfs->deviceName, dev->fanoutId);
+    }
+    int fanout_arg = dev->fanoutId | (PACKET_FANOUT_HASH << 16);
+    if(setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &fanout_arg, sizeof(fanout_arg)) == -1) {
+      myLog(LOG_ERR, "PCAP: device %s PACKET_FANOUT group %u failed: %s", bpfs->deviceName, dev->fanoutId, strerror(errno));
+      return NO;
+    }
+    return YES;
+  }
+
+  static bool fanout_join(EVMod *mod, BPFSoc *bpfs, int fd) {
+    HSP_mod_PCAP *mdata = (HSP_mod_PCAP *)mod->data;
+    if(bpfs->fanout == 0)
+      return YES;
+    // sockets for the same device are opened on different threads
+    SEMLOCK_DO(mdata->sync) {
+      if(fanout_join_locked(bpfs, fd)) {
+	bpfs->dev->fanoutSocks++;
+	bpfs->fanoutJoined = YES;
+      }
+    }
+    return bpfs->fanoutJoined;
+  }
+
+  static void fanout_leave(EVMod *mod, BPFSoc *bpfs) {
+    HSP_mod_PCAP *mdata = (HSP_mod_PCAP *)mod->data;
+    if(!bpfs->fanoutJoined)
+      return;
+    bpfs->fanoutJoined = NO;
+    SEMLOCK_DO(mdata->sync) {
+      // the kernel frees the group with its last socket,  after
+      // which the id may be handed to someone else
+      if(--bpfs->dev->fanoutSocks == 0)
+	bpfs->dev->fanoutIdSet = NO;
+    }
+  }
+
+  static HSPSamplingCtl *pcapDevCtl(EVMod *mod, BPFSoc *bpfs) {
+    HSP_mod_PCAP *mdata = (HSP_mod_PCAP *)mod->data;
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    HSPPcapDev *dev = bpfs->dev;
+    HSPSamplingCtl *ctl = NULL;
+    SEMLOCK_DO(mdata->sync) {
+      if(dev->ctl == NULL)
+	dev->ctl = samplingCtlNew(sp, bpfs->deviceName, bpfs->samplingRate);
+      if((ctl = dev->ctl))
+	dev->ctlSocks++;
+    }
+    return ctl;
+  }
+
+  static void pcapDevCtlRelease(EVMod *mod, BPFSoc *bpfs) {
+    HSP_mod_PCAP *mdata = (HSP_mod_PCAP *)mod->data;
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    HSPPcapDev *dev = bpfs->dev;
+    if(bpfs->ctl == NULL)
+      return;
+    bpfs->ctl = NULL;
+    SEMLOCK_DO(mdata->sync) {
+      if(--dev->ctlSocks == 0) {
+	samplingCtlFree(sp, dev->ctl);
+	dev->ctl = NULL;
+      }
+    }
+  }
+
+  static HSPPcapDev *getPcapDev(EVMod *mod, char *deviceName) {
+    HSP_mod_PCAP *mdata = (HSP_mod_PCAP *)mod->data;
+    HSPPcapDev *dev = NULL;
+    SEMLOCK_DO(mdata->sync) {
+      HSPPcapDev search = { .deviceName = deviceName };
+      dev = UTHashGet(mdata->devs, &search);
+      if(dev == NULL) {
+	dev = (HSPPcapDev *)my_calloc(sizeof(HSPPcapDev));
+	dev->deviceName = my_strdup(deviceName);
+	dev->devNum = UTHashN(mdata->devs);
+	UTHashAdd(mdata->devs, dev);
+      }
+    }
+    return dev;
+  }
+
+  /*_________________---------------------------__________________
+    _________________     tpacket_open          __________________
+    -----------------___________________________------------------
+    Native AF_PACKET socket with a TPACKET_V3 block ring, as an
+    alternative to libpcap (pcap { mmap=on }).
+  */
+
+  static int tpacket_open(EVMod *mod, BPFSoc *bpfs) {
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    // protocol 0 so nothing is queued from other interfaces
+    // before the bind() below picks the device and ETH_P_ALL
+    int fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if(fd == -1) {
+      myLog(LOG_ERR, "PCAP: device %s socket(AF_PACKET) failed: %s", bpfs->deviceName, strerror(errno));
+      return -1;
+    }
+    // sample (and truncate) before anything reaches the ring
+    bpfs->snaplen = sp->sFlowSettings_file->headerBytes;
+    if(bpfs->vlanbuf == NULL)
+      bpfs->vlanbuf = my_calloc(bpfs->snaplen + 4);
+    setKernelSampling(sp, bpfs, fd);
+
+    int ver = TPACKET_V3;
+    struct tpacket_req3 req = {
+      .tp_block_size = HSP_TPACKET_BLOCK_SIZE,
+      .tp_block_nr = HSP_TPACKET_BLOCK_NR,
+      .tp_frame_size = HSP_TPACKET_FRAME_SIZE,
+      .tp_frame_nr = (HSP_TPACKET_BLOCK_SIZE / HSP_TPACKET_FRAME_SIZE) * HSP_TPACKET_BLOCK_NR,
+      .tp_retire_blk_tov = HSP_TPACKET_BLOCK_TOV_MS,
+    };
+    if(setsockopt(fd, SOL_PACKET, PACKET_VERSION, &ver, sizeof(ver)) == -1
+       || setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) == -1) {
+      myLog(LOG_ERR, "PCAP: device %s TPACKET_V3 ring setup failed: %s", bpfs->deviceName, strerror(errno));
+      goto failed;
+    }
+    bpfs->ringLen = req.tp_block_size * req.tp_block_nr;
+    bpfs->ring = mmap(NULL, bpfs->ringLen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(bpfs->ring == MAP_FAILED) {
+      myLog(LOG_ERR, "PCAP: device %s mmap() failed: %s", bpfs->deviceName, strerror(errno));
+      bpfs->ring = NULL;
+      goto failed;
     }
+    bpfs->blockIdx = 0;
+
+    struct sockaddr_ll sll = {
+      .sll_family = AF_PACKET,
+      .sll_protocol = htons(ETH_P_ALL),
+      .sll_ifindex = bpfs->adaptor->ifIndex,
+    };
+    if(bind(fd, (struct sockaddr *)&sll, sizeof(sll)) == -1) {
+      myLog(LOG_ERR, "PCAP: device %s bind() failed: %s", bpfs->deviceName, strerror(errno));
+      goto failed;
+    }
+    if(!fanout_join(mod, bpfs, fd))
+      goto failed;
+    if(bpfs->promisc) {
+      struct packet_mreq mreq = {
+	.mr_ifindex = bpfs->adaptor->ifIndex,
+	.mr_type = PACKET_MR_PROMISC,
+      };
+      if(setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == -1)
+	myLog(LOG_ERR, "PCAP: device %s promisc failed: %s", bpfs->deviceName, strerror(errno));
+    }
+    return fd;
+
+  failed:
+    if(bpfs->ring) {
+      munmap(bpfs->ring, bpfs->ringLen);
+      bpfs->ring = NULL;
+    }
+    while(close(fd) == -1 && errno == EINTR);
+    return -1;
   }
 
   /*_________________---------------------------__________________
@@ -251,11 +626,24 @@ extern "C" {
   */
   
   static void tap_open(EVMod *mod, BPFSoc *bpfs) {
-    HSP_mod_PCAP *mdata = (HSP_mod_PCAP *)mod->data;
     HSP *sp = (HSP *)EVROOTDATA(mod);
+    EVBus *bus = bpfs->worker->bus;
     
     bpfs->samplingRate = lookupPacketSamplingRate(bpfs->adaptor, sp->sFlowSettings);
     bpfs->subSamplingRate = bpfs->samplingRate;
+    bpfs->kernelSampling = NO;
+
+    if(bpfs->mmap) {
+      int fd = tpacket_open(mod, bpfs);
+      if(fd == -1)
+	return;
+      myDebug(1, "PCAP: device %s opened OK (TPACKET_V3, worker %u)", bpfs->deviceName, bpfs->worker->index);
+      bpfs->sock = EVBusAddSocket(mod, bus, fd, readPackets_tpacket, bpfs);
+      bpfs->ctl = pcapDevCtl(mod, bpfs);
+      forceCounterPolling(sp, bpfs->adaptor);
+      return;
+    }
+
     bpfs->pcap = pcap_open_live(bpfs->deviceName,
 				sp->sFlowSettings_file->headerBytes,
 				bpfs->promisc,
@@ -266,10 +654,16 @@ extern "C" {
       return;
     }
     
-    myDebug(1, "PCAP: device %s opened OK", bpfs->deviceName);
     int fd = pcap_fileno(bpfs->pcap);
+    if(!fanout_join(mod, bpfs, fd)) {
+      pcap_close(bpfs->pcap);
+      bpfs->pcap = NULL;
+      return;
+    }
+    myDebug(1, "PCAP: device %s opened OK (worker %u)", bpfs->deviceName, bpfs->worker->index);
     setKernelSampling(sp, bpfs, fd);
-    bpfs->sock = EVBusAddSocket(mod, mdata->packetBus, fd, readPackets_pcap, bpfs);
+    bpfs->sock = EVBusAddSocket(mod, bus, fd, readPackets_pcap, bpfs);
+    bpfs->ctl = pcapDevCtl(mod, bpfs);
     // assume we always want to get counters for anything we are tapping.
     // Have to force this here in case there are no samples that would
     // trigger it in readPackets.c:takeSample()
@@ -283,6 +677,16 @@ extern "C" {
   
   static void tap_close(EVMod *mod, BPFSoc *bpfs) {
     bpfs->adaptor = NULL;
+    fanout_leave(mod, bpfs);
+    pcapDevCtlRelease(mod, bpfs);
+    if(bpfs->ring) {
+      // our own socket, so let EVSocketClose() close it
+      munmap(bpfs->ring, bpfs->ringLen);
+      bpfs->ring = NULL;
+      EVSocketClose(mod, bpfs->sock);
+      bpfs->sock = NULL;
+      return;
+    }
     bpfs->sock->fd = -1;
     if(bpfs->pcap) {
       pcap_close(bpfs->pcap);
@@ -296,17 +700,29 @@ extern "C" {
     _________________     addBPFSocket          __________________
     -----------------___________________________------------------
   */
-  static void addBPFSocket(EVMod *mod,  HSPPcap *pcap, SFLAdaptor *adaptor) {
-    HSP_mod_PCAP *mdata = (HSP_mod_PCAP *)mod->data;
-    myDebug(1, "PCAP addBPFSocket(%s) speed=%"PRIu64, adaptor->deviceName, adaptor->ifSpeed);
+  static void addBPFSocket(EVMod *mod, HSPPcapWorker *worker, HSPPcap *pcap, SFLAdaptor *adaptor) {
+    uint32_t workers = pcap->workers ?: 1;
+    if(worker->index >= workers)
+      return;
+    myDebug(1, "PCAP addBPFSocket(%s) speed=%"PRIu64" worker=%u/%u",
+	    adaptor->deviceName,
+	    adaptor->ifSpeed,
+	    worker->index,
+	    workers);
     BPFSoc *bpfs = (BPFSoc *)my_calloc(sizeof(BPFSoc));
-    UTArrayAdd(mdata->bpf_socs, bpfs);
+    UTArrayAdd(worker->bpf_socs, bpfs);
     bpfs->module = mod;
+    bpfs->worker = worker;
+    bpfs->skipCount = 1;
     bpfs->adaptor = adaptor;
     bpfs->deviceName = adaptor->deviceName;
+    bpfs->dev = getPcapDev(mod, adaptor->deviceName);
     bpfs->promisc = pcap->promisc;
     bpfs->vport = pcap->vport;
     bpfs->vport_set = pcap->vport_set;
+    bpfs->mmap = pcap->mmap;
+    if(workers > 1)
+      bpfs->fanout = workers;
     tap_open(mod, bpfs);
   }
 
@@ -316,7 +732,10 @@ extern "C" {
   */
 
   static void evt_config_first(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    HSP_mod_PCAP *mdata = (HSP_mod_PCAP *)mod->data;
     HSP *sp = (HSP *)EVROOTDATA(mod);
+    // this runs on every worker bus, and each one opens its own sockets
+    HSPPcapWorker *worker = getWorker(mdata, evt->bus);
 
     // the list of pcap {} sections may expand to a longer list of BPFSoc
     // objects if we are matching with patterns or on ifSpeed etc.
@@ -327,7 +746,7 @@ extern "C" {
 	  myLog(LOG_ERR, "PCAP: device %s not found", pcap->dev);
 	  continue;
 	}
-	addBPFSocket(mod, pcap, adaptor);
+	addBPFSocket(mod, worker, pcap, adaptor);
       }
       else if(pcap->speed_set) {
 	if(debug(1)) {
@@ -358,7 +777,7 @@ extern "C" {
 	    }
 	    else {
 	      // passed all the tests
-	      addBPFSocket(mod, pcap, adaptor);
+	      addBPFSocket(mod, worker, pcap, adaptor);
 	    }
 	  }
 	}
@@ -374,10 +793,12 @@ extern "C" {
   static void evt_intfs_changed(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
     HSP_mod_PCAP *mdata = (HSP_mod_PCAP *)mod->data;
     HSP *sp = (HSP *)EVROOTDATA(mod);
+    HSPPcapWorker *worker = getWorker(mdata, evt->bus);
     // close sockets and remove adaptor references for anything that no longer exists
     BPFSoc *bpfs;
-    UTARRAY_WALK(mdata->bpf_socs, bpfs) {
-      if(adaptorByName(sp, bpfs->deviceName) == NULL) {
+    UTARRAY_WALK(worker->bpf_socs, bpfs) {
+      if(bpfs->sock
+	 && adaptorByName(sp, bpfs->deviceName) == NULL) {
 	// no longer found
 	tap_close(mod, bpfs);
       }
@@ -390,14 +811,31 @@ extern "C" {
   */
 
   void mod_pcap(EVMod *mod) {
+    HSP *sp = (HSP *)EVROOTDATA(mod);
     mod->data = my_calloc(sizeof(HSP_mod_PCAP));
     HSP_mod_PCAP *mdata = (HSP_mod_PCAP *)mod->data;
-    mdata->bpf_socs = UTArrayNew(UTARRAY_DFLT);
-    // register call-backs
     mdata->packetBus = EVGetBus(mod, HSPBUS_PACKET, YES);
-    EVEventRx(mod, EVGetEvent(mdata->packetBus, HSPEVENT_CONFIG_FIRST), evt_config_first);
-    EVEventRx(mod, EVGetEvent(mdata->packetBus, HSPEVENT_INTFS_CHANGED), evt_intfs_changed);
-    EVEventRx(mod, EVGetEvent(mdata->packetBus, EVEVENT_TICK), evt_tick);
+    mdata->sync = (pthread_mutex_t *)my_calloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(mdata->sync, NULL);
+    mdata->devs = UTHASH_NEW(HSPPcapDev, deviceName, UTHASH_SKEY);
+    // the worker buses have to exist before the threads are started,
+    // so allocate enough here for the largest pcap { workers=N }
+    mdata->numWorkers = 1;
+    for(HSPPcap *pcap = sp->pcap.pcaps; pcap; pcap = pcap->nxt) {
+      if(pcap->workers > mdata->numWorkers)
+	mdata->numWorkers = pcap->workers;
+    }
+    mdata->workers = (HSPPcapWorker *)my_calloc(mdata->numWorkers * sizeof(HSPPcapWorker));
+    for(uint32_t ii = 0; ii < mdata->numWorkers; ii++) {
+      HSPPcapWorker *worker = &mdata->workers[ii];
+      worker->index = ii;
+      worker->bpf_socs = UTArrayNew(UTARRAY_DFLT);
+      worker->bus = packetWorkerBus(mod, ii);
+      // register call-backs
+      EVEventRx(mod, EVGetEvent(worker->bus, HSPEVENT_CONFIG_FIRST), evt_config_first);
+      EVEventRx(mod, EVGetEvent(worker->bus, HSPEVENT_INTFS_CHANGED), evt_intfs_changed);
+      EVEventRx(mod, EVGetEvent(worker->bus, EVEVENT_TICK), evt_tick);
+    }
   }
 
 #if defined(__cplusplus)
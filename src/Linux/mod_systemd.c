@@ -19,6 +19,8 @@ extern "C" {
 #include <linux/types.h>
 #include <sys/prctl.h>
 #include <sched.h>
+#include <sys/vfs.h> // for statfs
+#include <linux/magic.h>
 #include <dbus/dbus.h>
 #include <openssl/sha.h>
 
@@ -26,12 +28,7 @@ extern "C" {
 #include "cpu_utils.h"
 #include "util_dbus.h"
 
-  // limit the number of chars we will read from each line in /proc
-#define MAX_PROC_LINELEN 256
-#define MAX_PROC_TOKLEN 32
-
 #define HSP_SYSTEMD_MAX_FNAME_LEN 255
-#define HSP_SYSTEMD_MAX_STATS_LINELEN 512
 #define HSP_SYSTEMD_WAIT_STARTUP 5
 
 #define HSP_DBUS_TIMEOUT_mS 10000
@@ -43,6 +40,13 @@ extern "C" {
 
 #define HSP_SYSTEMD_CGROUP_PROCS "/sys/fs/cgroup/systemd/%s/cgroup.procs"
 #define HSP_SYSTEMD_CGROUP_ACCT "/sys/fs/cgroup/%s%s/%s"
+  // on the unified (v2) hierarchy the controller is not part of the path
+#define HSP_SYSTEMD_CGROUP2_PROCS "/sys/fs/cgroup/%s/cgroup.procs"
+#define HSP_SYSTEMD_CGROUP2_ACCT "/sys/fs/cgroup/%.0s%s/%s"
+
+#ifndef CGROUP2_SUPER_MAGIC
+#define CGROUP2_SUPER_MAGIC 0x63677270
+#endif
   
   typedef void (*HSPDBusHandler)(EVMod *mod, DBusMessage *dbm, void *magic);
 
@@ -65,10 +69,12 @@ extern "C" {
     char *cgroup;
     char uuid[16];
     UTHash *processes;
+    UTHash *procFiles; // cgroup files read on each poll
     bool marked:1;
     bool cpuAccounting:1;
     bool memoryAccounting:1;
     bool blockIOAccounting:1;
+    bool ioAccounting:1;
     HSPUnitCounters cntr;
   } HSPDBusUnit;
 
@@ -77,6 +83,10 @@ extern "C" {
     bool marked;
     HSPUnitCounters cntr;
     HSPUnitCounters last;
+    // /proc/<pid>/{stat,statm,io},  re-opened on each poll
+    UTProcFile *statFile;
+    UTProcFile *statmFile;
+    UTProcFile *ioFile;
   } HSPDBusProcess;
 
   typedef struct _HSPVMState_SYSTEMD {
@@ -105,6 +115,7 @@ extern "C" {
     uint32_t page_size;
     char *cgroup_procs;
     char *cgroup_acct;
+    bool cgroup2;
   } HSP_mod_SYSTEMD;
 
   /*_________________---------------------------__________________
@@ -237,14 +248,31 @@ extern "C" {
     return unit;
   }
 
+  static void HSPDBusProcessFree(HSPDBusProcess *process) {
+    if(process->statFile) UTProcFileFree(process->statFile);
+    if(process->statmFile) UTProcFileFree(process->statmFile);
+    if(process->ioFile) UTProcFileFree(process->ioFile);
+    my_free(process);
+  }
+
+  static UTProcFile *processFile(HSPDBusProcess *process, UTProcFile **p_pf, char *fname) {
+    if(*p_pf == NULL) {
+      char path[HSP_SYSTEMD_MAX_FNAME_LEN+1];
+      snprintf(path, HSP_SYSTEMD_MAX_FNAME_LEN, "/proc/%u/%s", process->pid, fname);
+      *p_pf = UTProcFileNew(path, NO);
+    }
+    return *p_pf;
+  }
+
   static void HSPDBusUnitFree(HSPDBusUnit *unit) {
     if(unit->name) my_free(unit->name);
     if(unit->obj) my_free(unit->obj);
     if(unit->cgroup) my_free(unit->cgroup);
     HSPDBusProcess *process;
     UTHASH_WALK(unit->processes, process)
-      my_free(process);
+      HSPDBusProcessFree(process);
     UTHashFree(unit->processes);
+    if(unit->procFiles) UTProcFileCacheFree(unit->procFiles);
     my_free(unit);
   }
 
@@ -257,29 +285,29 @@ extern "C" {
     // HSP_mod_SYSTEMD *mdata = (HSP_mod_SYSTEMD *)mod->data;
     uint64_t cpu_total = 0;
     // compare with the reading of /proc/stat in readCpuCounters.c
-    char path[HSP_SYSTEMD_MAX_FNAME_LEN+1];
-    sprintf(path, "/proc/%u/stat", process->pid);
-    FILE *statFile = fopen(path, "r");
-    if(statFile == NULL) {
-      myDebug(2, "cannot open %s : %s", path, strerror(errno));
+    UTProcFile *statFile = processFile(process, &process->statFile, "stat");
+    if(UTProcFileRead(statFile) < 0) {
+      myDebug(2, "cannot open %s : %s", statFile->path, strerror(errno));
     }
     else {
-      char line[MAX_PROC_LINELEN];
-      if(fgets(line, MAX_PROC_LINELEN, statFile)) {
-	char *p = line;
-	char buf[MAX_PROC_TOKLEN];
-	int tok = 0;
-	while(parseNextTok(&p, " ", NO, 0, NO, buf, MAX_PROC_TOKLEN)) {
-	  switch(++tok) {
-	  case 14: // utime
-	  case 15: // stime
-	  case 16: // cutime
-	  case 17: // cstime
-	    cpu_total += strtoll(buf, NULL, 0);
-	  }
+      // the comm field (2) is in parentheses and may contain
+      // spaces,  so start counting after the last ')'.
+      char *p = strrchr(statFile->buf, ')');
+      if(p) {
+	p++;
+	int tok = 2;
+	int len;
+	while(tok < 13
+	      && UTScanToken(&p, " \n", &len))
+	  tok++;
+	for(; tok < 17; tok++) {
+	  uint64_t val64;
+	  if(!UTScanU64(&p, &val64))
+	    break;
+	  // utime, stime, cutime, cstime
+	  cpu_total += val64;
 	}
       }
-      fclose(statFile);
     }
     // accumulate delta
     if(process->last.cpu_total)
@@ -311,26 +339,16 @@ extern "C" {
   static uint64_t readProcessRAM(EVMod *mod, HSPDBusProcess *process) {
     HSP_mod_SYSTEMD *mdata = (HSP_mod_SYSTEMD *)mod->data;
     uint64_t rss = 0;
-    char path[HSP_SYSTEMD_MAX_FNAME_LEN+1];
-    sprintf(path, "/proc/%u/statm", process->pid);
-    FILE *statFile = fopen(path, "r");
-    if(statFile == NULL) {
-      myDebug(2, "cannot open %s : %s", path, strerror(errno));
+    UTProcFile *statmFile = processFile(process, &process->statmFile, "statm");
+    if(UTProcFileRead(statmFile) < 0) {
+      myDebug(2, "cannot open %s : %s", statmFile->path, strerror(errno));
     }
     else {
-      char line[MAX_PROC_LINELEN];
-      if(fgets(line, MAX_PROC_LINELEN, statFile)) {
-	char *p = line;
-	char buf[MAX_PROC_TOKLEN];
-	int tok = 0;
-	while(parseNextTok(&p, " ", NO, 0, NO, buf, MAX_PROC_TOKLEN)) {
-	  switch(++tok) {
-	  case 2: // resident
-	    rss += strtoll(buf, NULL, 0);
-	  }
-	}
-      }
-      fclose(statFile);
+      // size resident shared ...
+      char *p = statmFile->buf;
+      uint64_t size;
+      if(UTScanU64(&p, &size))
+	UTScanU64(&p, &rss);
     }
     return rss * mdata->page_size;
   }
@@ -358,28 +376,28 @@ extern "C" {
     int found = NO;
     uint64_t rd_bytes = 0;
     uint64_t wr_bytes = 0;
-    char path[HSP_SYSTEMD_MAX_FNAME_LEN+1];
-    sprintf(path, "/proc/%u/io", process->pid);
-    FILE *statFile = fopen(path, "r");
-    if(statFile == NULL) {
-      myDebug(2, "cannot open %s : %s", path, strerror(errno));
+    UTProcFile *ioFile = processFile(process, &process->ioFile, "io");
+    if(UTProcFileRead(ioFile) < 0) {
+      myDebug(2, "cannot open %s : %s", ioFile->path, strerror(errno));
     }
     else {
       found = YES;
-      char line[MAX_PROC_LINELEN];
-      while(fgets(line, MAX_PROC_LINELEN, statFile)) {
-	char var[MAX_PROC_TOKLEN];
+      char *line;
+      while((line = UTProcFileLine(ioFile)) != NULL) {
+	char *p = line;
+	char *var;
+	int varLen;
 	uint64_t val64;
-	if(sscanf(line, "%s %"SCNu64, var, &val64) == 2) {
-	  if(!strcmp(var, "read_bytes:")
-	     || !strcmp(var, "rchar:"))
+	if((var = UTScanToken(&p, " \t", &varLen)) != NULL
+	   && UTScanU64(&p, &val64)) {
+	  if(UTSCAN_TOKEN_IS(var, varLen, "read_bytes:")
+	     || UTSCAN_TOKEN_IS(var, varLen, "rchar:"))
 	    rd_bytes += val64;
-	  else if(!strcmp(var, "write_bytes:")
-		  || !strcmp(var, "wchar:"))
+	  else if(UTSCAN_TOKEN_IS(var, varLen, "write_bytes:")
+		  || UTSCAN_TOKEN_IS(var, varLen, "wchar:"))
 	    wr_bytes += val64;
 	}
       }
-      fclose(statFile);
     }
     // accumulate deltas
     if(process->last.rd_bytes) process->cntr.rd_bytes += rd_bytes - process->last.rd_bytes;
@@ -411,29 +429,38 @@ extern "C" {
     -----------------___________________________------------------
   */
 
-  static bool readCgroupCounters(EVMod *mod, char *acct, char *cgroup, char *fname, int nvals, HSPNameVal *nameVals, bool multi) {
+  static UTProcFile *cgroupFile(EVMod *mod, HSPDBusUnit *unit, char *acct, char *fname) {
     HSP_mod_SYSTEMD *mdata = (HSP_mod_SYSTEMD *)mod->data;
-    int found = 0;
     char statsFileName[HSP_SYSTEMD_MAX_FNAME_LEN+1];
-    snprintf(statsFileName, HSP_SYSTEMD_MAX_FNAME_LEN, mdata->cgroup_acct, acct, cgroup, fname);
-    FILE *statsFile = fopen(statsFileName, "r");
-    if(statsFile == NULL) {
-      myDebug(2, "cannot open %s : %s", statsFileName, strerror(errno));
+    snprintf(statsFileName, HSP_SYSTEMD_MAX_FNAME_LEN, mdata->cgroup_acct, acct, unit->cgroup, fname);
+    if(unit->procFiles == NULL)
+      unit->procFiles = UTProcFileCacheNew();
+    return UTProcFileCacheGet(unit->procFiles, statsFileName, NO);
+  }
+
+  static bool readCgroupCounters(EVMod *mod, HSPDBusUnit *unit, char *acct, char *fname, int nvals, HSPNameVal *nameVals, bool multi) {
+    int found = 0;
+    UTProcFile *statsFile = cgroupFile(mod, unit, acct, fname);
+    if(UTProcFileRead(statsFile) < 0) {
+      myDebug(2, "cannot open %s : %s", statsFile->path, strerror(errno));
     }
     else {
-      char line[HSP_SYSTEMD_MAX_STATS_LINELEN];
-      char var[HSP_SYSTEMD_MAX_STATS_LINELEN];
-      uint64_t val64;
-      char *fmt = multi ?
-	"%*s %s %"SCNu64 :
-	"%s %"SCNu64 ;
-      while(fgets(line, HSP_SYSTEMD_MAX_STATS_LINELEN, statsFile)) {
+      char *line;
+      while((line = UTProcFileLine(statsFile)) != NULL) {
 	if(found == nvals && !multi) break;
-	if(sscanf(line, fmt, var, &val64) == 2) {
+	char *p = line;
+	char *var;
+	int varLen;
+	uint64_t val64;
+	if(multi)
+	  UTScanToken(&p, " \t", &varLen); // skip device id
+	if((var = UTScanToken(&p, " \t", &varLen)) != NULL
+	   && UTScanU64(&p, &val64)) {
 	  for(int ii = 0; ii < nvals; ii++) {
 	    char *nm = nameVals[ii].nv_name;
 	    if(nm == NULL) break; // null name is double-check
-	    if(strcmp(var, nm) == 0)  {
+	    if(my_strlen(nm) == varLen
+	       && memcmp(var, nm, varLen) == 0)  {
 	      nameVals[ii].nv_found = YES;
 	      nameVals[ii].nv_val64 += val64;
 	      found++;
@@ -441,11 +468,46 @@ extern "C" {
 	  }
         }
       }
-      fclose(statsFile);
     }
     return (found > 0);
   }
 
+  /*_________________---------------------------__________________
+    _________________     readCgroupIOStat      __________________
+    -----------------___________________________------------------
+    cgroup v2 io.stat has one line per device of the form:
+    "8:0 rbytes=1459200 wbytes=314773504 rios=192 wios=353 dbytes=0 dios=0"
+  */
+
+  static bool readCgroupIOStat(EVMod *mod, HSPDBusUnit *unit, SFLHost_vrt_dsk_counters *dskio) {
+    bool found = NO;
+    UTProcFile *statsFile = cgroupFile(mod, unit, "io", "io.stat");
+    if(UTProcFileRead(statsFile) < 0) {
+      myDebug(2, "cannot open %s : %s", statsFile->path, strerror(errno));
+      return NO;
+    }
+    char *line;
+    while((line = UTProcFileLine(statsFile)) != NULL) {
+      char *p = line;
+      int len;
+      UTScanToken(&p, " \t", &len); // skip device id
+      char *var;
+      while((var = UTScanToken(&p, " \t=", &len)) != NULL
+	    && *p == '=') {
+	uint64_t val64;
+	p++;
+	if(!UTScanU64(&p, &val64))
+	  break;
+	found = YES;
+	if(UTSCAN_TOKEN_IS(var, len, "rbytes")) dskio->rd_bytes += val64;
+	else if(UTSCAN_TOKEN_IS(var, len, "wbytes")) dskio->wr_bytes += val64;
+	else if(UTSCAN_TOKEN_IS(var, len, "rios")) dskio->rd_req += val64;
+	else if(UTSCAN_TOKEN_IS(var, len, "wios")) dskio->wr_req += val64;
+      }
+    }
+    return found;
+  }
+
   /*________________---------------------------__________________
     ________________   getCounters_SYSTEMD     __________________
     ----------------___________________________------------------
@@ -516,33 +578,48 @@ extern "C" {
     enum SFLVirDomainState virState = SFL_VIR_DOMAIN_RUNNING;
     cpuElem.counterBlock.host_vrt_cpu.state = virState;
 
-    uint64_t cpu_total = 0;
-    if(unit->cpuAccounting) {
+    // one read per unit from the cgroup if we can,  otherwise
+    // fall back on reading every process in the unit.
+    uint64_t cpu_mS = 0;
+    if(mdata->cgroup2) {
+      // cpu.stat is always present on the unified hierarchy
+      HSPNameVal cpuVals[] = {
+	{ "usage_usec",0,0 },
+	{ NULL,0,0},
+      };
+      if(readCgroupCounters(mod, unit, "cpu", "cpu.stat", 1, cpuVals, NO)) {
+	if(cpuVals[0].nv_found) cpu_mS = cpuVals[0].nv_val64 / 1000;
+      }
+    }
+    else if(unit->cpuAccounting) {
+      uint64_t cpu_total = 0;
       HSPNameVal cpuVals[] = {
 	{ "user",0,0 },
 	{ "system",0,0},
 	{ NULL,0,0},
       };
-      if(readCgroupCounters(mod, "cpuacct", unit->cgroup, "cpuacct.stat", 2, cpuVals, NO)) {
+      if(readCgroupCounters(mod, unit, "cpuacct", "cpuacct.stat", 2, cpuVals, NO)) {
 	if(cpuVals[0].nv_found) cpu_total += cpuVals[0].nv_val64;
 	if(cpuVals[1].nv_found) cpu_total += cpuVals[1].nv_val64;
       }
+      cpu_mS = JIFFY_TO_MS(cpu_total);
     }
-    if(cpu_total == 0) {
-      cpu_total = accumulateProcessCPU(mod, unit);
+    if(cpu_mS == 0) {
+      cpu_mS = JIFFY_TO_MS(accumulateProcessCPU(mod, unit));
     }
-    cpuElem.counterBlock.host_vrt_cpu.cpuTime = (uint32_t)(JIFFY_TO_MS(cpu_total));
+    cpuElem.counterBlock.host_vrt_cpu.cpuTime = (uint32_t)cpu_mS;
     SFLADD_ELEMENT(&cs, &cpuElem);
 
     SFLCounters_sample_element memElem = { 0 };
     memElem.tag = SFLCOUNTERS_HOST_VRT_MEM;
     uint64_t rss = 0;
     if(unit->memoryAccounting) {
+      // v2 has no "rss",  but "anon" is the equivalent
       HSPNameVal memVals[] = {
-	{ "rss",0,0 },
+	{ mdata->cgroup2 ? "anon" : "rss",0,0 },
 	{ NULL,0,0},
       };
-      if(readCgroupCounters(mod, "memory", unit->cgroup, "memory.stat", 2, memVals, NO)) {
+      if(readCgroupCounters(mod, unit, "memory", "memory.stat", 2, memVals, NO)) {
 	if(memVals[0].nv_found) rss += memVals[0].nv_val64;
       }
     }
@@ -557,13 +634,19 @@ extern "C" {
     // VM disk I/O counters
     SFLCounters_sample_element dskElem = { 0 };
     dskElem.tag = SFLCOUNTERS_HOST_VRT_DSK;
-    if(unit->blockIOAccounting) {
+    if(mdata->cgroup2
+       && (unit->ioAccounting || unit->blockIOAccounting)
+       && readCgroupIOStat(mod, unit, &dskElem.counterBlock.host_vrt_dsk)) {
+      // got it from io.stat
+    }
+    else if(!mdata->cgroup2
+	    && unit->blockIOAccounting) {
       HSPNameVal dskValsB[] = {
 	{ "Read",0,0 },
 	{ "Write",0,0},
 	{ NULL,0,0},
       };
-      if(readCgroupCounters(mod, "blkio", unit->cgroup, "blkio.io_service_bytes_recursive", 2, dskValsB, YES)) {
+      if(readCgroupCounters(mod, unit, "blkio", "blkio.io_service_bytes_recursive", 2, dskValsB, YES)) {
 	if(dskValsB[0].nv_found) {
 	  dskElem.counterBlock.host_vrt_dsk.rd_bytes += dskValsB[0].nv_val64;
 	}
@@ -578,7 +661,7 @@ extern "C" {
 	{ NULL,0,0},
       };
 
-      if(readCgroupCounters(mod, "blkio", unit->cgroup, "blkio.io_serviced_recursive", 2, dskValsO, YES)) {
+      if(readCgroupCounters(mod, unit, "blkio", "blkio.io_serviced_recursive", 2, dskValsO, YES)) {
 	if(dskValsO[0].nv_found) {
 	  dskElem.counterBlock.host_vrt_dsk.rd_req += dskValsO[0].nv_val64;
 	}
@@ -751,6 +834,18 @@ extern "C" {
     }
   }
 
+  static void handler_ioAccounting(EVMod *mod, DBusMessage *dbm, void *magic) {
+    HSPDBusUnit *unit = (HSPDBusUnit *)magic;
+    DBusMessageIter it;
+    if(dbus_message_iter_init(dbm, &it)) {
+      MyDBusBasicValue val;
+      if(db_get(&it, DBUS_TYPE_BOOLEAN, &val)) {
+	myDebug(1, "UNIT IOAccounting %u", val.bool_val);
+	unit->ioAccounting = val.bool_val;
+      }
+    }
+  }
+
   /*_________________---------------------------__________________
     _________________   handler_controlGroup    __________________
     -----------------___________________________------------------
@@ -785,15 +880,18 @@ extern "C" {
 
 	char path[HSP_SYSTEMD_MAX_FNAME_LEN+1];
 	sprintf(path, mdata->cgroup_procs, val.str);
-	FILE *pidsFile = fopen(path, "r");
-	if(pidsFile == NULL) {
+	if(unit->procFiles == NULL)
+	  unit->procFiles = UTProcFileCacheNew();
+	UTProcFile *pidsFile = UTProcFileCacheGet(unit->procFiles, path, NO);
+	if(UTProcFileRead(pidsFile) < 0) {
 	  myDebug(2, "cannot open %s : %s", path, strerror(errno));
 	}
 	else {
-	  char line[MAX_PROC_LINELEN];
+	  char *line;
 	  uint64_t pid64;
-	  while(fgets(line, MAX_PROC_LINELEN, pidsFile)) {
-	    if(sscanf(line, "%"SCNu64, &pid64) == 1) {
+	  while((line = UTProcFileLine(pidsFile)) != NULL) {
+	    char *p = line;
+	    if(UTScanU64(&p, &pid64)) {
 	      myDebug(1, "got PID=%"PRIu64, pid64);
 	      HSPDBusProcess search = { .pid = pid64 };
 	      process = UTHashGet(unit->processes, &search);
@@ -806,19 +904,20 @@ extern "C" {
 	      }
 	    }
 	  }
-	  fclose(pidsFile);
 
 	  if(UTHashN(unit->processes)) {
 	    // mark and sweep - sweep
 	    UTHASH_WALK(unit->processes, process)
 	      if(process->marked)
 		if(UTHashDel(unit->processes, process))
-		  my_free(process);
+		  HSPDBusProcessFree(process);
 	    // find or allocate the container
 	    getContainer(mod, unit, YES);
 	    getDbusProperty(mod, unit, handler_cpuAccounting, "CPUAccounting");
 	    getDbusProperty(mod, unit, handler_memoryAccounting, "MemoryAccounting");
 	    getDbusProperty(mod, unit, handler_blockIOAccounting, "BlockIOAccounting");
+	    if(mdata->cgroup2)
+	      getDbusProperty(mod, unit, handler_ioAccounting, "IOAccounting");
 	    // TODO: could try and get "MemoryCurrent" and "CPUUsageNSec" here, but since they
 	    // are usually not limited,  these numbers are usually == (uint64_t)-1.  So
 	    // we have to get the numbers from the cgroup accounting (if enabled) or fall
@@ -1156,13 +1255,21 @@ static DBusHandlerResult dbusCB(DBusConnection *connection, DBusMessage *message
     HSP *sp = (HSP *)EVROOTDATA(mod);
 
     if(sp->systemd.dropPriv == NO)
-      retainRootRequest(mod, "needed to read /proc/<pid>/io (if cgroup BlockIOAccounting is off).");
+      retainRootRequest(mod, "needed to read /proc/<pid>/io (if cgroup BlockIOAccounting/IOAccounting is off).");
 
     requestVNodeRole(mod, HSP_VNODE_PRIORITY_SYSTEMD);
 
+    // cgroup v2 (unified hierarchy) has different file names and paths
+    struct statfs cgfs;
+    if(statfs("/sys/fs/cgroup", &cgfs) == 0
+       && cgfs.f_type == CGROUP2_SUPER_MAGIC) {
+      myDebug(1, "systemd: cgroup v2");
+      mdata->cgroup2 = YES;
+    }
+
     // path formats for cgroup info - can be overridden in config
-    mdata->cgroup_procs = sp->systemd.cgroup_procs ?: HSP_SYSTEMD_CGROUP_PROCS;
-    mdata->cgroup_acct = sp->systemd.cgroup_acct ?: HSP_SYSTEMD_CGROUP_ACCT;
+    mdata->cgroup_procs = sp->systemd.cgroup_procs ?: (mdata->cgroup2 ? HSP_SYSTEMD_CGROUP2_PROCS : HSP_SYSTEMD_CGROUP_PROCS);
+    mdata->cgroup_acct = sp->systemd.cgroup_acct ?: (mdata->cgroup2 ? HSP_SYSTEMD_CGROUP2_ACCT : HSP_SYSTEMD_CGROUP_ACCT);
     
     // get page size for scaling memory pages->bytes
 #if defined(PAGESIZE)
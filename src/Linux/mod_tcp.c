@@ -97,6 +97,7 @@ extern "C" {
 
 #define HSP_READNL_RCV_BUF 8192
 #define HSP_READNL_BATCH 100
+#define HSP_READNL_RECVMMSG_MAX 16
 
   typedef struct _HSPTCPSample {
     struct _HSPTCPSample *prev; // timeoutQ
@@ -108,14 +109,51 @@ extern "C" {
     struct inet_diag_req_v2 conn_req;
     struct timespec qtime;
 #define HSP_TCP_TIMEOUT_MS 400
+    uint64_t joined_nS; // sum of ages at which samples joined this request
     EnumPktDirection pktdirn;
   } HSPTCPSample;
-    
+
+  // Recent tcp_info results,  so that samples from busy connections
+  // can be annotated straight away instead of being held for a lookup.
+  typedef struct _HSPTCPInfo {
+    struct _HSPTCPInfo *prev; // LRU
+    struct _HSPTCPInfo *next; // LRU
+    struct inet_diag_sockid id;
+    struct my_tcp_info tcpi;
+    struct timespec rtime;
+  } HSPTCPInfo;
+#define HSP_TCP_CACHE_MAX 4096
+#define HSP_TCP_CACHE_TTL_MS 1000
+
+  // With this many lookups pending,  stop asking for sockets one
+  // at a time and dump all the established ones instead (at most
+  // once per interval for each address family).  The interval grows
+  // by HSP_TCP_DUMP_INTERVAL_MS for every HSP_TCP_DUMP_SOCKETS sockets
+  // in the last dump,  so a host with a huge socket table is not
+  // walked over and over.
+#define HSP_TCP_DUMP_PENDING 64
+#define HSP_TCP_DUMP_INTERVAL_MS 100
+#define HSP_TCP_DUMP_INTERVAL_MAX_MS HSP_TCP_CACHE_TTL_MS
+#define HSP_TCP_DUMP_SOCKETS 1000
+#define HSP_TCP_DUMP_LOST_MS 1000
+
   typedef struct _HSP_mod_TCP {
     EVBus *packetBus;
     int nl_sock;
+    UTRecvBatch *recvBatch;
     UTHash *sampleHT;
     UTQ(HSPTCPSample) timeoutQ;
+    EVTimer *timeoutTimer;
+    UTHash *cacheHT;
+    UTQ(HSPTCPInfo) cacheQ;
+    bool dumpInFlight;
+    uint32_t dumpWant; // bit per address family (HSP_TCP_DUMP_V4/V6)
+#define HSP_TCP_DUMP_V4 1
+#define HSP_TCP_DUMP_V6 2
+    struct timespec dumpTime[3];
+    uint32_t dumpBit; // family in flight
+    uint32_t dumpCount; // sockets so far
+    uint32_t dumpSockets[3]; // in the last dump of each family
   } HSP_mod_TCP;
 
 
@@ -146,6 +184,46 @@ extern "C" {
     return buf;
   }
 
+  /*_________________---------------------------__________________
+    _________________      tcp_info cache       __________________
+    -----------------___________________________------------------
+  */
+
+  static HSPTCPInfo *tcpCacheGet(HSP_mod_TCP *mdata, struct inet_diag_sockid *id) {
+    HSPTCPInfo search = { .id = *id };
+    HSPTCPInfo *ti = UTHashGet(mdata->cacheHT, &search);
+    if(ti == NULL
+       || EVTimeDiff_mS(&ti->rtime, &mdata->packetBus->now) > HSP_TCP_CACHE_TTL_MS)
+      return NULL;
+    // most recently used goes to the back
+    UTQ_REMOVE(mdata->cacheQ, ti);
+    UTQ_ADD_TAIL(mdata->cacheQ, ti);
+    return ti;
+  }
+
+  static void tcpCachePut(HSP_mod_TCP *mdata, struct inet_diag_sockid *id, struct my_tcp_info *tcpi, bool add) {
+    HSPTCPInfo search = { .id = *id };
+    HSPTCPInfo *ti = UTHashGet(mdata->cacheHT, &search);
+    if(ti)
+      UTQ_REMOVE(mdata->cacheQ, ti);
+    else {
+      if(!add)
+	return;
+      if(UTHashN(mdata->cacheHT) >= HSP_TCP_CACHE_MAX) {
+	// recycle the least recently used
+	UTQ_REMOVE_HEAD(mdata->cacheQ, ti);
+	UTHashDel(mdata->cacheHT, ti);
+      }
+      else
+	ti = (HSPTCPInfo *)my_calloc(sizeof(HSPTCPInfo));
+      ti->id = *id;
+      UTHashAdd(mdata->cacheHT, ti);
+    }
+    ti->tcpi = *tcpi;
+    ti->rtime = mdata->packetBus->now;
+    UTQ_ADD_TAIL(mdata->cacheQ, ti);
+  }
+
   /*_________________---------------------------__________________
     _________________    diag_sockid_print      __________________
     -----------------___________________________------------------
@@ -174,13 +252,14 @@ extern "C" {
   */
 
 #define MAGIC_SEQ 0x50C00L
+#define MAGIC_SEQ_DUMP 0x50C01L
 
-  static int send_diag_msg(int sockfd, struct inet_diag_req_v2 *conn_req) {
+  static int send_diag_msg(int sockfd, struct inet_diag_req_v2 *conn_req, uint16_t flags, uint32_t seq) {
     struct nlmsghdr nlh = { 0 };
     nlh.nlmsg_len = NLMSG_LENGTH(sizeof(*conn_req));
-    nlh.nlmsg_flags = NLM_F_REQUEST;
+    nlh.nlmsg_flags = NLM_F_REQUEST | flags;
     nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
-    nlh.nlmsg_seq = MAGIC_SEQ;
+    nlh.nlmsg_seq = seq;
 
     struct iovec iov[2];
     iov[0].iov_base = (void*) &nlh;
@@ -200,15 +279,98 @@ extern "C" {
     return sendmsg(sockfd, &msg, 0);
   }
 
+  /*_________________---------------------------__________________
+    _________________     tcpDump               __________________
+    -----------------___________________________------------------
+    Ask for tcp_info on every established socket in one address
+    family.  Only one dump can be in progress on the socket,  so
+    the next family (if wanted) is requested when this one is done.
+  */
+
+  static int tcpDumpInterval_mS(HSP_mod_TCP *mdata, uint32_t bit) {
+    uint32_t interval = HSP_TCP_DUMP_INTERVAL_MS * (1 + (mdata->dumpSockets[bit] / HSP_TCP_DUMP_SOCKETS));
+    return (interval < HSP_TCP_DUMP_INTERVAL_MAX_MS) ? interval : HSP_TCP_DUMP_INTERVAL_MAX_MS;
+  }
+
+  static void tcpDump(EVMod *mod) {
+    HSP_mod_TCP *mdata = (HSP_mod_TCP *)mod->data;
+    if(mdata->dumpInFlight) {
+      if(EVTimeDiff_mS(&mdata->dumpTime[0], &mdata->packetBus->now) < HSP_TCP_DUMP_LOST_MS)
+	return;
+      myDebug(1, "TCP dump never completed");
+      mdata->dumpInFlight = NO;
+    }
+    for(uint32_t bit = HSP_TCP_DUMP_V4; bit <= HSP_TCP_DUMP_V6; bit <<= 1) {
+      if((mdata->dumpWant & bit)
+	 && EVTimeDiff_mS(&mdata->dumpTime[bit], &mdata->packetBus->now) >= tcpDumpInterval_mS(mdata, bit)) {
+	struct inet_diag_req_v2 conn_req = { 0 };
+	conn_req.sdiag_family = (bit == HSP_TCP_DUMP_V4) ? AF_INET : AF_INET6;
+	conn_req.sdiag_protocol = IPPROTO_TCP;
+	conn_req.idiag_states = (1<<TCP_ESTABLISHED);
+	conn_req.idiag_ext |= (1 << (INET_DIAG_INFO - 1));
+	if(send_diag_msg(mdata->nl_sock, &conn_req, NLM_F_DUMP, MAGIC_SEQ_DUMP) == -1) {
+	  myDebug(1, "TCP dump request failed: %s", strerror(errno));
+	  return;
+	}
+	mdata->dumpWant &= ~bit;
+	mdata->dumpInFlight = YES;
+	mdata->dumpBit = bit;
+	mdata->dumpCount = 0;
+	mdata->dumpTime[0] = mdata->dumpTime[bit] = mdata->packetBus->now;
+	HSP_TELEMETRY_ADD((HSP *)EVROOTDATA(mod), HSP_TELEMETRY_TCP_DUMPS, 1);
+	return;
+      }
+    }
+  }
+
+  /*_________________---------------------------__________________
+    _________________     tcpSampleRelease      __________________
+    -----------------___________________________------------------
+    Annotate the held samples (if we got an answer),  let them go
+    and account for how long they were held.
+  */
+
+  static void addTCPInfo(HSPPendingSample *ps, EnumPktDirection dirn, struct my_tcp_info *tcpi) {
+    SFLFlow_sample_element *tcpElem = pendingSample_calloc(ps, sizeof(SFLFlow_sample_element));
+    tcpElem->tag = SFLFLOW_EX_TCP_INFO;
+    tcpElem->flowType.tcp_info.dirn = dirn;
+    tcpElem->flowType.tcp_info.snd_mss = tcpi->tcpi_snd_mss;
+    tcpElem->flowType.tcp_info.rcv_mss = tcpi->tcpi_rcv_mss;
+    tcpElem->flowType.tcp_info.unacked = tcpi->tcpi_unacked;
+    tcpElem->flowType.tcp_info.lost = tcpi->tcpi_lost;
+    tcpElem->flowType.tcp_info.retrans = tcpi->tcpi_total_retrans;
+    tcpElem->flowType.tcp_info.pmtu = tcpi->tcpi_pmtu;
+    tcpElem->flowType.tcp_info.rtt = tcpi->tcpi_rtt;
+    tcpElem->flowType.tcp_info.rttvar = tcpi->tcpi_rttvar;
+    tcpElem->flowType.tcp_info.snd_cwnd = tcpi->tcpi_snd_cwnd;
+    tcpElem->flowType.tcp_info.reordering = tcpi->tcpi_reordering;
+    tcpElem->flowType.tcp_info.min_rtt = tcpi->tcpi_min_rtt;
+    // add to sample
+    SFLADD_ELEMENT(ps->fs, tcpElem);
+  }
+
+  static void tcpSampleRelease(EVMod *mod, HSPTCPSample *ts, struct my_tcp_info *tcpi) {
+    HSP_mod_TCP *mdata = (HSP_mod_TCP *)mod->data;
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    HSPPendingSample *ps;
+    UTARRAY_WALK(ts->samples, ps) {
+      if(tcpi)
+	addTCPInfo(ps, ts->pktdirn, tcpi);
+      releasePendingSample(sp, ps);
+    }
+    uint64_t age_nS = EVTimeDiff_nS(&ts->qtime, &mdata->packetBus->now);
+    uint64_t held_nS = (age_nS * UTArrayN(ts->samples)) - ts->joined_nS;
+    HSP_TELEMETRY_ADD(sp, HSP_TELEMETRY_TCP_HELD_US, held_nS / 1000);
+  }
+
   /*_________________---------------------------__________________
     _________________     parse_diag_msg        __________________
     -----------------___________________________------------------
   */
 
-  static void parse_diag_msg(EVMod *mod, struct inet_diag_msg *diag_msg, int rtalen)
+  static void parse_diag_msg(EVMod *mod, struct inet_diag_msg *diag_msg, int rtalen, bool dump)
   {
     HSP_mod_TCP *mdata = (HSP_mod_TCP *)mod->data;
-    HSP *sp = (HSP *)EVROOTDATA(mod);
 
     // user info.  Prefer getpwuid_r() if avaiable...
     // struct passwd *uid_info = getpwuid(diag_msg->idiag_uid);
@@ -249,32 +411,15 @@ extern "C" {
 	  // now see if we can get back to the sample that triggered this lookup
 	  HSPTCPSample search = { .conn_req.id = diag_msg->id };
 	  HSPTCPSample *found = UTHashDelKey(mdata->sampleHT, &search);
+	  // remember it for next time,  but a dump tells us about every
+	  // socket so only keep the ones we are interested in
+	  tcpCachePut(mdata, &diag_msg->id, &tcpi, (found || !dump));
 	  if(found) {
 	    myDebug(1, "found TCPSample: %s RTT:%uuS", tcpSamplePrint(found), tcpi.tcpi_rtt);
 	    // unlink from Q
 	    UTQ_REMOVE(mdata->timeoutQ, found);
-	    HSPPendingSample *ps;
-	    UTARRAY_WALK(found->samples, ps) {
-	      // populate tcp_info structure
-	      SFLFlow_sample_element *tcpElem = pendingSample_calloc(ps, sizeof(SFLFlow_sample_element));
-	      tcpElem->tag = SFLFLOW_EX_TCP_INFO;
-	      tcpElem->flowType.tcp_info.dirn = found->pktdirn;
-	      tcpElem->flowType.tcp_info.snd_mss = tcpi.tcpi_snd_mss;
-	      tcpElem->flowType.tcp_info.rcv_mss = tcpi.tcpi_rcv_mss;
-	      tcpElem->flowType.tcp_info.unacked = tcpi.tcpi_unacked;
-	      tcpElem->flowType.tcp_info.lost = tcpi.tcpi_lost;
-	      tcpElem->flowType.tcp_info.retrans = tcpi.tcpi_total_retrans;
-	      tcpElem->flowType.tcp_info.pmtu = tcpi.tcpi_pmtu;
-	      tcpElem->flowType.tcp_info.rtt = tcpi.tcpi_rtt;
-	      tcpElem->flowType.tcp_info.rttvar = tcpi.tcpi_rttvar;
-	      tcpElem->flowType.tcp_info.snd_cwnd = tcpi.tcpi_snd_cwnd;
-	      tcpElem->flowType.tcp_info.reordering = tcpi.tcpi_reordering;
-	      tcpElem->flowType.tcp_info.min_rtt = tcpi.tcpi_min_rtt;
-	      // add to sample
-	      SFLADD_ELEMENT(ps->fs, tcpElem);
-	      // release sample
-	      releasePendingSample(sp, ps);
-	    }
+	    // annotate and release samples
+	    tcpSampleRelease(mod, found, &tcpi);
 	    // and free my control-block
 	    tcpSampleFree(found);
 	  }
@@ -292,17 +437,41 @@ extern "C" {
   static void readNL(EVMod *mod, EVSocket *sock, void *magic)
   {
     HSP_mod_TCP *mdata = (HSP_mod_TCP *)mod->data;
-    uint8_t recv_buf[HSP_READNL_RCV_BUF];
+    UTRecvBatch *rb = mdata->recvBatch;
     int batch = 0;
+    int rxN = 0, rxI = 0, rxWant = 0;
     if(mdata->nl_sock > 0) {
       for( ; batch < HSP_READNL_BATCH; batch++) {
-	int numbytes = recv(mdata->nl_sock, recv_buf, sizeof(recv_buf), 0);
+	if(rxI == rxN) {
+	  if(rxN && rxN < rxWant) break; // drained
+	  // don't take more than we will get through this time
+	  rxWant = HSP_READNL_BATCH - batch;
+	  if(rxWant > rb->batch) rxWant = rb->batch;
+	  rxN = UTRecvBatchReadMax(rb, rxWant);
+	  rxI = 0;
+	  if(rxN <= 0) break;
+	}
+	uint8_t *recv_buf = UTRecvBatchBuf(rb, rxI);
+	int numbytes = UTRecvBatchLen(rb, rxI);
+	rxI++;
 	if(numbytes <= 0)
-	  break;
+	  continue;
 	struct nlmsghdr *nlh = (struct nlmsghdr*) recv_buf;
 	while(NLMSG_OK(nlh, numbytes)){
-	  if(nlh->nlmsg_type == NLMSG_DONE)
+	  if(nlh->nlmsg_type == NLMSG_DONE) {
+	    if(nlh->nlmsg_seq == MAGIC_SEQ_DUMP) {
+	      // dump complete - note how big and how long,  and
+	      // maybe start the next one
+	      struct timespec done;
+	      EVClockMono(&done);
+	      HSP_TELEMETRY_ADD((HSP *)EVROOTDATA(mod), HSP_TELEMETRY_TCP_DUMP_US,
+				EVTimeDiff_nS(&mdata->dumpTime[0], &done) / 1000);
+	      mdata->dumpSockets[mdata->dumpBit] = mdata->dumpCount;
+	      mdata->dumpInFlight = NO;
+	      tcpDump(mod);
+	    }
 	    break;
+	  }
 	  if(nlh->nlmsg_type == NLMSG_ERROR){
             struct nlmsgerr *err_msg = (struct nlmsgerr *)NLMSG_DATA(nlh);
 	    // Frequently see:
@@ -310,28 +479,48 @@ extern "C" {
 	    // "netlink error" (IPv6 but connection not established)
 	    // so only log when debugging:
 	    myDebug(1, "Error in netlink message: %d : %s", err_msg->error, strerror(-err_msg->error));
+	    if(nlh->nlmsg_seq == MAGIC_SEQ_DUMP)
+	      mdata->dumpInFlight = NO;
 	    break;
 	  }
-	  if(nlh->nlmsg_seq == MAGIC_SEQ) {
+	  if(nlh->nlmsg_seq == MAGIC_SEQ
+	     || nlh->nlmsg_seq == MAGIC_SEQ_DUMP) {
 	    struct inet_diag_msg *diag_msg = (struct inet_diag_msg*) NLMSG_DATA(nlh);
 	    int rtalen = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*diag_msg));
-	    parse_diag_msg(mod, diag_msg, rtalen);
+	    if(nlh->nlmsg_seq == MAGIC_SEQ_DUMP)
+	      mdata->dumpCount++;
+	    parse_diag_msg(mod, diag_msg, rtalen, (nlh->nlmsg_seq == MAGIC_SEQ_DUMP));
 	  }
 	  nlh = NLMSG_NEXT(nlh, numbytes);
 	}
       }
     }
+    // write out the samples we let go
+    pendingSampleBatchFlush((HSP *)EVROOTDATA(mod));
   }
 
   /*_________________---------------------------__________________
-    _________________       evt_deci            __________________
+    _________________       timeout             __________________
     -----------------___________________________------------------
+    One-shot timer, armed for the oldest request in the timeoutQ,
+    so we only wake up when there is something to time out.  If the
+    timer could not be created we fall back to checking on every
+    deci-tick instead.
   */
 
-  static void evt_deci(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+  static void tcpTimeoutArm(HSP_mod_TCP *mdata) {
+    HSPTCPSample *ts = mdata->timeoutQ.head;
+    if(ts
+       && mdata->timeoutTimer) {
+      int age_mS = EVTimeDiff_mS(&ts->qtime, &mdata->packetBus->now);
+      int due_mS = HSP_TCP_TIMEOUT_MS - age_mS + 1;
+      EVTimerSet(mdata->timeoutTimer, (due_mS > 0) ? due_mS : 1, 0);
+    }
+  }
+
+  static void tcpTimeout(EVMod *mod, EVTimer *timer, void *magic) {
     HSP_mod_TCP *mdata = (HSP_mod_TCP *)mod->data;
-    HSP *sp = (HSP *)EVROOTDATA(mod);
-    // myLog(LOG_INFO, "evt_deci: samplerHT elements=%u", UTHashN(mdata->sampleHT));
+    // myLog(LOG_INFO, "tcpTimeout: samplerHT elements=%u", UTHashN(mdata->sampleHT));
     for(HSPTCPSample *ts = mdata->timeoutQ.head; ts; ) {
       if(EVTimeDiff_nS(&ts->qtime, &mdata->packetBus->now) <= (HSP_TCP_TIMEOUT_MS * 1000000)) {
 	// not timed-out yet: we know everything after this point is current, so stop walking.
@@ -345,16 +534,19 @@ extern "C" {
 	// remove from HT
 	UTHashDel(mdata->sampleHT, ts);
 	// let the samples go
-	HSPPendingSample *ps;
-	UTARRAY_WALK(ts->samples, ps) {
-	  releasePendingSample(sp, ps);
-	}
+	tcpSampleRelease(mod, ts, NULL);
 	// free
 	tcpSampleFree(ts);
 	// walk
 	ts = next_ts;
       }
     }
+    // and wait for the next one
+    tcpTimeoutArm(mdata);
+  }
+
+  static void evt_deci(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    tcpTimeout(mod, NULL, NULL);
   }
 
   /*_________________---------------------------__________________
@@ -607,12 +799,22 @@ extern "C" {
 	    // I have no cookie :(
 	    sockid->idiag_cookie[0] = INET_DIAG_NOCOOKIE;
 	    sockid->idiag_cookie[1] = INET_DIAG_NOCOOKIE;
+	    // looked this one up recently?
+	    HSPTCPInfo *cached = tcpCacheGet(mdata, sockid);
+	    if(cached) {
+	      HSP_TELEMETRY_ADD(sp, HSP_TELEMETRY_TCP_CACHE_HITS, 1);
+	      addTCPInfo(ps, tcpSample->pktdirn, &cached->tcpi);
+	      tcpSampleFree(tcpSample);
+	      continue;
+	    }
+	    HSP_TELEMETRY_ADD(sp, HSP_TELEMETRY_TCP_CACHE_MISSES, 1);
 	    // put a hold on this one while we look it up
 	    holdPendingSample(ps);
 	    HSPTCPSample *tsInQ = UTHashGet(mdata->sampleHT, tcpSample);
 	    if(tsInQ) {
 	      myDebug(1, "request already pending");
 	      UTArrayAdd(tsInQ->samples, ps);
+	      tsInQ->joined_nS += EVTimeDiff_nS(&tsInQ->qtime, &mdata->packetBus->now);
 	      tcpSampleFree(tcpSample);
 	    }
 	    else {
@@ -621,8 +823,17 @@ extern "C" {
 	      // add to HT and timeout queue
 	      UTHashAdd(mdata->sampleHT, tcpSample);
 	      UTQ_ADD_TAIL(mdata->timeoutQ, tcpSample);
-	      // send the netlink request
-	      send_diag_msg(mdata->nl_sock, &tcpSample->conn_req);
+	      if(mdata->timeoutQ.head == tcpSample)
+		tcpTimeoutArm(mdata);
+	      if(UTHashN(mdata->sampleHT) < HSP_TCP_DUMP_PENDING) {
+		// send the netlink request
+		send_diag_msg(mdata->nl_sock, &tcpSample->conn_req, 0, MAGIC_SEQ);
+	      }
+	      else {
+		// too many to ask about one at a time
+		mdata->dumpWant |= (ip_ver == 4) ? HSP_TCP_DUMP_V4 : HSP_TCP_DUMP_V6;
+		tcpDump(mod);
+	      }
 	    }
 	  }
 	}
@@ -660,6 +871,8 @@ extern "C" {
       return;
     }
 
+    mdata->recvBatch = UTRecvBatchNew(mdata->nl_sock, "inet_diag", HSP_READNL_RECVMMSG_MAX, HSP_READNL_RCV_BUF);
+    UTRecvBatchTelemetry(mdata->recvBatch, &((HSP *)EVROOTDATA(mod))->telemetry[HSP_TELEMETRY_RX_INET_DIAG_CALLS]);
     EVBusAddSocket(mod, mdata->packetBus, mdata->nl_sock, readNL, NULL);
   }
 
@@ -675,10 +888,17 @@ extern "C" {
     // trim the hash-key len to select only the socket part of inet_diag_sockid
     // and leave out the interface and the cookie
     mdata->sampleHT->f_len = 36;
+    // same for the tcp_info cache
+    mdata->cacheHT = UTHASH_NEW(HSPTCPInfo, id, UTHASH_DFLT);
+    mdata->cacheHT->f_len = 36;
     // register call-backs
     mdata->packetBus = EVGetBus(mod, HSPBUS_PACKET, YES);
     EVEventRx(mod, EVGetEvent(mdata->packetBus, HSPEVENT_CONFIG_FIRST), evt_config_first);
-    EVEventRx(mod, EVGetEvent(mdata->packetBus, EVEVENT_DECI), evt_deci);
+    mdata->timeoutTimer = EVBusAddTimer(mod, mdata->packetBus, tcpTimeout, NULL);
+    if(mdata->timeoutTimer == NULL) {
+      myLog(LOG_ERR, "TCP: no timeout timer - checking for timeouts on deci-tick instead");
+      EVEventRx(mod, EVGetEvent(mdata->packetBus, EVEVENT_DECI), evt_deci);
+    }
     EVEventRx(mod, EVGetEvent(mdata->packetBus, HSPEVENT_FLOW_SAMPLE), evt_flow_sample);
   }
 
@@ -25,6 +25,8 @@ extern "C" {
     struct sockaddr_nl ulog_bind;
     uint32_t subSamplingRate;
     uint32_t actualSamplingRate;
+    uint32_t samplingRate; // as requested
+    HSPSamplingCtl *ctl;
   } HSP_mod_ULOG;
 
   /*_________________---------------------------__________________
@@ -89,6 +91,8 @@ extern "C" {
 	      /* reached zero. Set the next skip */
 	      uint32_t sr = mdata->subSamplingRate;
 	      MySkipCount = sr == 1 ? 1 : sfl_random((2 * sr) - 1);
+	      if(mdata->ctl)
+		samplingCtlCount(mdata->ctl);
 
 	      /* and take a sample */
 
@@ -132,6 +136,7 @@ extern "C" {
 	}
       }
     }
+    pendingSampleBatchFlush(sp);
   }
 
   /*_________________---------------------------__________________
@@ -190,12 +195,11 @@ extern "C" {
     -----------------___________________________------------------
   */
 
-  static void setSamplingRate(EVMod *mod) {
+  static void setSamplingRate(EVMod *mod, uint32_t samplingRate) {
     HSP_mod_ULOG *mdata = (HSP_mod_ULOG *)mod->data;
     HSP *sp = (HSP *)EVROOTDATA(mod);
 
-    uint32_t samplingRate = sp->sFlowSettings->samplingRate;
-
+    mdata->samplingRate = samplingRate;
     // set defaults assuming we will get 1:1 on ULOG or NFLOG and do our own sampling.
     mdata->subSamplingRate = samplingRate;
     mdata->actualSamplingRate = samplingRate;
@@ -230,7 +234,8 @@ extern "C" {
     if(sp->sFlowSettings == NULL)
       return; // no config (yet - may be waiting for DNS-SD)
 
-    setSamplingRate(mod);
+    setSamplingRate(mod, sp->sFlowSettings->samplingRate);
+    samplingCtlSetBase(mdata->ctl, mdata->actualSamplingRate);
 
     if(mdata->ulog_configured) {
       // already configured from the first time (when we still had root privileges)
@@ -240,8 +245,11 @@ extern "C" {
     if(sp->ulog.group != 0) {
       // ULOG group is set, so open the netfilter socket to ULOG
       int fd = openULOG(mod);
-      if(fd > 0)
+      if(fd > 0) {
 	EVBusAddSocket(mod, mdata->packetBus, fd, readPackets_ulog, NULL);
+	if(!sp->hardwareSampling)
+	  mdata->ctl = samplingCtlNew(sp, "ulog", mdata->actualSamplingRate);
+      }
     }
 
     mdata->ulog_configured = YES;
@@ -253,7 +261,27 @@ extern "C" {
   */
 
   static void evt_intfs_changed(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
-    setSamplingRate(mod);
+    HSP_mod_ULOG *mdata = (HSP_mod_ULOG *)mod->data;
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    setSamplingRate(mod, mdata->ctl ? samplingCtlRate(mdata->ctl) : sp->sFlowSettings->samplingRate);
+  }
+
+  /*_________________---------------------------__________________
+    _________________    evt_tick               __________________
+    -----------------___________________________------------------
+    The ULOG probability is set by the iptables rule,  so all the
+    adaptive sampling controller can change is our sub-sampling.
+  */
+
+  static void evt_tick(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    HSP_mod_ULOG *mdata = (HSP_mod_ULOG *)mod->data;
+    if(mdata->ctl) {
+      uint32_t rate = samplingCtlRate(mdata->ctl);
+      if(rate != mdata->samplingRate) {
+	setSamplingRate(mod, rate);
+	myDebug(1, "ULOG: sampling rate %u (sub-sampling %u)", mdata->actualSamplingRate, mdata->subSamplingRate);
+      }
+    }
   }
 
   /*_________________---------------------------__________________
@@ -267,6 +295,7 @@ extern "C" {
     mdata->packetBus = EVGetBus(mod, HSPBUS_PACKET, YES);
     EVEventRx(mod, EVGetEvent(mdata->packetBus, HSPEVENT_CONFIG_CHANGED), evt_config_changed);
     EVEventRx(mod, EVGetEvent(mdata->packetBus, HSPEVENT_INTFS_CHANGED), evt_intfs_changed);
+    EVEventRx(mod, EVGetEvent(mdata->packetBus, EVEVENT_TICK), evt_tick);
   }
 
 #if defined(__cplusplus)
@@ -433,6 +433,7 @@ extern "C" {
       myAdaptors.adaptors = adaptors;
       myAdaptors.capacity = HSP_MAX_VIFS;
       myAdaptors.num_adaptors = 0;
+      myAdaptors.byName = myAdaptors.byIndex = NULL;
       adaptorsElem.counterBlock.adaptors = xenstat_adaptors(mod, state->domId, &myAdaptors, HSP_MAX_VIFS);
       SFLADD_ELEMENT(cs, &adaptorsElem);
 
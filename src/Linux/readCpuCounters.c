@@ -15,21 +15,39 @@ extern "C" {
     -----------------___________________________------------------
   */
 
+  // these files are re-read on every poll,  so keep them open
+  static UTProcFile *pf_loadavg;
+  static UTProcFile *pf_stat;
+  static UTProcFile *pf_uptime;
+  static UTProcFile *pf_cpuinfo;
+
   int readCpuCounters(SFLHost_cpu_counters *cpu) {
     int gotData = NO;
-    FILE *procFile;
+    char *p;
     // We assume that the cpu counters struct has been initialized
     // with all zeros.
-    procFile= fopen("/proc/loadavg", "r");
-    if(procFile) {
-      // The docs are pretty clear about %f being "float" rather
-      // that "double", so just give the pointers to fscanf.
-      if(fscanf(procFile, "%f %f %f %"SCNu32"/%"SCNu32"",
-		&cpu->load_one,
-		&cpu->load_five,
-		&cpu->load_fifteen,
-		&cpu->proc_run,
-		&cpu->proc_total) == 5) {
+    if(pf_loadavg == NULL) {
+      pf_loadavg = UTProcFileNew("/proc/loadavg", YES);
+      pf_stat = UTProcFileNew("/proc/stat", YES);
+      pf_uptime = UTProcFileNew("/proc/uptime", YES);
+      // the first "cpu MHz" line is near the top,  and the whole
+      // file can be large on a host with many cores.
+      pf_cpuinfo = UTProcFileNew("/proc/cpuinfo", YES);
+      pf_cpuinfo->maxLen = 4096;
+    }
+
+    if(UTProcFileRead(pf_loadavg) > 0) {
+      double load_one, load_five, load_fifteen;
+      p = pf_loadavg->buf;
+      if(UTScanDouble(&p, &load_one)
+	 && UTScanDouble(&p, &load_five)
+	 && UTScanDouble(&p, &load_fifteen)
+	 && UTScanU32(&p, &cpu->proc_run)
+	 && *p++ == '/'
+	 && UTScanU32(&p, &cpu->proc_total)) {
+	cpu->load_one = (float)load_one;
+	cpu->load_five = (float)load_five;
+	cpu->load_fifteen = (float)load_fifteen;
 	gotData = YES;
       }
       if(cpu->proc_run > 0) {
@@ -38,60 +56,43 @@ extern "C" {
 	// Dave Mangot for pointing this out.
 	cpu->proc_run--;
       }
-      fclose(procFile);
     }
 
-    procFile = fopen("/proc/stat", "r");
-    if(procFile) {
+    if(UTProcFileRead(pf_stat) > 0) {
       // ASCII numbers in /proc/stat may be 64-bit (if not now
       // then someday), so it seems safer to read into
-      // 64-bit ints with scanf first,  then copy them
+      // 64-bit ints first,  then copy them
       // into the host_cpu structure from there. This also
       // allows us to convert "jiffies" to milliseconds.
-      uint64_t cpu_user=0;
-      uint64_t cpu_nice =0;
-      uint64_t cpu_system=0;
-      uint64_t cpu_idle=0;
-      uint64_t cpu_wio=0;
-      uint64_t cpu_intr=0;
-      uint64_t cpu_sintr=0;
+      uint64_t cpu_ticks[10] = { 0 };
       uint64_t cpu_interrupts=0;
       uint64_t cpu_contexts=0;
-      uint64_t cpu_steal=0;
-      uint64_t cpu_guest=0;
-      uint64_t cpu_guest_nice=0;
 
 #define JIFFY_TO_MS(i) (((i) * 1000L) / HZ)
 
-      // limit the number of chars we will read from each line
-      // (there can be more than this - fgets will chop for us)
-#define MAX_PROC_LINE_CHARS 240
-      char line[MAX_PROC_LINE_CHARS];
       uint32_t lineNo = 0;
-      while(fgets(line, MAX_PROC_LINE_CHARS, procFile)) {
+      char *line;
+      while((line = UTProcFileLine(pf_stat)) != NULL) {
+	p = line;
 	if(++lineNo == 1) {
-	  if(sscanf(line, "cpu %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64"",
-		    &cpu_user,
-		    &cpu_nice,
-		    &cpu_system,
-		    &cpu_idle,
-		    &cpu_wio,
-		    &cpu_intr,
-		    &cpu_sintr,
-		    &cpu_steal,
-		    &cpu_guest,
-		    &cpu_guest_nice) >= 4) {
+	  int nticks = 0;
+	  if(UTScanPrefix(&p, "cpu ")) {
+	    while(nticks < 10
+		  && UTScanU64(&p, &cpu_ticks[nticks]))
+	      nticks++;
+	  }
+	  if(nticks >= 4) {
 	    gotData = YES;
-	    cpu->cpu_user = (uint32_t)(JIFFY_TO_MS(cpu_user));
-	    cpu->cpu_nice = (uint32_t)(JIFFY_TO_MS(cpu_nice));
-	    cpu->cpu_system = (uint32_t)(JIFFY_TO_MS(cpu_system));
-	    cpu->cpu_idle = (uint32_t)(JIFFY_TO_MS(cpu_idle));
-	    cpu->cpu_wio = (uint32_t)(JIFFY_TO_MS(cpu_wio));
-	    cpu->cpu_intr = (uint32_t)(JIFFY_TO_MS(cpu_intr));
-	    cpu->cpu_sintr = (uint32_t)(JIFFY_TO_MS(cpu_sintr));
-	    cpu->cpu_steal = (uint32_t)(JIFFY_TO_MS(cpu_steal));
-	    cpu->cpu_guest = (uint32_t)(JIFFY_TO_MS(cpu_guest));
-	    cpu->cpu_guest_nice = (uint32_t)(JIFFY_TO_MS(cpu_guest_nice));
+	    cpu->cpu_user = (uint32_t)(JIFFY_TO_MS(cpu_ticks[0]));
+	    cpu->cpu_nice = (uint32_t)(JIFFY_TO_MS(cpu_ticks[1]));
+	    cpu->cpu_system = (uint32_t)(JIFFY_TO_MS(cpu_ticks[2]));
+	    cpu->cpu_idle = (uint32_t)(JIFFY_TO_MS(cpu_ticks[3]));
+	    cpu->cpu_wio = (uint32_t)(JIFFY_TO_MS(cpu_ticks[4]));
+	    cpu->cpu_intr = (uint32_t)(JIFFY_TO_MS(cpu_ticks[5]));
+	    cpu->cpu_sintr = (uint32_t)(JIFFY_TO_MS(cpu_ticks[6]));
+	    cpu->cpu_steal = (uint32_t)(JIFFY_TO_MS(cpu_ticks[7]));
+	    cpu->cpu_guest = (uint32_t)(JIFFY_TO_MS(cpu_ticks[8]));
+	    cpu->cpu_guest_nice = (uint32_t)(JIFFY_TO_MS(cpu_ticks[9]));
 	  }
 	}
 	else {
@@ -102,32 +103,30 @@ extern "C" {
 	    gotData = YES;
 	    cpu->cpu_num++;
 	  }
-	  else if(strncmp(line, "intr", 4) == 0) {
+	  else if(UTScanPrefix(&p, "intr ")) {
 	    // total interrupts is the second token on this line
-	    if(sscanf(line, "intr %"SCNu64"", &cpu_interrupts) == 1) {
+	    if(UTScanU64(&p, &cpu_interrupts)) {
 	      gotData = YES;
 	      cpu->interrupts = (uint32_t)cpu_interrupts;
 	    }
 	  }
-	  else if(strncmp(line, "ctxt", 4) == 0) {
-	    if(sscanf(line, "ctxt %"SCNu64"", &cpu_contexts) == 1) {
+	  else if(UTScanPrefix(&p, "ctxt ")) {
+	    if(UTScanU64(&p, &cpu_contexts)) {
 	      gotData = YES;
 	      cpu->contexts = (uint32_t)cpu_contexts;
 	    }
 	  }
 	}
       }
-      fclose(procFile);
     }
 
-    procFile = fopen("/proc/uptime", "r");
-    if(procFile) {
-      float uptime = 0;
-      if(fscanf(procFile, "%f",	&uptime) == 1) {
+    if(UTProcFileRead(pf_uptime) > 0) {
+      double uptime = 0;
+      p = pf_uptime->buf;
+      if(UTScanDouble(&p, &uptime)) {
 	gotData = YES;
 	cpu->uptime = (uint32_t)uptime;
       }
-      fclose(procFile);
     }
 
     // GNU libc knows the number of processors so
@@ -147,22 +146,21 @@ extern "C" {
     //cpu_speed.  According to Ganglia/libmetrics we should
     // look first in /sys/devices/system/cpu/cpu0/cpufreq/scaling_max_freq
     // but for now just take the first one from /proc/cpuinfo
-    procFile = fopen("/proc/cpuinfo", "r");
-    if(procFile) {
-#undef MAX_PROC_LINE_CHARS
-#define MAX_PROC_LINE_CHARS 80
-      char line[MAX_PROC_LINE_CHARS];
-      while(fgets(line, MAX_PROC_LINE_CHARS, procFile)) {
-	if(strncmp(line, "cpu MHz", 7) == 0) {
+    if(UTProcFileRead(pf_cpuinfo) > 0) {
+      char *line;
+      while((line = UTProcFileLine(pf_cpuinfo)) != NULL) {
+	p = line;
+	if(UTScanPrefix(&p, "cpu MHz")) {
 	  double cpu_mhz = 0.0;
-	  if(sscanf(line, "cpu MHz : %lf", &cpu_mhz) == 1) {
+	  p = UTScanSpace(p);
+	  if(*p++ == ':'
+	     && UTScanDouble(&p, &cpu_mhz)) {
 	    gotData = YES;
 	    cpu->cpu_speed = (uint32_t)(cpu_mhz);
 	    break;
 	  }
 	}
       }
-      fclose(procFile);
     }
 
     return gotData;
@@ -45,24 +45,30 @@ int remote_mount(const char *device, const char *type)
     -----------------___________________________------------------
   */
 
+  static UTProcFile *pf_diskstats;
+  static UTProcFile *pf_mounts;
+
   int readDiskCounters(HSP *sp, SFLHost_dsk_counters *dsk) {
     int gotData = NO;
-    FILE *procFile;
-    procFile= fopen("/proc/diskstats", "r");
-    if(procFile) {
+    char *line, *p;
+    if(pf_diskstats == NULL) {
+      pf_diskstats = UTProcFileNew("/proc/diskstats", YES);
+      pf_mounts = UTProcFileNew("/proc/mounts", YES);
+    }
+    if(UTProcFileRead(pf_diskstats) > 0) {
       // ASCII numbers in /proc/diskstats may be 64-bit (if not now
       // then someday), so it seems safer to read into
-      // 64-bit ints with scanf first,  then copy them
+      // 64-bit ints first,  then copy them
       // into the host_dsk structure from there.
       uint32_t majorNo;
       uint32_t minorNo;
 
       uint64_t reads = 0;
-      /* uint64_t reads_merged = 0;*/
+      uint64_t reads_merged = 0;
       uint64_t sectors_read = 0;
       uint64_t read_time_ms = 0;
       uint64_t writes = 0;
-      /* uint64_t writes_merged = 0;*/
+      uint64_t writes_merged = 0;
       uint64_t sectors_written = 0;
       uint64_t write_time_ms = 0;
 
@@ -70,24 +76,20 @@ int remote_mount(const char *device, const char *type)
       uint64_t total_sectors_read = 0;
       uint64_t total_sectors_written = 0;
 
-      // limit the number of chars we will read from each line
-      // (there can be more than this - fgets will chop for us)
-#define MAX_PROC_LINE_CHARS 240
-      char line[MAX_PROC_LINE_CHARS];
-      char devName[MAX_PROC_LINE_CHARS];
-      while(fgets(line, MAX_PROC_LINE_CHARS, procFile)) {
-	if(sscanf(line, "%"SCNu32" %"SCNu32" %s %"SCNu64" %*u %"SCNu64" %"SCNu64" %"SCNu64" %*u %"SCNu64" %"SCNu64"",
-		  &majorNo,
-		  &minorNo,
-		  devName,
-		  &reads,
-		  /*&reads_merged,*/
-		  &sectors_read,
-		  &read_time_ms,
-		  &writes,
-		  /*&writes_merged,*/
-		  &sectors_written,
-		  &write_time_ms) == 9) {
+      while((line = UTProcFileLine(pf_diskstats)) != NULL) {
+	p = line;
+	int devNameLen;
+	if(UTScanU32(&p, &majorNo)
+	   && UTScanU32(&p, &minorNo)
+	   && UTScanToken(&p, " \t", &devNameLen)
+	   && UTScanU64(&p, &reads)
+	   && UTScanU64(&p, &reads_merged)
+	   && UTScanU64(&p, &sectors_read)
+	   && UTScanU64(&p, &read_time_ms)
+	   && UTScanU64(&p, &writes)
+	   && UTScanU64(&p, &writes_merged)
+	   && UTScanU64(&p, &sectors_written)
+	   && UTScanU64(&p, &write_time_ms)) {
 	  gotData = YES;
 	  // report the sum over all disks - except software RAID devices and logical volumes
 	  // because that would cause double-counting.   We identify those by their
@@ -104,7 +106,6 @@ int remote_mount(const char *device, const char *type)
 	  }
 	}
       }
-      fclose(procFile);
 
       // accumulate the 64-bit counters (they may only be 32-bit counters in this OS)
       sp->diskIO.bytes_read += (total_sectors_read - sp->diskIO.last_sectors_read) * ASSUMED_DISK_SECTOR_BYTES;
@@ -119,18 +120,15 @@ int remote_mount(const char *device, const char *type)
     // borrowed heavily from ganglia/linux/metrics.c for this part where
     // we read the mount points and then interrogate them to add up the
     // disk space on local disks.
-    procFile = fopen("/proc/mounts", "r");
-    if(procFile) {
-#undef MAX_PROC_LINE_CHARS
-#define MAX_PROC_LINE_CHARS 240
-      char line[MAX_PROC_LINE_CHARS];
-      char device[MAX_PROC_LINE_CHARS];
-      char mount[MAX_PROC_LINE_CHARS];
-      char type[MAX_PROC_LINE_CHARS];
-      char mode[MAX_PROC_LINE_CHARS];
+    if(UTProcFileRead(pf_mounts) > 0) {
       void *treeRoot = NULL;
-      while(fgets(line, MAX_PROC_LINE_CHARS, procFile)) {
-	if(sscanf(line, "%s %s %s %s", device, mount, type, mode) == 4) {
+      while((line = UTProcFileLine(pf_mounts)) != NULL) {
+	p = line;
+	char *device = UTScanField(&p);
+	char *mount = UTScanField(&p);
+	char *type = UTScanField(&p);
+	char *mode = UTScanField(&p);
+	if(mode) {
 	  // must start with /dev/ or /dev2/ or ubi:
 	  if(strncmp(device, "/dev/", 5) == 0 ||
 	     strncmp(device, "/dev2/", 6) == 0 ||
@@ -163,7 +161,6 @@ int remote_mount(const char *device, const char *type)
 	}
       }
       tdestroy(treeRoot, my_free);
-      fclose(procFile);
     }
 
     return gotData;
@@ -25,7 +25,10 @@ extern "C" {
     if(uu.nodename) {
       int len = my_strlen(uu.nodename);
       if(len > hbufLen) len = hbufLen;
+      if(strncmp(hbuf, uu.nodename, hbufLen))
+	sp->staticRevision++; // hostname changed
       memcpy(hbuf, uu.nodename, len);
+      hbuf[len] = '\0';
       hid->hostname.str = hbuf;
       hid->hostname.len = len;
     }
@@ -79,7 +82,10 @@ extern "C" {
     if(uu.release) {
       int len = my_strlen(uu.release);
       if(len > rbufLen) len = rbufLen;
+      if(strncmp(rbuf, uu.release, rbufLen))
+	sp->staticRevision++;
       memcpy(rbuf, uu.release, len);
+      rbuf[len] = '\0';
       hid->os_release.str = rbuf;
       hid->os_release.len = len;
     }
@@ -16,11 +16,13 @@ extern "C" {
 #include <linux/ethtool.h>
 #include <linux/sockios.h>
 #include <linux/if_vlan.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 
-  // limit the number of chars we will read from each line
-  // in /proc/net/dev and /prov/net/vlan/config
-  // (there can be more than this - fgets will chop for us)
-#define MAX_PROC_LINE_CHARS 160
+  // read on every interface refresh
+  static UTProcFile *pf_vlanConfig;
+  static UTProcFile *pf_ifInet6;
+  static UTProcFile *pf_netDev;
 
 /*________________---------------------------__________________
   ________________      readVLANs            __________________
@@ -30,26 +32,30 @@ extern "C" {
   void readVLANs(HSP *sp)
   {
     // mark interfaces that are specific to a VLAN
-    FILE *procFile = fopen("/proc/net/vlan/config", "r");
-    if(procFile) {
-      char line[MAX_PROC_LINE_CHARS];
+    if(pf_vlanConfig == NULL)
+      pf_vlanConfig = UTProcFileNew("/proc/net/vlan/config", YES);
+    if(UTProcFileRead(pf_vlanConfig) > 0) {
+      char *line;
       int lineNo = 0;
-      while(fgets(line, MAX_PROC_LINE_CHARS, procFile)) {
-	// expect lines of the form "<device> VID: <vlan> ..."
+      while((line = UTProcFileLine(pf_vlanConfig)) != NULL) {
+	// expect lines of the form "<device> | <vlan> | <parent>"
 	// (with a header line on the first row)
-	char devName[MAX_PROC_LINE_CHARS];
-	int vlan;
+	char *p = line;
+	char *devName;
+	uint32_t vlan;
 	++lineNo;
-	if(lineNo > 1 && sscanf(line, "%s | %d", devName, &vlan) == 2) {
-	  SFLAdaptor *adaptor = adaptorByName(sp,  trimWhitespace(devName));
+	if(lineNo > 1
+	   && (devName = UTScanField(&p)) != NULL
+	   && UTScanPrefix(&p, "|")
+	   && UTScanU32(&p, &vlan)) {
+	  SFLAdaptor *adaptor = adaptorByName(sp, devName);
 	  if(adaptor &&
-	     vlan >= 0 && vlan < 4096) {
+	     vlan < 4096) {
 	    ADAPTOR_NIO(adaptor)->vlan = vlan;
 	    myDebug(1, "adaptor %s has 802.1Q vlan %d", devName, vlan);
 	  }
 	}
       }
-      fclose(procFile);
     }
   }
 
@@ -102,36 +108,33 @@ extern "C" {
 
   void readIPv6Addresses(HSP *sp, UTHash *addrHT)
   {
-    FILE *procFile = fopen("/proc/net/if_inet6", "r");
-    if(procFile) {
-      char line[MAX_PROC_LINE_CHARS];
-      int lineNo = 0;
-      while(fgets(line, MAX_PROC_LINE_CHARS, procFile)) {
+    if(pf_ifInet6 == NULL)
+      pf_ifInet6 = UTProcFileNew("/proc/net/if_inet6", YES);
+    if(UTProcFileRead(pf_ifInet6) > 0) {
+      char *line;
+      while((line = UTProcFileLine(pf_ifInet6)) != NULL) {
 	// expect lines of the form "<address> <netlink_no> <prefix_len(HEX)> <scope(HEX)> <flags(HEX)> <deviceName>
-	// (with a header line on the first row)
-	char devName[MAX_PROC_LINE_CHARS];
-	u_char addr[MAX_PROC_LINE_CHARS];
-	u_int devNo, maskBits, scope, flags;
-	++lineNo;
-	if(sscanf(line, "%s %x %x %x %x %s",
-		  addr,
-		  &devNo,
-		  &maskBits,
-		  &scope,
-		  &flags,
-		  devName) == 6) {
+	char *p = line;
+	char *addr, *devName;
+	uint32_t devNo, maskBits, scope, flags;
+	if((addr = UTScanField(&p)) != NULL
+	   && UTScanHex32(&p, &devNo)
+	   && UTScanHex32(&p, &maskBits)
+	   && UTScanHex32(&p, &scope)
+	   && UTScanHex32(&p, &flags)
+	   && (devName = UTScanField(&p)) != NULL) {
 
 	  myDebug(1, "adaptor %s has v6 address %s with scope 0x%x",
 		devName,
 		addr,
 		scope);
 
-	  SFLAdaptor *adaptor = adaptorByName(sp, trimWhitespace(devName));
+	  SFLAdaptor *adaptor = adaptorByName(sp, devName);
 	  if(adaptor) {
 	    HSPAdaptorNIO *niostate = ADAPTOR_NIO(adaptor);
 	    SFLAddress v6addr;
 	    v6addr.type = SFLADDRESSTYPE_IP_V6;
-	    if(hexToBinary(addr, v6addr.address.ip_v6.addr, 16) == 16) {
+	    if(hexToBinary((u_char *)addr, v6addr.address.ip_v6.addr, 16) == 16) {
 	      if(addrHT) {
 		// add to localIP6 lookup
 		if(UTHashGet(addrHT, &v6addr) == NULL) {
@@ -155,7 +158,6 @@ extern "C" {
 	  }
 	}
       }
-      fclose(procFile);
     }
   }
 
@@ -598,6 +600,190 @@ extern "C" {
     return (changed != NULL);
   }
 
+/*________________---------------------------__________________
+  ________________      readInterface        __________________
+  ----------------___________________________------------------
+  Read the state of one device and add or update its adaptor.
+  Used for every device in a full readInterfaces() pass, and for
+  individual devices when rtnetlink tells us they changed.
+*/
+
+  typedef struct _HSPIntfDelta {
+    uint32_t added;
+    uint32_t removed;
+    uint32_t cameup;
+    uint32_t wentdown;
+    uint32_t changed;
+  } HSPIntfDelta;
+
+  static void setAdaptorFlags(SFLAdaptor *adaptor, u_int flags, HSPIntfDelta *delta)
+  {
+    int up = (flags & IFF_UP) ? YES : NO;
+    int loopback = (flags & IFF_LOOPBACK) ? YES : NO;
+    int promisc =  (flags & IFF_PROMISC) ? YES : NO;
+    int bond_master = (flags & IFF_MASTER) ? YES : NO;
+    int bond_slave = (flags & IFF_SLAVE) ? YES : NO;
+    //int hasBroadcast = (flags & IFF_BROADCAST);
+    //int pointToPoint = (flags & IFF_POINTOPOINT);
+
+    // this flag might belong in the adaptorNIO struct
+    adaptor->promiscuous = promisc;
+
+    // remember some useful flags in the userData structure
+    HSPAdaptorNIO *adaptorNIO = ADAPTOR_NIO(adaptor);
+    if(adaptorNIO->up != up) {
+      if(up) {
+	delta->cameup++;
+	// trigger test for module eeprom data
+	adaptorNIO->ethtool_GMODULEINFO = YES;
+      }
+      else delta->wentdown++;
+      myDebug(1, "adaptor %s %s",
+	      adaptor->deviceName,
+	      up ? "came up" : "went down");
+    }
+    adaptorNIO->up = up;
+
+    // make sure we notice changes
+    if(adaptorNIO->loopback != loopback
+       || adaptorNIO->bond_master != bond_master
+       || adaptorNIO->bond_slave != bond_slave)
+      delta->changed++;
+
+    adaptorNIO->loopback = loopback;
+    adaptorNIO->bond_master = bond_master;
+    adaptorNIO->bond_slave = bond_slave;
+  }
+
+  static SFLAdaptor *readInterface(HSP *sp, char *devName, int fd, bool full_discovery, UTHash *localIPHT, HSPIntfDelta *delta)
+  {
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    // we set the ifr_name field to make our queries
+    strncpy(ifr.ifr_name, devName, sizeof(ifr.ifr_name));
+
+    myDebug(3, "reading interface %s", devName);
+
+    // Get the flags for this interface
+    if(ioctl(fd,SIOCGIFFLAGS, &ifr) < 0) {
+      myLog(LOG_ERR, "device %s Get SIOCGIFFLAGS failed : %s",
+	    devName,
+	    strerror(errno));
+      return NULL;
+    }
+    u_int flags = ifr.ifr_flags;
+
+    // used to ignore loopback interfaces here, and interfaces
+    // that are currently marked down, but now those are
+    // filtered at the point where we roll together the
+    // counters, or build the list for export
+
+    // Try and get the MAC Address for this interface
+    u_char macBytes[6];
+    int gotMac = NO;
+    if(ioctl(fd,SIOCGIFHWADDR, &ifr) < 0) {
+      myLog(LOG_ERR, "device %s Get SIOCGIFHWADDR failed : %s",
+	    devName,
+	    strerror(errno));
+    }
+    else {
+      memcpy(macBytes, (u_char *)&ifr.ifr_hwaddr.sa_data, 6);
+      gotMac = YES;
+    }
+
+    // Try and get the ifIndex for this interface
+    uint32_t ifIndex = 0;
+    if(ioctl(fd,SIOCGIFINDEX, &ifr) < 0) {
+      // only complain about this if we are debugging
+      myDebug(1, "device %s Get SIOCGIFINDEX failed : %s",
+	      devName,
+	      strerror(errno));
+    }
+    else {
+      ifIndex = ifr.ifr_ifindex;
+    }
+
+    // for now just assume that each interface has only one MAC.  It's not clear how we can
+    // learn multiple MACs this way anyhow.  It seems like there is just one per ifr record.
+    // find or create a new "adaptor" entry
+    SFLAdaptor *adaptor = nioAdaptorNew(devName, (gotMac ? macBytes : NULL), ifIndex);
+
+    bool addAdaptorToHT = YES;
+    SFLAdaptor *existing = adaptorByName(sp, devName);
+    if(existing
+       && adaptorEqual(adaptor, existing)) {
+      // no change - use existing object
+      adaptorFree(adaptor);
+      adaptor = existing;
+      addAdaptorToHT = NO;
+    }
+
+    // clear the mark so we don't free it below
+    adaptor->marked = NO;
+
+    setAdaptorFlags(adaptor, flags, delta);
+    HSPAdaptorNIO *adaptorNIO = ADAPTOR_NIO(adaptor);
+
+    // Try to get the IP address for this interface
+    if(ioctl(fd,SIOCGIFADDR, &ifr) < 0) {
+      // only complain about this if we are debugging
+      myDebug(1, "device %s Get SIOCGIFADDR failed : %s",
+	      devName,
+	      strerror(errno));
+    }
+    else {
+      if (ifr.ifr_addr.sa_family == AF_INET) {
+	struct sockaddr_in *s = (struct sockaddr_in *)&ifr.ifr_addr;
+	// IP addr is now s->sin_addr
+	adaptorNIO->ipAddr.type = SFLADDRESSTYPE_IP_V4;
+	adaptorNIO->ipAddr.address.ip_v4.addr = s->sin_addr.s_addr;
+	// add to localIP hash too
+	if(UTHashGet(localIPHT, &adaptorNIO->ipAddr) == NULL) {
+	  SFLAddress *addrCopy = my_calloc(sizeof(SFLAddress));
+	  *addrCopy = adaptorNIO->ipAddr;
+	  UTHashAdd(localIPHT, addrCopy);
+	}
+      }
+      //else if (ifr.ifr_addr.sa_family == AF_INET6) {
+      // not sure this ever happens - on a linux system IPv6 addresses
+      // are picked up from /proc/net/if_inet6
+      // struct sockaddr_in6 *s = (struct sockaddr_in6 *)&ifr.ifr_addr;
+      // IP6 addr is now s->sin6_addr;
+      //}
+    }
+
+    if(full_discovery) {
+      // allow modules to supply additional info on this adaptor
+      // (and influence ethtool data-gathering).  We broadcast this
+      // but it only really makes sense to receive it on the POLL_BUS
+      EVEventTxAll(sp->rootModule, HSPEVENT_INTF_READ, &adaptor, sizeof(adaptor));
+      // use ethtool to get info about direction/speed and more
+      if(read_ethtool_info(sp, &ifr, fd, adaptor) == YES) {
+	delta->changed++;
+      }
+    }
+
+    if(addAdaptorToHT) {
+      // it is a new adaptor name or the mac/ifindex changed
+      delta->added++;
+      adaptorAddOrReplace(sp->adaptorsByName, adaptor);
+      // add to "all namespaces" collections too.
+      if(gotMac) adaptorAddOrReplace(sp->adaptorsByMac, adaptor);
+      if(ifIndex) adaptorAddOrReplace(sp->adaptorsByIndex, adaptor);
+    }
+    return adaptor;
+  }
+
+  static void localIPFree(UTHash *ht)
+  {
+    if(ht) {
+      SFLAddress *ad;
+      UTHASH_WALK(ht, ad)
+	my_free(ad);
+      UTHashFree(ht);
+    }
+  }
+
 /*________________---------------------------__________________
   ________________      readInterfaces       __________________
   ----------------___________________________------------------
@@ -605,7 +791,7 @@ extern "C" {
 
   int readInterfaces(HSP *sp, bool full_discovery,  uint32_t *p_added, uint32_t *p_removed, uint32_t *p_cameup, uint32_t *p_wentdown, uint32_t *p_changed)
   {
-  uint32_t ad_added=0, ad_removed=0, ad_cameup=0, ad_wentdown=0, ad_changed=0;
+  HSPIntfDelta delta = { 0 };
 
   UTHash *newLocalIP = UTHASH_NEW(SFLAddress, address.ip_v4, UTHASH_DFLT);
   UTHash *newLocalIP6 = UTHASH_NEW(SFLAddress, address.ip_v6, UTHASH_DFLT);
@@ -626,175 +812,29 @@ extern "C" {
     return 0;
   }
 
-  FILE *procFile = fopen("/proc/net/dev", "r");
-  if(procFile) {
-    struct ifreq ifr;
-    memset(&ifr, 0, sizeof(ifr));
-    char line[MAX_PROC_LINE_CHARS];
+  if(pf_netDev == NULL)
+    pf_netDev = UTProcFileNew("/proc/net/dev", YES);
+  if(UTProcFileRead(pf_netDev) > 0) {
+    char *line;
     int lineNo = 0;
-    while(fgets(line, MAX_PROC_LINE_CHARS, procFile)) {
+    while((line = UTProcFileLine(pf_netDev)) != NULL) {
       if(lineNo++ < 2) continue; // skip headers
       // the device name is always the first token before the ":"
-      char buf[MAX_PROC_LINE_CHARS];
       char *p = line;
-      char *devName = parseNextTok(&p, " \t:", NO, '\0', NO, buf, MAX_PROC_LINE_CHARS);
-      if(devName == NULL) continue;
-      devName = trimWhitespace(devName);
-      int devNameLen = my_strlen(devName);
-      if(devNameLen == 0 || devNameLen >= IFNAMSIZ) continue;
-      // we set the ifr_name field to make our queries
-      strncpy(ifr.ifr_name, devName, sizeof(ifr.ifr_name));
-
-      myDebug(3, "reading interface %s", devName);
-
-      // Get the flags for this interface
-      if(ioctl(fd,SIOCGIFFLAGS, &ifr) < 0) {
-	myLog(LOG_ERR, "device %s Get SIOCGIFFLAGS failed : %s",
-	      devName,
-	      strerror(errno));
+      int devNameLen;
+      char *devName = UTScanToken(&p, " \t:", &devNameLen);
+      if(devName == NULL
+	 || devNameLen >= IFNAMSIZ)
 	continue;
-      }
-
-      int up = (ifr.ifr_flags & IFF_UP) ? YES : NO;
-      int loopback = (ifr.ifr_flags & IFF_LOOPBACK) ? YES : NO;
-      int promisc =  (ifr.ifr_flags & IFF_PROMISC) ? YES : NO;
-      int bond_master = (ifr.ifr_flags & IFF_MASTER) ? YES : NO;
-      int bond_slave = (ifr.ifr_flags & IFF_SLAVE) ? YES : NO;
-      //int hasBroadcast = (ifr.ifr_flags & IFF_BROADCAST);
-      //int pointToPoint = (ifr.ifr_flags & IFF_POINTOPOINT);
-
-      // used to ignore loopback interfaces here, and interfaces
-      // that are currently marked down, but now those are
-      // filtered at the point where we roll together the
-      // counters, or build the list for export
-
-      // Try and get the MAC Address for this interface
-      u_char macBytes[6];
-      int gotMac = NO;
-      if(ioctl(fd,SIOCGIFHWADDR, &ifr) < 0) {
-	myLog(LOG_ERR, "device %s Get SIOCGIFHWADDR failed : %s",
-	      devName,
-	      strerror(errno));
-      }
-      else {
-	memcpy(macBytes, (u_char *)&ifr.ifr_hwaddr.sa_data, 6);
-	gotMac = YES;
-      }
-
-      // Try and get the ifIndex for this interface
-      uint32_t ifIndex = 0;
-      if(ioctl(fd,SIOCGIFINDEX, &ifr) < 0) {
-	// only complain about this if we are debugging
-	myDebug(1, "device %s Get SIOCGIFINDEX failed : %s",
-		devName,
-		strerror(errno));
-      }
-      else {
-	ifIndex = ifr.ifr_ifindex;
-      }
-
-      // for now just assume that each interface has only one MAC.  It's not clear how we can
-      // learn multiple MACs this way anyhow.  It seems like there is just one per ifr record.
-      // find or create a new "adaptor" entry
-      SFLAdaptor *adaptor = nioAdaptorNew(devName, (gotMac ? macBytes : NULL), ifIndex);
-
-      bool addAdaptorToHT = YES;
-      SFLAdaptor *existing = adaptorByName(sp, devName);
-      if(existing
-	 && adaptorEqual(adaptor, existing)) {
-	// no change - use existing object
-	adaptorFree(adaptor);
-	adaptor = existing;
-	addAdaptorToHT = NO;
-      }
-
-      // clear the mark so we don't free it below
-      adaptor->marked = NO;
-
-      // this flag might belong in the adaptorNIO struct
-      adaptor->promiscuous = promisc;
-
-      // remember some useful flags in the userData structure
-      HSPAdaptorNIO *adaptorNIO = ADAPTOR_NIO(adaptor);
-      if(adaptorNIO->up != up) {
-	if(up) {
-	  ad_cameup++;
-	  // trigger test for module eeprom data
-	  adaptorNIO->ethtool_GMODULEINFO = YES;
-	}
-	else ad_wentdown++;
-	myDebug(1, "adaptor %s %s",
-		adaptor->deviceName,
-		up ? "came up" : "went down");
-      }
-      adaptorNIO->up = up;
-
-      // make sure we notice changes
-      if(adaptorNIO->loopback != loopback
-	 || adaptorNIO->bond_master != bond_master
-	 || adaptorNIO->bond_slave != bond_slave)
-	ad_changed++;
-
-      adaptorNIO->loopback = loopback;
-      adaptorNIO->bond_master = bond_master;
-      adaptorNIO->bond_slave = bond_slave;
-
-      // Try to get the IP address for this interface
-      if(ioctl(fd,SIOCGIFADDR, &ifr) < 0) {
-	// only complain about this if we are debugging
-	myDebug(1, "device %s Get SIOCGIFADDR failed : %s",
-		devName,
-		strerror(errno));
-      }
-      else {
-	if (ifr.ifr_addr.sa_family == AF_INET) {
-	  struct sockaddr_in *s = (struct sockaddr_in *)&ifr.ifr_addr;
-	  // IP addr is now s->sin_addr
-	  adaptorNIO->ipAddr.type = SFLADDRESSTYPE_IP_V4;
-	  adaptorNIO->ipAddr.address.ip_v4.addr = s->sin_addr.s_addr;
-	  // add to localIP hash too
-	  if(UTHashGet(newLocalIP, &adaptorNIO->ipAddr) == NULL) {
-	    SFLAddress *addrCopy = my_calloc(sizeof(SFLAddress));
-	    *addrCopy = adaptorNIO->ipAddr;
-	    UTHashAdd(newLocalIP, addrCopy);
-	  }
-	}
-	//else if (ifr.ifr_addr.sa_family == AF_INET6) {
-	// not sure this ever happens - on a linux system IPv6 addresses
-	// are picked up from /proc/net/if_inet6
-	// struct sockaddr_in6 *s = (struct sockaddr_in6 *)&ifr.ifr_addr;
-	// IP6 addr is now s->sin6_addr;
-	//}
-      }
-
-      if(full_discovery) {
-	// allow modules to supply additional info on this adaptor
-	// (and influence ethtool data-gathering).  We broadcast this
-	// but it only really makes sense to receive it on the POLL_BUS
-	EVEventTxAll(sp->rootModule, HSPEVENT_INTF_READ, &adaptor, sizeof(adaptor));
-	// use ethtool to get info about direction/speed and more
-	if(read_ethtool_info(sp, &ifr, fd, adaptor) == YES) {
-	  ad_changed++;
-	}
-      }
-
-      if(addAdaptorToHT) {
-	// it is a new adaptor name or the mac/ifindex changed
-	ad_added++;
-	adaptorAddOrReplace(sp->adaptorsByName, adaptor);
-	// add to "all namespaces" collections too.
-	if(gotMac) adaptorAddOrReplace(sp->adaptorsByMac, adaptor);
-	if(ifIndex) adaptorAddOrReplace(sp->adaptorsByIndex, adaptor);
-      }
-
+      devName[devNameLen] = '\0';
+      readInterface(sp, devName, fd, full_discovery, newLocalIP, &delta);
     }
-    fclose(procFile);
   }
 
   close (fd);
 
   // now remove and free any that are still marked
-  ad_removed = deleteMarkedAdaptors(sp, sp->adaptorsByName, YES);
+  delta.removed = deleteMarkedAdaptors(sp, sp->adaptorsByName, YES);
 
   // check in case any of the survivors are specific
   // to a particular VLAN
@@ -811,33 +851,326 @@ extern "C" {
   // overwritten.
   readIPv6Addresses(sp, newLocalIP6);
 
-  if(p_added) *p_added = ad_added;
-  if(p_removed) *p_removed = ad_removed;
-  if(p_cameup) *p_cameup = ad_cameup;
-  if(p_wentdown) *p_wentdown = ad_wentdown;
-  if(p_changed) *p_changed = ad_changed;
+  if(p_added) *p_added = delta.added;
+  if(p_removed) *p_removed = delta.removed;
+  if(p_cameup) *p_cameup = delta.cameup;
+  if(p_wentdown) *p_wentdown = delta.wentdown;
+  if(p_changed) *p_changed = delta.changed;
 
   // swap in new localIP lookup tables
   UTHash *oldLocalIP = sp->localIP;
   UTHash *oldLocalIP6 = sp->localIP6;
   sp->localIP = newLocalIP;
   sp->localIP6 = newLocalIP6;
-  if(oldLocalIP) {
-    SFLAddress *ad;
-    UTHASH_WALK(oldLocalIP, ad)
-      my_free(ad);
-    UTHashFree(oldLocalIP);
-  }
-  if(oldLocalIP6) {
-    SFLAddress *ad;
-    UTHASH_WALK(oldLocalIP6, ad)
-      my_free(ad);
-    UTHashFree(oldLocalIP6);
-  }
+  localIPFree(oldLocalIP);
+  localIPFree(oldLocalIP6);
 
   return sp->adaptorsByName->entries;
 }
 
+/*________________---------------------------__________________
+  ________________   rtnetlink tracking      __________________
+  ----------------___________________________------------------
+  Subscribe to RTNLGRP_LINK, RTNLGRP_IPV4_IFADDR and RTNLGRP_IPV6_IFADDR
+  so that adds, removes, up/down transitions and address changes are
+  applied to the adaptor tables one device at a time, as they happen.
+  This replaces the detectInterfaceChange() scan and the full rescan
+  that it would trigger.  The periodic refreshAdaptorListSecs rescan is
+  kept as a backstop, and a socket overrun (ENOBUFS) forces one too.
+*/
+
+#define HSP_RTNL_RCV_BUF 2000000
+#define HSP_RTNL_MSG_BYTES 16384
+#define HSP_RTNL_RECVMMSG_MAX 16
+#define HSP_RTNL_MAX_AFFECTED 256
+
+  typedef struct _HSPRtnlUpdate {
+    int fd; // for ioctls
+    HSPIntfDelta delta;
+    bool addrChanged;
+    bool resyncIPv6;
+    // copy-on-write of sp->localIP/localIP6,  swapped in at the end
+    // just as readInterfaces() does,  since other threads look there
+    UTHash *localIP;
+    UTHash *localIP6;
+    uint32_t affected[HSP_RTNL_MAX_AFFECTED];
+    uint32_t n_affected;
+    bool affectedOverflow;
+  } HSPRtnlUpdate;
+
+  static void rtnlAffected(HSPRtnlUpdate *upd, uint32_t ifIndex) {
+    for(uint32_t ii = 0; ii < upd->n_affected; ii++)
+      if(upd->affected[ii] == ifIndex)
+	return;
+    if(upd->n_affected < HSP_RTNL_MAX_AFFECTED)
+      upd->affected[upd->n_affected++] = ifIndex;
+    else
+      upd->affectedOverflow = YES;
+  }
+
+  static UTHash *localIPCopy(UTHash *ht, bool v6) {
+    UTHash *copy = v6
+      ? UTHASH_NEW(SFLAddress, address.ip_v6, UTHASH_DFLT)
+      : UTHASH_NEW(SFLAddress, address.ip_v4, UTHASH_DFLT);
+    SFLAddress *addr;
+    UTHASH_WALK(ht, addr) {
+      SFLAddress *addrCopy = my_calloc(sizeof(SFLAddress));
+      *addrCopy = *addr;
+      UTHashAdd(copy, addrCopy);
+    }
+    return copy;
+  }
+
+  static UTHash *rtnlLocalIP(HSP *sp, HSPRtnlUpdate *upd, bool v6) {
+    if(v6) {
+      if(upd->localIP6 == NULL)
+	upd->localIP6 = localIPCopy(sp->localIP6, YES);
+      return upd->localIP6;
+    }
+    if(upd->localIP == NULL)
+      upd->localIP = localIPCopy(sp->localIP, NO);
+    return upd->localIP;
+  }
+
+  static void rtnlLink(HSP *sp, struct nlmsghdr *nlh, HSPRtnlUpdate *upd) {
+    struct ifinfomsg *ifi = (struct ifinfomsg *)NLMSG_DATA(nlh);
+    // bridge port notifications come on the same group
+    if(ifi->ifi_family != AF_UNSPEC)
+      return;
+    char *devName = NULL;
+    u_char *mac = NULL;
+    int attrlen = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi));
+    for(struct rtattr *rta = IFLA_RTA(ifi); RTA_OK(rta, attrlen); rta = RTA_NEXT(rta, attrlen)) {
+      if(rta->rta_type == IFLA_IFNAME)
+	devName = (char *)RTA_DATA(rta);
+      else if(rta->rta_type == IFLA_ADDRESS
+	      && RTA_PAYLOAD(rta) == 6)
+	mac = (u_char *)RTA_DATA(rta);
+    }
+    SFLAdaptor *adaptor = adaptorByIndex(sp, ifi->ifi_index);
+
+    if(nlh->nlmsg_type == RTM_DELLINK) {
+      if(adaptor) {
+	myDebug(1, "rtnetlink: adaptor %s removed", adaptor->deviceName);
+	rtnlAffected(upd, ifi->ifi_index);
+	deleteAdaptor(sp, adaptor, YES);
+	upd->delta.removed++;
+      }
+      return;
+    }
+
+    if(devName == NULL
+       || my_strlen(devName) >= IFNAMSIZ)
+      return;
+
+    if(adaptor
+       && my_strequal(adaptor->deviceName, devName) == NO) {
+      // renamed - drop the old one and read it in again
+      myDebug(1, "rtnetlink: adaptor %s renamed %s", adaptor->deviceName, devName);
+      deleteAdaptor(sp, adaptor, YES);
+      upd->delta.removed++;
+      adaptor = NULL;
+    }
+
+    if(adaptor
+       && (mac == NULL || memcmp(mac, adaptor->macs[0].mac, 6) == 0)
+       && ifi->ifi_change == 0) {
+      // nothing we track has changed
+      return;
+    }
+
+    // new device, or a flag/MAC change. Read this one device with the
+    // same full discovery that a global refresh would do,  since
+    // speed and duplex may have changed when it came up.
+    rtnlAffected(upd, ifi->ifi_index);
+    readInterface(sp, devName, upd->fd, YES, rtnlLocalIP(sp, upd, NO), &upd->delta);
+  }
+
+  static void rtnlAddr(HSP *sp, struct nlmsghdr *nlh, HSPRtnlUpdate *upd) {
+    struct ifaddrmsg *ifa = (struct ifaddrmsg *)NLMSG_DATA(nlh);
+    if(ifa->ifa_family != AF_INET
+       && ifa->ifa_family != AF_INET6)
+      return;
+    bool v6 = (ifa->ifa_family == AF_INET6);
+    SFLAddress addr = { 0 };
+    bool gotAddr = NO;
+    int attrlen = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifa));
+    for(struct rtattr *rta = IFA_RTA(ifa); RTA_OK(rta, attrlen); rta = RTA_NEXT(rta, attrlen)) {
+      // IFA_LOCAL is the address itself on point-to-point links,
+      // so prefer it over IFA_ADDRESS when both are present
+      if((rta->rta_type == IFA_LOCAL
+	  || (rta->rta_type == IFA_ADDRESS && !gotAddr))) {
+	if(v6 && RTA_PAYLOAD(rta) == 16) {
+	  addr.type = SFLADDRESSTYPE_IP_V6;
+	  memcpy(addr.address.ip_v6.addr, RTA_DATA(rta), 16);
+	  gotAddr = YES;
+	}
+	else if(!v6 && RTA_PAYLOAD(rta) == 4) {
+	  addr.type = SFLADDRESSTYPE_IP_V4;
+	  memcpy(&addr.address.ip_v4.addr, RTA_DATA(rta), 4);
+	  gotAddr = YES;
+	}
+      }
+    }
+    if(!gotAddr)
+      return;
+
+    upd->addrChanged = YES;
+    UTHash *ht = rtnlLocalIP(sp, upd, v6);
+    SFLAdaptor *adaptor = adaptorByIndex(sp, ifa->ifa_index);
+    HSPAdaptorNIO *adaptorNIO = adaptor ? ADAPTOR_NIO(adaptor) : NULL;
+
+    if(nlh->nlmsg_type == RTM_NEWADDR) {
+      if(UTHashGet(ht, &addr) == NULL) {
+	SFLAddress *addrCopy = my_calloc(sizeof(SFLAddress));
+	*addrCopy = addr;
+	UTHashAdd(ht, addrCopy);
+      }
+      if(adaptorNIO) {
+	// take it as the adaptor's address if it is a better choice,  or
+	// if it is the first v4 address (which SIOCGIFADDR would return)
+	EnumIPSelectionPriority ipPriority = agentAddressPriority(sp,
+								  &addr,
+								  adaptorNIO->vlan,
+								  adaptorNIO->loopback);
+	if(ipPriority > adaptorNIO->ipPriority
+	   || (!v6 && adaptorNIO->ipAddr.type != SFLADDRESSTYPE_IP_V4)) {
+	  adaptorNIO->ipAddr = addr;
+	  adaptorNIO->ipPriority = ipPriority;
+	}
+      }
+    }
+    else {
+      SFLAddress *found = UTHashDelKey(ht, &addr);
+      if(found)
+	my_free(found);
+      if(adaptorNIO
+	 && SFLAddress_equal(&adaptorNIO->ipAddr, &addr)) {
+	// lost the chosen address - fall back to whatever the
+	// primary v4 address is now,  and look again at the v6 ones
+	memset(&adaptorNIO->ipAddr, 0, sizeof(adaptorNIO->ipAddr));
+	struct ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, adaptor->deviceName, sizeof(ifr.ifr_name));
+	if(ioctl(upd->fd, SIOCGIFADDR, &ifr) == 0
+	   && ifr.ifr_addr.sa_family == AF_INET) {
+	  struct sockaddr_in *s = (struct sockaddr_in *)&ifr.ifr_addr;
+	  adaptorNIO->ipAddr.type = SFLADDRESSTYPE_IP_V4;
+	  adaptorNIO->ipAddr.address.ip_v4.addr = s->sin_addr.s_addr;
+	}
+	adaptorNIO->ipPriority = agentAddressPriority(sp,
+						      &adaptorNIO->ipAddr,
+						      adaptorNIO->vlan,
+						      adaptorNIO->loopback);
+	upd->resyncIPv6 = YES;
+      }
+    }
+    if(adaptor)
+      rtnlAffected(upd, ifa->ifa_index);
+  }
+
+  static void readRtnl(EVMod *mod, EVSocket *sock, void *magic)
+  {
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    UTRecvBatch *rb = (UTRecvBatch *)magic;
+    HSPRtnlUpdate upd = { 0 };
+    upd.fd = socket(PF_INET, SOCK_DGRAM, 0);
+
+    for(;;) {
+      int want = rb->batch;
+      int n = UTRecvBatchRead(rb);
+      if(n < 0) {
+	if(errno == ENOBUFS) {
+	  // lost notifications - only a full rescan can recover
+	  myLog(LOG_INFO, "rtnetlink overrun - requesting full interface refresh");
+	  sp->refreshAdaptorList = YES;
+	  continue;
+	}
+	break;
+      }
+      if(n == 0)
+	break;
+      for(int ii = 0; ii < n; ii++) {
+	int len = UTRecvBatchLen(rb, ii);
+	for(struct nlmsghdr *nlh = (struct nlmsghdr *)UTRecvBatchBuf(rb, ii);
+	    NLMSG_OK(nlh, len);
+	    nlh = NLMSG_NEXT(nlh, len)) {
+	  switch(nlh->nlmsg_type) {
+	  case RTM_NEWLINK:
+	  case RTM_DELLINK:
+	    rtnlLink(sp, nlh, &upd);
+	    break;
+	  case RTM_NEWADDR:
+	  case RTM_DELADDR:
+	    rtnlAddr(sp, nlh, &upd);
+	    break;
+	  }
+	}
+      }
+      if(n < want)
+	break;
+    }
+
+    if(upd.delta.added) {
+      // VLAN membership and address priorities as in readInterfaces()
+      readVLANs(sp);
+      setAddressPriorities(sp);
+    }
+    if(upd.resyncIPv6)
+      readIPv6Addresses(sp, NULL);
+    if(upd.fd >= 0)
+      close(upd.fd);
+
+    // swap in the updated localIP lookup tables
+    if(upd.localIP) {
+      UTHash *oldLocalIP = sp->localIP;
+      sp->localIP = upd.localIP;
+      localIPFree(oldLocalIP);
+    }
+    if(upd.localIP6) {
+      UTHash *oldLocalIP6 = sp->localIP6;
+      sp->localIP6 = upd.localIP6;
+      localIPFree(oldLocalIP6);
+    }
+
+    HSPIntfDelta *d = &upd.delta;
+    if(d->added || d->removed || d->cameup || d->wentdown || d->changed || upd.addrChanged) {
+      myDebug(1, "rtnetlink: interfaces added: %u removed: %u cameup: %u wentdown: %u changed: %u addrs: %s",
+	      d->added, d->removed, d->cameup, d->wentdown, d->changed,
+	      upd.addrChanged ? "YES" : "NO");
+      interfacesChanged(sp,
+			(d->added || d->cameup || d->wentdown || d->changed),
+			upd.affectedOverflow ? NULL : upd.affected,
+			upd.affectedOverflow ? 0 : upd.n_affected);
+    }
+  }
+
+  bool rtnlTrackInterfaces(HSP *sp)
+  {
+    int nl_sock = socket(AF_NETLINK, SOCK_RAW|SOCK_NONBLOCK|SOCK_CLOEXEC, NETLINK_ROUTE);
+    if(nl_sock < 0) {
+      myLog(LOG_ERR, "rtnetlink socket() failed: %s", strerror(errno));
+      return NO;
+    }
+    struct sockaddr_nl sa = { .nl_family = AF_NETLINK,
+			      .nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR };
+    if(bind(nl_sock, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+      myLog(LOG_ERR, "rtnetlink bind() failed: %s", strerror(errno));
+      close(nl_sock);
+      return NO;
+    }
+    // a burst of veth churn should not overrun us
+    int rcvbuf = HSP_RTNL_RCV_BUF;
+    if(setsockopt(nl_sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0) {
+      myLog(LOG_ERR, "rtnetlink setsockopt(SO_RCVBUF) failed: %s", strerror(errno));
+    }
+    sp->rtnl_sock = nl_sock;
+    UTRecvBatch *rb = UTRecvBatchNew(nl_sock, "rtnetlink", HSP_RTNL_RECVMMSG_MAX, HSP_RTNL_MSG_BYTES);
+    UTRecvBatchTelemetry(rb, &sp->telemetry[HSP_TELEMETRY_RX_RTNL_CALLS]);
+    EVBusAddSocket(sp->rootModule, sp->pollBus, nl_sock, readRtnl, rb);
+    return YES;
+  }
+
 #if defined(__cplusplus)
 } /* extern "C" */
 #endif
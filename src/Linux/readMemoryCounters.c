@@ -13,48 +13,52 @@ extern "C" {
     -----------------___________________________------------------
   */
 
+  static UTProcFile *pf_meminfo;
+  static UTProcFile *pf_vmstat;
+
   int readMemoryCounters(SFLHost_mem_counters *mem) {
     int gotData = NO;
-    FILE *procFile;
-    // limit the number of chars we will read from each line
-    // (there can be more than this - fgets will chop for us)
-#define MAX_PROC_LINE_CHARS 80
-    char line[MAX_PROC_LINE_CHARS];
-    char var[MAX_PROC_LINE_CHARS];
+    char *line, *p, *var;
+    int varLen;
     uint64_t val64;
 
+    if(pf_meminfo == NULL) {
+      pf_meminfo = UTProcFileNew("/proc/meminfo", YES);
+      pf_vmstat = UTProcFileNew("/proc/vmstat", YES);
+    }
+
     // zero the structure so we can accumulate into it.
     memset(mem, 0, sizeof(*mem));
 
-    procFile= fopen("/proc/meminfo", "r");
-    if(procFile) {
-      while(fgets(line, MAX_PROC_LINE_CHARS, procFile)) {
-	if(sscanf(line, "%s %"SCNu64"", var, &val64) == 2) {
+    if(UTProcFileRead(pf_meminfo) > 0) {
+      while((line = UTProcFileLine(pf_meminfo)) != NULL) {
+	p = line;
+	if((var = UTScanToken(&p, " \t", &varLen))
+	   && UTScanU64(&p, &val64)) {
 	  gotData = YES;
-	  if(strcmp(var, "MemTotal:") == 0) mem->mem_total += val64 * 1024;
-	  else if(strcmp(var, "MemFree:") == 0) mem->mem_free += val64 * 1024;
-	  else if(strcmp(var, "Buffers:") == 0) mem->mem_buffers += val64 * 1024;
-	  else if(strcmp(var, "Cached:") == 0) mem->mem_cached += val64 * 1024;
-	  else if(strcmp(var, "SwapTotal:") == 0) mem->swap_total += val64 * 1024;
-	  else if(strcmp(var, "SwapFree:") == 0) mem->swap_free += val64 * 1024;
-	  else if(strcmp(var, "SReclaimable:") == 0) mem->mem_cached += val64 * 1024;
+	  if(UTSCAN_TOKEN_IS(var, varLen, "MemTotal:")) mem->mem_total += val64 * 1024;
+	  else if(UTSCAN_TOKEN_IS(var, varLen, "MemFree:")) mem->mem_free += val64 * 1024;
+	  else if(UTSCAN_TOKEN_IS(var, varLen, "Buffers:")) mem->mem_buffers += val64 * 1024;
+	  else if(UTSCAN_TOKEN_IS(var, varLen, "Cached:")) mem->mem_cached += val64 * 1024;
+	  else if(UTSCAN_TOKEN_IS(var, varLen, "SwapTotal:")) mem->swap_total += val64 * 1024;
+	  else if(UTSCAN_TOKEN_IS(var, varLen, "SwapFree:")) mem->swap_free += val64 * 1024;
+	  else if(UTSCAN_TOKEN_IS(var, varLen, "SReclaimable:")) mem->mem_cached += val64 * 1024;
 	}
       }
-      fclose(procFile);
     }
 
-    procFile= fopen("/proc/vmstat", "r");
-    if(procFile) {
-      while(fgets(line, MAX_PROC_LINE_CHARS, procFile)) {
-	if(sscanf(line, "%s %"SCNu64"", var, &val64) == 2) {
+    if(UTProcFileRead(pf_vmstat) > 0) {
+      while((line = UTProcFileLine(pf_vmstat)) != NULL) {
+	p = line;
+	if((var = UTScanToken(&p, " \t", &varLen))
+	   && UTScanU64(&p, &val64)) {
 	  gotData = YES;
-	  if(strcmp(var, "pgpgin") == 0) mem->page_in += (uint32_t)val64;
-	  else if(strcmp(var, "pgpgout") == 0) mem->page_out += (uint32_t)val64;
-	  else if(strcmp(var, "pswpin") == 0) mem->swap_in += (uint32_t)val64;
-	  else if(strcmp(var, "pswpout") == 0) mem->swap_out += (uint32_t)val64;
+	  if(UTSCAN_TOKEN_IS(var, varLen, "pgpgin")) mem->page_in += (uint32_t)val64;
+	  else if(UTSCAN_TOKEN_IS(var, varLen, "pgpgout")) mem->page_out += (uint32_t)val64;
+	  else if(UTSCAN_TOKEN_IS(var, varLen, "pswpin")) mem->swap_in += (uint32_t)val64;
+	  else if(UTSCAN_TOKEN_IS(var, varLen, "pswpout")) mem->swap_out += (uint32_t)val64;
 	}
       }
-      fclose(procFile);
     }
 
     return gotData;
@@ -13,6 +13,16 @@ extern "C" {
 #include <linux/types.h>
 #include <linux/ethtool.h>
 #include <linux/sockios.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+#if defined(__has_include)
+#if __has_include(<linux/ethtool_netlink.h>)
+#define HSP_ETHTOOL_NETLINK 1
+#include <linux/genetlink.h>
+#include <linux/ethtool_netlink.h>
+#endif
+#endif
 
   /*_________________---------------------------__________________
     _________________ shareActorIDFromSlave     __________________
@@ -36,15 +46,16 @@ extern "C" {
     -----------------___________________________------------------
   */
 
+  // /proc/net/bonding/<dev> files, kept open (by path)
+  static UTHash *bondFiles;
+
   void updateBondCounters(HSP *sp, SFLAdaptor *bond) {
     char procFileName[256];
     snprintf(procFileName, 256, "/proc/net/bonding/%s", bond->deviceName);
-    FILE *procFile = fopen(procFileName, "r");
-    if(procFile) {
-      // limit the number of chars we will read from each line
-      // (there can be more than this - fgets will chop for us)
-#define MAX_PROC_LINE_CHARS 240
-      char line[MAX_PROC_LINE_CHARS];
+    if(bondFiles == NULL)
+      bondFiles = UTProcFileCacheNew();
+    UTProcFile *procFile = UTProcFileCacheGet(bondFiles, procFileName, YES);
+    if(UTProcFileRead(procFile) > 0) {
       SFLAdaptor *currentSlave = NULL;
       HSPAdaptorNIO *slave_nio = NULL;
       HSPAdaptorNIO *bond_nio = ADAPTOR_NIO(bond);
@@ -57,13 +68,14 @@ extern "C" {
       memset(bond_nio->lacp.partnerSystemID, 0, 6);
       int readingMaster = YES; // bond master data comes first
       int gotActorID = NO;
-      while(fgets(line, MAX_PROC_LINE_CHARS, procFile)) {
-	char buf_var[MAX_PROC_LINE_CHARS];
-	char buf_val[MAX_PROC_LINE_CHARS];
-	// buf_var is up to first ':', buf_val is the rest
-	if(sscanf(line, "%[^:]:%[^\n]", buf_var, buf_val) == 2) {
-	  char *tok_var = trimWhitespace(buf_var);
-	  char *tok_val = trimWhitespace(buf_val);
+      char *line;
+      while((line = UTProcFileLine(procFile)) != NULL) {
+	// tok_var is up to first ':', tok_val is the rest
+	char *sep = strchr(line, ':');
+	if(sep && sep != line && sep[1] != '\0') {
+	  *sep = '\0';
+	  char *tok_var = trimWhitespace(line);
+	  char *tok_val = trimWhitespace(sep + 1);
 
 	  if(readingMaster) {
 	    if(my_strequal(tok_var, "MII Status")) {
@@ -82,9 +94,11 @@ extern "C" {
 	      myDebug(1, "updateBondCounters: %s system identification %s",
 		      bond->deviceName,
 		      tok_val);
-	      char sys_mac[MAX_PROC_LINE_CHARS];
+	      char *p = tok_val;
+	      char *sys_mac;
 	      uint64_t code;
-	      if(sscanf(tok_val, "%"SCNu64"  %s", &code, sys_mac) == 2) {
+	      if(UTScanU64(&p, &code)
+		 && (sys_mac = UTScanField(&p)) != NULL) {
 		if(hexToBinary((u_char *)sys_mac,bond_nio->lacp.actorSystemID, 6) != 6) {
 		  myLog(LOG_ERR, "updateBondCounters: system mac read error: %s", sys_mac);
 		}
@@ -104,7 +118,8 @@ extern "C" {
 	    }
 
 	    if(my_strequal(tok_var, "Aggregator ID")) {
-	      aggID = strtol(tok_val, NULL, 0);
+	      char *p = tok_val;
+	      UTScanU32(&p, &aggID);
 	      myDebug(1, "updateBondCounters: %s aggID %u", bond->deviceName, aggID);
 	    }
 	  }
@@ -174,7 +189,9 @@ extern "C" {
 	    }
 
 	    if(my_strequal(tok_var, "Aggregator ID")) {
-	      uint32_t slave_aggID = strtol(tok_val, NULL, 0);
+	      char *p = tok_val;
+	      uint32_t slave_aggID = 0;
+	      UTScanU32(&p, &slave_aggID);
 	      if(slave_aggID == aggID) {
 		// remember that is the slave port that has the same aggregator ID as the bond
 		aggregator_slave_nio = slave_nio;
@@ -188,8 +205,6 @@ extern "C" {
 	// go back and fill in the actorSystemID on all the slave ports
 	shareActorIDFromSlave(sp, bond_nio, aggregator_slave_nio);
       }
-
-      fclose(procFile);
     }
   }
 
@@ -327,15 +342,16 @@ extern "C" {
       HSPAdaptorNIO *nio = ADAPTOR_NIO(adaptor);
       if(nio->poller
 	 && nio->switchPort) {
-	uint32_t countdown = nio->poller->countersCountdown;
+	uint32_t countdown = sfl_poller_get_countersCountdown(nio->poller);
 	uint32_t nudgeBack = countdown % sp->syncPollingInterval;
 	uint32_t nudgeFwd = sp->syncPollingInterval - nudgeBack;
-	// take the smaller nudge - as long as it's in the future
+	// take the smaller nudge - as long as it's in the future.
+	// (this pins the poller's phase so the agent won't rebalance it)
 	if(nudgeBack < nudgeFwd
 	   && countdown > nudgeBack)
-	  nio->poller->countersCountdown -= nudgeBack;
+	  sfl_poller_set_countersCountdown(nio->poller, countdown - nudgeBack);
 	else
-	  nio->poller->countersCountdown += nudgeFwd;
+	  sfl_poller_set_countersCountdown(nio->poller, countdown + nudgeFwd);
       }
     }
   }
@@ -804,11 +820,494 @@ extern "C" {
     return accumulate;
   }
 
+  /*_________________---------------------------__________________
+    _________________   netlink stats snapshot  __________________
+    -----------------___________________________------------------
+    A single RTM_GETSTATS dump with the IFLA_STATS_LINK_64 filter returns
+    the 64-bit counters for every link.  They are latched into each
+    adaptor so that all the per-adaptor requests in the same second are
+    served from that snapshot instead of re-parsing /proc/net/dev.
+    Kernels before 4.7 do not know RTM_GETSTATS, and there we fall back
+    to /proc/net/dev.
+  */
+
+#define HSP_NIO_NL_BUF 65536
+
+  static bool nioNetlinkOpen(HSP *sp) {
+    int nl_sock = socket(AF_NETLINK, SOCK_RAW|SOCK_CLOEXEC, NETLINK_ROUTE);
+    if(nl_sock < 0) {
+      myLog(LOG_ERR, "nio netlink socket() failed: %s", strerror(errno));
+      return NO;
+    }
+    // the dump is read synchronously on the pollBus, so don't wait forever
+    struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+    if(setsockopt(nl_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+      myLog(LOG_ERR, "nio netlink setsockopt(SO_RCVTIMEO) failed: %s", strerror(errno));
+    }
+    sp->nio_nl_sock = nl_sock;
+    if(sp->nio_nl_buf == NULL)
+      sp->nio_nl_buf = (u_char *)my_calloc(HSP_NIO_NL_BUF);
+    return YES;
+  }
+
+  static void nioNetlinkClose(HSP *sp) {
+    if(sp->nio_nl_sock > 0)
+      close(sp->nio_nl_sock);
+    sp->nio_nl_sock = 0;
+  }
+
+  static void nioLatchStats64(HSP *sp, uint32_t ifIndex, struct rtnl_link_stats64 *st, time_t clk) {
+    SFLAdaptor *adaptor = adaptorByIndex(sp, ifIndex);
+    if(adaptor == NULL)
+      return;
+    HSPAdaptorNIO *niostate = ADAPTOR_NIO(adaptor);
+    // fold the fields together just as the kernel does when it
+    // prints /proc/net/dev, so the numbers are the same either way
+    niostate->nl_ctrs.bytes_in = st->rx_bytes;
+    niostate->nl_ctrs.pkts_in = (uint32_t)st->rx_packets;
+    niostate->nl_ctrs.errs_in = (uint32_t)st->rx_errors;
+    niostate->nl_ctrs.drops_in = (uint32_t)(st->rx_dropped + st->rx_missed_errors);
+    niostate->nl_ctrs.bytes_out = st->tx_bytes;
+    niostate->nl_ctrs.pkts_out = (uint32_t)st->tx_packets;
+    niostate->nl_ctrs.errs_out = (uint32_t)st->tx_errors;
+    niostate->nl_ctrs.drops_out = (uint32_t)st->tx_dropped;
+    niostate->nl_snapshot = clk;
+  }
+
+  // Latch the links in one recv() worth of the RTM_GETSTATS dump.  Returns
+  // 1 at the end of the dump,  -1 if the kernel rejected the request, or 0
+  // if there is more to come.  (Also called by hsflowd_bench.)
+  int parseNioStatsDump(HSP *sp, u_char *buf, int len, time_t clk, uint32_t *links) {
+    for(struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+	NLMSG_OK(nlh, len);
+	nlh = NLMSG_NEXT(nlh, len)) {
+      if(nlh->nlmsg_seq != sp->nio_nl_seq)
+	continue;
+      if(nlh->nlmsg_type == NLMSG_DONE) {
+	myDebug(3, "nio netlink dump: %u links", *links);
+	return 1;
+      }
+      if(nlh->nlmsg_type == NLMSG_ERROR) {
+	struct nlmsgerr *err_msg = (struct nlmsgerr *)NLMSG_DATA(nlh);
+	if(err_msg->error == 0)
+	  continue;
+	myLog(LOG_INFO, "RTM_GETSTATS failed (%s), reading /proc/net/dev instead",
+	      strerror(-err_msg->error));
+	sp->nio_nl_unsupported = YES;
+	return -1;
+      }
+      if(nlh->nlmsg_type != RTM_NEWSTATS)
+	continue;
+      struct if_stats_msg *ifsm = (struct if_stats_msg *)NLMSG_DATA(nlh);
+      int attrlen = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifsm));
+      for(struct rtattr *rta = (struct rtattr *)((char *)ifsm + NLMSG_ALIGN(sizeof(*ifsm)));
+	  RTA_OK(rta, attrlen);
+	  rta = RTA_NEXT(rta, attrlen)) {
+	if(rta->rta_type == IFLA_STATS_LINK_64) {
+	  // newer kernels may append fields, older ones may have fewer
+	  struct rtnl_link_stats64 st = { 0 };
+	  int stlen = RTA_PAYLOAD(rta);
+	  memcpy(&st, RTA_DATA(rta), (stlen < sizeof(st)) ? stlen : sizeof(st));
+	  nioLatchStats64(sp, ifsm->ifindex, &st, clk);
+	  (*links)++;
+	}
+      }
+    }
+    return 0;
+  }
+
+  static bool nioNetlinkDump(HSP *sp, time_t clk) {
+    if(sp->nio_nl_sock <= 0
+       && !nioNetlinkOpen(sp))
+      return NO;
+
+    struct {
+      struct nlmsghdr nlh;
+      struct if_stats_msg ifsm;
+    } req = { 0 };
+    req.nlh.nlmsg_len = sizeof(req);
+    req.nlh.nlmsg_type = RTM_GETSTATS;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nlh.nlmsg_seq = ++sp->nio_nl_seq;
+    req.ifsm.family = AF_UNSPEC;
+    req.ifsm.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+    if(send(sp->nio_nl_sock, &req, sizeof(req), 0) < 0) {
+      myLog(LOG_ERR, "nio netlink send(RTM_GETSTATS) failed: %s", strerror(errno));
+      nioNetlinkClose(sp);
+      return NO;
+    }
+
+    uint32_t links = 0;
+    for(;;) {
+      int len = recv(sp->nio_nl_sock, sp->nio_nl_buf, HSP_NIO_NL_BUF, 0);
+      if(len <= 0) {
+	myLog(LOG_ERR, "nio netlink recv() failed: %s", strerror(errno));
+	// may have left part of the dump in the socket, so start again next time
+	nioNetlinkClose(sp);
+	return NO;
+      }
+      switch(parseNioStatsDump(sp, sp->nio_nl_buf, len, clk, &links)) {
+      case 1:
+	return YES;
+      case -1:
+	nioNetlinkClose(sp);
+	return NO;
+      }
+    }
+  }
+
+  static bool nioNetlinkSnapshot(HSP *sp, time_t clk) {
+    if(sp->nio_nl_unsupported)
+      return NO;
+    if(sp->nio_snapshot == clk)
+      return YES;
+    if(!nioNetlinkDump(sp, clk))
+      return NO;
+    sp->nio_snapshot = clk;
+    return YES;
+  }
+
+  /*_________________---------------------------__________________
+    _________________   ethtool-netlink stats   __________________
+    -----------------___________________________------------------
+    With "ethtoolNetlink=on",  ask for just the standard IEEE 802.3
+    MAC group (ETHTOOL_MSG_STATS_GET, kernel 5.13+) rather than having
+    ETHTOOL_GSTATS copy out every driver counter (1000+ on some NICs)
+    only to pick out four of them.  Devices whose driver does not
+    report that group stay on the ETHTOOL_GSTATS path.
+  */
+
+#ifdef HSP_ETHTOOL_NETLINK
+
+#define HSP_ETHTOOL_NL_BUF 8192
+
+  static struct nlattr *nlAttrPut(struct nlmsghdr *nlh, int type, const void *data, int len) {
+    struct nlattr *nla = (struct nlattr *)((char *)nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+    nla->nla_type = type;
+    nla->nla_len = NLA_HDRLEN + len;
+    if(len)
+      memcpy((char *)nla + NLA_HDRLEN, data, len);
+    nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + NLA_ALIGN(nla->nla_len);
+    return nla;
+  }
+
+  static void nlAttrNestEnd(struct nlmsghdr *nlh, struct nlattr *nest) {
+    nest->nla_len = (char *)nlh + nlh->nlmsg_len - (char *)nest;
+  }
+
+#define NLA_OK(nla, len) ((len) >= (int)sizeof(struct nlattr)		\
+			  && (nla)->nla_len >= sizeof(struct nlattr)	\
+			  && (nla)->nla_len <= (len))
+#define NLA_NEXT(nla, len) ((len) -= NLA_ALIGN((nla)->nla_len),		\
+			    (struct nlattr *)((char *)(nla) + NLA_ALIGN((nla)->nla_len)))
+#define NLA_DATA(nla) ((void *)((char *)(nla) + NLA_HDRLEN))
+#define NLA_PAYLOAD(nla) ((int)(nla)->nla_len - NLA_HDRLEN)
+#define NLA_TYPE(nla) ((nla)->nla_type & NLA_TYPE_MASK)
+
+  static int ethtoolNetlinkTxRx(HSP *sp, struct nlmsghdr *req) {
+    req->nlmsg_seq = ++sp->ethtool_nl_seq;
+    if(send(sp->ethtool_nl_sock, req, req->nlmsg_len, 0) < 0)
+      return -1;
+    for(;;) {
+      int len = recv(sp->ethtool_nl_sock, sp->ethtool_nl_buf, HSP_ETHTOOL_NL_BUF, 0);
+      if(len <= 0)
+	return -1;
+      struct nlmsghdr *nlh = (struct nlmsghdr *)sp->ethtool_nl_buf;
+      if(NLMSG_OK(nlh, len)
+	 && nlh->nlmsg_seq == sp->ethtool_nl_seq)
+	return len;
+      // stale reply from a request that timed out - keep reading
+    }
+  }
+
+  static bool ethtoolNetlinkOpen(HSP *sp) {
+    int nl_sock = socket(AF_NETLINK, SOCK_RAW|SOCK_CLOEXEC, NETLINK_GENERIC);
+    if(nl_sock < 0) {
+      myLog(LOG_ERR, "ethtool netlink socket() failed: %s", strerror(errno));
+      return NO;
+    }
+    struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+    setsockopt(nl_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    sp->ethtool_nl_sock = nl_sock;
+    if(sp->ethtool_nl_buf == NULL)
+      sp->ethtool_nl_buf = (u_char *)my_calloc(HSP_ETHTOOL_NL_BUF);
+
+    // look up the "ethtool" generic-netlink family
+    uint32_t reqbuf[64] = { 0 };
+    struct nlmsghdr *req = (struct nlmsghdr *)reqbuf;
+    req->nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+    req->nlmsg_type = GENL_ID_CTRL;
+    req->nlmsg_flags = NLM_F_REQUEST;
+    struct genlmsghdr *genl = (struct genlmsghdr *)NLMSG_DATA(req);
+    genl->cmd = CTRL_CMD_GETFAMILY;
+    genl->version = 1;
+    nlAttrPut(req, CTRL_ATTR_FAMILY_NAME, ETHTOOL_GENL_NAME, sizeof(ETHTOOL_GENL_NAME));
+    int len = ethtoolNetlinkTxRx(sp, req);
+    struct nlmsghdr *nlh = (struct nlmsghdr *)sp->ethtool_nl_buf;
+    if(len > 0
+       && nlh->nlmsg_type == GENL_ID_CTRL) {
+      int attrlen = nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+      for(struct nlattr *nla = (struct nlattr *)((char *)NLMSG_DATA(nlh) + GENL_HDRLEN);
+	  NLA_OK(nla, attrlen);
+	  nla = NLA_NEXT(nla, attrlen)) {
+	if(NLA_TYPE(nla) == CTRL_ATTR_FAMILY_ID)
+	  sp->ethtool_nl_family = *(uint16_t *)NLA_DATA(nla);
+      }
+    }
+    if(sp->ethtool_nl_family == 0) {
+      myLog(LOG_INFO, "ethtool netlink family not found, using ETHTOOL_GSTATS");
+      sp->ethtoolNetlink = NO;
+      close(nl_sock);
+      sp->ethtool_nl_sock = 0;
+      return NO;
+    }
+    myDebug(1, "ethtool netlink family=%u", sp->ethtool_nl_family);
+    return YES;
+  }
+
+  // Returns 1 with the MAC stats filled in,  0 if the device does not
+  // report the MAC group,  or -1 if we did not get a usable answer this
+  // time (send/recv error or timeout).
+  static int ethtoolNetlinkStats(HSP *sp, SFLAdaptor *adaptor, HSP_ethtool_counters *et_ctrs) {
+    if(sp->ethtool_nl_sock <= 0
+       && !ethtoolNetlinkOpen(sp))
+      return sp->ethtoolNetlink ? -1 : 0; // no family means no netlink stats at all
+
+    uint32_t reqbuf[64] = { 0 };
+    struct nlmsghdr *req = (struct nlmsghdr *)reqbuf;
+    req->nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+    req->nlmsg_type = sp->ethtool_nl_family;
+    req->nlmsg_flags = NLM_F_REQUEST;
+    struct genlmsghdr *genl = (struct genlmsghdr *)NLMSG_DATA(req);
+    genl->cmd = ETHTOOL_MSG_STATS_GET;
+    genl->version = ETHTOOL_GENL_VERSION;
+    struct nlattr *hdr = nlAttrPut(req, ETHTOOL_A_STATS_HEADER | NLA_F_NESTED, NULL, 0);
+    uint32_t ifIndex = adaptor->ifIndex;
+    nlAttrPut(req, ETHTOOL_A_HEADER_DEV_INDEX, &ifIndex, sizeof(ifIndex));
+    nlAttrNestEnd(req, hdr);
+    struct nlattr *grps = nlAttrPut(req, ETHTOOL_A_STATS_GROUPS | NLA_F_NESTED, NULL, 0);
+    nlAttrPut(req, ETHTOOL_A_BITSET_NOMASK, NULL, 0);
+    uint32_t nbits = __ETHTOOL_STATS_CNT;
+    nlAttrPut(req, ETHTOOL_A_BITSET_SIZE, &nbits, sizeof(nbits));
+    uint32_t bits = (1 << ETHTOOL_STATS_ETH_MAC);
+    nlAttrPut(req, ETHTOOL_A_BITSET_VALUE, &bits, sizeof(bits));
+    nlAttrNestEnd(req, grps);
+
+    int len = ethtoolNetlinkTxRx(sp, req);
+    if(len <= 0) {
+      myDebug(1, "ethtool netlink STATS_GET(%s) failed: %s", adaptor->deviceName, strerror(errno));
+      return -1;
+    }
+    struct nlmsghdr *nlh = (struct nlmsghdr *)sp->ethtool_nl_buf;
+    if(nlh->nlmsg_type == NLMSG_ERROR) {
+      struct nlmsgerr *err_msg = (struct nlmsgerr *)NLMSG_DATA(nlh);
+      myDebug(1, "ethtool netlink STATS_GET(%s) error: %s", adaptor->deviceName, strerror(-err_msg->error));
+      return (err_msg->error == -EOPNOTSUPP) ? 0 : -1;
+    }
+    if(nlh->nlmsg_type != sp->ethtool_nl_family)
+      return -1;
+    int found = 0;
+    int attrlen = nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+    for(struct nlattr *nla = (struct nlattr *)((char *)NLMSG_DATA(nlh) + GENL_HDRLEN);
+	NLA_OK(nla, attrlen);
+	nla = NLA_NEXT(nla, attrlen)) {
+      if(NLA_TYPE(nla) != ETHTOOL_A_STATS_GRP)
+	continue;
+      uint32_t grp_id = (uint32_t)-1;
+      int grplen = NLA_PAYLOAD(nla);
+      for(struct nlattr *ga = (struct nlattr *)NLA_DATA(nla); NLA_OK(ga, grplen); ga = NLA_NEXT(ga, grplen)) {
+	if(NLA_TYPE(ga) == ETHTOOL_A_STATS_GRP_ID)
+	  grp_id = *(uint32_t *)NLA_DATA(ga);
+	else if(NLA_TYPE(ga) == ETHTOOL_A_STATS_GRP_STAT
+		&& grp_id == ETHTOOL_STATS_ETH_MAC) {
+	  // each stat is a nest holding one u64 whose type is the stat id
+	  struct nlattr *st = (struct nlattr *)NLA_DATA(ga);
+	  if(NLA_PAYLOAD(ga) < NLA_HDRLEN + (int)sizeof(uint64_t))
+	    continue;
+	  uint64_t val;
+	  memcpy(&val, NLA_DATA(st), sizeof(val));
+	  switch(NLA_TYPE(st)) {
+	  case ETHTOOL_A_STATS_ETH_MAC_21_RX_MCAST: et_ctrs->mcasts_in = val; found++; break;
+	  case ETHTOOL_A_STATS_ETH_MAC_18_TX_MCAST: et_ctrs->mcasts_out = val; found++; break;
+	  case ETHTOOL_A_STATS_ETH_MAC_22_RX_BCAST: et_ctrs->bcasts_in = val; found++; break;
+	  case ETHTOOL_A_STATS_ETH_MAC_19_TX_BCAST: et_ctrs->bcasts_out = val; found++; break;
+	  }
+	}
+      }
+    }
+    return (found > 0) ? 1 : 0;
+  }
+
+#endif /* HSP_ETHTOOL_NETLINK */
+
+  /*_________________---------------------------__________________
+    _________________    updateAdaptorNio       __________________
+    -----------------___________________________------------------
+  */
+
+  static void updateAdaptorNio(HSP *sp, SFLAdaptor *adaptor, SFLHost_nio_counters *ctrs, bool filtered, int fd) {
+    HSPAdaptorNIO *niostate = ADAPTOR_NIO(adaptor);
+    struct ifreq ifr;
+    memset (&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, adaptor->deviceName, sizeof(ifr.ifr_name));
+    HSP_ethtool_counters et_ctrs = { 0 };
+    bool gotStats = NO;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+#ifdef HSP_ETHTOOL_NETLINK
+    if(sp->ethtoolNetlink
+       && niostate->ethtool_GSTATS
+       && !niostate->et_nl_unsupported
+       && adaptor->ifIndex) {
+      switch(ethtoolNetlinkStats(sp, adaptor, &et_ctrs)) {
+      case 1:
+	gotStats = YES;
+	break;
+      case 0:
+	// don't ask again,  and don't mix the two sources either
+	myDebug(1, "%s: no ethtool-netlink MAC stats, using ETHTOOL_GSTATS", adaptor->deviceName);
+	niostate->et_nl_unsupported = YES;
+	memset(&et_ctrs, 0, sizeof(et_ctrs));
+	break;
+      default:
+	// no answer this time: leave these counters where they
+	// were,  and try again on the next poll
+	et_ctrs = niostate->et_last;
+	gotStats = YES;
+	break;
+      }
+    }
+#endif
+
+    if (!gotStats
+	&& niostate->ethtool_GSTATS
+	&& niostate->et_found) {
+      // get the latest stats block for this device via ethtool
+      // and read out the counters that we located by name.
+      // The buffer is kept with the adaptor,  and only
+      // reallocated if the number of counters changes.
+      if(niostate->et_stats == NULL
+	 || niostate->et_stats_n != niostate->et_nctrs) {
+	if(niostate->et_stats)
+	  my_free(niostate->et_stats);
+	uint32_t bytes = sizeof(struct ethtool_stats);
+	bytes += niostate->et_nctrs * sizeof(uint64_t);
+	bytes += 32; // pad - just in case driver wants to write more
+	niostate->et_stats = (struct ethtool_stats *)my_calloc(bytes);
+	niostate->et_stats_n = niostate->et_nctrs;
+      }
+      struct ethtool_stats *et_stats = niostate->et_stats;
+      et_stats->cmd = ETHTOOL_GSTATS;
+      et_stats->n_stats = niostate->et_nctrs;
+
+      // now issue the ioctl
+      ifr.ifr_data = (char *)et_stats;
+      if(ioctl(fd, SIOCETHTOOL, &ifr) >= 0) {
+	if(getDebug() > 2) {
+	  for(int xx = 0; xx < et_stats->n_stats; xx++) {
+	    myDebug(1, "ethtool counter for %s at index %d == %"PRIu64,
+		    adaptor->deviceName,
+		    xx,
+		    et_stats->data[xx]);
+	  }
+	}
+	if(niostate->et_idx_mcasts_in)
+	  et_ctrs.mcasts_in = et_stats->data[niostate->et_idx_mcasts_in - 1];
+	if(niostate->et_idx_mcasts_out)
+	  et_ctrs.mcasts_out = et_stats->data[niostate->et_idx_mcasts_out - 1];
+	if(niostate->et_idx_bcasts_in)
+	  et_ctrs.bcasts_in = et_stats->data[niostate->et_idx_bcasts_in - 1];
+	if(niostate->et_idx_bcasts_out)
+	  et_ctrs.bcasts_out = et_stats->data[niostate->et_idx_bcasts_out - 1];
+      }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    HSP_TELEMETRY_ADD(sp, HSP_TELEMETRY_ETHTOOL_US, EVTimeDiff_nS(&t0, &t1) / 1000);
+
+#if ( HSP_OPTICAL_STATS && ETHTOOL_GMODULEEEPROM )
+    if(filtered) {
+      // If we are refreshing stats for an individual device, then
+      // check for SFP (lane) stats too. This operation can be slow so
+      // it's important to avoid doing it when we are refreshing
+      // counters for all interfaces for host-sflow network totals.
+      // Since the host-sflow network totals do not include optical
+      // stats,  this is not a problem.
+      switch(niostate->modinfo_type) {
+      case ETH_MODULE_SFF_8472: sff8472_read(adaptor, &ifr, fd); break;
+      case ETH_MODULE_SFF_8436: sff8436_read(adaptor, &ifr, fd); break;
+      }
+    }
+#endif /*  ( HSP_OPTICAL_STATS && ETHTOOL_GMODULEEEPROM ) */
+
+    accumulateNioCounters(sp, adaptor, ctrs, &et_ctrs);
+  }
+
   /*_________________---------------------------__________________
     _________________    updateNioCounters      __________________
     -----------------___________________________------------------
   */
 
+  // parse one line of /proc/net/dev (or /proc/<pid>/net/dev) in place.
+  // The format is:
+  // Inter-|   Receive                                                |  Transmit
+  //  face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed
+  // so the header lines are rejected because they have no ':'
+  // followed by numbers.
+  bool parseProcNetDevLine(char *line, char **p_devName, SFLHost_nio_counters *ctrs) {
+    char *sep = strchr(line, ':');
+    if(sep == NULL)
+      return NO;
+    *sep = '\0';
+    char *p = sep + 1;
+    uint64_t rx[8], tx[4];
+    for(int ii = 0; ii < 8; ii++)
+      if(!UTScanU64(&p, &rx[ii]))
+	return NO;
+    for(int ii = 0; ii < 4; ii++)
+      if(!UTScanU64(&p, &tx[ii]))
+	return NO;
+    *p_devName = trimWhitespace(line);
+    ctrs->bytes_in = rx[0];
+    ctrs->pkts_in = (uint32_t)rx[1];
+    ctrs->errs_in = (uint32_t)rx[2];
+    ctrs->drops_in = (uint32_t)rx[3];
+    ctrs->bytes_out = tx[0];
+    ctrs->pkts_out = (uint32_t)tx[1];
+    ctrs->errs_out = (uint32_t)tx[2];
+    ctrs->drops_out = (uint32_t)tx[3];
+    return YES;
+  }
+
+  static UTProcFile *pf_netdev;
+
+  static void updateNioCounters_procNetDev(HSP *sp, SFLAdaptor *filter, int fd) {
+    if(pf_netdev == NULL)
+      pf_netdev = UTProcFileNew("/proc/net/dev", YES);
+    if(UTProcFileRead(pf_netdev) > 0) {
+      char *line;
+      while((line = UTProcFileLine(pf_netdev)) != NULL) {
+	char *deviceName;
+	SFLHost_nio_counters ctrs = { 0 };
+	if(parseProcNetDevLine(line, &deviceName, &ctrs)) {
+	  SFLAdaptor *adaptor = adaptorByName(sp, deviceName);
+	  if(adaptor) {
+
+	    if(filter && (filter != adaptor))
+	      continue;
+
+	    HSPAdaptorNIO *niostate = ADAPTOR_NIO(adaptor);
+
+	    if(niostate->procNetDev == NO)
+	      continue;
+
+	    updateAdaptorNio(sp, adaptor, &ctrs, (filter != NULL), fd);
+	  }
+	}
+      }
+    }
+  }
+
   void updateNioCounters(HSP *sp, SFLAdaptor *filter) {
 
     assert(EVCurrentBus() == sp->pollBus);
@@ -833,124 +1332,35 @@ extern "C" {
       }
     }
 
-    FILE *procFile;
-    procFile= fopen("/proc/net/dev", "r");
-    if(procFile) {
-      int fd = socket (PF_INET, SOCK_DGRAM, 0);
-      struct ifreq ifr;
-      memset (&ifr, 0, sizeof(ifr));
-      // ASCII numbers in /proc/diskstats may be 64-bit (if not now
-      // then someday), so it seems safer to read into
-      // 64-bit ints with scanf first,  then copy them
-      // into the host_nio structure from there.
-      uint64_t bytes_in = 0;
-      uint64_t pkts_in = 0;
-      uint64_t errs_in = 0;
-      uint64_t drops_in = 0;
-      uint64_t bytes_out = 0;
-      uint64_t pkts_out = 0;
-      uint64_t errs_out = 0;
-      uint64_t drops_out = 0;
-      // limit the number of chars we will read from each line
-      // (there can be more than this - fgets will chop for us)
-#define MAX_PROC_LINE_CHARS 240
-      char line[MAX_PROC_LINE_CHARS];
-      while(fgets(line, MAX_PROC_LINE_CHARS, procFile)) {
-	char deviceName[MAX_PROC_LINE_CHARS];
-	// assume the format is:
-	// Inter-|   Receive                                                |  Transmit
-	//  face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed
-	if(sscanf(line, "%[^:]:%"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64" %*u %*u %*u %*u %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64"",
-		  deviceName,
-		  &bytes_in,
-		  &pkts_in,
-		  &errs_in,
-		  &drops_in,
-		  &bytes_out,
-		  &pkts_out,
-		  &errs_out,
-		  &drops_out) == 9) {
-	  SFLAdaptor *adaptor = adaptorByName(sp, deviceName);
-	  if(adaptor) {
-
-	    if(filter && (filter != adaptor))
-	      continue;
-
-	    HSPAdaptorNIO *niostate = ADAPTOR_NIO(adaptor);
-
-	    if(niostate->procNetDev == NO)
-	      continue;
-
-	    SFLHost_nio_counters ctrs = {
-	      .bytes_in = bytes_in,
-	      .pkts_in = (uint32_t)pkts_in,
-	      .errs_in = (uint32_t)errs_in,
-	      .drops_in = (uint32_t)drops_in,
-	      .bytes_out = bytes_out,
-	      .pkts_out = (uint32_t)pkts_out,
-	      .errs_out = (uint32_t)errs_out,
-	      .drops_out = (uint32_t)drops_out
-	    };
-	    HSP_ethtool_counters et_ctrs = { 0 };
-	    if (niostate->ethtool_GSTATS
-		&& niostate->et_found) {
-	      // get the latest stats block for this device via ethtool
-	      // and read out the counters that we located by name.
-
-	      uint32_t bytes = sizeof(struct ethtool_stats);
-	      bytes += niostate->et_nctrs * sizeof(uint64_t);
-	      bytes += 32; // pad - just in case driver wants to write more
-	      struct ethtool_stats *et_stats = (struct ethtool_stats *)my_calloc(bytes);
-	      et_stats->cmd = ETHTOOL_GSTATS;
-	      et_stats->n_stats = niostate->et_nctrs;
-
-	      // now issue the ioctl
-	      strncpy(ifr.ifr_name, adaptor->deviceName, sizeof(ifr.ifr_name));
-	      ifr.ifr_data = (char *)et_stats;
-	      if(ioctl(fd, SIOCETHTOOL, &ifr) >= 0) {
-		if(getDebug() > 2) {
-		  for(int xx = 0; xx < et_stats->n_stats; xx++) {
-		    myDebug(1, "ethtool counter for %s at index %d == %"PRIu64,
-			    adaptor->deviceName,
-			    xx,
-			    et_stats->data[xx]);
-		  }
-		}
-		if(niostate->et_idx_mcasts_in)
-		  et_ctrs.mcasts_in = et_stats->data[niostate->et_idx_mcasts_in - 1];
-		if(niostate->et_idx_mcasts_out)
-		  et_ctrs.mcasts_out = et_stats->data[niostate->et_idx_mcasts_out - 1];
-		if(niostate->et_idx_bcasts_in)
-		  et_ctrs.bcasts_in = et_stats->data[niostate->et_idx_bcasts_in - 1];
-		if(niostate->et_idx_bcasts_out)
-		  et_ctrs.bcasts_out = et_stats->data[niostate->et_idx_bcasts_out - 1];
-	      }
-	      my_free(et_stats);
-	    }
-
-#if ( HSP_OPTICAL_STATS && ETHTOOL_GMODULEEEPROM )
-	    if(filter) {
-	      // If we are refreshing stats for an individual device, then
-	      // check for SFP (lane) stats too. This operation can be slow so
-	      // it's important to avoid doing it when we are refreshing
-	      // counters for all interfaces for host-sflow network totals.
-	      // Since the host-sflow network totals do not include optical
-	      // stats,  this is not a problem.
-	      switch(niostate->modinfo_type) {
-	      case ETH_MODULE_SFF_8472: sff8472_read(adaptor, &ifr, fd); break;
-	      case ETH_MODULE_SFF_8436: sff8436_read(adaptor, &ifr, fd); break;
-	      }
-	    }
-#endif /*  ( HSP_OPTICAL_STATS && ETHTOOL_GMODULEEEPROM ) */
-
-	    accumulateNioCounters(sp, adaptor, &ctrs, &et_ctrs);
-	  }
+    // one control socket for all the ethtool/SFP ioctls
+    if(sp->nio_ctl_sock <= 0)
+      sp->nio_ctl_sock = socket(PF_INET, SOCK_DGRAM|SOCK_CLOEXEC, 0);
+    int fd = sp->nio_ctl_sock;
+    uint64_t ethtool_uS = sp->telemetry[HSP_TELEMETRY_ETHTOOL_US];
+    if(nioNetlinkSnapshot(sp, clk)) {
+      // serve from the snapshot
+      if(filter) {
+	HSPAdaptorNIO *niostate = ADAPTOR_NIO(filter);
+	if(niostate->procNetDev
+	   && niostate->nl_snapshot == clk)
+	  updateAdaptorNio(sp, filter, &niostate->nl_ctrs, YES, fd);
+      }
+      else {
+	SFLAdaptor *adaptor;
+	UTHASH_WALK(sp->adaptorsByIndex, adaptor) {
+	  HSPAdaptorNIO *niostate = ADAPTOR_NIO(adaptor);
+	  if(niostate->procNetDev
+	     && niostate->nl_snapshot == clk)
+	    updateAdaptorNio(sp, adaptor, &niostate->nl_ctrs, NO, fd);
 	}
       }
-      if(fd >= 0)
-	close(fd);
-      fclose(procFile);
     }
+    else {
+      updateNioCounters_procNetDev(sp, filter, fd);
+    }
+    myDebug(2, "updateNioCounters(%s): ethtool %"PRIu64" uS",
+	    filter ? filter->deviceName : "all",
+	    sp->telemetry[HSP_TELEMETRY_ETHTOOL_US] - ethtool_uS);
   }
 
   /*_________________---------------------------__________________
@@ -958,6 +1368,33 @@ extern "C" {
     -----------------___________________________------------------
   */
 
+  static bool accumulateNio(SFLHost_nio_counters *nio, SFLAdaptor *adaptor, bool skipVirtual) {
+    HSPAdaptorNIO *niostate = ADAPTOR_NIO(adaptor);
+
+    // in the case where we are adding up across all
+    // interfaces, be careful to avoid double-counting.
+    // By leaving this test until now we make it possible
+    // to know the counters for any interface or sub-interface
+    // if required (e.g. for the readPackets() module).
+    if(skipVirtual && (niostate->up == NO
+		       || niostate->vlan != HSP_VLAN_ALL
+		       || niostate->loopback
+		       || niostate->bond_master)) {
+      return NO;
+    }
+
+    // report the sum over all devices that match the filter
+    nio->bytes_in += niostate->nio.bytes_in;
+    nio->pkts_in += niostate->nio.pkts_in;
+    nio->errs_in += niostate->nio.errs_in;
+    nio->drops_in += niostate->nio.drops_in;
+    nio->bytes_out += niostate->nio.bytes_out;
+    nio->pkts_out += niostate->nio.pkts_out;
+    nio->errs_out += niostate->nio.errs_out;
+    nio->drops_out += niostate->nio.drops_out;
+    return YES;
+  }
+
   int readNioCounters(HSP *sp, SFLHost_nio_counters *nio, char *devFilter, SFLAdaptorList *adList) {
     int interface_count = 0;
     size_t devFilterLen = devFilter ? strlen(devFilter) : 0;
@@ -968,35 +1405,27 @@ extern "C" {
     updateNioCounters(sp, NULL);
 
     SFLAdaptor *adaptor;
+    if(adList) {
+      // VM or container: only visit its own adaptors and look up the
+      // global adaptor (which holds the NIO state) for each one by name.
+      SFLAdaptor *vm_adaptor;
+      ADAPTORLIST_WALK(adList, vm_adaptor) {
+	if(devFilter && strncmp(devFilter, vm_adaptor->deviceName, devFilterLen))
+	  continue;
+	SFLAdaptor search = { .deviceName = vm_adaptor->deviceName };
+	adaptor = UTHashGet(sp->adaptorsByName, &search);
+	if(adaptor
+	   && accumulateNio(nio, adaptor, (devFilter == NULL)))
+	  interface_count++;
+      }
+      return interface_count;
+    }
+
     UTHASH_WALK(sp->adaptorsByName, adaptor) {
       // note that the devFilter here is a prefix-match
       if(devFilter == NULL || !strncmp(devFilter, adaptor->deviceName, devFilterLen)) {
-	if(adList == NULL || adaptorListGet(adList, adaptor->deviceName) != NULL) {
-	  HSPAdaptorNIO *niostate = ADAPTOR_NIO(adaptor);
-
-	  // in the case where we are adding up across all
-	  // interfaces, be careful to avoid double-counting.
-	  // By leaving this test until now we make it possible
-	  // to know the counters for any interface or sub-interface
-	  // if required (e.g. for the readPackets() module).
-	  if(devFilter == NULL && (niostate->up == NO
-				   || niostate->vlan != HSP_VLAN_ALL
-				   || niostate->loopback
-				   || niostate->bond_master)) {
-	    continue;
-	  }
-
+	if(accumulateNio(nio, adaptor, (devFilter == NULL)))
 	  interface_count++;
-	  // report the sum over all devices that match the filter
-	  nio->bytes_in += niostate->nio.bytes_in;
-	  nio->pkts_in += niostate->nio.pkts_in;
-	  nio->errs_in += niostate->nio.errs_in;
-	  nio->drops_in += niostate->nio.drops_in;
-	  nio->bytes_out += niostate->nio.bytes_out;
-	  nio->pkts_out += niostate->nio.pkts_out;
-	  nio->errs_out += niostate->nio.errs_out;
-	  nio->drops_out += niostate->nio.drops_out;
-	}
       }
     }
     return interface_count;
@@ -137,6 +137,7 @@ extern "C" {
 	}
 
 	SEMLOCK_DO(sp->sync_agent) {
+	  sfl_poller_set_staticRevision(poller, sp->staticRevision);
 	  sfl_poller_writeCountersSample(poller, cs);
 	  sp->counterSampleQueued = YES;
 	  sp->telemetry[HSP_TELEMETRY_COUNTER_SAMPLES]++;
@@ -164,13 +165,16 @@ extern "C" {
       SFLDataSource_instance dsi;
       SFL_DS_SET(dsi, 0, adaptor->ifIndex, 0); // ds_class,ds_index,ds_instance
       SEMLOCK_DO(sp->sync_agent) {
-	adaptorNIO->poller = sfl_agent_addPoller(sp->agent, &dsi, sp, agentCB_getCounters_interface_request);
-	sfl_poller_set_sFlowCpInterval(adaptorNIO->poller, sp->actualPollingInterval);
-	sfl_poller_set_sFlowCpReceiver(adaptorNIO->poller, HSP_SFLOW_RECEIVER_INDEX);
-	// remember the device name to make the lookups easier later.
-	// Don't want to point directly to the SFLAdaptor or SFLAdaptorNIO object
-	// in case it gets freed at some point.  The device name is enough.
-	adaptorNIO->poller->userData = (void *)my_strdup(adaptor->deviceName);
+	// check again - may have more than one packet thread
+	if(adaptorNIO->poller == NULL) {
+	  adaptorNIO->poller = sfl_agent_addPoller(sp->agent, &dsi, sp, agentCB_getCounters_interface_request);
+	  sfl_poller_set_sFlowCpInterval(adaptorNIO->poller, sp->actualPollingInterval);
+	  sfl_poller_set_sFlowCpReceiver(adaptorNIO->poller, HSP_SFLOW_RECEIVER_INDEX);
+	  // remember the device name to make the lookups easier later.
+	  // Don't want to point directly to the SFLAdaptor or SFLAdaptorNIO object
+	  // in case it gets freed at some point.  The device name is enough.
+	  adaptorNIO->poller->userData = (void *)my_strdup(adaptor->deviceName);
+	}
       }
     }
     return adaptorNIO->poller;
@@ -198,9 +202,12 @@ extern "C" {
       SFL_DS_SET(dsi, 0, adaptor->ifIndex, 0); // ds_class,ds_index,ds_instance
       // add sampler
       SEMLOCK_DO(sp->sync_agent) {
-	adaptorNIO->sampler = sfl_agent_addSampler(sp->agent, &dsi);
-	sfl_sampler_set_sFlowFsReceiver(adaptorNIO->sampler, HSP_SFLOW_RECEIVER_INDEX);
-	sfl_sampler_set_sFlowFsMaximumHeaderSize(adaptorNIO->sampler, sp->sFlowSettings_file->headerBytes);
+	// check again - may have more than one packet thread
+	if(adaptorNIO->sampler == NULL) {
+	  adaptorNIO->sampler = sfl_agent_addSampler(sp->agent, &dsi);
+	  sfl_sampler_set_sFlowFsReceiver(adaptorNIO->sampler, HSP_SFLOW_RECEIVER_INDEX);
+	  sfl_sampler_set_sFlowFsMaximumHeaderSize(adaptorNIO->sampler, sp->sFlowSettings_file->headerBytes);
+	}
       }
     }
     return adaptorNIO->sampler;
@@ -212,17 +219,75 @@ extern "C" {
     -----------------___________________________------------------
   */
 
-  static HSPPendingSample *pendingSampleNew(SFLSampler *sampler, SFL_FLOW_SAMPLE_TYPE *fs)  {
-    HSPPendingSample *ps = (HSPPendingSample *)my_calloc(sizeof(HSPPendingSample));
-    ps->fs = fs;
+  // Packet worker threads without a receiver shard hold back their
+  // finished samples and write them in one go at the end of each read
+  // batch,  so that they only take sp->sync_agent once per batch.
+  static __thread UTArray *pendingBatch;
+  // The flow-sample event is looked up on whichever bus is running
+  // in this thread.
+  static __thread EVEvent *evt_flow_sample;
+  static __thread bool flow_sample_handoff;
+
+  // Recycled samples.  The free-list is only touched by the thread that
+  // owns the pool.  mod_tcp (for one) may hold on to samples for a while,
+  // but it releases them on the same bus.  A sample that a worker hands
+  // over to the packet bus is freed there,  so it goes back on its own
+  // pool's returned list - the one thing another thread may touch - and
+  // the owner takes that whole list back when its free-list runs dry.
+  typedef struct _HSPPendingPool {
+    HSPPendingSample *freeList;
+    uint32_t freeCount;
+    HSPPendingSample *returned;
+  } HSPPendingPool;
+  static __thread HSPPendingPool *pendingPool;
+
+  static HSPPendingPool *myPendingPool(void) {
+    // never freed - the bus threads last as long as the process
+    if(pendingPool == NULL)
+      pendingPool = (HSPPendingPool *)my_calloc(sizeof(HSPPendingPool));
+    return pendingPool;
+  }
+
+  HSPPendingSample *pendingSampleNew(SFLSampler *sampler)  {
+    HSPPendingPool *pool = myPendingPool();
+    if(pool->freeList == NULL
+       && __atomic_load_n(&pool->returned, __ATOMIC_RELAXED)) {
+      pool->freeList = __atomic_exchange_n(&pool->returned, NULL, __ATOMIC_ACQUIRE);
+      for(HSPPendingSample *ret = pool->freeList; ret; ret = ret->nxt)
+	pool->freeCount++;
+    }
+    HSPPendingSample *ps = pool->freeList;
+    if(ps) {
+      pool->freeList = ps->nxt;
+      pool->freeCount--;
+      // the header buffer is always written before it is read,
+      // so only the fixed-size structures need to be cleared.
+      memset(&ps->fs_mem, 0, sizeof(ps->fs_mem));
+      memset(&ps->hdrElem, 0, sizeof(ps->hdrElem));
+      ps->nxt = NULL;
+      ps->arenaUsed = 0;
+    }
+    else
+      ps = (HSPPendingSample *)my_calloc(sizeof(HSPPendingSample));
+    ps->fs = &ps->fs_mem;
+    ps->pool = pool;
     ps->sampler = sampler;
     ps->refCount = 1;
-    ps->ptrsToFree = UTArrayNew(UTARRAY_DFLT);
     return ps;
   }
 
   void *pendingSample_calloc(HSPPendingSample *ps, size_t len) {
+    // keep 8-byte alignment in the arena
+    size_t alen = (len + 7) & ~7;
+    if(ps->arenaUsed + alen <= sizeof(ps->arena)) {
+      void *ptr = (u_char *)ps->arena + ps->arenaUsed;
+      ps->arenaUsed += alen;
+      memset(ptr, 0, len);
+      return ptr;
+    }
     void *ptr = my_calloc(len);
+    if(ps->ptrsToFree == NULL)
+      ps->ptrsToFree = UTArrayNew(UTARRAY_DFLT);
     UTArrayAdd(ps->ptrsToFree, ptr);
     return ptr;
   }
@@ -231,21 +296,167 @@ extern "C" {
     ps->refCount++;
   }
 
+  void pendingSampleFree(HSPPendingSample *ps)
+  {
+    if(ps->ptrsToFree
+       && UTArrayN(ps->ptrsToFree)) {
+      void *ptr;
+      UTARRAY_WALK(ps->ptrsToFree, ptr) my_free(ptr);
+      UTArrayReset(ps->ptrsToFree);
+    }
+    HSPPendingPool *pool = myPendingPool();
+    if(ps->pool != pool) {
+      // handed over from another thread - give it back
+      HSPPendingPool *owner = ps->pool;
+      HSPPendingSample *head = __atomic_load_n(&owner->returned, __ATOMIC_RELAXED);
+      do {
+	ps->nxt = head;
+      } while(!__atomic_compare_exchange_n(&owner->returned, &head, ps, YES, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+      return;
+    }
+    if(pool->freeCount >= HSP_PENDINGSAMPLE_POOL_MAX) {
+      // let a burst drain back to the usual working set
+      if(ps->ptrsToFree)
+	UTArrayFree(ps->ptrsToFree);
+      my_free(ps);
+      return;
+    }
+    ps->nxt = pool->freeList;
+    pool->freeList = ps;
+    pool->freeCount++;
+  }
+
   void releasePendingSample(HSP *sp, HSPPendingSample *ps)
   {
     if(--ps->refCount == 0) {
       EVBus *bus = EVCurrentBus();
-      sfl_agent_set_now(ps->sampler->agent, bus->now.tv_sec, bus->now.tv_nsec);
-      SEMLOCK_DO(sp->sync_agent) {
+      HSPShard *shard = getShard(sp);
+      if(shard) {
+	// this thread has a receiver of its own - no lock needed
+	sfl_receiver_set_now(&shard->receiver, bus->now.tv_sec, bus->now.tv_nsec);
+	sfl_sampler_writeFlowSampleTo(ps->sampler, &shard->receiver, ps->fs);
+	HSP_TELEMETRY_ADD(sp, HSP_TELEMETRY_FLOW_SAMPLES, 1);
+      }
+      else if(pendingBatch) {
+	UTArrayAdd(pendingBatch, ps);
+	return;
+      }
+      else {
+	SEMLOCK_DO(sp->sync_agent) {
+	  sfl_agent_set_now(ps->sampler->agent, bus->now.tv_sec, bus->now.tv_nsec);
+	  sfl_sampler_writeFlowSample(ps->sampler, ps->fs);
+	  HSP_TELEMETRY_ADD(sp, HSP_TELEMETRY_FLOW_SAMPLES, 1);
+	}
+      }
+      pendingSampleFree(ps);
+    }
+  }
+
+  /*_________________---------------------------__________________
+    _________________   pendingSampleBatch      __________________
+    -----------------___________________________------------------
+  */
+
+  void pendingSampleBatchStart(void)
+  {
+    if(pendingBatch == NULL)
+      pendingBatch = UTArrayNew(UTARRAY_DFLT);
+  }
+
+  void pendingSampleBatchFlush(HSP *sp)
+  {
+    if(pendingBatch == NULL
+       || UTArrayN(pendingBatch) == 0)
+      return;
+    EVBus *bus = EVCurrentBus();
+    HSPPendingSample *ps;
+    SEMLOCK_DO(sp->sync_agent) {
+      sfl_agent_set_now(sp->agent, bus->now.tv_sec, bus->now.tv_nsec);
+      UTARRAY_WALK(pendingBatch, ps) {
 	sfl_sampler_writeFlowSample(ps->sampler, ps->fs);
-	sp->telemetry[HSP_TELEMETRY_FLOW_SAMPLES]++;
       }
-      void *ptr;
-      UTARRAY_WALK(ps->ptrsToFree, ptr) my_free(ptr);
-      UTArrayFree(ps->ptrsToFree);
-      my_free(ps->fs);
-      my_free(ps);
     }
+    HSP_TELEMETRY_ADD(sp, HSP_TELEMETRY_FLOW_SAMPLES, UTArrayN(pendingBatch));
+    UTARRAY_WALK(pendingBatch, ps) pendingSampleFree(ps);
+    UTArrayReset(pendingBatch);
+  }
+
+  /*_________________---------------------------__________________
+    _________________   packet worker buses     __________________
+    -----------------___________________________------------------
+    Packet sources with workers=N read on the packet bus and on
+    "packet.1" ... "packet.N-1".  The annotators (mod_tcp, for one)
+    keep their state on the packet bus,  so if any of them registered
+    for HSPEVENT_FLOW_SAMPLE there,  a sample taken on a worker bus is
+    passed over to the packet bus to be annotated and written.  With
+    no annotators it is written on the worker bus:  to that bus's own
+    receiver shard if sflow { workerShards=on },  otherwise to the
+    main receiver,  a read batch at a time.  The packet bus itself
+    always writes to the main receiver,  so that its samples keep the
+    configured subAgentId,  but it batches too:  each packet source
+    flushes after a read,  and anything released in between (mod_tcp
+    timeouts,  samples handed over by a worker) goes out on the next
+    read or on the next deci tick.
+  */
+
+  // both set at module init,  before the bus threads start
+  static EVEvent *packetFlowSample;
+  static EVEvent *packetHandoff;
+
+  static void evt_flow_sample_handoff(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    HSPPendingSample *ps;
+    memcpy(&ps, data, sizeof(ps));
+    EVEventTx(sp->rootModule, packetFlowSample, ps, sizeof(*ps));
+    releasePendingSample(sp, ps);
+  }
+
+  static void evt_worker_start(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    uint32_t index = 0;
+    sscanf(evt->bus->name, HSPBUS_PACKET ".%u", &index);
+    if(sp->workerShards)
+      startShard(sp, index);
+    else
+      pendingSampleBatchStart();
+  }
+
+  static void evt_packet_config_first(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    pendingSampleBatchStart();
+  }
+
+  static void evt_packet_deci(EVMod *mod, EVEvent *evt, void *data, size_t dataLen) {
+    pendingSampleBatchFlush((HSP *)EVROOTDATA(mod));
+  }
+
+  // called once the modules are loaded,  before the buses start
+  void packetBusStart(HSP *sp) {
+    EVBus *packetBus = EVGetBus(sp->rootModule, HSPBUS_PACKET, NO);
+    if(packetBus == NULL)
+      return;
+    EVEventRx(sp->rootModule, EVGetEvent(packetBus, HSPEVENT_CONFIG_FIRST), evt_packet_config_first);
+    EVEventRx(sp->rootModule, EVGetEvent(packetBus, EVEVENT_DECI), evt_packet_deci);
+  }
+
+  EVBus *packetWorkerBus(EVMod *mod, uint32_t index) {
+    HSP *sp = (HSP *)EVROOTDATA(mod);
+    EVBus *packetBus = EVGetBus(mod, HSPBUS_PACKET, YES);
+    if(packetHandoff == NULL) {
+      packetFlowSample = EVGetEvent(packetBus, HSPEVENT_FLOW_SAMPLE);
+      packetHandoff = EVGetEvent(packetBus, HSPEVENT_FLOW_SAMPLE_HANDOFF);
+      EVEventRx(sp->rootModule, packetHandoff, evt_flow_sample_handoff);
+    }
+    if(index == 0)
+      return packetBus;
+    char busName[32];
+    snprintf(busName, 32, "%s.%u", HSPBUS_PACKET, index);
+    EVBus *bus = EVGetBus(mod, busName, NO);
+    if(bus == NULL) {
+      // first module to ask for this worker
+      bus = EVGetBus(mod, busName, YES);
+      EVEventRx(sp->rootModule, EVGetEvent(bus, EVEVENT_START), evt_worker_start);
+    }
+    return bus;
   }
 
   /*_________________---------------------------__________________
@@ -343,12 +554,10 @@ extern "C" {
       }
     }
 
-    SFL_FLOW_SAMPLE_TYPE *fs = my_calloc(sizeof(SFL_FLOW_SAMPLE_TYPE));
-
     // set the ingress and egress ifIndex numbers.
     // Can be "INTERNAL" (0x3FFFFFFF) or "UNKNOWN" (0).
-    fs->input = ad_in ? ad_in->ifIndex : (internal_in ? SFL_INTERNAL_INTERFACE : 0);
-    fs->output = ad_out ? ad_out->ifIndex : (internal_out ? SFL_INTERNAL_INTERFACE : 0);
+    uint32_t fs_input = ad_in ? ad_in->ifIndex : (internal_in ? SFL_INTERNAL_INTERFACE : 0);
+    uint32_t fs_output = ad_out ? ad_out->ifIndex : (internal_out ? SFL_INTERNAL_INTERFACE : 0);
 
     SFLAdaptor *sampler_dev = ad_tap;
     if(ad_tap
@@ -410,12 +619,17 @@ extern "C" {
     }
 
     // build the sampled header structure
-    HSPPendingSample *ps = pendingSampleNew(sampler, fs);
-    SFLFlow_sample_element *hdrElem = pendingSample_calloc(ps, sizeof(SFLFlow_sample_element));
+    HSPPendingSample *ps = pendingSampleNew(sampler);
+    SFL_FLOW_SAMPLE_TYPE *fs = ps->fs;
+    fs->input = fs_input;
+    fs->output = fs_output;
+    SFLFlow_sample_element *hdrElem = &ps->hdrElem;
     hdrElem->tag = SFLFLOW_HEADER;
     uint32_t FCS_bytes = 4;
     uint32_t maxHdrLen = sampler->sFlowFsMaximumHeaderSize;
-    hdrElem->flowType.header.header_bytes = (u_char *)pendingSample_calloc(ps, maxHdrLen);
+    hdrElem->flowType.header.header_bytes = (maxHdrLen <= HSP_MAX_HEADER_BYTES)
+      ? ps->hdrBytes
+      : (u_char *)pendingSample_calloc(ps, maxHdrLen);
     hdrElem->flowType.header.frame_length = pkt_len + FCS_bytes;
     hdrElem->flowType.header.stripped = FCS_bytes;
     
@@ -473,10 +687,11 @@ extern "C" {
     // above with the (possibly more granular) ulogSamplingRate, but then
     // we would have to look up the sampler object every time, which
     // might be too expensive in the case where ulogSamplingRate==1.
-    sampler->samplePool += actualSamplingRate;
-    
+    // The sampler may be shared with other packet threads.
+    __atomic_add_fetch(&sampler->samplePool, actualSamplingRate, __ATOMIC_RELAXED);
+
     // accumulate total drops
-    sp->telemetry[HSP_TELEMETRY_DROPPED_SAMPLES] += drops;
+    HSP_TELEMETRY_ADD(sp, HSP_TELEMETRY_DROPPED_SAMPLES, drops);
 
     // also accumulate dropped-samples we detected against whichever sampler
     // sends the next sample. This is not perfect,  but is likely to accrue
@@ -485,12 +700,187 @@ extern "C" {
     fs->drops = samplerNIO->netlink_drops;
 
     // wrap it and send it out in case someone else wants to annotate it
-    if(sp->evt_flow_sample == NULL)
-      sp->evt_flow_sample = EVGetEvent(EVCurrentBus(), HSPEVENT_FLOW_SAMPLE);
-    EVEventTx(sp->rootModule, sp->evt_flow_sample, ps, sizeof(*ps));
+    if(evt_flow_sample == NULL) {
+      evt_flow_sample = EVGetEvent(EVCurrentBus(), HSPEVENT_FLOW_SAMPLE);
+      // the modules have all registered by the time packets arrive
+      flow_sample_handoff = (packetFlowSample
+			     && evt_flow_sample != packetFlowSample
+			     && UTArrayN(packetFlowSample->actions) > 0);
+    }
+    if(flow_sample_handoff) {
+      EVEventTx(sp->rootModule, packetHandoff, &ps, sizeof(ps));
+      return;
+    }
+    EVEventTx(sp->rootModule, evt_flow_sample, ps, sizeof(*ps));
     releasePendingSample(sp, ps);
   }
 
+  /*_________________---------------------------__________________
+    _________________   adaptive sampling       __________________
+    -----------------___________________________------------------
+    With samplingBudget=<samples/sec> (host-wide) and/or
+    portSamplingBudget=<samples/sec> (per source) each packet source
+    that can change its own rate registers an HSPSamplingCtl.  Once
+    a second we estimate the packet rate behind each source from the
+    samples it took,  and pick the smallest rate that keeps it inside
+    both budgets.  The host-wide budget is shared by water-filling,
+    so a quiet port keeps its configured rate while a busy one is
+    backed off.  We back off as soon as a budget is exceeded but
+    only speed up again after a sustained quiet spell,  so the rate
+    does not flap.  The rate in each sample always comes from the
+    source,  so sampling_rate and sample_pool stay correct across a
+    change.
+  */
+
+  HSPSamplingCtl *samplingCtlNew(HSP *sp, char *name, uint32_t baseRate)
+  {
+    if(sp->samplingBudget == 0
+       && sp->portSamplingBudget == 0)
+      return NULL;
+    HSPSamplingCtl *ctl = (HSPSamplingCtl *)my_calloc(sizeof(HSPSamplingCtl));
+    ctl->name = my_strdup(name);
+    ctl->baseRate = baseRate;
+    ctl->rate = baseRate;
+    SEMLOCK_DO(sp->sync_sampling) {
+      UTArrayAdd(sp->samplingCtls, ctl);
+    }
+    return ctl;
+  }
+
+  void samplingCtlFree(HSP *sp, HSPSamplingCtl *ctl)
+  {
+    if(ctl == NULL)
+      return;
+    SEMLOCK_DO(sp->sync_sampling) {
+      UTArrayDel(sp->samplingCtls, ctl);
+    }
+    my_free(ctl->name);
+    my_free(ctl);
+  }
+
+  void samplingCtlSetBase(HSPSamplingCtl *ctl, uint32_t baseRate)
+  {
+    if(ctl == NULL)
+      return;
+    __atomic_store_n(&ctl->baseRate, baseRate, __ATOMIC_RELAXED);
+    // a new configured rate takes effect straight away,  and the
+    // controller will back off from there if it has to
+    __atomic_store_n(&ctl->rate, baseRate, __ATOMIC_RELAXED);
+  }
+
+  static uint32_t budgetRate(uint64_t pkts, uint32_t budget, uint32_t pct)
+  {
+    // smallest rate that keeps pkts/rate within pct% of budget
+    if(budget == 0)
+      return 0;
+    uint64_t lim = ((uint64_t)budget * pct);
+    uint64_t rate = ((pkts * 100) + lim - 1) / lim;
+    return (rate > HSP_SAMPLING_CTL_MAX_RATE) ? HSP_SAMPLING_CTL_MAX_RATE : rate;
+  }
+
+  static uint32_t portRate(HSP *sp, HSPSamplingCtl *ctl, uint32_t pct)
+  {
+    uint32_t rate = ctl->baseRate;
+    uint32_t port = budgetRate(ctl->pkts, sp->portSamplingBudget, pct);
+    return (port > rate) ? port : rate;
+  }
+
+  static double hostSamples(HSP *sp, uint32_t hostRate, uint32_t pct)
+  {
+    double samples = 0;
+    HSPSamplingCtl *ctl;
+    UTARRAY_WALK(sp->samplingCtls, ctl) {
+      if(ctl->baseRate == 0)
+	continue;
+      uint32_t rate = portRate(sp, ctl, pct);
+      if(hostRate > rate)
+	rate = hostRate;
+      samples += (double)ctl->pkts / rate;
+    }
+    return samples;
+  }
+
+  static uint32_t hostRate(HSP *sp, uint32_t pct)
+  {
+    // smallest common rate that, applied only to the sources that are
+    // sampling more finely than that,  keeps the total within pct% of
+    // the host budget
+    if(sp->samplingBudget == 0)
+      return 0;
+    double lim = ((double)sp->samplingBudget * pct) / 100.0;
+    uint32_t lo = 1, hi = HSP_SAMPLING_CTL_MAX_RATE;
+    if(hostSamples(sp, lo, pct) <= lim)
+      return 0;
+    while(lo < hi) {
+      uint32_t mid = lo + ((hi - lo) / 2);
+      if(hostSamples(sp, mid, pct) <= lim)
+	hi = mid;
+      else
+	lo = mid + 1;
+    }
+    return hi;
+  }
+
+  static uint32_t ctlRate(HSP *sp, HSPSamplingCtl *ctl, uint32_t hostRate, uint32_t pct)
+  {
+    uint32_t rate = portRate(sp, ctl, pct);
+    return (hostRate > rate) ? hostRate : rate;
+  }
+
+  void samplingCtlTick(HSP *sp)
+  {
+    if(UTArrayN(sp->samplingCtls) == 0)
+      return;
+    SEMLOCK_DO(sp->sync_sampling) {
+      // estimate packets/sec behind each source
+      uint64_t totalPkts = 0;
+      HSPSamplingCtl *ctl;
+      UTARRAY_WALK(sp->samplingCtls, ctl) {
+	uint32_t samples = __atomic_exchange_n(&ctl->samples, 0, __ATOMIC_RELAXED);
+	if(ctl->settleTicks)
+	  ctl->settleTicks--; // just changed, so keep the last estimate
+	else
+	  ctl->pkts = (uint64_t)samples * ctl->rate;
+	totalPkts += ctl->pkts;
+      }
+      uint32_t hostRate_hi = hostRate(sp, 100);
+      uint32_t hostRate_mid = hostRate(sp, HSP_SAMPLING_CTL_HEADROOM);
+      uint32_t hostRate_lo = hostRate(sp, HSP_SAMPLING_CTL_LOWATER);
+      UTARRAY_WALK(sp->samplingCtls, ctl) {
+	uint32_t rate = samplingCtlRate(ctl);
+	uint32_t newRate = rate;
+	if(ctl->baseRate == 0
+	   || ctl->settleTicks)
+	  continue; // sampling off, or still settling
+	if(ctlRate(sp, ctl, hostRate_hi, 100) > rate) {
+	  // over budget - back off now
+	  newRate = ctlRate(sp, ctl, hostRate_mid, HSP_SAMPLING_CTL_HEADROOM);
+	  ctl->quietTicks = 0;
+	}
+	else if(ctlRate(sp, ctl, hostRate_lo, HSP_SAMPLING_CTL_LOWATER) < rate) {
+	  // well under budget
+	  if(++ctl->quietTicks >= HSP_SAMPLING_CTL_QUIET_TICKS) {
+	    newRate = ctlRate(sp, ctl, hostRate_mid, HSP_SAMPLING_CTL_HEADROOM);
+	    ctl->quietTicks = 0;
+	  }
+	}
+	else
+	  ctl->quietTicks = 0;
+	if(newRate != rate) {
+	  myDebug(1, "adaptive sampling: %s rate %u -> %u (pkts/sec=%"PRIu64" host pkts/sec=%"PRIu64")",
+		  ctl->name,
+		  rate,
+		  newRate,
+		  ctl->pkts,
+		  totalPkts);
+	  __atomic_store_n(&ctl->rate, newRate, __ATOMIC_RELAXED);
+	  ctl->settleTicks = HSP_SAMPLING_CTL_SETTLE_TICKS;
+	  sp->telemetry[HSP_TELEMETRY_SAMPLING_CHANGES]++;
+	}
+      }
+    }
+  }
+
   /*_________________---------------------------__________________
     _________________   configSwitchPorts       __________________
     -----------------___________________________------------------
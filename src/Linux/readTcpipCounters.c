@@ -8,9 +8,6 @@ extern "C" {
 
 #include "hsflowd.h"
 
-  // make sure we read whole lines at a time
-#define MAX_PROC_LINE_CHARS 2048
-
   /*_________________---------------------------__________________
     _________________    parseCounterArray      __________________
     -----------------___________________________------------------
@@ -20,20 +17,16 @@ extern "C" {
     char *p = str;
     int ff = 0;
     for(; ff < n; ff++) {
-      char buf[MAX_PROC_LINE_CHARS];
-      char *var = parseNextTok(&p, " \t", NO, 0, NO, buf, MAX_PROC_LINE_CHARS);
       // stop if we reach the end of the line - or if something was not a number
-      if(var == NULL) {
-	// no more tokens
-	break;
-      }
-      char *end = NULL;
-      long val = strtol(var, &end, 0);
-      if(end == var) {
-	// nothing was consumed - it wasn't a number
+      // (the "Tcp: MaxConn" field can be -1)
+      p = UTScanSpace(p);
+      bool negative = (*p == '-');
+      if(negative)
+	p++;
+      uint64_t val;
+      if(!UTScanU64(&p, &val))
 	break;
-      }
-      counters[ff] = (uint32_t)val;
+      counters[ff] = negative ? (uint32_t)(0 - val) : (uint32_t)val;
     }
     return ff;
   }
@@ -43,31 +36,31 @@ extern "C" {
     -----------------___________________________------------------
   */
 
+  static UTProcFile *pf_snmp;
+
   int readTcpipCounters(HSP *sp, SFLHost_ip_counters *c_ip, SFLHost_icmp_counters *c_icmp, SFLHost_tcp_counters *c_tcp, SFLHost_udp_counters *c_udp) {
     int count = 0;
-    FILE *procFile;
-    char line[MAX_PROC_LINE_CHARS];
+    char *line;
 
-    procFile= fopen("/proc/net/snmp", "r");
-    if(procFile) {
-      while(fgets(line, MAX_PROC_LINE_CHARS, procFile)) {
+    if(pf_snmp == NULL)
+      pf_snmp = UTProcFileNew("/proc/net/snmp", YES);
+    if(UTProcFileRead(pf_snmp) > 0) {
+      while((line = UTProcFileLine(pf_snmp)) != NULL) {
 	char *p = line;
-	char buf[MAX_PROC_LINE_CHARS];
-	char *var = parseNextTok(&p, " \t", NO, 0, NO, buf, MAX_PROC_LINE_CHARS);
-	if(strcmp(var, "Ip:") == 0) {
+	// the header lines fail to parse as numbers and are skipped
+	if(UTScanPrefix(&p, "Ip:")) {
 	  count += parseCounterArray(p, (uint32_t *)c_ip, SFLHOST_NUM_IP_COUNTERS);
 	}
-	else if(strcmp(var, "Icmp:") == 0) {
+	else if(UTScanPrefix(&p, "Icmp:")) {
 	  count += parseCounterArray(p, (uint32_t *)c_icmp, SFLHOST_NUM_ICMP_COUNTERS);
 	}
-	else if(strcmp(var, "Tcp:") == 0) {
+	else if(UTScanPrefix(&p, "Tcp:")) {
 	  count += parseCounterArray(p, (uint32_t *)c_tcp, SFLHOST_NUM_TCP_COUNTERS);
 	}
-	else if(strcmp(var, "Udp:") == 0) {
+	else if(UTScanPrefix(&p, "Udp:")) {
 	  count += parseCounterArray(p, (uint32_t *)c_udp, SFLHOST_NUM_UDP_COUNTERS);
 	}
       }
-      fclose(procFile);
     }
     return (count > 0);
   }
@@ -225,6 +225,8 @@ extern "C" {
     UTHeapHeader *bufferLists[UT_MAX_BUFFER_Q];
     pid_t realmIdx;
     uint32_t totalAllocatedBytes;
+    uint64_t allocs;   // every UTHeapQNew()
+    uint64_t osAllocs; // the ones that had to go to the OS
   } UTHeapRealm;
 
   // separate realm for each thread
@@ -253,6 +255,7 @@ extern "C" {
     int queueIdx = 4;
     for(int l = (len + 15) >> 4; l > 0; l >>= 1) queueIdx++;
     UTHeapHeader *utBuf = (UTHeapHeader *)utRealm.bufferLists[queueIdx];
+    utRealm.allocs++;
     if(utBuf) {
       // peel it off
       utRealm.bufferLists[queueIdx] = utBuf->nxt;
@@ -261,6 +264,7 @@ extern "C" {
       // allocate a new one
       utBuf = (UTHeapHeader *)my_os_calloc(1<<queueIdx);
       utRealm.totalAllocatedBytes += (1<<queueIdx);
+      utRealm.osAllocs++;
     }
     // remember the details so we know what to do on free (overwriting the nxt pointer)
     utBuf->h.realmIdx = utRealm.realmIdx;
@@ -269,6 +273,12 @@ extern "C" {
     return (char *)utBuf + sizeof(UTHeapHeader);
   }
 
+  // allocation counts for this thread
+  void UTHeapQStats(uint64_t *allocs, uint64_t *osAllocs) {
+    if(allocs) *allocs = utRealm.allocs;
+    if(osAllocs) *osAllocs = utRealm.osAllocs;
+  }
+
   /*_________________---------------------------__________________
     _________________    foreign thread free    __________________
     -----------------___________________________------------------
@@ -1163,8 +1173,29 @@ extern "C" {
     return adList;
   }
 
+  // Same,  but keep hash indices by name and ifIndex so that
+  // adaptorListGet() and adaptorListAdd() do not scan the array.
+  // The deviceName and ifIndex must not change while the adaptor
+  // is in the list.
+  SFLAdaptorList *adaptorListNewIndexed()
+  {
+    SFLAdaptorList *adList = adaptorListNew();
+    adList->byName = UTHASH_NEW(SFLAdaptor, deviceName, UTHASH_SKEY);
+    adList->byIndex = UTHASH_NEW(SFLAdaptor, ifIndex, UTHASH_DFLT);
+    return adList;
+  }
+
+  static void adaptorListUnIndex(SFLAdaptorList *adList, SFLAdaptor *ad)
+  {
+    // UTHashDel() only removes the entry if it is this adaptor
+    if(adList->byName) UTHashDel((UTHash *)adList->byName, ad);
+    if(adList->byIndex) UTHashDel((UTHash *)adList->byIndex, ad);
+  }
+
   void adaptorListReset(SFLAdaptorList *adList)
   {
+    if(adList->byName) UTHashReset((UTHash *)adList->byName);
+    if(adList->byIndex) UTHashReset((UTHash *)adList->byIndex);
     for(uint32_t i = 0; i < adList->num_adaptors; i++) {
       if(adList->adaptors[i]) {
 	adaptorFree(adList->adaptors[i]);
@@ -1177,6 +1208,8 @@ extern "C" {
   void adaptorListFree(SFLAdaptorList *adList)
   {
     adaptorListReset(adList);
+    if(adList->byName) UTHashFree((UTHash *)adList->byName);
+    if(adList->byIndex) UTHashFree((UTHash *)adList->byIndex);
     my_free(adList->adaptors);
     my_free(adList);
   }
@@ -1193,6 +1226,7 @@ extern "C" {
     for(uint32_t i = 0; i < adList->num_adaptors; i++) {
       SFLAdaptor *ad = adList->adaptors[i];
       if(ad && ad->marked) {
+	adaptorListUnIndex(adList, ad);
 	adaptorFree(ad);
 	adList->adaptors[i] = NULL;
 	removed++;
@@ -1219,6 +1253,10 @@ extern "C" {
 
   SFLAdaptor *adaptorListGet(SFLAdaptorList *adList, char *dev)
   {
+    if(adList->byName) {
+      SFLAdaptor search = { .deviceName = dev };
+      return UTHashGet((UTHash *)adList->byName, &search);
+    }
     SFLAdaptor *ad;
     ADAPTORLIST_WALK(adList, ad)
       if(my_strequal(ad->deviceName, dev)) return ad;
@@ -1227,6 +1265,11 @@ extern "C" {
 
   SFLAdaptor *adaptorListGet_ifIndex(SFLAdaptorList *adList, uint32_t ifIndex)
   {
+    if(adList->byIndex
+       && ifIndex) {
+      SFLAdaptor search = { .ifIndex = ifIndex };
+      return UTHashGet((UTHash *)adList->byIndex, &search);
+    }
     SFLAdaptor *ad;
     ADAPTORLIST_WALK(adList, ad)
       if(ifIndex == ad->ifIndex) return ad;
@@ -1245,6 +1288,11 @@ extern "C" {
       adList->adaptors = (SFLAdaptor **)my_realloc(adList->adaptors, adList->capacity * sizeof(SFLAdaptor *));
     }
     adList->adaptors[adList->num_adaptors++] = adaptor;
+    if(adList->byName)
+      UTHashAdd((UTHash *)adList->byName, adaptor);
+    if(adList->byIndex
+       && adaptor->ifIndex)
+      UTHashAdd((UTHash *)adList->byIndex, adaptor);
   }
 
   /*________________---------------------------__________________
@@ -1781,6 +1829,363 @@ static uint32_t hashSearch(UTHash *oh, void *obj, void **found) {
     return fd;
   }
 
+  /*_________________---------------------------__________________
+    _________________   batched receive         __________________
+    -----------------___________________________------------------
+    Replaces a loop of recv()/read() calls on a datagram socket with
+    recvmmsg() into a vector of buffers that is allocated once.  The
+    batch starts small and doubles whenever it comes back full, then
+    halves again when the backlog drains, so an idle socket does not
+    pay to set up maxMsgs headers on every call.  A caller that stops
+    after a fixed number of messages should use UTRecvBatchReadMax()
+    so that it never pulls more off the socket than it will process.
+  */
+
+#define UT_RECVBATCH_CTRL CMSG_SPACE(sizeof(uint32_t))
+
+  UTRecvBatch *UTRecvBatchNew(int fd, char *name, uint32_t maxMsgs, uint32_t bufLen) {
+    UTRecvBatch *rb = (UTRecvBatch *)my_calloc(sizeof(UTRecvBatch));
+    rb->fd = fd;
+    rb->name = my_strdup(name);
+    rb->maxMsgs = maxMsgs ?: 1;
+    rb->bufLen = bufLen;
+    rb->batch = (rb->maxMsgs < UT_RECVBATCH_MIN) ? rb->maxMsgs : UT_RECVBATCH_MIN;
+    rb->bufs = (u_char *)my_calloc(rb->maxMsgs * (bufLen + 1));
+    rb->msgs = (struct mmsghdr *)my_calloc(rb->maxMsgs * sizeof(struct mmsghdr));
+    rb->iov = (struct iovec *)my_calloc(rb->maxMsgs * sizeof(struct iovec));
+    rb->peers = (struct sockaddr_storage *)my_calloc(rb->maxMsgs * sizeof(struct sockaddr_storage));
+    rb->ctrl = (u_char *)my_calloc(rb->maxMsgs * UT_RECVBATCH_CTRL);
+    for(uint32_t ii = 0; ii < rb->maxMsgs; ii++) {
+      rb->iov[ii].iov_base = UTRecvBatchBuf(rb, ii);
+      rb->iov[ii].iov_len = bufLen;
+      rb->msgs[ii].msg_hdr.msg_iov = &rb->iov[ii];
+      rb->msgs[ii].msg_hdr.msg_iovlen = 1;
+    }
+    // ask the kernel to tell us how many datagrams it dropped because
+    // the receive queue was full. Not all socket types support this.
+    int one = 1;
+    if(setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one)) < 0) {
+      myDebug(1, "%s: setsockopt(SO_RXQ_OVFL) failed: %s", name, strerror(errno));
+    }
+    return rb;
+  }
+
+  // counters may be shared by several sockets (and threads)
+  void UTRecvBatchTelemetry(UTRecvBatch *rb, uint64_t *counters) {
+    rb->telemetry = counters;
+  }
+
+#define UT_RECVBATCH_ADD(rb, ctr, n) \
+  if((rb)->telemetry) __atomic_add_fetch(&(rb)->telemetry[(ctr)], (n), __ATOMIC_RELAXED)
+
+  void UTRecvBatchFree(UTRecvBatch *rb) {
+    my_free(rb->name);
+    my_free(rb->bufs);
+    my_free(rb->msgs);
+    my_free(rb->iov);
+    my_free(rb->peers);
+    my_free(rb->ctrl);
+    my_free(rb);
+  }
+
+  // returns the number of messages received (at most max), 0 if there
+  // was nothing to read, or -1 on error (with errno preserved).
+  int UTRecvBatchReadMax(UTRecvBatch *rb, uint32_t max) {
+    uint32_t want = (max < rb->batch) ? max : rb->batch;
+    if(want == 0)
+      return 0;
+    for(uint32_t ii = 0; ii < want; ii++) {
+      struct msghdr *hdr = &rb->msgs[ii].msg_hdr;
+      hdr->msg_name = &rb->peers[ii];
+      hdr->msg_namelen = sizeof(struct sockaddr_storage);
+      hdr->msg_control = rb->ctrl + (ii * UT_RECVBATCH_CTRL);
+      hdr->msg_controllen = UT_RECVBATCH_CTRL;
+      hdr->msg_flags = 0;
+      rb->msgs[ii].msg_len = 0;
+    }
+    int n = recvmmsg(rb->fd, rb->msgs, want, MSG_DONTWAIT, NULL);
+    int err = errno;
+    rb->calls++;
+    UT_RECVBATCH_ADD(rb, UT_RECVBATCH_CALLS, 1);
+    if(n < 0) {
+      if(err == EAGAIN
+	 || err == EWOULDBLOCK)
+	n = 0;
+      else if(err == ENOBUFS) {
+	rb->enobufs++;
+	UT_RECVBATCH_ADD(rb, UT_RECVBATCH_ENOBUFS, 1);
+      }
+    }
+    if(n > 0) {
+      rb->msgs_rx += n;
+      UT_RECVBATCH_ADD(rb, UT_RECVBATCH_MSGS, n);
+      // the drop counter is cumulative, so the last one is enough
+      struct msghdr *hdr = &rb->msgs[n-1].msg_hdr;
+      for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+	if(cmsg->cmsg_level == SOL_SOCKET
+	   && cmsg->cmsg_type == SO_RXQ_OVFL) {
+	  uint32_t drops;
+	  memcpy(&drops, CMSG_DATA(cmsg), sizeof(uint32_t));
+	  UT_RECVBATCH_ADD(rb, UT_RECVBATCH_RXQ_DROPS, (uint32_t)(drops - rb->rxq_drops));
+	  rb->rxq_drops = drops;
+	}
+      }
+    }
+    // adapt to the backlog (a short read that was capped by the
+    // caller says nothing about it)
+    if(n == (int)rb->batch) {
+      rb->batch <<= 1;
+      if(rb->batch > rb->maxMsgs)
+	rb->batch = rb->maxMsgs;
+    }
+    else if(want == rb->batch
+	    && n < (int)(rb->batch >> 2)
+	    && rb->batch > UT_RECVBATCH_MIN) {
+      rb->batch >>= 1;
+      if(rb->batch < UT_RECVBATCH_MIN)
+	rb->batch = UT_RECVBATCH_MIN;
+    }
+    if(debug(1)) {
+      time_t now = time(NULL);
+      if((now - rb->lastReport) >= UT_RECVBATCH_REPORT_S) {
+	rb->lastReport = now;
+	myDebug(1, "recvbatch %s: calls=%"PRIu64" msgs=%"PRIu64" msgs/call=%.2f batch=%u rxq_drops=%u enobufs=%u",
+		rb->name,
+		rb->calls,
+		rb->msgs_rx,
+		rb->calls ? ((double)rb->msgs_rx / (double)rb->calls) : 0.0,
+		rb->batch,
+		rb->rxq_drops,
+		rb->enobufs);
+      }
+    }
+    errno = err;
+    return n;
+  }
+
+  int UTRecvBatchRead(UTRecvBatch *rb) {
+    return UTRecvBatchReadMax(rb, rb->batch);
+  }
+
+  /*_________________---------------------------__________________
+    _________________   /proc and /sys reader   __________________
+    -----------------___________________________------------------
+    For files that are read on every poll,  keep the descriptor open and
+    re-read from offset 0 with pread(),  which makes procfs, sysfs and
+    cgroupfs generate the content again.  The buffer is kept and only
+    ever grows.  If the file vanishes (e.g. a container exited) the
+    read fails,  the fd is closed,  and the open is retried next time.
+    Only a bounded set of host-wide files should be kept open.  Files
+    that come and go with each process, service or container are
+    opened for every read (keepOpen=NO) and just keep their buffer,
+    or a busy host would run out of descriptors.
+  */
+
+#define UT_PROCFILE_MIN_BUF 4096
+
+  UTProcFile *UTProcFileNew(char *path, bool keepOpen) {
+    UTProcFile *pf = (UTProcFile *)my_calloc(sizeof(UTProcFile));
+    pf->path = my_strdup(path);
+    pf->fd = -1;
+    pf->keepOpen = keepOpen;
+    return pf;
+  }
+
+  static void procFileClose(UTProcFile *pf) {
+    if(pf->fd >= 0)
+      close(pf->fd);
+    pf->fd = -1;
+  }
+
+  void UTProcFileFree(UTProcFile *pf) {
+    procFileClose(pf);
+    my_free(pf->path);
+    if(pf->buf)
+      my_free(pf->buf);
+    my_free(pf);
+  }
+
+  // returns the number of bytes read,  or -1 if the file
+  // could not be opened or read.  The content is '\0'-terminated
+  // and the line iterator is reset.
+  int UTProcFileRead(UTProcFile *pf) {
+    pf->len = 0;
+    pf->nextLine = NULL;
+    if(pf->fd < 0) {
+      pf->fd = open(pf->path, O_RDONLY|O_CLOEXEC);
+      if(pf->fd < 0) {
+	myDebug(3, "UTProcFileRead: open(%s) failed: %s", pf->path, strerror(errno));
+	return -1;
+      }
+    }
+    if(pf->buf == NULL) {
+      pf->bufCap = UT_PROCFILE_MIN_BUF;
+      pf->buf = (char *)my_calloc(pf->bufCap);
+    }
+    for(;;) {
+      if(pf->len >= (pf->bufCap - 1)) {
+	// grow (and remember) so the next read fits in one go
+	char *newBuf = (char *)my_calloc(pf->bufCap * 2);
+	memcpy(newBuf, pf->buf, pf->len);
+	my_free(pf->buf);
+	pf->buf = newBuf;
+	pf->bufCap *= 2;
+      }
+      ssize_t n = pread(pf->fd, pf->buf + pf->len, pf->bufCap - pf->len - 1, pf->len);
+      if(n < 0) {
+	if(errno == EINTR)
+	  continue;
+	myDebug(3, "UTProcFileRead: pread(%s) failed: %s", pf->path, strerror(errno));
+	procFileClose(pf);
+	pf->len = 0;
+	return -1;
+      }
+      if(n == 0)
+	break;
+      pf->len += n;
+      if(pf->maxLen
+	 && pf->len >= pf->maxLen)
+	break;
+    }
+    pf->buf[pf->len] = '\0';
+    pf->nextLine = pf->buf;
+    if(!pf->keepOpen)
+      procFileClose(pf);
+    return pf->len;
+  }
+
+  // iterate over the lines from the last read.  The newline is
+  // replaced with '\0',  so the line can be scanned in place.
+  char *UTProcFileLine(UTProcFile *pf) {
+    char *line = pf->nextLine;
+    if(line == NULL
+       || *line == '\0')
+      return NULL;
+    char *eol = strchr(line, '\n');
+    if(eol) {
+      *eol = '\0';
+      pf->nextLine = eol + 1;
+    }
+    else
+      pf->nextLine = line + strlen(line);
+    return line;
+  }
+
+  UTHash *UTProcFileCacheNew(void) {
+    return UTHASH_NEW(UTProcFile, path, UTHASH_SKEY);
+  }
+
+  UTProcFile *UTProcFileCacheGet(UTHash *cache, char *path, bool keepOpen) {
+    UTProcFile search = { .path = path };
+    UTProcFile *pf = UTHashGet(cache, &search);
+    if(pf == NULL) {
+      pf = UTProcFileNew(path, keepOpen);
+      UTHashAdd(cache, pf);
+    }
+    return pf;
+  }
+
+  void UTProcFileCacheFree(UTHash *cache) {
+    UTProcFile *pf;
+    UTHASH_WALK(cache, pf)
+      UTProcFileFree(pf);
+    UTHashFree(cache);
+  }
+
+  char *UTScanSpace(char *p) {
+    while(*p == ' ' || *p == '\t')
+      p++;
+    return p;
+  }
+
+  bool UTScanU64(char **p, uint64_t *val) {
+    char *q = UTScanSpace(*p);
+    if(*q < '0' || *q > '9')
+      return NO;
+    uint64_t v = 0;
+    while(*q >= '0' && *q <= '9')
+      v = (v * 10) + (*q++ - '0');
+    *val = v;
+    *p = q;
+    return YES;
+  }
+
+  bool UTScanU32(char **p, uint32_t *val) {
+    uint64_t v64;
+    if(!UTScanU64(p, &v64))
+      return NO;
+    *val = (uint32_t)v64;
+    return YES;
+  }
+
+  bool UTScanHex32(char **p, uint32_t *val) {
+    char *q = UTScanSpace(*p);
+    uint32_t v = 0;
+    int nibbles = 0;
+    for(;; q++, nibbles++) {
+      uint32_t nib;
+      if(*q >= '0' && *q <= '9') nib = *q - '0';
+      else if(*q >= 'a' && *q <= 'f') nib = *q - 'a' + 10;
+      else if(*q >= 'A' && *q <= 'F') nib = *q - 'A' + 10;
+      else break;
+      v = (v << 4) | nib;
+    }
+    if(nibbles == 0)
+      return NO;
+    *val = v;
+    *p = q;
+    return YES;
+  }
+
+  // enough for "12.34" in /proc/loadavg or /proc/uptime (no exponent)
+  bool UTScanDouble(char **p, double *val) {
+    char *q = UTScanSpace(*p);
+    uint64_t ipart = 0;
+    if(!UTScanU64(&q, &ipart))
+      return NO;
+    double v = (double)ipart;
+    if(*q == '.') {
+      double scale = 0.1;
+      for(q++; *q >= '0' && *q <= '9'; q++, scale /= 10)
+	v += (*q - '0') * scale;
+    }
+    *val = v;
+    *p = q;
+    return YES;
+  }
+
+  // returns the next token (not '\0'-terminated) and its length,
+  // skipping leading whitespace and stopping at any char in delim
+  char *UTScanToken(char **p, char *delim, int *len) {
+    char *q = UTScanSpace(*p);
+    char *tok = q;
+    while(*q && strchr(delim, *q) == NULL)
+      q++;
+    *len = q - tok;
+    *p = q;
+    return (*len > 0) ? tok : NULL;
+  }
+
+  // next whitespace-delimited field,  '\0'-terminated in place
+  char *UTScanField(char **p) {
+    int len;
+    char *tok = UTScanToken(p, " \t\n", &len);
+    if(tok && **p) {
+      **p = '\0';
+      (*p)++;
+    }
+    return tok;
+  }
+
+  bool UTScanPrefix(char **p, const char *prefix) {
+    char *q = UTScanSpace(*p);
+    size_t plen = strlen(prefix);
+    if(strncmp(q, prefix, plen) != 0)
+      return NO;
+    *p = q + plen;
+    return YES;
+  }
+
   /*_________________---------------------------__________________
     _________________          regex            __________________
     -----------------___________________________------------------
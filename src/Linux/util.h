@@ -91,6 +91,7 @@ extern "C" {
   void *UTHeapQReAlloc(void *buf, size_t newSiz);
   void UTHeapQFree(void *buf);
   void UTHeapGC(void);
+  void UTHeapQStats(uint64_t *allocs, uint64_t *osAllocs);
 
 #define my_calloc UTHeapQNew
 #define my_realloc UTHeapQReAlloc
@@ -224,6 +225,7 @@ extern "C" {
 
   // SFLAdaptorList
   SFLAdaptorList *adaptorListNew(void);
+  SFLAdaptorList *adaptorListNewIndexed(void);
   void adaptorListReset(SFLAdaptorList *adList);
   void adaptorListFree(SFLAdaptorList *adList);
   void adaptorListMarkAll(SFLAdaptorList *adList);
@@ -241,6 +243,47 @@ extern "C" {
   int UTSocketUDP(char *bindaddr, int family, uint16_t port, int bufferSize);
   int UTUnixDomainSocket(char *path);
 
+  // batched datagram receive: one recvmmsg() drains up to maxMsgs
+  // messages into a reusable buffer vector. The batch size adapts
+  // to the backlog, and calls/msgs/drops are kept per-socket.
+  typedef struct _UTRecvBatch {
+    int fd;
+    char *name;
+    uint32_t maxMsgs;
+    uint32_t bufLen;
+    uint32_t batch;
+    u_char *bufs;
+    struct mmsghdr *msgs;
+    struct iovec *iov;
+    struct sockaddr_storage *peers;
+    u_char *ctrl;
+    // telemetry
+    uint64_t calls;
+    uint64_t msgs_rx;
+    uint32_t rxq_drops;  // latest SO_RXQ_OVFL count from the kernel
+    uint32_t enobufs;    // netlink reports overruns as ENOBUFS instead
+    time_t lastReport;
+    uint64_t *telemetry; // optional: UT_RECVBATCH_NUM_COUNTERS to add to
+  } UTRecvBatch;
+  typedef enum {
+    UT_RECVBATCH_CALLS=0,
+    UT_RECVBATCH_MSGS,
+    UT_RECVBATCH_RXQ_DROPS,
+    UT_RECVBATCH_ENOBUFS,
+    UT_RECVBATCH_NUM_COUNTERS
+  } EnumUTRecvBatchCounter;
+#define UT_RECVBATCH_MIN 4
+#define UT_RECVBATCH_REPORT_S 60
+  UTRecvBatch *UTRecvBatchNew(int fd, char *name, uint32_t maxMsgs, uint32_t bufLen);
+  int UTRecvBatchRead(UTRecvBatch *rb);
+  int UTRecvBatchReadMax(UTRecvBatch *rb, uint32_t max);
+  void UTRecvBatchTelemetry(UTRecvBatch *rb, uint64_t *counters);
+  void UTRecvBatchFree(UTRecvBatch *rb);
+  // each buffer has one spare byte so the caller can '\0' terminate
+#define UTRecvBatchBuf(rb, ii) ((rb)->bufs + ((ii) * ((rb)->bufLen + 1)))
+#define UTRecvBatchLen(rb, ii) ((rb)->msgs[(ii)].msg_len)
+#define UTRecvBatchPeer(rb, ii) (&(rb)->peers[(ii)])
+
   // SFLAddress utils
   char *SFLAddress_print(SFLAddress *addr, char *buf, size_t len);
   int SFLAddress_equal(SFLAddress *addr1, SFLAddress *addr2);
@@ -288,6 +331,37 @@ extern "C" {
 
 #define UTHASH_WALK(oh, obj) for(uint32_t _ii=0; _ii<oh->cap; _ii++) if(((obj)=(typeof(obj))oh->bins[_ii]) && (obj) != UTHASH_DBIN)
 
+  // /proc and /sys reader: keeps the descriptor open and re-reads
+  // the whole file with pread() into a buffer that is kept too.
+  typedef struct _UTProcFile {
+    char *path;
+    int fd;
+    bool keepOpen;
+    uint32_t maxLen; // stop after this many bytes (0 = whole file)
+    char *buf;
+    uint32_t bufCap;
+    uint32_t len;
+    char *nextLine;
+  } UTProcFile;
+  UTProcFile *UTProcFileNew(char *path, bool keepOpen);
+  void UTProcFileFree(UTProcFile *pf);
+  int UTProcFileRead(UTProcFile *pf);
+  char *UTProcFileLine(UTProcFile *pf);
+  // cache of files (by path) e.g. for one container's cgroup
+  UTHash *UTProcFileCacheNew(void);
+  UTProcFile *UTProcFileCacheGet(UTHash *cache, char *path, bool keepOpen);
+  void UTProcFileCacheFree(UTHash *cache);
+  // non-locale scanners that advance *p
+  char *UTScanSpace(char *p);
+  bool UTScanU64(char **p, uint64_t *val);
+  bool UTScanU32(char **p, uint32_t *val);
+  bool UTScanHex32(char **p, uint32_t *val);
+  bool UTScanDouble(char **p, double *val);
+  char *UTScanToken(char **p, char *delim, int *len);
+  bool UTScanPrefix(char **p, const char *prefix);
+  char *UTScanField(char **p);
+#define UTSCAN_TOKEN_IS(tok, len, str) ((len) == (sizeof(str) - 1) && memcmp((tok), (str), (len)) == 0)
+
   regex_t *UTRegexCompile(char *pattern_str);
   int UTRegexExtractInt(regex_t *rx, char *str, int nvals, int *val1, int *val2, int *val3);
 
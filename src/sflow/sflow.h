@@ -748,6 +748,10 @@ typedef struct _SFLAdaptorList {
   uint32_t capacity;
   uint32_t num_adaptors;
   SFLAdaptor **adaptors;
+  /* optional lookup indices, maintained by the host agent.
+     Must be NULL when the list is just a borrowed array. */
+  void *byName;
+  void *byIndex;
 } SFLAdaptorList;
 
 typedef struct _SFLHost_par_counters {
@@ -75,6 +75,7 @@ void sfl_agent_release(SFLAgent *agent)
   /* release and free the pollers */
   for( pl= agent->pollers; pl != NULL; ) {
     SFLPoller *nextPl = pl->nxt;
+    sfl_agent_staticCacheFree(agent, &pl->staticCache);
     sflFree(agent, pl);
     pl = nextPl;
   }
@@ -104,17 +105,109 @@ void sfl_agent_tick(SFLAgent *agent, time_t now)
 {
   SFLReceiver *rcv;
   SFLSampler *sm;
-  SFLPoller *pl;
 
   agent->now = now;
   /* pollers use ticks to decide when to ask for counters */
-  for( pl = agent->pollers; pl != NULL; pl = pl->nxt) sfl_poller_tick(pl, now);
+  sfl_agent_tickPollers(agent);
   /* receivers use ticks to flush send data */
   for( rcv = agent->receivers; rcv != NULL; rcv = rcv->nxt) sfl_receiver_tick(rcv, now);
   /* samplers use ticks to decide when they are sampling too fast */
   for( sm = agent->samplers; sm != NULL; sm = sm->nxt) sfl_sampler_tick(sm, now);
 }
 
+/*_________________---------------------------__________________
+  _________________   sfl_agent_tickPollers   __________________
+  -----------------___________________________------------------
+Only the pollers in this tick's wheel slot are visited. Anything
+over the budget is carried over, and served first next time.
+Pinned pollers (e.g. batches lined up by synchronize_polling) are
+polled even if the budget is spent, so they stay together.
+*/
+
+#define SFL_REBALANCE_MAX_INTERVALS 32
+
+static void rebalancePollers(SFLAgent *agent)
+{
+  struct { uint32_t interval, n, idx; } grp[SFL_REBALANCE_MAX_INTERVALS];
+  uint32_t ngrp = 0, gg;
+  SFLPoller *pl;
+
+  /* count the unpinned pollers for each interval */
+  for(pl = agent->pollers; pl != NULL; pl = pl->nxt) {
+    if(pl->sFlowCpInterval == 0 || pl->phasePinned) continue;
+    for(gg = 0; gg < ngrp; gg++)
+      if(grp[gg].interval == pl->sFlowCpInterval) break;
+    if(gg == ngrp) {
+      /* too many different intervals - the rest keep the phase they have */
+      if(ngrp == SFL_REBALANCE_MAX_INTERVALS) continue;
+      grp[gg].interval = pl->sFlowCpInterval;
+      grp[gg].n = grp[gg].idx = 0;
+      ngrp++;
+    }
+    grp[gg].n++;
+  }
+
+  /* and spread them out evenly, in list order */
+  for(pl = agent->pollers; pl != NULL; pl = pl->nxt) {
+    if(pl->sFlowCpInterval == 0 || pl->phasePinned) continue;
+    for(gg = 0; gg < ngrp; gg++) {
+      if(grp[gg].interval == pl->sFlowCpInterval) {
+	uint64_t phase = ((uint64_t)grp[gg].idx++ * grp[gg].interval) / grp[gg].n;
+	if(phase != pl->phase)
+	  sfl_poller_set_phase(pl, (uint32_t)phase);
+	break;
+      }
+    }
+  }
+
+  /* pollers that follow a master go where it went */
+  for(pl = agent->pollers; pl != NULL; pl = pl->nxt)
+    if(pl->syncMaster) sfl_poller_follow(pl);
+}
+
+uint32_t sfl_agent_tickPollers(SFLAgent *agent)
+{
+  uint32_t polls = 0;
+  SFLPoller *pl, *nxt;
+
+  if(agent->pollRebalance) {
+    rebalancePollers(agent);
+    agent->pollRebalance = 0;
+  }
+
+  uint32_t tick = ++agent->pollTick;
+
+  /* carried over from last time */
+  while(agent->pollBacklog
+	&& (agent->pollBudget == 0
+	    || polls < agent->pollBudget)) {
+    sfl_poller_poll(agent->pollBacklog);
+    polls++;
+  }
+
+  /* due now */
+  for(pl = agent->pollWheel[tick & (SFL_POLL_WHEEL_SLOTS - 1)]; pl != NULL; pl = nxt) {
+    nxt = pl->wheelNxt;
+    if((int32_t)(pl->dueTick - tick) > 0) continue; /* due on a later turn */
+    if(agent->pollBudget
+       && polls >= agent->pollBudget
+       && !pl->phasePinned) {
+      sfl_poller_carryOver(pl);
+      agent->pollCarryOvers++;
+      continue;
+    }
+    sfl_poller_poll(pl);
+    polls++;
+  }
+  agent->pollsLastTick = polls;
+  return polls;
+}
+
+void sfl_agent_set_pollBudget(SFLAgent *agent, uint32_t maxPollsPerTick)
+{
+  agent->pollBudget = maxPollsPerTick;
+}
+
 /*_________________---------------------------__________________
   _________________   sfl_agent_set_now       __________________
   -----------------___________________________------------------
@@ -254,6 +347,7 @@ SFLPoller *sfl_agent_addPoller(SFLAgent *agent,
   if(prev) prev->nxt = newpl;
   else agent->pollers = newpl;
   newpl->nxt = pl;
+  agent->numPollers++;
   return newpl;
 }
 
@@ -291,8 +385,16 @@ int sfl_agent_removePoller(SFLAgent *agent, SFLDataSource_instance *pdsi)
   /* find it, unlink it and free it */
   for(prev = NULL, pl = agent->pollers; pl != NULL; prev = pl, pl = pl->nxt) {
     if(sfl_dsi_compare(pdsi, &pl->dsi) == 0) {
+      SFLPoller *other;
       if(prev == NULL) agent->pollers = pl->nxt;
       else prev->nxt = pl->nxt;
+      sfl_poller_unschedule(pl);
+      /* nobody should follow it any more */
+      for(other = agent->pollers; other != NULL; other = other->nxt)
+	if(other->syncMaster == pl) other->syncMaster = NULL;
+      agent->numPollers--;
+      agent->pollRebalance = 1;
+      sfl_agent_staticCacheFree(agent, &pl->staticCache);
       sflFree(agent, pl);
       return 1;
     }
@@ -516,6 +618,29 @@ static void sflFree(SFLAgent *agent, void *obj)
   else SFL_FREE(obj);
 }
 
+/*_________________---------------------------__________________
+  _________________  static counters cache    __________________
+  -----------------___________________________------------------
+  make sure the cache can hold len bytes. Returns 0 on failure.
+*/
+
+int sfl_agent_staticCacheAlloc(SFLAgent *agent, SFLStaticCountersCache *cache, uint32_t len)
+{
+  if(cache->xdr && cache->capacity >= len) return 1;
+  sfl_agent_staticCacheFree(agent, cache);
+  if(len == 0) len = 4;
+  cache->xdr = (uint32_t *)sflAlloc(agent, len);
+  if(cache->xdr == NULL) return 0;
+  cache->capacity = len;
+  return 1;
+}
+
+void sfl_agent_staticCacheFree(SFLAgent *agent, SFLStaticCountersCache *cache)
+{
+  if(cache->xdr) sflFree(agent, cache->xdr);
+  memset(cache, 0, sizeof(*cache));
+}
+
 #if defined(__cplusplus)
 } /* extern "C" */
 #endif
@@ -87,7 +87,10 @@ typedef struct _SFLDataSource_instance {
  (dsi).ds_instance = (inst); \
  } while(0)
 
-#define SFL_SAMPLECOLLECTOR_DATA_QUADS (SFL_MAX_DATAGRAM_SIZE + SFL_DATA_PAD) / sizeof(uint32_t)
+/* the datagram,  plus room to encode one more sample beyond it before
+   we know if it fits (see sfl_receiver_writeFlowSample) */
+#define SFL_SAMPLECOLLECTOR_DATAGRAM_BYTES (SFL_MAX_DATAGRAM_SIZE + SFL_DATA_PAD)
+#define SFL_SAMPLECOLLECTOR_DATA_QUADS (SFL_SAMPLECOLLECTOR_DATAGRAM_BYTES + SFL_MAX_DATAGRAM_SIZE) / sizeof(uint32_t)
 
 typedef struct _SFLSampleCollector {
   uint32_t data[SFL_SAMPLECOLLECTOR_DATA_QUADS];
@@ -110,6 +113,11 @@ typedef struct _SFLReceiver {
   uint32_t sFlowRcvrDatagramVersion;
   /* public fields */
   struct _SFLAgent *agent;    /* pointer to my agent */
+  void *userData;             /* can be useful to hang something else here */
+  /* shard receivers (see sfl_receiver_init_shard) */
+  uint32_t shardId;           /* added to agent->subId.  0 == main receiver */
+  time_t now;                 /* own clock - seconds */
+  time_t now_nS;              /* own clock - nanoseconds */
   /* private fields */
   SFLSampleCollector sampleCollector;
 #ifdef SFLOW_DO_SOCKET
@@ -149,6 +157,17 @@ typedef void (*getCountersFn_t)(void *magic,                   /* callback to ge
 				struct _SFLPoller *sampler,    /* called with self */
 				SFL_COUNTERS_SAMPLE_TYPE *cs); /* struct to fill in */
 
+/* pre-encoded XDR for the counter elements that rarely change */
+#define SFL_STATIC_CACHE_MAX_ELEMENTS 8
+typedef struct _SFLStaticCountersCache {
+  uint32_t revision;
+  uint32_t num_elements;
+  uint32_t tags[SFL_STATIC_CACHE_MAX_ELEMENTS];
+  uint32_t len;       /* bytes */
+  uint32_t capacity;  /* bytes */
+  uint32_t *xdr;
+} SFLStaticCountersCache;
+
 typedef struct _SFLPoller {
   /* for linked list */
   struct _SFLPoller *nxt;
@@ -163,8 +182,18 @@ typedef struct _SFLPoller {
   getCountersFn_t getCountersFn;
   /* private fields */
   SFLReceiver *myReceiver;
-  time_t countersCountdown;
   uint32_t countersSampleSeqNo;
+  /* timer wheel (see sfl_agent_tickPollers) */
+  struct _SFLPoller *wheelNxt;
+  struct _SFLPoller *wheelPrv;
+  int32_t wheelSlot;        /* -1 when not scheduled */
+  uint32_t dueTick;         /* agent->pollTick when next poll is due */
+  uint32_t phase;           /* dueTick % sFlowCpInterval */
+  int phasePinned;          /* exempt from rebalancing and budget */
+  struct _SFLPoller *syncMaster; /* follow this poller's phase */
+  /* static element cache (see sfl_poller_set_staticRevision) */
+  uint32_t staticRevision;
+  SFLStaticCountersCache staticCache;
 } SFLPoller;
 
 typedef void *(*allocFn_t)(void *magic,               /* callback to allocate space on heap */
@@ -189,11 +218,27 @@ typedef void (*sendFn_t)(void *magic,                 /* optional override fn to
 /* prime numbers are good for hash tables */
 #define SFL_HASHTABLE_SIZ 199
 
+/* poller timer wheel: one slot per tick (power of 2). Pollers with
+   a longer interval just sit in their slot for more than one turn */
+#define SFL_POLL_WHEEL_SLOTS 512
+#define SFL_POLL_BACKLOG SFL_POLL_WHEEL_SLOTS
+
 typedef struct _SFLAgent {
   SFLSampler *jumpTable[SFL_HASHTABLE_SIZ]; /* fast lookup table for samplers (by ifIndex) */
   SFLSampler *samplers;   /* the list of samplers */
   SFLPoller  *pollers;    /* the list of samplers */
   SFLReceiver *receivers; /* the array of receivers */
+  /* poller schedule */
+  SFLPoller *pollWheel[SFL_POLL_WHEEL_SLOTS];
+  SFLPoller *pollBacklog;     /* due but over budget - FIFO */
+  SFLPoller *pollBacklogTail;
+  uint32_t pollTick;          /* ticks so far */
+  uint32_t pollBudget;        /* max polls per tick (0 == no limit) */
+  uint32_t numPollers;
+  int pollRebalance;          /* phases need to be reassigned */
+  uint32_t pollsLastTick;     /* polls in the last tick */
+  uint32_t pollBacklogN;      /* pollers carried over to the next tick */
+  uint64_t pollCarryOvers;    /* total polls that were carried over */
   time_t bootTime;        /* time when we booted or started */
   time_t now;             /* time now - seconds */
   time_t now_nS;          /* time now - nanoseconds 0-1000000000 */
@@ -284,6 +329,13 @@ void     sfl_poller_set_sFlowCpReceiver(SFLPoller *poller, uint32_t sFlowCpRecei
 uint32_t sfl_poller_get_sFlowCpInterval(SFLPoller *poller);
 void     sfl_poller_set_sFlowCpInterval(SFLPoller *poller, uint32_t sFlowCpInterval);
 void     sfl_poller_synchronize_polling(SFLPoller *poller, SFLPoller *master);
+/* Set this to a non-zero number that changes whenever the host_hid, host_par,
+   adaptors or portName elements might have changed. Those elements are then
+   encoded once per revision and the cached XDR is reused */
+void     sfl_poller_set_staticRevision(SFLPoller *poller, uint32_t revision);
+/* ticks until the next poll. Setting it pins the poller's phase */
+uint32_t sfl_poller_get_countersCountdown(SFLPoller *poller);
+void     sfl_poller_set_countersCountdown(SFLPoller *poller, uint32_t countdown);
 
 /* call this to indicate a discontinuity with a counter like samplePool so that the
    sflow collector will ignore the next delta */
@@ -306,6 +358,13 @@ uint32_t sfl_sampler_get_backoffThreshold(SFLSampler *sampler);
 /* call this once per second (N.B. not on interrupt stack i.e. not hard real-time) */
 void sfl_agent_tick(SFLAgent *agent, time_t now);
 
+/* or call this once per second to run just the pollers that are due. Returns
+   the number of pollers that were called. Phases are spread evenly across each
+   polling interval, and at most pollBudget pollers are called (the rest
+   are carried over to the next tick). */
+uint32_t sfl_agent_tickPollers(SFLAgent *agent);
+void sfl_agent_set_pollBudget(SFLAgent *agent, uint32_t maxPollsPerTick);
+
 /* call this to set more accurate "now" - e.g. to influence datagram timestamp */
 void sfl_agent_set_now(SFLAgent *agent, time_t now_S, time_t now_nS);
 
@@ -318,6 +377,11 @@ uint32_t sfl_agent_uptime_mS(SFLAgent *agent);
 /* call this with each flow sample */
 void sfl_sampler_writeFlowSample(SFLSampler *sampler, SFL_FLOW_SAMPLE_TYPE *fs);
 
+/* call this with each flow sample to send it via a particular (e.g. shard) receiver.
+   The sampler sequence number is updated atomically, so a sampler may be shared
+   by several threads as long as each one writes to its own receiver */
+void sfl_sampler_writeFlowSampleTo(SFLSampler *sampler, SFLReceiver *receiver, SFL_FLOW_SAMPLE_TYPE *fs);
+
 /* call this to push counters samples (usually done in the getCountersFn callback) */
 void sfl_poller_writeCountersSample(SFLPoller *poller, SFL_COUNTERS_SAMPLE_TYPE *cs);
 
@@ -328,16 +392,29 @@ void sfl_agent_release(SFLAgent *agent);
 /* internal fns */
 
 void sfl_receiver_init(SFLReceiver *receiver, SFLAgent *agent);
+/* a shard receiver is not on the agent's list. It is owned by one thread,
+   and sends its own datagram stream as sub-agent (agent->subId + shardId),
+   timestamped with its own clock (see sfl_receiver_set_now) */
+void sfl_receiver_init_shard(SFLReceiver *receiver, SFLAgent *agent, uint32_t shardId);
+void sfl_receiver_set_now(SFLReceiver *receiver, time_t now_S, time_t now_nS);
 void sfl_sampler_init(SFLSampler *sampler, SFLAgent *agent, SFLDataSource_instance *pdsi);
 void sfl_poller_init(SFLPoller *poller, SFLAgent *agent, SFLDataSource_instance *pdsi, void *magic, getCountersFn_t getCountersFn);
 
 
 void sfl_receiver_tick(SFLReceiver *receiver, time_t now);
-void sfl_poller_tick(SFLPoller *poller, time_t now);
+void sfl_poller_schedule(SFLPoller *poller);
+void sfl_poller_unschedule(SFLPoller *poller);
+void sfl_poller_set_phase(SFLPoller *poller, uint32_t phase);
+void sfl_poller_follow(SFLPoller *poller);
+void sfl_poller_carryOver(SFLPoller *poller);
+void sfl_poller_poll(SFLPoller *poller);
 void sfl_sampler_tick(SFLSampler *sampler, time_t now);
 
 int sfl_receiver_writeFlowSample(SFLReceiver *receiver, SFL_FLOW_SAMPLE_TYPE *fs);
 int sfl_receiver_writeCountersSample(SFLReceiver *receiver, SFL_COUNTERS_SAMPLE_TYPE *cs);
+int sfl_receiver_writeCountersSampleCached(SFLReceiver *receiver, SFL_COUNTERS_SAMPLE_TYPE *cs, SFLStaticCountersCache *cache, uint32_t revision);
+int sfl_agent_staticCacheAlloc(SFLAgent *agent, SFLStaticCountersCache *cache, uint32_t len);
+void sfl_agent_staticCacheFree(SFLAgent *agent, SFLStaticCountersCache *cache);
 int sfl_receiver_writeEncoded(SFLReceiver *receiver, uint32_t samples, uint32_t *data, int packedSize);
 void sfl_receiver_flush(SFLReceiver *receiver);
 
@@ -31,6 +31,9 @@ void sfl_poller_init(SFLPoller *poller,
   
   /* restore the linked list ptr */
   poller->nxt = nxtPtr;
+
+  /* not on the timer wheel until an interval is set */
+  poller->wheelSlot = -1;
   
   /* now copy in the parameters */
   poller->agent = agent;
@@ -47,6 +50,9 @@ void sfl_poller_init(SFLPoller *poller,
 static void reset(SFLPoller *poller)
 {
   SFLDataSource_instance dsi = poller->dsi;
+  /* must come off the wheel before the links are cleared */
+  sfl_poller_unschedule(poller);
+  sfl_agent_staticCacheFree(poller->agent, &poller->staticCache);
   sfl_poller_init(poller, poller->agent, &dsi, poller->magic, poller->getCountersFn);
 }
 
@@ -73,18 +79,142 @@ uint32_t sfl_poller_get_sFlowCpInterval(SFLPoller *poller) {
 
 void sfl_poller_set_sFlowCpInterval(SFLPoller *poller, uint32_t sFlowCpInterval) {
   poller->sFlowCpInterval = sFlowCpInterval;
-  /* Set the countersCountdown to be a randomly selected value between 1 and
-     sFlowCpInterval. That way the counter polling would be desynchronised
-     (on a 200-port switch, polling all the counters in one second could be harmful). */
-  poller->countersCountdown = sFlowCpInterval ? sfl_random(sFlowCpInterval) : 0;
+  poller->phasePinned = 0;
+  poller->syncMaster = NULL;
+  if(sFlowCpInterval) {
+    /* Start with a randomly selected countdown between 1 and sFlowCpInterval
+       so the counter polling is desynchronised (on a 200-port switch, polling
+       all the counters in one second could be harmful). The agent will then
+       spread the phases out evenly at the next tick. */
+    poller->dueTick = poller->agent->pollTick + sfl_random(sFlowCpInterval);
+    poller->phase = poller->dueTick % sFlowCpInterval;
+    poller->agent->pollRebalance = 1;
+  }
+  sfl_poller_schedule(poller);
 }
 
 void sfl_poller_synchronize_polling(SFLPoller *poller, SFLPoller *master) {
   /* This can be used if there is a reason to make pollers report at about the same
-     time,  such as if they are in a LAG relationship */
-  if(master->countersCountdown) {
-    poller->countersCountdown = master->countersCountdown;
+     time,  such as if they are in a LAG relationship. The poller keeps following
+     the master if the agent moves its phase. */
+  if(master->sFlowCpInterval
+     && master != poller) {
+    poller->syncMaster = master;
+    poller->phasePinned = 1;
+    sfl_poller_follow(poller);
+  }
+}
+
+/* called when the master is rebalanced, too */
+void sfl_poller_follow(SFLPoller *poller) {
+  SFLPoller *master = poller->syncMaster;
+  if(master == NULL
+     || master->sFlowCpInterval == 0)
+    return;
+  poller->phase = master->phase;
+  poller->dueTick = master->dueTick;
+  sfl_poller_schedule(poller);
+}
+
+void sfl_poller_set_staticRevision(SFLPoller *poller, uint32_t revision) {
+  poller->staticRevision = revision;
+}
+
+uint32_t sfl_poller_get_countersCountdown(SFLPoller *poller) {
+  if(poller->sFlowCpInterval == 0)
+    return 0;
+  int32_t countdown = (int32_t)(poller->dueTick - poller->agent->pollTick);
+  return countdown > 0 ? (uint32_t)countdown : 1;
+}
+
+void sfl_poller_set_countersCountdown(SFLPoller *poller, uint32_t countdown) {
+  if(poller->sFlowCpInterval == 0
+     || countdown == 0)
+    return;
+  poller->dueTick = poller->agent->pollTick + countdown;
+  poller->phase = poller->dueTick % poller->sFlowCpInterval;
+  poller->phasePinned = 1;
+  poller->syncMaster = NULL;
+  sfl_poller_schedule(poller);
+}
+
+/*_________________---------------------------__________________
+  _________________    timer wheel            __________________
+  -----------------___________________________------------------
+Each poller is linked into the wheel slot for its dueTick, so a
+tick only visits the pollers in one slot. The backlog holds pollers
+that were due but did not fit in the agent's per-tick budget.
+*/
+
+static SFLPoller **wheelHead(SFLAgent *agent, int32_t slot) {
+  return (slot == SFL_POLL_BACKLOG) ? &agent->pollBacklog : &agent->pollWheel[slot];
+}
+
+void sfl_poller_unschedule(SFLPoller *poller)
+{
+  SFLAgent *agent = poller->agent;
+  if(poller->wheelSlot < 0) return;
+  if(poller->wheelPrv) poller->wheelPrv->wheelNxt = poller->wheelNxt;
+  else *wheelHead(agent, poller->wheelSlot) = poller->wheelNxt;
+  if(poller->wheelNxt) poller->wheelNxt->wheelPrv = poller->wheelPrv;
+  if(poller->wheelSlot == SFL_POLL_BACKLOG) {
+    if(agent->pollBacklogTail == poller) agent->pollBacklogTail = poller->wheelPrv;
+    agent->pollBacklogN--;
   }
+  poller->wheelNxt = poller->wheelPrv = NULL;
+  poller->wheelSlot = -1;
+}
+
+static void wheelInsert(SFLPoller *poller, int32_t slot)
+{
+  SFLAgent *agent = poller->agent;
+  poller->wheelSlot = slot;
+  if(slot == SFL_POLL_BACKLOG) {
+    /* append, so the backlog is served in order */
+    poller->wheelNxt = NULL;
+    poller->wheelPrv = agent->pollBacklogTail;
+    if(agent->pollBacklogTail) agent->pollBacklogTail->wheelNxt = poller;
+    else agent->pollBacklog = poller;
+    agent->pollBacklogTail = poller;
+    agent->pollBacklogN++;
+  }
+  else {
+    SFLPoller **head = wheelHead(agent, slot);
+    poller->wheelPrv = NULL;
+    poller->wheelNxt = *head;
+    if(*head) (*head)->wheelPrv = poller;
+    *head = poller;
+  }
+}
+
+/* the first tick after now that lands on the poller's phase */
+static uint32_t nextPhaseTick(SFLPoller *poller) {
+  uint32_t interval = poller->sFlowCpInterval;
+  uint32_t next = poller->agent->pollTick + 1;
+  return next + ((poller->phase + interval - (next % interval)) % interval);
+}
+
+void sfl_poller_schedule(SFLPoller *poller)
+{
+  sfl_poller_unschedule(poller);
+  if(poller->sFlowCpInterval == 0) return;
+  if((int32_t)(poller->dueTick - poller->agent->pollTick) <= 0)
+    poller->dueTick = nextPhaseTick(poller);
+  wheelInsert(poller, poller->dueTick & (SFL_POLL_WHEEL_SLOTS - 1));
+}
+
+void sfl_poller_set_phase(SFLPoller *poller, uint32_t phase)
+{
+  if(poller->sFlowCpInterval == 0) return;
+  poller->phase = phase % poller->sFlowCpInterval;
+  poller->dueTick = nextPhaseTick(poller);
+  sfl_poller_schedule(poller);
+}
+
+void sfl_poller_carryOver(SFLPoller *poller)
+{
+  sfl_poller_unschedule(poller);
+  wheelInsert(poller, SFL_POLL_BACKLOG);
 }
 
 /*_________________---------------------------------__________________
@@ -96,26 +226,26 @@ so that the sflow collector will know to ignore the next delta.
 void sfl_poller_resetCountersSeqNo(SFLPoller *poller) {  poller->countersSampleSeqNo = 0; }
 
 /*_________________---------------------------__________________
-  _________________    sfl_poller_tick        __________________
+  _________________    sfl_poller_poll        __________________
   -----------------___________________________------------------
+Called by the agent when the poller is due.
 */
 
-void sfl_poller_tick(SFLPoller *poller, time_t now)
+void sfl_poller_poll(SFLPoller *poller)
 {
-  if(poller->countersCountdown == 0) return; /* counters retrieval was not enabled */
-  if(poller->sFlowCpReceiver == 0) return;
+  /* reschedule first, in case the callback changes the interval. Adding
+     the interval to the dueTick keeps the phase even if this poll was late */
+  poller->dueTick += poller->sFlowCpInterval;
+  sfl_poller_schedule(poller);
 
-  if(--poller->countersCountdown == 0) {
-    if(poller->getCountersFn != NULL) {
-      /* call out for counters */
-      SFL_COUNTERS_SAMPLE_TYPE cs;
-      memset(&cs, 0, sizeof(cs));
-      poller->getCountersFn(poller->magic, poller, &cs);
-      // this countersFn is expected to fill in some counter block elements
-      // and then call sfl_poller_writeCountersSample(poller, &cs);
-    }
-    /* reset the countdown */
-    poller->countersCountdown = poller->sFlowCpInterval;
+  if(poller->sFlowCpReceiver == 0) return;
+  if(poller->getCountersFn != NULL) {
+    /* call out for counters */
+    SFL_COUNTERS_SAMPLE_TYPE cs;
+    memset(&cs, 0, sizeof(cs));
+    poller->getCountersFn(poller->magic, poller, &cs);
+    // this countersFn is expected to fill in some counter block elements
+    // and then call sfl_poller_writeCountersSample(poller, &cs);
   }
 }
 
@@ -134,8 +264,11 @@ void sfl_poller_writeCountersSample(SFLPoller *poller, SFL_COUNTERS_SAMPLE_TYPE
 #else
   cs->source_id = SFL_DS_DATASOURCE(poller->dsi);
 #endif
-  /* sent to my receiver */
-  if(poller->myReceiver) sfl_receiver_writeCountersSample(poller->myReceiver, cs);
+  /* sent to my receiver, with the static elements from the cache if we can */
+  if(poller->myReceiver) sfl_receiver_writeCountersSampleCached(poller->myReceiver,
+								cs,
+								&poller->staticCache,
+								poller->staticRevision);
 }
 
 
@@ -2,12 +2,12 @@
  * http://sflow.net/license.html
  */
 
-
 #if defined(__cplusplus)
 extern "C" {
 #endif
 
 #include <assert.h>
+#include <stddef.h>
 #include "sflow_api.h"
 
 static void resetSampleCollector(SFLReceiver *receiver);
@@ -15,6 +15,8 @@ static void sendSample(SFLReceiver *receiver);
 static void sflError(SFLReceiver *receiver, char *errm);
 static void putNet32(SFLReceiver *receiver, uint32_t val);
 static void putAddress(SFLReceiver *receiver, SFLAddress *addr);
+static void putMACAddress(SFLReceiver *receiver, uint8_t *mac);
+static void xdrSwapInit(void);
 #ifdef SFLOW_DO_SOCKET
 static void initSocket(SFLReceiver *receiver);
 #endif
@@ -29,6 +31,9 @@ void sfl_receiver_init(SFLReceiver *receiver, SFLAgent *agent)
   /* first clear everything */
   memset(receiver, 0, sizeof(*receiver));
 
+  /* pick the byte-swapping routines for this CPU */
+  xdrSwapInit();
+
   /* now copy in the parameters */
   receiver->agent = agent;
 
@@ -45,6 +50,23 @@ void sfl_receiver_init(SFLReceiver *receiver, SFLAgent *agent)
   resetSampleCollector(receiver);
 }
 
+/*_________________---------------------------__________________
+  _________________  sfl_receiver_init_shard  __________________
+  -----------------___________________________------------------
+*/
+
+void sfl_receiver_init_shard(SFLReceiver *receiver, SFLAgent *agent, uint32_t shardId)
+{
+  sfl_receiver_init(receiver, agent);
+  receiver->shardId = shardId;
+}
+
+void sfl_receiver_set_now(SFLReceiver *receiver, time_t now_S, time_t now_nS)
+{
+  receiver->now = now_S;
+  receiver->now_nS = now_nS;
+}
+
 /*_________________---------------------------__________________
   _________________      reset                __________________
   -----------------___________________________------------------
@@ -172,18 +194,132 @@ static void putNet32(SFLReceiver *receiver, uint32_t val)
   *receiver->sampleCollector.datap++ = htonl(val);
 }
 
-static void putNetFloat(SFLReceiver *receiver, float val)
+/*_________________-----------------------------__________________
+  _________________   bulk byte-swapping        __________________
+  -----------------_____________________________------------------
+  Most counter blocks are long runs of 32-bit or 64-bit fields,  so
+  on x86 they are swapped into the datagram 16 or 32 bytes at a time
+  with pshufb (SSSE3 or AVX2,  whichever the CPU has - chosen once at
+  runtime so the library can still be built for a generic target).
+  Whatever is left over goes through the scalar loop.
+*/
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(SFL_XDR_NO_SIMD)
+#define SFL_XDR_SIMD 1
+#include <immintrin.h>
+#endif
+
+typedef enum {
+  SFLXDR_SWAP_UNKNOWN = -1,
+  SFLXDR_SWAP_SCALAR = 0,
+  SFLXDR_SWAP_SSSE3,
+  SFLXDR_SWAP_AVX2
+} EnumSFLXDRSwap;
+
+/* the per-run helpers are expanded into each fixed layout,  where the
+   run counts are constants and the short runs unroll into plain moves */
+#ifdef __GNUC__
+#define SFL_XDR_INLINE inline __attribute__((always_inline))
+#else
+#define SFL_XDR_INLINE inline
+#endif
+
+static EnumSFLXDRSwap xdrSwapLevel = SFLXDR_SWAP_UNKNOWN;
+
+static const uint8_t xdrSwap32Mask[32] = {
+  3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12,
+  3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12 };
+
+static const uint8_t xdrSwap64Mask[32] = {
+  7,6,5,4,3,2,1,0, 15,14,13,12,11,10,9,8,
+  7,6,5,4,3,2,1,0, 15,14,13,12,11,10,9,8 };
+
+static void xdrSwapInit(void)
+{
+  if(xdrSwapLevel != SFLXDR_SWAP_UNKNOWN)
+    return;
+#ifdef SFL_XDR_SIMD
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")) xdrSwapLevel = SFLXDR_SWAP_AVX2;
+  else if(__builtin_cpu_supports("ssse3")) xdrSwapLevel = SFLXDR_SWAP_SSSE3;
+  else xdrSwapLevel = SFLXDR_SWAP_SCALAR;
+#else
+  xdrSwapLevel = SFLXDR_SWAP_SCALAR;
+#endif
+}
+
+#ifdef SFL_XDR_SIMD
+__attribute__((target("ssse3")))
+static size_t xdrSwap_ssse3(u_char *to, const u_char *from, size_t bytes, const uint8_t *mask)
+{
+  __m128i m = _mm_loadu_si128((const __m128i *)mask);
+  size_t done = 0;
+  for(; (done + 16) <= bytes; done += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(from + done));
+    _mm_storeu_si128((__m128i *)(to + done), _mm_shuffle_epi8(v, m));
+  }
+  return done;
+}
+
+__attribute__((target("avx2")))
+static size_t xdrSwap_avx2(u_char *to, const u_char *from, size_t bytes, const uint8_t *mask)
+{
+  __m256i m = _mm256_loadu_si256((const __m256i *)mask);
+  size_t done = 0;
+  for(; (done + 32) <= bytes; done += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(from + done));
+    _mm256_storeu_si256((__m256i *)(to + done), _mm256_shuffle_epi8(v, m));
+  }
+  if((done + 16) <= bytes) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(from + done));
+    _mm_storeu_si128((__m128i *)(to + done), _mm_shuffle_epi8(v, _mm256_castsi256_si128(m)));
+    done += 16;
+  }
+  return done;
+}
+#endif /* SFL_XDR_SIMD */
+
+/* swap as much as possible in 16-byte chunks,  and return the number of bytes done */
+static size_t xdrSwapBulk(u_char *to, const u_char *from, size_t bytes, const uint8_t *mask)
 {
-  // not sure how to byte-swap a float - just alias it to an int32
-  uint32_t reg32;
-  memcpy(&reg32, &val, 4);
-  putNet32(receiver, reg32);
+#ifdef SFL_XDR_SIMD
+  if(bytes >= 16) {
+    if(xdrSwapLevel == SFLXDR_SWAP_AVX2) return xdrSwap_avx2(to, from, bytes, mask);
+    if(xdrSwapLevel == SFLXDR_SWAP_SSSE3) return xdrSwap_ssse3(to, from, bytes, mask);
+  }
+#endif
+  return 0;
 }
 
-static void putNet32_run(SFLReceiver *receiver, void *obj, size_t quads)
+/* These take and return the write position rather than going through
+   receiver->sampleCollector.datap,  so a layout can be written without
+   the pointer being reloaded after every store. */
+static SFL_XDR_INLINE uint32_t *xdrNet32_run(uint32_t *to, const u_char *from, size_t quads)
 {
-  uint32_t *from = (uint32_t *)obj;
-  while(quads--) putNet32(receiver, *from++);
+  size_t done = xdrSwapBulk((u_char *)to, from, quads * 4, xdrSwap32Mask) / 4;
+  for(; done < quads; done++) {
+    uint32_t val;
+    memcpy(&val, from + (done * 4), 4);
+    to[done] = htonl(val);
+  }
+  return to + quads;
+}
+
+static SFL_XDR_INLINE uint32_t *xdrNet64_run(uint32_t *to, const u_char *from, size_t n)
+{
+  size_t done = xdrSwapBulk((u_char *)to, from, n * 8, xdrSwap64Mask) / 8;
+  for(; done < n; done++) {
+    uint64_t val64;
+    memcpy(&val64, from + (done * 8), 8);
+    to[done * 2] = htonl((uint32_t)(val64 >> 32));
+    to[(done * 2) + 1] = htonl((uint32_t)val64);
+  }
+  return to + (n * 2);
+}
+
+static SFL_XDR_INLINE void putNet32_run(SFLReceiver *receiver, void *obj, size_t quads)
+{
+  receiver->sampleCollector.datap = xdrNet32_run(receiver->sampleCollector.datap, (u_char *)obj, quads);
 }
 
 static void putNet64(SFLReceiver *receiver, uint64_t val64)
@@ -208,9 +344,11 @@ static void put128(SFLReceiver *receiver, u_char *val)
 
 static void putString(SFLReceiver *receiver, SFLString *s)
 {
+  uint32_t quads = (s->len + 3) / 4;
   putNet32(receiver, s->len);
+  if(quads) receiver->sampleCollector.datap[quads - 1] = 0; /* zero the pad bytes */
   memcpy(receiver->sampleCollector.datap, s->str, s->len);
-  receiver->sampleCollector.datap += (s->len + 3) / 4; /* pad to 4-byte boundary */
+  receiver->sampleCollector.datap += quads; /* pad to 4-byte boundary */
 }
 
 static uint32_t stringEncodingLength(SFLString *s) {
@@ -238,50 +376,11 @@ static uint32_t addressEncodingLength(SFLAddress *addr) {
 
 static void putMACAddress(SFLReceiver *receiver, uint8_t *mac)
 {
+  receiver->sampleCollector.datap[1] = 0; /* zero the pad bytes */
   memcpy(receiver->sampleCollector.datap, mac, 6);
   receiver->sampleCollector.datap += 2;
 }
 
-static void putSampledEthernet(SFLReceiver *receiver, SFLSampled_ethernet *ethernet)
-{
-  putNet32(receiver, ethernet->eth_len);
-  putMACAddress(receiver, ethernet->src_mac);
-  putMACAddress(receiver, ethernet->dst_mac);
-  putNet32(receiver, ethernet->eth_type);
-}
-
-static void putSampledIPv4(SFLReceiver *receiver, SFLSampled_ipv4 *ipv4)
-{
-  putNet32(receiver, ipv4->length);
-  putNet32(receiver, ipv4->protocol);
-  put32(receiver, ipv4->src_ip.addr);
-  put32(receiver, ipv4->dst_ip.addr);
-  putNet32(receiver, ipv4->src_port);
-  putNet32(receiver, ipv4->dst_port);
-  putNet32(receiver, ipv4->tcp_flags);
-  putNet32(receiver, ipv4->tos);
-}
-
-static void putSampledIPv6(SFLReceiver *receiver, SFLSampled_ipv6 *ipv6)
-{
-  putNet32(receiver, ipv6->length);
-  putNet32(receiver, ipv6->protocol);
-  put128(receiver, ipv6->src_ip.addr);
-  put128(receiver, ipv6->dst_ip.addr);
-  putNet32(receiver, ipv6->src_port);
-  putNet32(receiver, ipv6->dst_port);
-  putNet32(receiver, ipv6->tcp_flags);
-  putNet32(receiver, ipv6->priority);
-}
-
-static void putSwitch(SFLReceiver *receiver, SFLExtended_switch *sw)
-{
-  putNet32(receiver, sw->src_vlan);
-  putNet32(receiver, sw->src_priority);
-  putNet32(receiver, sw->dst_vlan);
-  putNet32(receiver, sw->dst_priority);
-}
-
 static void putRouter(SFLReceiver *receiver, SFLExtended_router *router)
 {
   putAddress(receiver, &router->nexthop);
@@ -430,32 +529,6 @@ static uint32_t mplsFtnEncodingLength(SFLExtended_mpls_FTN *ftn) {
   return stringEncodingLength( &ftn->mplsFTNDescr) + 4;
 }
 
-static void putMplsLdpFec(SFLReceiver *receiver, SFLExtended_mpls_LDP_FEC *ldpfec)
-{
-  putNet32(receiver, ldpfec->mplsFecAddrPrefixLength);
-}
-
-static uint32_t mplsLdpFecEncodingLength(SFLExtended_mpls_LDP_FEC *ldpfec) {
-  return 4;
-}
-
-static uint32_t tunnelDecapEncodingLength(SFLExtended_decapsulate *decap) {
-  return 4;
-}
-
-static uint32_t tunnelVniEncodingLength(SFLExtended_vni *vni) {
-  return 4;
-}
-
-static void putVlanTunnel(SFLReceiver *receiver, SFLExtended_vlan_tunnel *vlanTunnel)
-{
-  putLabelStack(receiver, &vlanTunnel->stack);
-}
-
-static uint32_t vlanTunnelEncodingLength(SFLExtended_vlan_tunnel *vlanTunnel) {
-  return labelStackEncodingLength(&vlanTunnel->stack);
-}
-
 static void putAdaptorList(SFLReceiver *receiver, SFLAdaptorList *adaptorList)
 {
   uint32_t i, j;
@@ -485,30 +558,6 @@ static uint32_t adaptorListEncodingLength(SFLAdaptorList *adaptorList)
   return len;
 }
 
-static void putGenericCounters(SFLReceiver *receiver, SFLIf_counters *counters)
-{
-  putNet32(receiver, counters->ifIndex);
-  putNet32(receiver, counters->ifType);
-  putNet64(receiver, counters->ifSpeed);
-  putNet32(receiver, counters->ifDirection);
-  putNet32(receiver, counters->ifStatus);
-  putNet64(receiver, counters->ifInOctets);
-  putNet32(receiver, counters->ifInUcastPkts);
-  putNet32(receiver, counters->ifInMulticastPkts);
-  putNet32(receiver, counters->ifInBroadcastPkts);
-  putNet32(receiver, counters->ifInDiscards);
-  putNet32(receiver, counters->ifInErrors);
-  putNet32(receiver, counters->ifInUnknownProtos);
-  putNet64(receiver, counters->ifOutOctets);
-  putNet32(receiver, counters->ifOutUcastPkts);
-  putNet32(receiver, counters->ifOutMulticastPkts);
-  putNet32(receiver, counters->ifOutBroadcastPkts);
-  putNet32(receiver, counters->ifOutDiscards);
-  putNet32(receiver, counters->ifOutErrors);
-  putNet32(receiver, counters->ifPromiscuousMode);
-}
-
-
 static void putAPPContext(SFLReceiver *receiver, SFLSampled_APP_CTXT *ctxt)
 {
   putString(receiver, &ctxt->application);
@@ -544,37 +593,6 @@ static uint32_t appEncodingLength(SFLSampled_APP *app) {
   return elemSiz;
 }
 
-static void putSocket4(SFLReceiver *receiver, SFLExtended_socket_ipv4 *socket4) {
-    putNet32(receiver, socket4->protocol);
-    put32(receiver, socket4->local_ip.addr);
-    put32(receiver, socket4->remote_ip.addr);
-    putNet32(receiver, socket4->local_port);
-    putNet32(receiver, socket4->remote_port);
-}
-
-static void putSocket6(SFLReceiver *receiver, SFLExtended_socket_ipv6 *socket6) {
-    putNet32(receiver, socket6->protocol);
-    put128(receiver, socket6->local_ip.addr);
-    put128(receiver, socket6->remote_ip.addr);
-    putNet32(receiver, socket6->local_port);
-    putNet32(receiver, socket6->remote_port);
-}
-
-static void putTCPInfo(SFLReceiver *receiver, SFLExtended_TCP_info *tcp_info) {
-    putNet32(receiver, tcp_info->dirn);
-    putNet32(receiver, tcp_info->snd_mss);
-    putNet32(receiver, tcp_info->rcv_mss);
-    putNet32(receiver, tcp_info->unacked);
-    putNet32(receiver, tcp_info->lost);
-    putNet32(receiver, tcp_info->retrans);
-    putNet32(receiver, tcp_info->pmtu);
-    putNet32(receiver, tcp_info->rtt);
-    putNet32(receiver, tcp_info->rttvar);
-    putNet32(receiver, tcp_info->snd_cwnd);
-    putNet32(receiver, tcp_info->reordering);
-    putNet32(receiver, tcp_info->min_rtt);
-}
-
 static uint32_t appCountersEncodingLength(SFLAPPCounters *appctrs) {
   uint32_t elemSiz = 0;
   elemSiz += stringEncodingLength(&appctrs->application);
@@ -582,19 +600,6 @@ static uint32_t appCountersEncodingLength(SFLAPPCounters *appctrs) {
   return elemSiz;
 }
 
-static uint32_t appResourcesEncodingLength(SFLAPPResources *appresource) {
-  uint32_t elemSiz = 0;
-  elemSiz += 6 * 4; // 6x32-bit
-  elemSiz += 2 * 8; // 2x64-bit (mem) gauges
-  return elemSiz;
-}
-
-static uint32_t appWorkersEncodingLength(SFLAPPWorkers *appworkers) {
-  uint32_t elemSiz = 0;
-  elemSiz += 5 * 4; // 5x32-bit
-  return elemSiz;
-}
-
 static uint32_t sfpEncodingLength(SFLSFP_counters *sfp) {
   uint32_t elemSiz = 0;
   elemSiz += 16; // id, total_lanes, voltage, temp
@@ -627,77 +632,424 @@ static void putSFP(SFLReceiver *receiver, SFLSFP_counters *sfp) {
  
    
 /*_________________-----------------------------__________________
-  _________________      computeFlowSampleSize  __________________
+  _________________   fixed-layout elements     __________________
   -----------------_____________________________------------------
+  Elements with a fixed wire format are described by a table of runs:
+  each run is a count of same-kind fields starting at an offset in the
+  C struct. The XDR size of each layout is a compile-time constant,  and
+  every run is checked at compile time to fit inside its struct.
 */
 
-static int computeFlowSampleSize(SFLReceiver *receiver, SFL_FLOW_SAMPLE_TYPE *fs)
+enum SFLXDRRunKind {
+  SFLXDR_NET32 = 1, /* uint32_t fields (or float),  byte-swapped */
+  SFLXDR_NET64,     /* uint64_t fields,  byte-swapped */
+  SFLXDR_RAW,       /* quads already in network byte order (IP addresses) */
+  SFLXDR_MAC        /* 6-byte MAC in an 8-byte slot,  zero padded */
+};
+
+#define SFLXDR_MAX_RUNS 8
+
+typedef struct _SFLXDRRun {
+  uint16_t offset;
+  uint8_t kind;
+  uint8_t count;
+} SFLXDRRun;
+
+typedef struct _SFLXDRLayout {
+  uint32_t xdrSize;  /* bytes */
+  uint32_t numRuns;
+  SFLXDRRun runs[SFLXDR_MAX_RUNS];
+} SFLXDRLayout;
+
+#define SFLXDR_KIND_BYTES(k) (((k) == SFLXDR_NET64 || (k) == SFLXDR_MAC) ? 8 : 4)
+#define SFLXDR_RUN_ENTRY(t, f, k, n) { offsetof(t, f), k, n },
+#define SFLXDR_RUN_BYTES(t, f, k, n) + ((n) * SFLXDR_KIND_BYTES(k))
+#define SFLXDR_RUN_ONE(t, f, k, n) + 1
+#define SFLXDR_RUN_FITS(t, f, k, n) && (offsetof(t, f) + ((n) * SFLXDR_KIND_BYTES(k)) <= sizeof(t))
+/* compile-time check: a negative array size works with any C or C++ compiler */
+#define SFLXDR_ASSERT(cond, name) typedef char name[(cond) ? 1 : -1]
+#define SFLXDR_SIZE(L) (0 L(SFLXDR_RUN_BYTES))
+#define SFLXDR_LAYOUT(L) { SFLXDR_SIZE(L), (0 L(SFLXDR_RUN_ONE)), { L(SFLXDR_RUN_ENTRY) } }
+#define SFLXDR_DEFINE(name, L) \
+  SFLXDR_ASSERT((1 L(SFLXDR_RUN_FITS)), name##_runs_fit); \
+  SFLXDR_ASSERT((0 L(SFLXDR_RUN_ONE)) <= SFLXDR_MAX_RUNS, name##_max_runs); \
+  static const SFLXDRLayout name = SFLXDR_LAYOUT(L)
+
+/* flow elements */
+
+#define SFLXDR_SAMPLED_ETHERNET(RUN)			\
+  RUN(SFLSampled_ethernet, eth_len, SFLXDR_NET32, 1)	\
+  RUN(SFLSampled_ethernet, src_mac, SFLXDR_MAC, 2)	\
+  RUN(SFLSampled_ethernet, eth_type, SFLXDR_NET32, 1)
+
+#define SFLXDR_SAMPLED_IPV4(RUN)			\
+  RUN(SFLSampled_ipv4, length, SFLXDR_NET32, 2)		\
+  RUN(SFLSampled_ipv4, src_ip, SFLXDR_RAW, 2)		\
+  RUN(SFLSampled_ipv4, src_port, SFLXDR_NET32, 4)
+
+#define SFLXDR_SAMPLED_IPV6(RUN)			\
+  RUN(SFLSampled_ipv6, length, SFLXDR_NET32, 2)		\
+  RUN(SFLSampled_ipv6, src_ip, SFLXDR_RAW, 8)		\
+  RUN(SFLSampled_ipv6, src_port, SFLXDR_NET32, 4)
+
+#define SFLXDR_EX_SWITCH(RUN)				\
+  RUN(SFLExtended_switch, src_vlan, SFLXDR_NET32, 4)
+
+#define SFLXDR_EX_MPLS_LDP_FEC(RUN)					\
+  RUN(SFLExtended_mpls_LDP_FEC, mplsFecAddrPrefixLength, SFLXDR_NET32, 1)
+
+#define SFLXDR_EX_DECAP(RUN)						\
+  RUN(SFLExtended_decapsulate, inner_header_offset, SFLXDR_NET32, 1)
+
+#define SFLXDR_EX_VNI(RUN)			\
+  RUN(SFLExtended_vni, vni, SFLXDR_NET32, 1)
+
+#define SFLXDR_EX_SOCKET4(RUN)					\
+  RUN(SFLExtended_socket_ipv4, protocol, SFLXDR_NET32, 1)	\
+  RUN(SFLExtended_socket_ipv4, local_ip, SFLXDR_RAW, 2)		\
+  RUN(SFLExtended_socket_ipv4, local_port, SFLXDR_NET32, 2)
+
+#define SFLXDR_EX_SOCKET6(RUN)					\
+  RUN(SFLExtended_socket_ipv6, protocol, SFLXDR_NET32, 1)	\
+  RUN(SFLExtended_socket_ipv6, local_ip, SFLXDR_RAW, 8)		\
+  RUN(SFLExtended_socket_ipv6, local_port, SFLXDR_NET32, 2)
+
+#define SFLXDR_EX_TCP_INFO(RUN)				\
+  RUN(SFLExtended_TCP_info, dirn, SFLXDR_NET32, 12)
+
+/* counter blocks */
+
+#define SFLXDR_IF_COUNTERS(RUN)				\
+  RUN(SFLIf_counters, ifIndex, SFLXDR_NET32, 2)		\
+  RUN(SFLIf_counters, ifSpeed, SFLXDR_NET64, 1)		\
+  RUN(SFLIf_counters, ifDirection, SFLXDR_NET32, 2)	\
+  RUN(SFLIf_counters, ifInOctets, SFLXDR_NET64, 1)	\
+  RUN(SFLIf_counters, ifInUcastPkts, SFLXDR_NET32, 6)	\
+  RUN(SFLIf_counters, ifOutOctets, SFLXDR_NET64, 1)	\
+  RUN(SFLIf_counters, ifOutUcastPkts, SFLXDR_NET32, 6)
+
+#define SFLXDR_ETHERNET_COUNTERS(RUN)					\
+  RUN(SFLEthernet_counters, dot3StatsAlignmentErrors, SFLXDR_NET32, 13)
+
+#define SFLXDR_TOKENRING_COUNTERS(RUN)				\
+  RUN(SFLTokenring_counters, dot5StatsLineErrors, SFLXDR_NET32, 18)
+
+#define SFLXDR_VG_COUNTERS(RUN)						\
+  RUN(SFLVg_counters, dot12InHighPriorityFrames, SFLXDR_NET32, 1)	\
+  RUN(SFLVg_counters, dot12InHighPriorityOctets, SFLXDR_NET64, 1)	\
+  RUN(SFLVg_counters, dot12InNormPriorityFrames, SFLXDR_NET32, 1)	\
+  RUN(SFLVg_counters, dot12InNormPriorityOctets, SFLXDR_NET64, 1)	\
+  RUN(SFLVg_counters, dot12InIPMErrors, SFLXDR_NET32, 5)		\
+  RUN(SFLVg_counters, dot12OutHighPriorityOctets, SFLXDR_NET64, 1)	\
+  RUN(SFLVg_counters, dot12TransitionIntoTrainings, SFLXDR_NET32, 1)	\
+  RUN(SFLVg_counters, dot12HCInHighPriorityOctets, SFLXDR_NET64, 3)
+
+#define SFLXDR_VLAN_COUNTERS(RUN)			\
+  RUN(SFLVlan_counters, vlan_id, SFLXDR_NET32, 1)	\
+  RUN(SFLVlan_counters, octets, SFLXDR_NET64, 1)	\
+  RUN(SFLVlan_counters, ucastPkts, SFLXDR_NET32, 4)
+
+#define SFLXDR_LACP_COUNTERS(RUN)				\
+  RUN(SFLLACP_counters, actorSystemID, SFLXDR_MAC, 2)		\
+  RUN(SFLLACP_counters, attachedAggID, SFLXDR_NET32, 10)
+
+#define SFLXDR_PROCESSOR_COUNTERS(RUN)				\
+  RUN(SFLProcessor_counters, five_sec_cpu, SFLXDR_NET32, 3)	\
+  RUN(SFLProcessor_counters, total_memory, SFLXDR_NET64, 2)
+
+#define SFLXDR_HOST_PAR_COUNTERS(RUN)			\
+  RUN(SFLHost_par_counters, dsClass, SFLXDR_NET32, 2)
+
+#define SFLXDR_HOST_CPU_COUNTERS(RUN)				\
+  RUN(SFLHost_cpu_counters, load_one, SFLXDR_NET32, 20)
+
+#define SFLXDR_HOST_MEM_COUNTERS(RUN)				\
+  RUN(SFLHost_mem_counters, mem_total, SFLXDR_NET64, 7)	\
+  RUN(SFLHost_mem_counters, page_in, SFLXDR_NET32, 4)
+
+#define SFLXDR_HOST_DSK_COUNTERS(RUN)					\
+  RUN(SFLHost_dsk_counters, disk_total, SFLXDR_NET64, 2)		\
+  RUN(SFLHost_dsk_counters, part_max_used, SFLXDR_NET32, 2)		\
+  RUN(SFLHost_dsk_counters, bytes_read, SFLXDR_NET64, 1)		\
+  RUN(SFLHost_dsk_counters, read_time, SFLXDR_NET32, 2)		\
+  RUN(SFLHost_dsk_counters, bytes_written, SFLXDR_NET64, 1)		\
+  RUN(SFLHost_dsk_counters, write_time, SFLXDR_NET32, 1)
+
+#define SFLXDR_HOST_NIO_COUNTERS(RUN)				\
+  RUN(SFLHost_nio_counters, bytes_in, SFLXDR_NET64, 1)	\
+  RUN(SFLHost_nio_counters, pkts_in, SFLXDR_NET32, 3)	\
+  RUN(SFLHost_nio_counters, bytes_out, SFLXDR_NET64, 1)	\
+  RUN(SFLHost_nio_counters, pkts_out, SFLXDR_NET32, 3)
+
+#define SFLXDR_HOST_VRT_NODE_COUNTERS(RUN)			\
+  RUN(SFLHost_vrt_node_counters, mhz, SFLXDR_NET32, 2)		\
+  RUN(SFLHost_vrt_node_counters, memory, SFLXDR_NET64, 2)	\
+  RUN(SFLHost_vrt_node_counters, num_domains, SFLXDR_NET32, 1)
+
+#define SFLXDR_HOST_VRT_CPU_COUNTERS(RUN)			\
+  RUN(SFLHost_vrt_cpu_counters, state, SFLXDR_NET32, 3)
+
+#define SFLXDR_HOST_VRT_MEM_COUNTERS(RUN)			\
+  RUN(SFLHost_vrt_mem_counters, memory, SFLXDR_NET64, 2)
+
+#define SFLXDR_HOST_VRT_DSK_COUNTERS(RUN)				\
+  RUN(SFLHost_vrt_dsk_counters, capacity, SFLXDR_NET64, 3)		\
+  RUN(SFLHost_vrt_dsk_counters, rd_req, SFLXDR_NET32, 1)		\
+  RUN(SFLHost_vrt_dsk_counters, rd_bytes, SFLXDR_NET64, 1)		\
+  RUN(SFLHost_vrt_dsk_counters, wr_req, SFLXDR_NET32, 1)		\
+  RUN(SFLHost_vrt_dsk_counters, wr_bytes, SFLXDR_NET64, 1)		\
+  RUN(SFLHost_vrt_dsk_counters, errs, SFLXDR_NET32, 1)
+
+#define SFLXDR_HOST_GPU_NVML(RUN)				\
+  RUN(SFLHost_gpu_nvml, device_count, SFLXDR_NET32, 4)	\
+  RUN(SFLHost_gpu_nvml, mem_total, SFLXDR_NET64, 2)		\
+  RUN(SFLHost_gpu_nvml, ecc_errors, SFLXDR_NET32, 4)
+
+#define SFLXDR_HOST_IP_COUNTERS(RUN)					\
+  RUN(SFLHost_ip_counters, ipForwarding, SFLXDR_NET32, SFLHOST_NUM_IP_COUNTERS)
+
+#define SFLXDR_HOST_ICMP_COUNTERS(RUN)					\
+  RUN(SFLHost_icmp_counters, icmpInMsgs, SFLXDR_NET32, SFLHOST_NUM_ICMP_COUNTERS)
+
+#define SFLXDR_HOST_TCP_COUNTERS(RUN)					\
+  RUN(SFLHost_tcp_counters, tcpRtoAlgorithm, SFLXDR_NET32, SFLHOST_NUM_TCP_COUNTERS)
+
+#define SFLXDR_HOST_UDP_COUNTERS(RUN)					\
+  RUN(SFLHost_udp_counters, udpInDatagrams, SFLXDR_NET32, SFLHOST_NUM_UDP_COUNTERS)
+
+#define SFLXDR_BCM_TABLES(RUN)						\
+  RUN(SFLBCM_tables, bcm_host_entries, SFLXDR_NET32, XDRSIZ_BCM_TABLES / 4)
+
+#define SFLXDR_APP_RESOURCES(RUN)			\
+  RUN(SFLAPPResources, user_time, SFLXDR_NET32, 2)	\
+  RUN(SFLAPPResources, mem_used, SFLXDR_NET64, 2)	\
+  RUN(SFLAPPResources, fd_open, SFLXDR_NET32, 4)
+
+#define SFLXDR_APP_WORKERS(RUN)				\
+  RUN(SFLAPPWorkers, workers_active, SFLXDR_NET32, 5)
+
+SFLXDR_DEFINE(xdrSampledEthernet, SFLXDR_SAMPLED_ETHERNET);
+SFLXDR_DEFINE(xdrSampledIPv4, SFLXDR_SAMPLED_IPV4);
+SFLXDR_DEFINE(xdrSampledIPv6, SFLXDR_SAMPLED_IPV6);
+SFLXDR_DEFINE(xdrSwitch, SFLXDR_EX_SWITCH);
+SFLXDR_DEFINE(xdrMplsLdpFec, SFLXDR_EX_MPLS_LDP_FEC);
+SFLXDR_DEFINE(xdrDecap, SFLXDR_EX_DECAP);
+SFLXDR_DEFINE(xdrVni, SFLXDR_EX_VNI);
+SFLXDR_DEFINE(xdrSocket4, SFLXDR_EX_SOCKET4);
+SFLXDR_DEFINE(xdrSocket6, SFLXDR_EX_SOCKET6);
+SFLXDR_DEFINE(xdrTCPInfo, SFLXDR_EX_TCP_INFO);
+
+SFLXDR_DEFINE(xdrIfCounters, SFLXDR_IF_COUNTERS);
+SFLXDR_DEFINE(xdrEthernetCounters, SFLXDR_ETHERNET_COUNTERS);
+SFLXDR_DEFINE(xdrTokenringCounters, SFLXDR_TOKENRING_COUNTERS);
+SFLXDR_DEFINE(xdrVgCounters, SFLXDR_VG_COUNTERS);
+SFLXDR_DEFINE(xdrVlanCounters, SFLXDR_VLAN_COUNTERS);
+SFLXDR_DEFINE(xdrLACPCounters, SFLXDR_LACP_COUNTERS);
+SFLXDR_DEFINE(xdrProcessorCounters, SFLXDR_PROCESSOR_COUNTERS);
+SFLXDR_DEFINE(xdrHostParCounters, SFLXDR_HOST_PAR_COUNTERS);
+SFLXDR_DEFINE(xdrHostCpuCounters, SFLXDR_HOST_CPU_COUNTERS);
+SFLXDR_DEFINE(xdrHostMemCounters, SFLXDR_HOST_MEM_COUNTERS);
+SFLXDR_DEFINE(xdrHostDskCounters, SFLXDR_HOST_DSK_COUNTERS);
+SFLXDR_DEFINE(xdrHostNioCounters, SFLXDR_HOST_NIO_COUNTERS);
+SFLXDR_DEFINE(xdrHostVrtNodeCounters, SFLXDR_HOST_VRT_NODE_COUNTERS);
+SFLXDR_DEFINE(xdrHostVrtCpuCounters, SFLXDR_HOST_VRT_CPU_COUNTERS);
+SFLXDR_DEFINE(xdrHostVrtMemCounters, SFLXDR_HOST_VRT_MEM_COUNTERS);
+SFLXDR_DEFINE(xdrHostVrtDskCounters, SFLXDR_HOST_VRT_DSK_COUNTERS);
+SFLXDR_DEFINE(xdrHostGpuNVML, SFLXDR_HOST_GPU_NVML);
+SFLXDR_DEFINE(xdrHostIPCounters, SFLXDR_HOST_IP_COUNTERS);
+SFLXDR_DEFINE(xdrHostICMPCounters, SFLXDR_HOST_ICMP_COUNTERS);
+SFLXDR_DEFINE(xdrHostTCPCounters, SFLXDR_HOST_TCP_COUNTERS);
+SFLXDR_DEFINE(xdrHostUDPCounters, SFLXDR_HOST_UDP_COUNTERS);
+SFLXDR_DEFINE(xdrBCMTables, SFLXDR_BCM_TABLES);
+SFLXDR_DEFINE(xdrAPPResources, SFLXDR_APP_RESOURCES);
+SFLXDR_DEFINE(xdrAPPWorkers, SFLXDR_APP_WORKERS);
+
+/* the published sizes must agree with the layouts */
+SFLXDR_ASSERT(SFLXDR_SIZE(SFLXDR_EX_SOCKET4) == XDRSIZ_SFLEXTENDED_SOCKET4, sflxdr_size_socket4);
+SFLXDR_ASSERT(SFLXDR_SIZE(SFLXDR_EX_SOCKET6) == XDRSIZ_SFLEXTENDED_SOCKET6, sflxdr_size_socket6);
+SFLXDR_ASSERT(SFLXDR_SIZE(SFLXDR_EX_TCP_INFO) == XDRSIZ_SFLEXTENDED_TCP_INFO, sflxdr_size_tcp_info);
+SFLXDR_ASSERT(SFLXDR_SIZE(SFLXDR_LACP_COUNTERS) == XDRSIZ_LACP_COUNTERS, sflxdr_size_lacp);
+SFLXDR_ASSERT(SFLXDR_SIZE(SFLXDR_HOST_IP_COUNTERS) == XDRSIZ_IP_COUNTERS, sflxdr_size_host_ip);
+SFLXDR_ASSERT(SFLXDR_SIZE(SFLXDR_HOST_ICMP_COUNTERS) == XDRSIZ_ICMP_COUNTERS, sflxdr_size_host_icmp);
+SFLXDR_ASSERT(SFLXDR_SIZE(SFLXDR_HOST_TCP_COUNTERS) == XDRSIZ_TCP_COUNTERS, sflxdr_size_host_tcp);
+SFLXDR_ASSERT(SFLXDR_SIZE(SFLXDR_HOST_UDP_COUNTERS) == XDRSIZ_UDP_COUNTERS, sflxdr_size_host_udp);
+SFLXDR_ASSERT(SFLXDR_SIZE(SFLXDR_BCM_TABLES) == XDRSIZ_BCM_TABLES, sflxdr_size_bcm_tables);
+SFLXDR_ASSERT(SFLXDR_SIZE(SFLXDR_IF_COUNTERS) == 88, sflxdr_size_generic);
+SFLXDR_ASSERT(SFLXDR_SIZE(SFLXDR_HOST_CPU_COUNTERS) == 80, sflxdr_size_host_cpu);
+SFLXDR_ASSERT(SFLXDR_SIZE(SFLXDR_HOST_MEM_COUNTERS) == 72, sflxdr_size_host_mem);
+SFLXDR_ASSERT(SFLXDR_SIZE(SFLXDR_HOST_DSK_COUNTERS) == 52, sflxdr_size_host_dsk);
+SFLXDR_ASSERT(SFLXDR_SIZE(SFLXDR_HOST_NIO_COUNTERS) == 40, sflxdr_size_host_nio);
+
+static SFL_XDR_INLINE void putLayout(SFLReceiver *receiver, const SFLXDRLayout *layout, void *obj)
 {
-  SFLFlow_sample_element *elem;
-  uint32_t elemSiz;
-#ifdef SFL_USE_32BIT_INDEX
-  uint siz = 52; /* tag, length, sequence_number, ds_class, ds_index, sampling_rate,
-		     sample_pool, drops, inputFormat, input, outputFormat, output, number of elements */
-#else
-  uint32_t siz = 40; /* tag, length, sequence_number, source_id, sampling_rate,
-		     sample_pool, drops, input, output, number of elements */
+  uint32_t *to = receiver->sampleCollector.datap;
+  uint32_t ii, jj;
+#if defined(__GNUC__) && (__GNUC__ >= 8)
+#pragma GCC unroll 8
 #endif
-
-  fs->num_elements = 0; /* we're going to count them again even if this was set by the client */
-  for(elem = fs->elements; elem != NULL; elem = elem->nxt) {
-    fs->num_elements++;
-    siz += 8; /* tag, length */
-    elemSiz = 0;
-    switch(elem->tag) {
-    case SFLFLOW_HEADER:
-      elemSiz = 16; /* header_protocol, frame_length, stripped, header_length */
-      elemSiz += ((elem->flowType.header.header_length + 3) / 4) * 4; /* header, rounded up to nearest 4 bytes */
+  for(ii = 0; ii < layout->numRuns; ii++) {
+    const SFLXDRRun *run = &layout->runs[ii];
+    u_char *from = (u_char *)obj + run->offset;
+    switch(run->kind) {
+    case SFLXDR_NET32: to = xdrNet32_run(to, from, run->count); break;
+    case SFLXDR_NET64: to = xdrNet64_run(to, from, run->count); break;
+    case SFLXDR_RAW:
+      /* only ever a few quads,  so copy them one at a time rather than
+	 let the compiler turn a variable-length memcpy into rep movs */
+      for(jj = 0; jj < run->count; jj++) {
+	uint32_t quad;
+	memcpy(&quad, from + (jj * 4), 4);
+	*to++ = quad;
+      }
       break;
-    case SFLFLOW_ETHERNET: elemSiz = sizeof(SFLSampled_ethernet); break;
-    case SFLFLOW_IPV4: elemSiz = sizeof(SFLSampled_ipv4); break;
-    case SFLFLOW_IPV6: elemSiz = sizeof(SFLSampled_ipv6); break;
-    case SFLFLOW_EX_SWITCH: elemSiz = sizeof(SFLExtended_switch); break;
-    case SFLFLOW_EX_ROUTER: elemSiz = routerEncodingLength(&elem->flowType.router); break;
-    case SFLFLOW_EX_GATEWAY: elemSiz = gatewayEncodingLength(&elem->flowType.gateway); break;
-    case SFLFLOW_EX_USER: elemSiz = userEncodingLength(&elem->flowType.user); break;
-    case SFLFLOW_EX_URL: elemSiz = urlEncodingLength(&elem->flowType.url); break;
-    case SFLFLOW_EX_MPLS: elemSiz = mplsEncodingLength(&elem->flowType.mpls); break;
-    case SFLFLOW_EX_NAT: elemSiz = natEncodingLength(&elem->flowType.nat); break;
-    case SFLFLOW_EX_MPLS_TUNNEL: elemSiz = mplsTunnelEncodingLength(&elem->flowType.mpls_tunnel); break;
-    case SFLFLOW_EX_MPLS_VC: elemSiz = mplsVcEncodingLength(&elem->flowType.mpls_vc); break;
-    case SFLFLOW_EX_MPLS_FTN: elemSiz = mplsFtnEncodingLength(&elem->flowType.mpls_ftn); break;
-    case SFLFLOW_EX_MPLS_LDP_FEC: elemSiz = mplsLdpFecEncodingLength(&elem->flowType.mpls_ldp_fec); break;
-    case SFLFLOW_EX_VLAN_TUNNEL: elemSiz = vlanTunnelEncodingLength(&elem->flowType.vlan_tunnel); break;
-	case SFLFLOW_EX_L2_TUNNEL_EGRESS:
-	case SFLFLOW_EX_L2_TUNNEL_INGRESS: elemSiz = sizeof(SFLExtended_l2_tunnel); break;
-	case SFLFLOW_EX_IPV4_TUNNEL_EGRESS:
-	case SFLFLOW_EX_IPV4_TUNNEL_INGRESS: elemSiz = sizeof(SFLExtended_ipv4_tunnel); break;
-	case SFLFLOW_EX_DECAP_EGRESS:
-	case SFLFLOW_EX_DECAP_INGRESS: elemSiz = tunnelDecapEncodingLength(&elem->flowType.tunnel_decap); break;
-	case SFLFLOW_EX_VNI_EGRESS:
-	case SFLFLOW_EX_VNI_INGRESS: elemSiz = tunnelVniEncodingLength(&elem->flowType.tunnel_vni); break;
-    case SFLFLOW_APP: elemSiz = appEncodingLength(&elem->flowType.app); break;
-    case SFLFLOW_APP_CTXT: elemSiz = appContextLength(&elem->flowType.context); break;
-    case SFLFLOW_APP_ACTOR_INIT:
-    case SFLFLOW_APP_ACTOR_TGT: elemSiz = stringEncodingLength(&elem->flowType.actor.actor); break;
-    case SFLFLOW_EX_PROXY_SOCKET4:
-    case SFLFLOW_EX_SOCKET4: elemSiz = XDRSIZ_SFLEXTENDED_SOCKET4;  break;
-    case SFLFLOW_EX_PROXY_SOCKET6:
-    case SFLFLOW_EX_SOCKET6: elemSiz = XDRSIZ_SFLEXTENDED_SOCKET6;  break;
-    case SFLFLOW_EX_TCP_INFO: elemSiz = XDRSIZ_SFLEXTENDED_TCP_INFO;  break;
-    default:
-      sflError(receiver, "unexpected packet_data_tag");
-      return -1;
+    case SFLXDR_MAC:
+      for(jj = 0; jj < run->count; jj++) {
+	uint32_t quad;
+	uint16_t tail;
+	memcpy(&quad, from + (jj * 8), 4);
+	memcpy(&tail, from + (jj * 8) + 4, 2);
+	*to++ = quad;
+	/* last two bytes of the MAC,  then the zero pad */
+	*to++ = (htonl(1) == 1) ? ((uint32_t)tail << 16) : tail;
+      }
       break;
     }
-    // cache the element size, and accumulate it into the overall FlowSample size
-    elem->length = elemSiz;
-    siz += elemSiz;
+  }
+  receiver->sampleCollector.datap = to;
+}
+
+/*_________________-----------------------------__________________
+  _________________   one-pass sample writing   __________________
+  -----------------_____________________________------------------
+  A sample is encoded in a single walk of its element list,  straight
+  into the datagram after whatever is already there (the collector has
+  room for one more full-sized sample beyond the datagram limit). Each
+  element's length,  and the sample's length and element count,  are
+  back-patched once the bytes are written. Only then do we know if the
+  sample fits in this datagram - if not,  the datagram is sent without
+  it and the sample moves to the start of the next one.
+*/
+
+static uint32_t *startElement(SFLReceiver *receiver, uint32_t tag, uint32_t elemSiz, u_char *limit, char *tooBig)
+{
+  uint32_t *lenp;
+  if(((u_char *)receiver->sampleCollector.datap + 8 + elemSiz) > limit) {
+    sflError(receiver, tooBig);
+    return NULL;
+  }
+  putNet32(receiver, tag);
+  lenp = receiver->sampleCollector.datap++;
+  return lenp;
+}
+
+static void endElement(SFLReceiver *receiver, uint32_t *lenp, uint32_t *length)
+{
+  *length = (uint32_t)((u_char *)receiver->sampleCollector.datap - (u_char *)(lenp + 1));
+  *lenp = htonl(*length);
+}
+
+static void moveToNextDatagram(SFLReceiver *receiver, uint32_t *start, uint32_t packedSize)
+{
+  uint32_t sample[SFL_MAX_DATAGRAM_SIZE / sizeof(uint32_t)];
+  memcpy(sample, start, packedSize);
+  sendSample(receiver);
+  memcpy(receiver->sampleCollector.datap, sample, packedSize);
+  receiver->sampleCollector.datap += (packedSize / 4);
+}
+
+static void commitSample(SFLReceiver *receiver, uint32_t *start, uint32_t packedSize)
+{
+  // if this sample puts the datagram over the limit,  then the datagram
+  // should have been sent before it went in.
+  if((receiver->sampleCollector.pktlen + packedSize) >= receiver->sFlowRcvrMaximumDatagramSize)
+    moveToNextDatagram(receiver, start, packedSize);
+  receiver->sampleCollector.numSamples++;
+  receiver->sampleCollector.pktlen += packedSize;
+}
+
+/*_________________-----------------------------__________________
+  _________________      putFlowElement         __________________
+  -----------------_____________________________------------------
+*/
+
+static void putSampledHeader(SFLReceiver *receiver, SFLSampled_header *header)
+{
+  uint32_t quads = (header->header_length + 3) / 4;
+  putNet32(receiver, header->header_protocol);
+  putNet32(receiver, header->frame_length);
+  putNet32(receiver, header->stripped);
+  putNet32(receiver, header->header_length);
+  /* the header,  zero-padded to a multiple of 4 bytes */
+  if(quads) receiver->sampleCollector.datap[quads - 1] = 0;
+  memcpy(receiver->sampleCollector.datap, header->header_bytes, header->header_length);
+  receiver->sampleCollector.datap += quads;
+}
+
+#define SFL_FLOW_TOO_BIG "flow sample too big for datagram"
+
+/* variable-length elements are measured first so the buffer cannot be overrun */
+#define SFL_PUT_VARIABLE(siz, put)					\
+  if((lenp = startElement(receiver, elem->tag, (siz), limit, SFL_FLOW_TOO_BIG)) == NULL) return -1; \
+  put;									\
+  break
+
+/* fixed layouts are expanded in place,  with the table as a constant */
+#define SFL_PUT_FIXED(layout) SFL_PUT_VARIABLE((layout).xdrSize, putLayout(receiver, &(layout), ft))
+
+static int putFlowElement(SFLReceiver *receiver, SFLFlow_sample_element *elem, u_char *limit)
+{
+  uint32_t *lenp = NULL;
+  SFLFlow_type *ft = &elem->flowType;
+
+  switch(elem->tag) {
+  case SFLFLOW_HEADER:
+    SFL_PUT_VARIABLE(16 + (((ft->header.header_length + 3) / 4) * 4), putSampledHeader(receiver, &ft->header));
+  case SFLFLOW_ETHERNET:
+  case SFLFLOW_EX_L2_TUNNEL_EGRESS:
+  case SFLFLOW_EX_L2_TUNNEL_INGRESS: SFL_PUT_FIXED(xdrSampledEthernet);
+  case SFLFLOW_IPV4:
+  case SFLFLOW_EX_IPV4_TUNNEL_EGRESS:
+  case SFLFLOW_EX_IPV4_TUNNEL_INGRESS: SFL_PUT_FIXED(xdrSampledIPv4);
+  case SFLFLOW_IPV6:
+  case SFLFLOW_EX_IPV6_TUNNEL_EGRESS:
+  case SFLFLOW_EX_IPV6_TUNNEL_INGRESS: SFL_PUT_FIXED(xdrSampledIPv6);
+  case SFLFLOW_EX_SWITCH: SFL_PUT_FIXED(xdrSwitch);
+  case SFLFLOW_EX_MPLS_LDP_FEC: SFL_PUT_FIXED(xdrMplsLdpFec);
+  case SFLFLOW_EX_DECAP_EGRESS:
+  case SFLFLOW_EX_DECAP_INGRESS: SFL_PUT_FIXED(xdrDecap);
+  case SFLFLOW_EX_VNI_EGRESS:
+  case SFLFLOW_EX_VNI_INGRESS: SFL_PUT_FIXED(xdrVni);
+  case SFLFLOW_EX_PROXY_SOCKET4:
+  case SFLFLOW_EX_SOCKET4: SFL_PUT_FIXED(xdrSocket4);
+  case SFLFLOW_EX_PROXY_SOCKET6:
+  case SFLFLOW_EX_SOCKET6: SFL_PUT_FIXED(xdrSocket6);
+  case SFLFLOW_EX_TCP_INFO: SFL_PUT_FIXED(xdrTCPInfo);
+  case SFLFLOW_EX_ROUTER: SFL_PUT_VARIABLE(routerEncodingLength(&ft->router), putRouter(receiver, &ft->router));
+  case SFLFLOW_EX_GATEWAY: SFL_PUT_VARIABLE(gatewayEncodingLength(&ft->gateway), putGateway(receiver, &ft->gateway));
+  case SFLFLOW_EX_USER: SFL_PUT_VARIABLE(userEncodingLength(&ft->user), putUser(receiver, &ft->user));
+  case SFLFLOW_EX_URL: SFL_PUT_VARIABLE(urlEncodingLength(&ft->url), putUrl(receiver, &ft->url));
+  case SFLFLOW_EX_MPLS: SFL_PUT_VARIABLE(mplsEncodingLength(&ft->mpls), putMpls(receiver, &ft->mpls));
+  case SFLFLOW_EX_NAT: SFL_PUT_VARIABLE(natEncodingLength(&ft->nat), putNat(receiver, &ft->nat));
+  case SFLFLOW_EX_MPLS_TUNNEL: SFL_PUT_VARIABLE(mplsTunnelEncodingLength(&ft->mpls_tunnel), putMplsTunnel(receiver, &ft->mpls_tunnel));
+  case SFLFLOW_EX_MPLS_VC: SFL_PUT_VARIABLE(mplsVcEncodingLength(&ft->mpls_vc), putMplsVc(receiver, &ft->mpls_vc));
+  case SFLFLOW_EX_MPLS_FTN: SFL_PUT_VARIABLE(mplsFtnEncodingLength(&ft->mpls_ftn), putMplsFtn(receiver, &ft->mpls_ftn));
+  case SFLFLOW_EX_VLAN_TUNNEL: SFL_PUT_VARIABLE(labelStackEncodingLength(&ft->vlan_tunnel.stack), putLabelStack(receiver, &ft->vlan_tunnel.stack));
+  case SFLFLOW_APP: SFL_PUT_VARIABLE(appEncodingLength(&ft->app), putAPP(receiver, &ft->app));
+  case SFLFLOW_APP_CTXT: SFL_PUT_VARIABLE(appContextLength(&ft->context), putAPPContext(receiver, &ft->context));
+  case SFLFLOW_APP_ACTOR_INIT:
+  case SFLFLOW_APP_ACTOR_TGT: SFL_PUT_VARIABLE(stringEncodingLength(&ft->actor.actor), putString(receiver, &ft->actor.actor));
+  default:
+    sflError(receiver, "unexpected packet_data_tag");
+    return -1;
   }
 
-  return siz;
+  endElement(receiver, lenp, &elem->length);
+  return 0;
 }
 
+#undef SFL_PUT_FIXED
+#undef SFL_PUT_VARIABLE
+
 /*_________________-------------------------------__________________
   _________________ sfl_receiver_writeFlowSample  __________________
   -----------------_______________________________------------------
@@ -705,26 +1057,15 @@ static int computeFlowSampleSize(SFLReceiver *receiver, SFL_FLOW_SAMPLE_TYPE *fs
 
 int sfl_receiver_writeFlowSample(SFLReceiver *receiver, SFL_FLOW_SAMPLE_TYPE *fs)
 {
-  int packedSize;
+  uint32_t *start, *lenp, *nump;
+  u_char *limit;
+  uint32_t packedSize;
   SFLFlow_sample_element *elem;
 
   if(fs == NULL) return -1;
-  if((packedSize = computeFlowSampleSize(receiver, fs)) == -1) return -1;
 
-  // check in case this one sample alone is too big for the datagram
-  // in fact - if it is even half as big then we should ditch it. Very
-  // important to avoid overruning the packet buffer.
-  if(packedSize > (int)(receiver->sFlowRcvrMaximumDatagramSize)) {
-    sflError(receiver, "flow sample too big for datagram");
-    return -1;
-  }
-
-  // if the sample pkt is full enough so that this sample might put
-  // it over the limit, then we should send it now before going on.
-  if((receiver->sampleCollector.pktlen + packedSize) >= receiver->sFlowRcvrMaximumDatagramSize)
-    sendSample(receiver);
-    
-  receiver->sampleCollector.numSamples++;
+  start = receiver->sampleCollector.datap;
+  limit = (u_char *)start + receiver->sFlowRcvrMaximumDatagramSize;
 
 #ifdef SFL_USE_32BIT_INDEX
   putNet32(receiver, SFLFLOW_SAMPLE_EXPANDED);
@@ -732,7 +1073,7 @@ int sfl_receiver_writeFlowSample(SFLReceiver *receiver, SFL_FLOW_SAMPLE_TYPE *fs
   putNet32(receiver, SFLFLOW_SAMPLE);
 #endif
 
-  putNet32(receiver, packedSize - 8); // don't include tag and len
+  lenp = receiver->sampleCollector.datap++; // back-patched below
   putNet32(receiver, fs->sequence_number);
 
 #ifdef SFL_USE_32BIT_INDEX
@@ -756,82 +1097,18 @@ int sfl_receiver_writeFlowSample(SFLReceiver *receiver, SFL_FLOW_SAMPLE_TYPE *fs
   putNet32(receiver, fs->output);
 #endif
 
-  putNet32(receiver, fs->num_elements);
+  nump = receiver->sampleCollector.datap++; // back-patched below
 
+  fs->num_elements = 0; /* we're going to count them again even if this was set by the client */
   for(elem = fs->elements; elem != NULL; elem = elem->nxt) {
-
-    putNet32(receiver, elem->tag);
-    putNet32(receiver, elem->length); // length cached in computeFlowSampleSize()
-
-    switch(elem->tag) {
-    case SFLFLOW_HEADER:
-    putNet32(receiver, elem->flowType.header.header_protocol);
-    putNet32(receiver, elem->flowType.header.frame_length);
-    putNet32(receiver, elem->flowType.header.stripped);
-    putNet32(receiver, elem->flowType.header.header_length);
-    /* the header */
-    memcpy(receiver->sampleCollector.datap, elem->flowType.header.header_bytes, elem->flowType.header.header_length);
-    /* round up to multiple of 4 to preserve alignment */
-    receiver->sampleCollector.datap += ((elem->flowType.header.header_length + 3) / 4);
-      break;
-	case SFLFLOW_ETHERNET: putSampledEthernet(receiver, &elem->flowType.ethernet); break;
-	case SFLFLOW_IPV4: putSampledIPv4(receiver, &elem->flowType.ipv4); break;
-	case SFLFLOW_IPV6: putSampledIPv6(receiver, &elem->flowType.ipv6); break;
-    case SFLFLOW_EX_SWITCH: putSwitch(receiver, &elem->flowType.sw); break;
-    case SFLFLOW_EX_ROUTER: putRouter(receiver, &elem->flowType.router); break;
-    case SFLFLOW_EX_GATEWAY: putGateway(receiver, &elem->flowType.gateway); break;
-    case SFLFLOW_EX_USER: putUser(receiver, &elem->flowType.user); break;
-    case SFLFLOW_EX_URL: putUrl(receiver, &elem->flowType.url); break;
-    case SFLFLOW_EX_MPLS: putMpls(receiver, &elem->flowType.mpls); break;
-    case SFLFLOW_EX_NAT: putNat(receiver, &elem->flowType.nat); break;
-    case SFLFLOW_EX_MPLS_TUNNEL: putMplsTunnel(receiver, &elem->flowType.mpls_tunnel); break;
-    case SFLFLOW_EX_MPLS_VC: putMplsVc(receiver, &elem->flowType.mpls_vc); break;
-    case SFLFLOW_EX_MPLS_FTN: putMplsFtn(receiver, &elem->flowType.mpls_ftn); break;
-    case SFLFLOW_EX_MPLS_LDP_FEC: putMplsLdpFec(receiver, &elem->flowType.mpls_ldp_fec); break;
-    case SFLFLOW_EX_VLAN_TUNNEL: putVlanTunnel(receiver, &elem->flowType.vlan_tunnel); break;
-	case SFLFLOW_EX_L2_TUNNEL_EGRESS: 
-	case SFLFLOW_EX_L2_TUNNEL_INGRESS:
-		putSampledEthernet(receiver, &elem->flowType.tunnel_l2.header);
-		break;
-	case SFLFLOW_EX_IPV4_TUNNEL_EGRESS:
-	case SFLFLOW_EX_IPV4_TUNNEL_INGRESS:
-		putSampledIPv4(receiver, &elem->flowType.tunnel_ipv4.header);
-		break;
-	case SFLFLOW_EX_IPV6_TUNNEL_EGRESS:
-	case SFLFLOW_EX_IPV6_TUNNEL_INGRESS:
-		putSampledIPv6(receiver, &elem->flowType.tunnel_ipv6.header);
-		break;
-	case SFLFLOW_EX_DECAP_EGRESS:
-	case SFLFLOW_EX_DECAP_INGRESS:
-		putNet32(receiver, elem->flowType.tunnel_decap.inner_header_offset);
-		break;
-	case SFLFLOW_EX_VNI_EGRESS:
-	case SFLFLOW_EX_VNI_INGRESS:
-		putNet32(receiver, elem->flowType.tunnel_vni.vni);
-		break;
-    case SFLFLOW_APP: putAPP(receiver, &elem->flowType.app); break;
-    case SFLFLOW_APP_CTXT: putAPPContext(receiver, &elem->flowType.context); break;
-    case SFLFLOW_APP_ACTOR_INIT:
-    case SFLFLOW_APP_ACTOR_TGT: putString(receiver, &elem->flowType.actor.actor); break;
-    case SFLFLOW_EX_PROXY_SOCKET4:
-    case SFLFLOW_EX_SOCKET4: putSocket4(receiver, &elem->flowType.socket4); break;
-    case SFLFLOW_EX_PROXY_SOCKET6:
-    case SFLFLOW_EX_SOCKET6: putSocket6(receiver, &elem->flowType.socket6); break;
-    case SFLFLOW_EX_TCP_INFO: putTCPInfo(receiver, &elem->flowType.tcp_info); break;
-    default:
-      sflError(receiver, "unexpected packet_data_tag");
-      return -1;
-      break;
-    }
+    fs->num_elements++;
+    if(putFlowElement(receiver, elem, limit) == -1) return -1;
   }
 
-  // sanity check
-  assert(((u_char *)receiver->sampleCollector.datap
-	  - (u_char *)receiver->sampleCollector.data
-	  - receiver->sampleCollector.pktlen)  == (uint32_t)packedSize);
-
-  // update the pktlen
-  receiver->sampleCollector.pktlen = (uint32_t)((u_char *)receiver->sampleCollector.datap - (u_char *)receiver->sampleCollector.data);
+  packedSize = (uint32_t)((u_char *)receiver->sampleCollector.datap - (u_char *)start);
+  *lenp = htonl(packedSize - 8); // don't include tag and len
+  *nump = htonl(fs->num_elements);
+  commitSample(receiver, start, packedSize);
 
   // if the sample pkt is full enough so that another packet-sample the same size would
   // put it over the size threshold, then just send it now.  After all,  if we waited and then
@@ -839,80 +1116,104 @@ int sfl_receiver_writeFlowSample(SFLReceiver *receiver, SFL_FLOW_SAMPLE_TYPE *fs
   if((receiver->sampleCollector.pktlen + packedSize) >= receiver->sFlowRcvrMaximumDatagramSize)
     sendSample(receiver);
 
-  return packedSize;
+  return (int)packedSize;
+}
+
+/* elements that almost never change,  and can be pre-encoded */
+static int isStaticElement(uint32_t tag)
+{
+  switch(tag) {
+  case SFLCOUNTERS_HOST_HID:
+  case SFLCOUNTERS_HOST_PAR:
+  case SFLCOUNTERS_ADAPTORS:
+  case SFLCOUNTERS_PORTNAME:
+    return 1;
+  }
+  return 0;
 }
 
 /*_________________-----------------------------__________________
-  _________________ computeCountersSampleSize   __________________
+  _________________ putCountersElement          __________________
   -----------------_____________________________------------------
 */
 
-static int computeCountersSampleSize(SFLReceiver *receiver, SFL_COUNTERS_SAMPLE_TYPE *cs)
+static void putHostId(SFLReceiver *receiver, SFLHost_hid_counters *hid)
 {
-  SFLCounters_sample_element *elem;
-  uint32_t elemSiz;
+  putString(receiver, &hid->hostname);
+  put128(receiver, hid->uuid);
+  putNet32(receiver, hid->machine_type);
+  putNet32(receiver, hid->os_name);
+  putString(receiver, &hid->os_release);
+}
 
-#ifdef SFL_USE_32BIT_INDEX
-  uint siz = 24; /* tag, length, sequence_number, ds_class, ds_index, number of elements */
-#else
-  uint32_t siz = 20; /* tag, length, sequence_number, source_id, number of elements */
-#endif
+static void putAPPCounters(SFLReceiver *receiver, SFLAPPCounters *appctrs)
+{
+  putString(receiver, &appctrs->application);
+  // status_OK and the 10 error counters
+  putNet32_run(receiver, &appctrs->status_OK, 11);
+}
 
-  cs->num_elements = 0; /* we're going to count them again even if this was set by the client */
-  for( elem = cs->elements; elem != NULL; elem = elem->nxt) {
-    cs->num_elements++;
-    siz += 8; /* tag, length */
-    elemSiz = 0;
-    /* here we are assuming that the structure fields are not expanded to be 64-bit aligned,
-       because then the sizeof(struct) would be larger than the wire-encoding. */
-
-    switch(elem->tag) {
-    case SFLCOUNTERS_GENERIC:  elemSiz = sizeof(elem->counterBlock.generic); break;
-    case SFLCOUNTERS_ETHERNET: elemSiz = sizeof(elem->counterBlock.ethernet); break;
-    case SFLCOUNTERS_TOKENRING: elemSiz = sizeof(elem->counterBlock.tokenring); break;
-    case SFLCOUNTERS_VG: elemSiz = sizeof(elem->counterBlock.vg); break;
-    case SFLCOUNTERS_VLAN: elemSiz = sizeof(elem->counterBlock.vlan); break;
-    case SFLCOUNTERS_LACP: elemSiz = XDRSIZ_LACP_COUNTERS; break;
-    case SFLCOUNTERS_SFP: elemSiz = sfpEncodingLength(&elem->counterBlock.sfp); break;
-    case SFLCOUNTERS_PROCESSOR: elemSiz = sizeof(elem->counterBlock.processor);  break;
-    case SFLCOUNTERS_HOST_HID: elemSiz = hostIdEncodingLength(&elem->counterBlock.host_hid);  break;
-    case SFLCOUNTERS_HOST_PAR: elemSiz = 8 /*sizeof(elem->counterBlock.host_par)*/;  break;
-    case SFLCOUNTERS_ADAPTORS: elemSiz = adaptorListEncodingLength(elem->counterBlock.adaptors);  break;
-    case SFLCOUNTERS_HOST_CPU: elemSiz = 80 /*sizeof(elem->counterBlock.host_cpu)*/;  break;
-    case SFLCOUNTERS_HOST_MEM: elemSiz = 72 /*sizeof(elem->counterBlock.host_mem)*/ ;  break;
-    case SFLCOUNTERS_HOST_DSK: elemSiz = 52 /*sizeof(elem->counterBlock.host_dsk)*/;  break;
-    case SFLCOUNTERS_HOST_NIO: elemSiz = 40 /*sizeof(elem->counterBlock.host_nio)*/;  break;
-    case SFLCOUNTERS_HOST_IP: elemSiz = XDRSIZ_IP_COUNTERS;  break;
-    case SFLCOUNTERS_HOST_ICMP: elemSiz = XDRSIZ_ICMP_COUNTERS;  break;
-    case SFLCOUNTERS_HOST_TCP: elemSiz = XDRSIZ_TCP_COUNTERS;  break;
-    case SFLCOUNTERS_HOST_UDP: elemSiz = XDRSIZ_UDP_COUNTERS;  break;
-    case SFLCOUNTERS_HOST_VRT_NODE: elemSiz = 28 /*sizeof(elem->counterBlock.host_vrt_node)*/;  break;
-    case SFLCOUNTERS_HOST_VRT_CPU: elemSiz = 12 /*sizeof(elem->counterBlock.host_vrt_cpu)*/;  break;
-    case SFLCOUNTERS_HOST_VRT_MEM: elemSiz = 16 /*sizeof(elem->counterBlock.host_vrt_mem)*/;  break;
-    case SFLCOUNTERS_HOST_VRT_DSK: elemSiz = 52 /*sizeof(elem->counterBlock.host_vrt_dsk)*/;  break;
-    case SFLCOUNTERS_HOST_VRT_NIO: elemSiz = 40 /*sizeof(elem->counterBlock.host_vrt_nio)*/;  break;
-    case SFLCOUNTERS_HOST_GPU_NVML: elemSiz = 48 /*sizeof(elem->counterBlock.host_gpu_nvml)*/;  break;
-    case SFLCOUNTERS_APP:  elemSiz = appCountersEncodingLength(&elem->counterBlock.app); break;
-    case SFLCOUNTERS_APP_RESOURCES:  elemSiz = appResourcesEncodingLength(&elem->counterBlock.appResources); break;
-    case SFLCOUNTERS_APP_WORKERS:  elemSiz = appWorkersEncodingLength(&elem->counterBlock.appWorkers); break;
-    case SFLCOUNTERS_PORTNAME:  elemSiz = stringEncodingLength(&elem->counterBlock.portName.portName); break;
-    case SFLCOUNTERS_BCM_TABLES: elemSiz = XDRSIZ_BCM_TABLES;  break;
-    default:
-      {
-	char errm[128];
-	sprintf(errm, "computeCounterSampleSize(): unexpected counters tag (%u)", elem->tag);
-	sflError(receiver, errm);
-	return -1;
-      }
-      break;
+#define SFL_COUNTERS_TOO_BIG "counters sample too big for datagram"
+
+#define SFL_PUT_VARIABLE(siz, put)					\
+  if((lenp = startElement(receiver, elem->tag, (siz), limit, SFL_COUNTERS_TOO_BIG)) == NULL) return -1; \
+  put;									\
+  break
+
+#define SFL_PUT_FIXED(layout) SFL_PUT_VARIABLE((layout).xdrSize, putLayout(receiver, &(layout), cb))
+
+static int putCountersElement(SFLReceiver *receiver, SFLCounters_sample_element *elem, u_char *limit)
+{
+  uint32_t *lenp = NULL;
+  SFLCounters_type *cb = &elem->counterBlock;
+
+  switch(elem->tag) {
+  case SFLCOUNTERS_GENERIC: SFL_PUT_FIXED(xdrIfCounters);
+  case SFLCOUNTERS_ETHERNET: SFL_PUT_FIXED(xdrEthernetCounters);
+  case SFLCOUNTERS_TOKENRING: SFL_PUT_FIXED(xdrTokenringCounters);
+  case SFLCOUNTERS_VG: SFL_PUT_FIXED(xdrVgCounters);
+  case SFLCOUNTERS_VLAN: SFL_PUT_FIXED(xdrVlanCounters);
+  case SFLCOUNTERS_LACP: SFL_PUT_FIXED(xdrLACPCounters);
+  case SFLCOUNTERS_PROCESSOR: SFL_PUT_FIXED(xdrProcessorCounters);
+  case SFLCOUNTERS_HOST_PAR: SFL_PUT_FIXED(xdrHostParCounters);
+  case SFLCOUNTERS_HOST_CPU: SFL_PUT_FIXED(xdrHostCpuCounters);
+  case SFLCOUNTERS_HOST_MEM: SFL_PUT_FIXED(xdrHostMemCounters);
+  case SFLCOUNTERS_HOST_DSK: SFL_PUT_FIXED(xdrHostDskCounters);
+  case SFLCOUNTERS_HOST_NIO:
+  case SFLCOUNTERS_HOST_VRT_NIO: SFL_PUT_FIXED(xdrHostNioCounters);
+  case SFLCOUNTERS_HOST_VRT_NODE: SFL_PUT_FIXED(xdrHostVrtNodeCounters);
+  case SFLCOUNTERS_HOST_VRT_CPU: SFL_PUT_FIXED(xdrHostVrtCpuCounters);
+  case SFLCOUNTERS_HOST_VRT_MEM: SFL_PUT_FIXED(xdrHostVrtMemCounters);
+  case SFLCOUNTERS_HOST_VRT_DSK: SFL_PUT_FIXED(xdrHostVrtDskCounters);
+  case SFLCOUNTERS_HOST_GPU_NVML: SFL_PUT_FIXED(xdrHostGpuNVML);
+  case SFLCOUNTERS_HOST_IP: SFL_PUT_FIXED(xdrHostIPCounters);
+  case SFLCOUNTERS_HOST_ICMP: SFL_PUT_FIXED(xdrHostICMPCounters);
+  case SFLCOUNTERS_HOST_TCP: SFL_PUT_FIXED(xdrHostTCPCounters);
+  case SFLCOUNTERS_HOST_UDP: SFL_PUT_FIXED(xdrHostUDPCounters);
+  case SFLCOUNTERS_BCM_TABLES: SFL_PUT_FIXED(xdrBCMTables);
+  case SFLCOUNTERS_APP_RESOURCES: SFL_PUT_FIXED(xdrAPPResources);
+  case SFLCOUNTERS_APP_WORKERS: SFL_PUT_FIXED(xdrAPPWorkers);
+  case SFLCOUNTERS_SFP: SFL_PUT_VARIABLE(sfpEncodingLength(&cb->sfp), putSFP(receiver, &cb->sfp));
+  case SFLCOUNTERS_HOST_HID: SFL_PUT_VARIABLE(hostIdEncodingLength(&cb->host_hid), putHostId(receiver, &cb->host_hid));
+  case SFLCOUNTERS_ADAPTORS: SFL_PUT_VARIABLE(adaptorListEncodingLength(cb->adaptors), putAdaptorList(receiver, cb->adaptors));
+  case SFLCOUNTERS_APP: SFL_PUT_VARIABLE(appCountersEncodingLength(&cb->app), putAPPCounters(receiver, &cb->app));
+  case SFLCOUNTERS_PORTNAME: SFL_PUT_VARIABLE(stringEncodingLength(&cb->portName.portName), putString(receiver, &cb->portName.portName));
+  default:
+    {
+      char errm[128];
+      sprintf(errm, "unexpected counters tag (%u)", elem->tag);
+      sflError(receiver, errm);
+      return -1;
     }
-    // cache the element size, and accumulate it into the overall FlowSample size
-    elem->length = elemSiz;
-    siz += elemSiz;
   }
-  return siz;
+
+  endElement(receiver, lenp, &elem->length);
+  return 0;
 }
 
+#undef SFL_PUT_FIXED
+#undef SFL_PUT_VARIABLE
+
 /*_________________----------------------------------__________________
   _________________ sfl_receiver_writeCountersSample __________________
   -----------------__________________________________------------------
@@ -920,34 +1221,63 @@ static int computeCountersSampleSize(SFLReceiver *receiver, SFL_COUNTERS_SAMPLE_
 
 int sfl_receiver_writeCountersSample(SFLReceiver *receiver, SFL_COUNTERS_SAMPLE_TYPE *cs)
 {
-  int packedSize;
+  return sfl_receiver_writeCountersSampleCached(receiver, cs, NULL, 0);
+}
+
+/*_________________----------------------------------------__________________
+  _________________ sfl_receiver_writeCountersSampleCached __________________
+  -----------------________________________________________------------------
+  The static elements (see isStaticElement) are written first. If the
+  cache holds the same list of static elements at the same revision,  the
+  bytes are just copied in,  otherwise they are encoded in place and then
+  copied out to the cache for next time. A revision of 0 disables this.
+*/
+
+static int staticCacheHit(SFLStaticCountersCache *cache, SFL_COUNTERS_SAMPLE_TYPE *cs, uint32_t revision)
+{
   SFLCounters_sample_element *elem;
+  uint32_t n = 0;
+  if(cache->xdr == NULL
+     || cache->revision != revision)
+    return 0;
+  for(elem = cs->elements; elem != NULL; elem = elem->nxt) {
+    if(isStaticElement(elem->tag)) {
+      if(n == cache->num_elements
+	 || cache->tags[n] != elem->tag)
+	return 0;
+      n++;
+    }
+  }
+  return (n == cache->num_elements);
+}
+
+int sfl_receiver_writeCountersSampleCached(SFLReceiver *receiver, SFL_COUNTERS_SAMPLE_TYPE *cs, SFLStaticCountersCache *cache, uint32_t revision)
+{
+  uint32_t *start, *lenp, *nump;
+  u_char *limit;
+  uint32_t packedSize;
+  SFLCounters_sample_element *elem;
+  SFLStaticCountersCache *hit = NULL;
+  int staticFirst;
 
   if(cs == NULL) return -1;
-  // if the sample pkt is full enough so that this sample might put
-  // it over the limit, then we should send it now.
-  if((packedSize = computeCountersSampleSize(receiver, cs)) == -1) return -1;
-  
-  // check in case this one sample alone is too big for the datagram
-  // in fact - if it is even half as big then we should ditch it. Very
-  // important to avoid overruning the packet buffer.
-  if(packedSize > (int)(receiver->sFlowRcvrMaximumDatagramSize)) {
-    sflError(receiver, "counters sample too big for datagram");
-    return -1;
+  if(cache && revision) {
+    if(staticCacheHit(cache, cs, revision))
+      hit = cache;
   }
-  
-  if((receiver->sampleCollector.pktlen + packedSize) >= receiver->sFlowRcvrMaximumDatagramSize)
-    sendSample(receiver);
-  
-  receiver->sampleCollector.numSamples++;
-  
+  else cache = NULL;
+  staticFirst = (cache != NULL);
+
+  start = receiver->sampleCollector.datap;
+  limit = (u_char *)start + receiver->sFlowRcvrMaximumDatagramSize;
+
 #ifdef SFL_USE_32BIT_INDEX
   putNet32(receiver, SFLCOUNTERS_SAMPLE_EXPANDED);
 #else
   putNet32(receiver, SFLCOUNTERS_SAMPLE);
 #endif
 
-  putNet32(receiver, packedSize - 8); // tag and length not included
+  lenp = receiver->sampleCollector.datap++; // back-patched below
   putNet32(receiver, cs->sequence_number);
 
 #ifdef SFL_USE_32BIT_INDEX
@@ -957,261 +1287,62 @@ int sfl_receiver_writeCountersSample(SFLReceiver *receiver, SFL_COUNTERS_SAMPLE_
   putNet32(receiver, cs->source_id);
 #endif
 
-  putNet32(receiver, cs->num_elements);
-  
-  for(elem = cs->elements; elem != NULL; elem = elem->nxt) {
-    
-    putNet32(receiver, elem->tag);
-    putNet32(receiver, elem->length); // length cached in computeCountersSampleSize()
-    
-    switch(elem->tag) {
-    case SFLCOUNTERS_GENERIC:
-      putGenericCounters(receiver, &(elem->counterBlock.generic));
-      break;
-    case SFLCOUNTERS_ETHERNET:
-      // all these counters are 32-bit
-      putNet32_run(receiver, &elem->counterBlock.ethernet, sizeof(elem->counterBlock.ethernet) / 4);
-      break;
-    case SFLCOUNTERS_TOKENRING:
-      // all these counters are 32-bit
-      putNet32_run(receiver, &elem->counterBlock.tokenring, sizeof(elem->counterBlock.tokenring) / 4);
-      break;
-    case SFLCOUNTERS_VG:
-      putNet32(receiver, elem->counterBlock.vg.dot12InHighPriorityFrames);
-      putNet64(receiver, elem->counterBlock.vg.dot12InHighPriorityOctets);
-      putNet32(receiver, elem->counterBlock.vg.dot12InNormPriorityFrames);
-      putNet64(receiver, elem->counterBlock.vg.dot12InNormPriorityOctets);
-      putNet32(receiver, elem->counterBlock.vg.dot12InIPMErrors);
-      putNet32(receiver, elem->counterBlock.vg.dot12InOversizeFrameErrors);
-      putNet32(receiver, elem->counterBlock.vg.dot12InDataErrors);
-      putNet32(receiver, elem->counterBlock.vg.dot12InNullAddressedFrames);
-      putNet32(receiver, elem->counterBlock.vg.dot12OutHighPriorityFrames);
-      putNet64(receiver, elem->counterBlock.vg.dot12OutHighPriorityOctets);
-      putNet32(receiver, elem->counterBlock.vg.dot12TransitionIntoTrainings);
-      putNet64(receiver, elem->counterBlock.vg.dot12HCInHighPriorityOctets);
-      putNet64(receiver, elem->counterBlock.vg.dot12HCInNormPriorityOctets);
-      putNet64(receiver, elem->counterBlock.vg.dot12HCOutHighPriorityOctets);
-      break;
-    case SFLCOUNTERS_VLAN:
-      putNet32(receiver, elem->counterBlock.vlan.vlan_id);
-      putNet64(receiver, elem->counterBlock.vlan.octets);
-      putNet32(receiver, elem->counterBlock.vlan.ucastPkts);
-      putNet32(receiver, elem->counterBlock.vlan.multicastPkts);
-      putNet32(receiver, elem->counterBlock.vlan.broadcastPkts);
-      putNet32(receiver, elem->counterBlock.vlan.discards);
-      break;
-    case SFLCOUNTERS_LACP:
-      putMACAddress(receiver, elem->counterBlock.lacp.actorSystemID);
-      putMACAddress(receiver, elem->counterBlock.lacp.partnerSystemID);
-      putNet32(receiver, elem->counterBlock.lacp.attachedAggID);
-      putNet32(receiver, elem->counterBlock.lacp.portState.all);
-      putNet32(receiver, elem->counterBlock.lacp.LACPDUsRx);
-      putNet32(receiver, elem->counterBlock.lacp.markerPDUsRx);
-      putNet32(receiver, elem->counterBlock.lacp.markerResponsePDUsRx);
-      putNet32(receiver, elem->counterBlock.lacp.unknownRx);
-      putNet32(receiver, elem->counterBlock.lacp.illegalRx);
-      putNet32(receiver, elem->counterBlock.lacp.LACPDUsTx);
-      putNet32(receiver, elem->counterBlock.lacp.markerPDUsTx);
-      putNet32(receiver, elem->counterBlock.lacp.markerResponsePDUsTx);
-      break;
-    case SFLCOUNTERS_SFP:
-      putSFP(receiver, &elem->counterBlock.sfp);
-      break;
-    case SFLCOUNTERS_PROCESSOR:
-      putNet32(receiver, elem->counterBlock.processor.five_sec_cpu);
-      putNet32(receiver, elem->counterBlock.processor.one_min_cpu);
-      putNet32(receiver, elem->counterBlock.processor.five_min_cpu);
-      putNet64(receiver, elem->counterBlock.processor.total_memory);
-      putNet64(receiver, elem->counterBlock.processor.free_memory);
-      break;
-    case SFLCOUNTERS_HOST_HID:
-      putString(receiver, &elem->counterBlock.host_hid.hostname);
-      put128(receiver, elem->counterBlock.host_hid.uuid);
-      putNet32(receiver, elem->counterBlock.host_hid.machine_type);
-      putNet32(receiver, elem->counterBlock.host_hid.os_name);
-      putString(receiver, &elem->counterBlock.host_hid.os_release);
-      break;
-    case SFLCOUNTERS_HOST_PAR:
-      putNet32(receiver, elem->counterBlock.host_par.dsClass);
-      putNet32(receiver, elem->counterBlock.host_par.dsIndex);
-      break;
-    case SFLCOUNTERS_ADAPTORS:
-      putAdaptorList(receiver, elem->counterBlock.adaptors);
-      break;
-    case SFLCOUNTERS_HOST_CPU:
-      putNetFloat(receiver, elem->counterBlock.host_cpu.load_one);
-      putNetFloat(receiver, elem->counterBlock.host_cpu.load_five);
-      putNetFloat(receiver, elem->counterBlock.host_cpu.load_fifteen);
-      putNet32(receiver, elem->counterBlock.host_cpu.proc_run);
-      putNet32(receiver, elem->counterBlock.host_cpu.proc_total);
-      putNet32(receiver, elem->counterBlock.host_cpu.cpu_num);
-      putNet32(receiver, elem->counterBlock.host_cpu.cpu_speed);
-      putNet32(receiver, elem->counterBlock.host_cpu.uptime);
-      putNet32(receiver, elem->counterBlock.host_cpu.cpu_user);
-      putNet32(receiver, elem->counterBlock.host_cpu.cpu_nice);
-      putNet32(receiver, elem->counterBlock.host_cpu.cpu_system);
-      putNet32(receiver, elem->counterBlock.host_cpu.cpu_idle);
-      putNet32(receiver, elem->counterBlock.host_cpu.cpu_wio);
-      putNet32(receiver, elem->counterBlock.host_cpu.cpu_intr);
-      putNet32(receiver, elem->counterBlock.host_cpu.cpu_sintr);
-      putNet32(receiver, elem->counterBlock.host_cpu.interrupts);
-      putNet32(receiver, elem->counterBlock.host_cpu.contexts);
-      putNet32(receiver, elem->counterBlock.host_cpu.cpu_steal);
-      putNet32(receiver, elem->counterBlock.host_cpu.cpu_guest);
-      putNet32(receiver, elem->counterBlock.host_cpu.cpu_guest_nice);
-      break;
-    case SFLCOUNTERS_HOST_MEM:
-      putNet64(receiver, elem->counterBlock.host_mem.mem_total);
-      putNet64(receiver, elem->counterBlock.host_mem.mem_free);
-      putNet64(receiver, elem->counterBlock.host_mem.mem_shared);
-      putNet64(receiver, elem->counterBlock.host_mem.mem_buffers);
-      putNet64(receiver, elem->counterBlock.host_mem.mem_cached);
-      putNet64(receiver, elem->counterBlock.host_mem.swap_total);
-      putNet64(receiver, elem->counterBlock.host_mem.swap_free);
-      putNet32(receiver, elem->counterBlock.host_mem.page_in);
-      putNet32(receiver, elem->counterBlock.host_mem.page_out);
-      putNet32(receiver, elem->counterBlock.host_mem.swap_in);
-      putNet32(receiver, elem->counterBlock.host_mem.swap_out);
-      break;
-    case SFLCOUNTERS_HOST_DSK:
-      putNet64(receiver, elem->counterBlock.host_dsk.disk_total);
-      putNet64(receiver, elem->counterBlock.host_dsk.disk_free);
-      putNet32(receiver, elem->counterBlock.host_dsk.part_max_used);
-      putNet32(receiver, elem->counterBlock.host_dsk.reads);
-      putNet64(receiver, elem->counterBlock.host_dsk.bytes_read);
-      putNet32(receiver, elem->counterBlock.host_dsk.read_time);
-      putNet32(receiver, elem->counterBlock.host_dsk.writes);
-      putNet64(receiver, elem->counterBlock.host_dsk.bytes_written);
-      putNet32(receiver, elem->counterBlock.host_dsk.write_time);
-      break;
-    case SFLCOUNTERS_HOST_NIO:
-      putNet64(receiver, elem->counterBlock.host_nio.bytes_in);
-      putNet32(receiver, elem->counterBlock.host_nio.pkts_in);
-      putNet32(receiver, elem->counterBlock.host_nio.errs_in);
-      putNet32(receiver, elem->counterBlock.host_nio.drops_in);
-      putNet64(receiver, elem->counterBlock.host_nio.bytes_out);
-      putNet32(receiver, elem->counterBlock.host_nio.pkts_out);
-      putNet32(receiver, elem->counterBlock.host_nio.errs_out);
-      putNet32(receiver, elem->counterBlock.host_nio.drops_out);
-      break;
-    case SFLCOUNTERS_HOST_VRT_NODE:
-      putNet32(receiver, elem->counterBlock.host_vrt_node.mhz);
-      putNet32(receiver, elem->counterBlock.host_vrt_node.cpus);
-      putNet64(receiver, elem->counterBlock.host_vrt_node.memory);
-      putNet64(receiver, elem->counterBlock.host_vrt_node.memory_free);
-      putNet32(receiver, elem->counterBlock.host_vrt_node.num_domains);
-      break;
-    case SFLCOUNTERS_HOST_VRT_CPU:
-      putNet32(receiver, elem->counterBlock.host_vrt_cpu.state);
-      putNet32(receiver, elem->counterBlock.host_vrt_cpu.cpuTime);
-      putNet32(receiver, elem->counterBlock.host_vrt_cpu.nrVirtCpu);
-      break;
-    case SFLCOUNTERS_HOST_VRT_MEM:
-      putNet64(receiver, elem->counterBlock.host_vrt_mem.memory);
-      putNet64(receiver, elem->counterBlock.host_vrt_mem.maxMemory);
-      break;
-    case SFLCOUNTERS_HOST_VRT_DSK:
-      putNet64(receiver, elem->counterBlock.host_vrt_dsk.capacity);
-      putNet64(receiver, elem->counterBlock.host_vrt_dsk.allocation);
-      putNet64(receiver, elem->counterBlock.host_vrt_dsk.available);
-      putNet32(receiver, elem->counterBlock.host_vrt_dsk.rd_req);
-      putNet64(receiver, elem->counterBlock.host_vrt_dsk.rd_bytes);
-      putNet32(receiver, elem->counterBlock.host_vrt_dsk.wr_req);
-      putNet64(receiver, elem->counterBlock.host_vrt_dsk.wr_bytes);
-      putNet32(receiver, elem->counterBlock.host_vrt_dsk.errs);
-      break;
-    case SFLCOUNTERS_HOST_VRT_NIO:
-      putNet64(receiver, elem->counterBlock.host_vrt_nio.bytes_in);
-      putNet32(receiver, elem->counterBlock.host_vrt_nio.pkts_in);
-      putNet32(receiver, elem->counterBlock.host_vrt_nio.errs_in);
-      putNet32(receiver, elem->counterBlock.host_vrt_nio.drops_in);
-      putNet64(receiver, elem->counterBlock.host_vrt_nio.bytes_out);
-      putNet32(receiver, elem->counterBlock.host_vrt_nio.pkts_out);
-      putNet32(receiver, elem->counterBlock.host_vrt_nio.errs_out);
-      putNet32(receiver, elem->counterBlock.host_vrt_nio.drops_out);
-      break; 
-    case SFLCOUNTERS_HOST_GPU_NVML:
-      putNet32(receiver, elem->counterBlock.host_gpu_nvml.device_count);
-      putNet32(receiver, elem->counterBlock.host_gpu_nvml.processes);
-      putNet32(receiver, elem->counterBlock.host_gpu_nvml.gpu_time);
-      putNet32(receiver, elem->counterBlock.host_gpu_nvml.mem_time);
-      putNet64(receiver, elem->counterBlock.host_gpu_nvml.mem_total);
-      putNet64(receiver, elem->counterBlock.host_gpu_nvml.mem_free);
-      putNet32(receiver, elem->counterBlock.host_gpu_nvml.ecc_errors);
-      putNet32(receiver, elem->counterBlock.host_gpu_nvml.energy);
-      putNet32(receiver, elem->counterBlock.host_gpu_nvml.temperature);
-      putNet32(receiver, elem->counterBlock.host_gpu_nvml.fan_speed);
-      break;
+  nump = receiver->sampleCollector.datap++; // back-patched below
 
-    case SFLCOUNTERS_HOST_IP:
-      putNet32_run(receiver, &elem->counterBlock.host_ip, XDRSIZ_IP_COUNTERS / 4);
-      break;
-    case SFLCOUNTERS_HOST_ICMP:
-      putNet32_run(receiver, &elem->counterBlock.host_icmp, XDRSIZ_ICMP_COUNTERS / 4);
-      break;
-    case SFLCOUNTERS_HOST_TCP:
-      putNet32_run(receiver, &elem->counterBlock.host_tcp, XDRSIZ_TCP_COUNTERS / 4);
-      break;
-    case SFLCOUNTERS_HOST_UDP:
-      putNet32_run(receiver, &elem->counterBlock.host_udp, XDRSIZ_UDP_COUNTERS / 4);
-      break;
-
-    case SFLCOUNTERS_APP:
-      putString(receiver, &elem->counterBlock.app.application);
-      putNet32(receiver, elem->counterBlock.app.status_OK);
-      putNet32(receiver, elem->counterBlock.app.errors_OTHER);
-      putNet32(receiver, elem->counterBlock.app.errors_TIMEOUT);
-      putNet32(receiver, elem->counterBlock.app.errors_INTERNAL_ERROR);
-      putNet32(receiver, elem->counterBlock.app.errors_BAD_REQUEST);
-      putNet32(receiver, elem->counterBlock.app.errors_FORBIDDEN);
-      putNet32(receiver, elem->counterBlock.app.errors_TOO_LARGE);
-      putNet32(receiver, elem->counterBlock.app.errors_NOT_IMPLEMENTED);
-      putNet32(receiver, elem->counterBlock.app.errors_NOT_FOUND);
-      putNet32(receiver, elem->counterBlock.app.errors_UNAVAILABLE);
-      putNet32(receiver, elem->counterBlock.app.errors_UNAUTHORIZED);
-      break; 
-    case SFLCOUNTERS_APP_RESOURCES:
-      putNet32(receiver, elem->counterBlock.appResources.user_time);
-      putNet32(receiver, elem->counterBlock.appResources.system_time);
-      putNet64(receiver, elem->counterBlock.appResources.mem_used);
-      putNet64(receiver, elem->counterBlock.appResources.mem_max);
-      putNet32(receiver, elem->counterBlock.appResources.fd_open);
-      putNet32(receiver, elem->counterBlock.appResources.fd_max);
-      putNet32(receiver, elem->counterBlock.appResources.conn_open);
-      putNet32(receiver, elem->counterBlock.appResources.conn_max);
-      break;
-    case SFLCOUNTERS_APP_WORKERS:
-      putNet32(receiver, elem->counterBlock.appWorkers.workers_active);
-      putNet32(receiver, elem->counterBlock.appWorkers.workers_idle);
-      putNet32(receiver, elem->counterBlock.appWorkers.workers_max);
-      putNet32(receiver, elem->counterBlock.appWorkers.req_delayed);
-      putNet32(receiver, elem->counterBlock.appWorkers.req_dropped);
-      break;
-    case SFLCOUNTERS_PORTNAME: 
-      putString(receiver, &elem->counterBlock.portName.portName);
-      break;
-    case SFLCOUNTERS_BCM_TABLES:
-      putNet32_run(receiver, &elem->counterBlock.bcm_tables, XDRSIZ_BCM_TABLES / 4);
-      break;
-
-    default:
-      {
-	char errm[128];
-	sprintf(errm, "unexpected counters tag (%u)", elem->tag);
-	sflError(receiver, errm);
-	return -1;
+  if(hit) {
+    // splice in the pre-encoded static elements
+    if(((u_char *)receiver->sampleCollector.datap + hit->len) > limit) {
+      sflError(receiver, SFL_COUNTERS_TOO_BIG);
+      return -1;
+    }
+    memcpy(receiver->sampleCollector.datap, hit->xdr, hit->len);
+    receiver->sampleCollector.datap += (hit->len / 4);
+  }
+  else if(cache) {
+    // encode the static elements here,  and remember the result
+    uint32_t *staticStart = receiver->sampleCollector.datap;
+    uint32_t tags[SFL_STATIC_CACHE_MAX_ELEMENTS];
+    uint32_t n = 0;
+    for(elem = cs->elements; elem != NULL; elem = elem->nxt) {
+      if(!isStaticElement(elem->tag)) continue;
+      if(n == SFL_STATIC_CACHE_MAX_ELEMENTS) {
+	/* too many to remember - don't cache this one */
+	cache = NULL;
+	break;
       }
-      break;
+      tags[n++] = elem->tag;
+      if(putCountersElement(receiver, elem, limit) == -1) return -1;
+    }
+    if(cache) {
+      uint32_t len = (uint32_t)((u_char *)receiver->sampleCollector.datap - (u_char *)staticStart);
+      if(sfl_agent_staticCacheAlloc(receiver->agent, cache, len)) {
+	memcpy(cache->xdr, staticStart, len);
+	memcpy(cache->tags, tags, n * sizeof(uint32_t));
+	cache->len = len;
+	cache->num_elements = n;
+	cache->revision = revision;
+      }
+    }
+    else {
+      /* write the rest of the static elements normally */
+      for(; elem != NULL; elem = elem->nxt)
+	if(isStaticElement(elem->tag)
+	   && putCountersElement(receiver, elem, limit) == -1) return -1;
     }
   }
-  // sanity check
-  assert(((u_char *)receiver->sampleCollector.datap
-	  - (u_char *)receiver->sampleCollector.data
-	  - receiver->sampleCollector.pktlen)  == (uint32_t)packedSize);
 
-  // update the pktlen
-  receiver->sampleCollector.pktlen = (uint32_t)((u_char *)receiver->sampleCollector.datap - (u_char *)receiver->sampleCollector.data);
-  return packedSize;
+  cs->num_elements = 0; /* we're going to count them again even if this was set by the client */
+  for(elem = cs->elements; elem != NULL; elem = elem->nxt) {
+    cs->num_elements++;
+    if(staticFirst && isStaticElement(elem->tag)) continue;
+    if(putCountersElement(receiver, elem, limit) == -1) return -1;
+  }
+
+  packedSize = (uint32_t)((u_char *)receiver->sampleCollector.datap - (u_char *)start);
+  *lenp = htonl(packedSize - 8); // tag and length not included
+  *nump = htonl(cs->num_elements);
+  commitSample(receiver, start, packedSize);
+  return (int)packedSize;
 }
 
 /*_________________-------------------------------__________________
@@ -1276,9 +1407,12 @@ static void sendSample(SFLReceiver *receiver)
   receiver->sampleCollector.datap = receiver->sampleCollector.data;
   putNet32(receiver, SFLDATAGRAM_VERSION5);
   putAddress(receiver, &agent->myIP);
-  putNet32(receiver, agent->subId);
+  putNet32(receiver, agent->subId + receiver->shardId);
   putNet32(receiver, ++receiver->sampleCollector.packetSeqNo);
-  putNet32(receiver, sfl_agent_uptime_mS(agent));
+  if(receiver->shardId)
+    putNet32(receiver, ((receiver->now - agent->bootTime) * 1000) + (receiver->now_nS / 1000000));
+  else
+    putNet32(receiver, sfl_agent_uptime_mS(agent));
   putNet32(receiver, receiver->sampleCollector.numSamples);
   
   /* send */
@@ -1329,8 +1463,8 @@ static void resetSampleCollector(SFLReceiver *receiver)
   receiver->sampleCollector.pktlen = 0;
   receiver->sampleCollector.numSamples = 0;
 
-  /* clear the buffer completely (ensures that pad bytes will always be zeros - thank you CW) */
-  memset((u_char *)receiver->sampleCollector.data, 0, (SFL_SAMPLECOLLECTOR_DATA_QUADS * 4));
+  /* clear the datagram part of the buffer (ensures that pad bytes will always be zeros - thank you CW) */
+  memset((u_char *)receiver->sampleCollector.data, 0, SFL_SAMPLECOLLECTOR_DATAGRAM_BYTES);
 
   /* point the datap to just after the header */
   receiver->sampleCollector.datap = (receiver->agent->myIP.type == SFLADDRESSTYPE_IP_V6) ?
@@ -1352,6 +1486,9 @@ static void sflError(SFLReceiver *receiver, char *msg)
   resetSampleCollector(receiver);
 }
 
+#ifdef SFL_REFERENCE_ENCODER
+#include "sflow_receiver_ref.c"
+#endif
 
 #if defined(__cplusplus)
 } /* extern "C" */
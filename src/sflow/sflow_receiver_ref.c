@@ -0,0 +1,810 @@
+/* This software is distributed under the following license:
+ * http://sflow.net/license.html
+ */
+
+/* The original two-pass encoder: compute the sample size with one walk
+   of the element list,  then encode with another. Kept as the reference
+   for the byte-for-byte equivalence tests in sflow_xdr_bench.c,  and not
+   part of libsflow. It is #included at the end of sflow_receiver.c when
+   SFL_REFERENCE_ENCODER is defined,  so it shares that file's helpers. */
+
+static void putNet32_run_scalar(SFLReceiver *receiver, void *obj, size_t quads)
+{
+  uint32_t *from = (uint32_t *)obj;
+  while(quads--) putNet32(receiver, *from++);
+}
+
+static void putNetFloat(SFLReceiver *receiver, float val)
+{
+  // not sure how to byte-swap a float - just alias it to an int32
+  uint32_t reg32;
+  memcpy(&reg32, &val, 4);
+  putNet32(receiver, reg32);
+}
+
+static void putSampledEthernet(SFLReceiver *receiver, SFLSampled_ethernet *ethernet)
+{
+  putNet32(receiver, ethernet->eth_len);
+  putMACAddress(receiver, ethernet->src_mac);
+  putMACAddress(receiver, ethernet->dst_mac);
+  putNet32(receiver, ethernet->eth_type);
+}
+
+static void putSampledIPv4(SFLReceiver *receiver, SFLSampled_ipv4 *ipv4)
+{
+  putNet32(receiver, ipv4->length);
+  putNet32(receiver, ipv4->protocol);
+  put32(receiver, ipv4->src_ip.addr);
+  put32(receiver, ipv4->dst_ip.addr);
+  putNet32(receiver, ipv4->src_port);
+  putNet32(receiver, ipv4->dst_port);
+  putNet32(receiver, ipv4->tcp_flags);
+  putNet32(receiver, ipv4->tos);
+}
+
+static void putSampledIPv6(SFLReceiver *receiver, SFLSampled_ipv6 *ipv6)
+{
+  putNet32(receiver, ipv6->length);
+  putNet32(receiver, ipv6->protocol);
+  put128(receiver, ipv6->src_ip.addr);
+  put128(receiver, ipv6->dst_ip.addr);
+  putNet32(receiver, ipv6->src_port);
+  putNet32(receiver, ipv6->dst_port);
+  putNet32(receiver, ipv6->tcp_flags);
+  putNet32(receiver, ipv6->priority);
+}
+
+static void putSwitch(SFLReceiver *receiver, SFLExtended_switch *sw)
+{
+  putNet32(receiver, sw->src_vlan);
+  putNet32(receiver, sw->src_priority);
+  putNet32(receiver, sw->dst_vlan);
+  putNet32(receiver, sw->dst_priority);
+}
+
+static void putMplsLdpFec(SFLReceiver *receiver, SFLExtended_mpls_LDP_FEC *ldpfec)
+{
+  putNet32(receiver, ldpfec->mplsFecAddrPrefixLength);
+}
+
+static uint32_t mplsLdpFecEncodingLength(SFLExtended_mpls_LDP_FEC *ldpfec) {
+  return 4;
+}
+
+static uint32_t tunnelDecapEncodingLength(SFLExtended_decapsulate *decap) {
+  return 4;
+}
+
+static uint32_t tunnelVniEncodingLength(SFLExtended_vni *vni) {
+  return 4;
+}
+
+static void putVlanTunnel(SFLReceiver *receiver, SFLExtended_vlan_tunnel *vlanTunnel)
+{
+  putLabelStack(receiver, &vlanTunnel->stack);
+}
+
+static uint32_t vlanTunnelEncodingLength(SFLExtended_vlan_tunnel *vlanTunnel) {
+  return labelStackEncodingLength(&vlanTunnel->stack);
+}
+
+static void putGenericCounters(SFLReceiver *receiver, SFLIf_counters *counters)
+{
+  putNet32(receiver, counters->ifIndex);
+  putNet32(receiver, counters->ifType);
+  putNet64(receiver, counters->ifSpeed);
+  putNet32(receiver, counters->ifDirection);
+  putNet32(receiver, counters->ifStatus);
+  putNet64(receiver, counters->ifInOctets);
+  putNet32(receiver, counters->ifInUcastPkts);
+  putNet32(receiver, counters->ifInMulticastPkts);
+  putNet32(receiver, counters->ifInBroadcastPkts);
+  putNet32(receiver, counters->ifInDiscards);
+  putNet32(receiver, counters->ifInErrors);
+  putNet32(receiver, counters->ifInUnknownProtos);
+  putNet64(receiver, counters->ifOutOctets);
+  putNet32(receiver, counters->ifOutUcastPkts);
+  putNet32(receiver, counters->ifOutMulticastPkts);
+  putNet32(receiver, counters->ifOutBroadcastPkts);
+  putNet32(receiver, counters->ifOutDiscards);
+  putNet32(receiver, counters->ifOutErrors);
+  putNet32(receiver, counters->ifPromiscuousMode);
+}
+
+static void putSocket4(SFLReceiver *receiver, SFLExtended_socket_ipv4 *socket4) {
+    putNet32(receiver, socket4->protocol);
+    put32(receiver, socket4->local_ip.addr);
+    put32(receiver, socket4->remote_ip.addr);
+    putNet32(receiver, socket4->local_port);
+    putNet32(receiver, socket4->remote_port);
+}
+
+static void putSocket6(SFLReceiver *receiver, SFLExtended_socket_ipv6 *socket6) {
+    putNet32(receiver, socket6->protocol);
+    put128(receiver, socket6->local_ip.addr);
+    put128(receiver, socket6->remote_ip.addr);
+    putNet32(receiver, socket6->local_port);
+    putNet32(receiver, socket6->remote_port);
+}
+
+static void putTCPInfo(SFLReceiver *receiver, SFLExtended_TCP_info *tcp_info) {
+    putNet32(receiver, tcp_info->dirn);
+    putNet32(receiver, tcp_info->snd_mss);
+    putNet32(receiver, tcp_info->rcv_mss);
+    putNet32(receiver, tcp_info->unacked);
+    putNet32(receiver, tcp_info->lost);
+    putNet32(receiver, tcp_info->retrans);
+    putNet32(receiver, tcp_info->pmtu);
+    putNet32(receiver, tcp_info->rtt);
+    putNet32(receiver, tcp_info->rttvar);
+    putNet32(receiver, tcp_info->snd_cwnd);
+    putNet32(receiver, tcp_info->reordering);
+    putNet32(receiver, tcp_info->min_rtt);
+}
+
+static uint32_t appResourcesEncodingLength(SFLAPPResources *appresource) {
+  uint32_t elemSiz = 0;
+  elemSiz += 6 * 4; // 6x32-bit
+  elemSiz += 2 * 8; // 2x64-bit (mem) gauges
+  return elemSiz;
+}
+
+static uint32_t appWorkersEncodingLength(SFLAPPWorkers *appworkers) {
+  uint32_t elemSiz = 0;
+  elemSiz += 5 * 4; // 5x32-bit
+  return elemSiz;
+}
+
+/*_________________-----------------------------__________________
+  _________________      computeFlowSampleSize  __________________
+  -----------------_____________________________------------------
+*/
+
+static int computeFlowSampleSize(SFLReceiver *receiver, SFL_FLOW_SAMPLE_TYPE *fs)
+{
+  SFLFlow_sample_element *elem;
+  uint32_t elemSiz;
+#ifdef SFL_USE_32BIT_INDEX
+  uint siz = 52; /* tag, length, sequence_number, ds_class, ds_index, sampling_rate,
+		     sample_pool, drops, inputFormat, input, outputFormat, output, number of elements */
+#else
+  uint32_t siz = 40; /* tag, length, sequence_number, source_id, sampling_rate,
+		     sample_pool, drops, input, output, number of elements */
+#endif
+
+  fs->num_elements = 0; /* we're going to count them again even if this was set by the client */
+  for(elem = fs->elements; elem != NULL; elem = elem->nxt) {
+    fs->num_elements++;
+    siz += 8; /* tag, length */
+    elemSiz = 0;
+    switch(elem->tag) {
+    case SFLFLOW_HEADER:
+      elemSiz = 16; /* header_protocol, frame_length, stripped, header_length */
+      elemSiz += ((elem->flowType.header.header_length + 3) / 4) * 4; /* header, rounded up to nearest 4 bytes */
+      break;
+    case SFLFLOW_ETHERNET: elemSiz = sizeof(SFLSampled_ethernet); break;
+    case SFLFLOW_IPV4: elemSiz = sizeof(SFLSampled_ipv4); break;
+    case SFLFLOW_IPV6: elemSiz = sizeof(SFLSampled_ipv6); break;
+    case SFLFLOW_EX_SWITCH: elemSiz = sizeof(SFLExtended_switch); break;
+    case SFLFLOW_EX_ROUTER: elemSiz = routerEncodingLength(&elem->flowType.router); break;
+    case SFLFLOW_EX_GATEWAY: elemSiz = gatewayEncodingLength(&elem->flowType.gateway); break;
+    case SFLFLOW_EX_USER: elemSiz = userEncodingLength(&elem->flowType.user); break;
+    case SFLFLOW_EX_URL: elemSiz = urlEncodingLength(&elem->flowType.url); break;
+    case SFLFLOW_EX_MPLS: elemSiz = mplsEncodingLength(&elem->flowType.mpls); break;
+    case SFLFLOW_EX_NAT: elemSiz = natEncodingLength(&elem->flowType.nat); break;
+    case SFLFLOW_EX_MPLS_TUNNEL: elemSiz = mplsTunnelEncodingLength(&elem->flowType.mpls_tunnel); break;
+    case SFLFLOW_EX_MPLS_VC: elemSiz = mplsVcEncodingLength(&elem->flowType.mpls_vc); break;
+    case SFLFLOW_EX_MPLS_FTN: elemSiz = mplsFtnEncodingLength(&elem->flowType.mpls_ftn); break;
+    case SFLFLOW_EX_MPLS_LDP_FEC: elemSiz = mplsLdpFecEncodingLength(&elem->flowType.mpls_ldp_fec); break;
+    case SFLFLOW_EX_VLAN_TUNNEL: elemSiz = vlanTunnelEncodingLength(&elem->flowType.vlan_tunnel); break;
+	case SFLFLOW_EX_L2_TUNNEL_EGRESS:
+	case SFLFLOW_EX_L2_TUNNEL_INGRESS: elemSiz = sizeof(SFLExtended_l2_tunnel); break;
+	case SFLFLOW_EX_IPV4_TUNNEL_EGRESS:
+	case SFLFLOW_EX_IPV4_TUNNEL_INGRESS: elemSiz = sizeof(SFLExtended_ipv4_tunnel); break;
+	case SFLFLOW_EX_DECAP_EGRESS:
+	case SFLFLOW_EX_DECAP_INGRESS: elemSiz = tunnelDecapEncodingLength(&elem->flowType.tunnel_decap); break;
+	case SFLFLOW_EX_VNI_EGRESS:
+	case SFLFLOW_EX_VNI_INGRESS: elemSiz = tunnelVniEncodingLength(&elem->flowType.tunnel_vni); break;
+    case SFLFLOW_APP: elemSiz = appEncodingLength(&elem->flowType.app); break;
+    case SFLFLOW_APP_CTXT: elemSiz = appContextLength(&elem->flowType.context); break;
+    case SFLFLOW_APP_ACTOR_INIT:
+    case SFLFLOW_APP_ACTOR_TGT: elemSiz = stringEncodingLength(&elem->flowType.actor.actor); break;
+    case SFLFLOW_EX_PROXY_SOCKET4:
+    case SFLFLOW_EX_SOCKET4: elemSiz = XDRSIZ_SFLEXTENDED_SOCKET4;  break;
+    case SFLFLOW_EX_PROXY_SOCKET6:
+    case SFLFLOW_EX_SOCKET6: elemSiz = XDRSIZ_SFLEXTENDED_SOCKET6;  break;
+    case SFLFLOW_EX_TCP_INFO: elemSiz = XDRSIZ_SFLEXTENDED_TCP_INFO;  break;
+    default:
+      sflError(receiver, "unexpected packet_data_tag");
+      return -1;
+      break;
+    }
+    // cache the element size, and accumulate it into the overall FlowSample size
+    elem->length = elemSiz;
+    siz += elemSiz;
+  }
+
+  return siz;
+}
+
+/*_________________-------------------------------__________________
+  _________________ sfl_receiver_writeFlowSample_ref  ______________
+  -----------------_______________________________------------------
+*/
+
+int sfl_receiver_writeFlowSample_ref(SFLReceiver *receiver, SFL_FLOW_SAMPLE_TYPE *fs)
+{
+  int packedSize;
+  SFLFlow_sample_element *elem;
+
+  if(fs == NULL) return -1;
+  if((packedSize = computeFlowSampleSize(receiver, fs)) == -1) return -1;
+
+  // check in case this one sample alone is too big for the datagram
+  // in fact - if it is even half as big then we should ditch it. Very
+  // important to avoid overruning the packet buffer.
+  if(packedSize > (int)(receiver->sFlowRcvrMaximumDatagramSize)) {
+    sflError(receiver, "flow sample too big for datagram");
+    return -1;
+  }
+
+  // if the sample pkt is full enough so that this sample might put
+  // it over the limit, then we should send it now before going on.
+  if((receiver->sampleCollector.pktlen + packedSize) >= receiver->sFlowRcvrMaximumDatagramSize)
+    sendSample(receiver);
+    
+  receiver->sampleCollector.numSamples++;
+
+#ifdef SFL_USE_32BIT_INDEX
+  putNet32(receiver, SFLFLOW_SAMPLE_EXPANDED);
+#else
+  putNet32(receiver, SFLFLOW_SAMPLE);
+#endif
+
+  putNet32(receiver, packedSize - 8); // don't include tag and len
+  putNet32(receiver, fs->sequence_number);
+
+#ifdef SFL_USE_32BIT_INDEX
+  putNet32(receiver, fs->ds_class);
+  putNet32(receiver, fs->ds_index);
+#else
+  putNet32(receiver, fs->source_id);
+#endif
+
+  putNet32(receiver, fs->sampling_rate);
+  putNet32(receiver, fs->sample_pool);
+  putNet32(receiver, fs->drops);
+
+#ifdef SFL_USE_32BIT_INDEX
+  putNet32(receiver, fs->inputFormat);
+  putNet32(receiver, fs->input);
+  putNet32(receiver, fs->outputFormat);
+  putNet32(receiver, fs->output);
+#else
+  putNet32(receiver, fs->input);
+  putNet32(receiver, fs->output);
+#endif
+
+  putNet32(receiver, fs->num_elements);
+
+  for(elem = fs->elements; elem != NULL; elem = elem->nxt) {
+
+    putNet32(receiver, elem->tag);
+    putNet32(receiver, elem->length); // length cached in computeFlowSampleSize()
+
+    switch(elem->tag) {
+    case SFLFLOW_HEADER:
+    putNet32(receiver, elem->flowType.header.header_protocol);
+    putNet32(receiver, elem->flowType.header.frame_length);
+    putNet32(receiver, elem->flowType.header.stripped);
+    putNet32(receiver, elem->flowType.header.header_length);
+    /* the header */
+    memcpy(receiver->sampleCollector.datap, elem->flowType.header.header_bytes, elem->flowType.header.header_length);
+    /* round up to multiple of 4 to preserve alignment */
+    receiver->sampleCollector.datap += ((elem->flowType.header.header_length + 3) / 4);
+      break;
+	case SFLFLOW_ETHERNET: putSampledEthernet(receiver, &elem->flowType.ethernet); break;
+	case SFLFLOW_IPV4: putSampledIPv4(receiver, &elem->flowType.ipv4); break;
+	case SFLFLOW_IPV6: putSampledIPv6(receiver, &elem->flowType.ipv6); break;
+    case SFLFLOW_EX_SWITCH: putSwitch(receiver, &elem->flowType.sw); break;
+    case SFLFLOW_EX_ROUTER: putRouter(receiver, &elem->flowType.router); break;
+    case SFLFLOW_EX_GATEWAY: putGateway(receiver, &elem->flowType.gateway); break;
+    case SFLFLOW_EX_USER: putUser(receiver, &elem->flowType.user); break;
+    case SFLFLOW_EX_URL: putUrl(receiver, &elem->flowType.url); break;
+    case SFLFLOW_EX_MPLS: putMpls(receiver, &elem->flowType.mpls); break;
+    case SFLFLOW_EX_NAT: putNat(receiver, &elem->flowType.nat); break;
+    case SFLFLOW_EX_MPLS_TUNNEL: putMplsTunnel(receiver, &elem->flowType.mpls_tunnel); break;
+    case SFLFLOW_EX_MPLS_VC: putMplsVc(receiver, &elem->flowType.mpls_vc); break;
+    case SFLFLOW_EX_MPLS_FTN: putMplsFtn(receiver, &elem->flowType.mpls_ftn); break;
+    case SFLFLOW_EX_MPLS_LDP_FEC: putMplsLdpFec(receiver, &elem->flowType.mpls_ldp_fec); break;
+    case SFLFLOW_EX_VLAN_TUNNEL: putVlanTunnel(receiver, &elem->flowType.vlan_tunnel); break;
+	case SFLFLOW_EX_L2_TUNNEL_EGRESS: 
+	case SFLFLOW_EX_L2_TUNNEL_INGRESS:
+		putSampledEthernet(receiver, &elem->flowType.tunnel_l2.header);
+		break;
+	case SFLFLOW_EX_IPV4_TUNNEL_EGRESS:
+	case SFLFLOW_EX_IPV4_TUNNEL_INGRESS:
+		putSampledIPv4(receiver, &elem->flowType.tunnel_ipv4.header);
+		break;
+	case SFLFLOW_EX_IPV6_TUNNEL_EGRESS:
+	case SFLFLOW_EX_IPV6_TUNNEL_INGRESS:
+		putSampledIPv6(receiver, &elem->flowType.tunnel_ipv6.header);
+		break;
+	case SFLFLOW_EX_DECAP_EGRESS:
+	case SFLFLOW_EX_DECAP_INGRESS:
+		putNet32(receiver, elem->flowType.tunnel_decap.inner_header_offset);
+		break;
+	case SFLFLOW_EX_VNI_EGRESS:
+	case SFLFLOW_EX_VNI_INGRESS:
+		putNet32(receiver, elem->flowType.tunnel_vni.vni);
+		break;
+    case SFLFLOW_APP: putAPP(receiver, &elem->flowType.app); break;
+    case SFLFLOW_APP_CTXT: putAPPContext(receiver, &elem->flowType.context); break;
+    case SFLFLOW_APP_ACTOR_INIT:
+    case SFLFLOW_APP_ACTOR_TGT: putString(receiver, &elem->flowType.actor.actor); break;
+    case SFLFLOW_EX_PROXY_SOCKET4:
+    case SFLFLOW_EX_SOCKET4: putSocket4(receiver, &elem->flowType.socket4); break;
+    case SFLFLOW_EX_PROXY_SOCKET6:
+    case SFLFLOW_EX_SOCKET6: putSocket6(receiver, &elem->flowType.socket6); break;
+    case SFLFLOW_EX_TCP_INFO: putTCPInfo(receiver, &elem->flowType.tcp_info); break;
+    default:
+      sflError(receiver, "unexpected packet_data_tag");
+      return -1;
+      break;
+    }
+  }
+
+  // sanity check
+  assert(((u_char *)receiver->sampleCollector.datap
+	  - (u_char *)receiver->sampleCollector.data
+	  - receiver->sampleCollector.pktlen)  == (uint32_t)packedSize);
+
+  // update the pktlen
+  receiver->sampleCollector.pktlen = (uint32_t)((u_char *)receiver->sampleCollector.datap - (u_char *)receiver->sampleCollector.data);
+
+  // if the sample pkt is full enough so that another packet-sample the same size would
+  // put it over the size threshold, then just send it now.  After all,  if we waited and then
+  // reacted when the next sample came we would just be sending the same datagram... only delayed.
+  if((receiver->sampleCollector.pktlen + packedSize) >= receiver->sFlowRcvrMaximumDatagramSize)
+    sendSample(receiver);
+
+  return packedSize;
+}
+
+/*_________________-----------------------------__________________
+  _________________ countersElementSize         __________________
+  -----------------_____________________________------------------
+*/
+
+static int countersElementSize(SFLReceiver *receiver, SFLCounters_sample_element *elem)
+{
+  uint32_t elemSiz = 0;
+  /* here we are assuming that the structure fields are not expanded to be 64-bit aligned,
+     because then the sizeof(struct) would be larger than the wire-encoding. */
+
+  switch(elem->tag) {
+  case SFLCOUNTERS_GENERIC:  elemSiz = sizeof(elem->counterBlock.generic); break;
+  case SFLCOUNTERS_ETHERNET: elemSiz = sizeof(elem->counterBlock.ethernet); break;
+  case SFLCOUNTERS_TOKENRING: elemSiz = sizeof(elem->counterBlock.tokenring); break;
+  case SFLCOUNTERS_VG: elemSiz = sizeof(elem->counterBlock.vg); break;
+  case SFLCOUNTERS_VLAN: elemSiz = sizeof(elem->counterBlock.vlan); break;
+  case SFLCOUNTERS_LACP: elemSiz = XDRSIZ_LACP_COUNTERS; break;
+  case SFLCOUNTERS_SFP: elemSiz = sfpEncodingLength(&elem->counterBlock.sfp); break;
+  case SFLCOUNTERS_PROCESSOR: elemSiz = sizeof(elem->counterBlock.processor);  break;
+  case SFLCOUNTERS_HOST_HID: elemSiz = hostIdEncodingLength(&elem->counterBlock.host_hid);  break;
+  case SFLCOUNTERS_HOST_PAR: elemSiz = 8 /*sizeof(elem->counterBlock.host_par)*/;  break;
+  case SFLCOUNTERS_ADAPTORS: elemSiz = adaptorListEncodingLength(elem->counterBlock.adaptors);  break;
+  case SFLCOUNTERS_HOST_CPU: elemSiz = 80 /*sizeof(elem->counterBlock.host_cpu)*/;  break;
+  case SFLCOUNTERS_HOST_MEM: elemSiz = 72 /*sizeof(elem->counterBlock.host_mem)*/ ;  break;
+  case SFLCOUNTERS_HOST_DSK: elemSiz = 52 /*sizeof(elem->counterBlock.host_dsk)*/;  break;
+  case SFLCOUNTERS_HOST_NIO: elemSiz = 40 /*sizeof(elem->counterBlock.host_nio)*/;  break;
+  case SFLCOUNTERS_HOST_IP: elemSiz = XDRSIZ_IP_COUNTERS;  break;
+  case SFLCOUNTERS_HOST_ICMP: elemSiz = XDRSIZ_ICMP_COUNTERS;  break;
+  case SFLCOUNTERS_HOST_TCP: elemSiz = XDRSIZ_TCP_COUNTERS;  break;
+  case SFLCOUNTERS_HOST_UDP: elemSiz = XDRSIZ_UDP_COUNTERS;  break;
+  case SFLCOUNTERS_HOST_VRT_NODE: elemSiz = 28 /*sizeof(elem->counterBlock.host_vrt_node)*/;  break;
+  case SFLCOUNTERS_HOST_VRT_CPU: elemSiz = 12 /*sizeof(elem->counterBlock.host_vrt_cpu)*/;  break;
+  case SFLCOUNTERS_HOST_VRT_MEM: elemSiz = 16 /*sizeof(elem->counterBlock.host_vrt_mem)*/;  break;
+  case SFLCOUNTERS_HOST_VRT_DSK: elemSiz = 52 /*sizeof(elem->counterBlock.host_vrt_dsk)*/;  break;
+  case SFLCOUNTERS_HOST_VRT_NIO: elemSiz = 40 /*sizeof(elem->counterBlock.host_vrt_nio)*/;  break;
+  case SFLCOUNTERS_HOST_GPU_NVML: elemSiz = 48 /*sizeof(elem->counterBlock.host_gpu_nvml)*/;  break;
+  case SFLCOUNTERS_APP:  elemSiz = appCountersEncodingLength(&elem->counterBlock.app); break;
+  case SFLCOUNTERS_APP_RESOURCES:  elemSiz = appResourcesEncodingLength(&elem->counterBlock.appResources); break;
+  case SFLCOUNTERS_APP_WORKERS:  elemSiz = appWorkersEncodingLength(&elem->counterBlock.appWorkers); break;
+  case SFLCOUNTERS_PORTNAME:  elemSiz = stringEncodingLength(&elem->counterBlock.portName.portName); break;
+  case SFLCOUNTERS_BCM_TABLES: elemSiz = XDRSIZ_BCM_TABLES;  break;
+  default:
+    {
+      char errm[128];
+      sprintf(errm, "computeCounterSampleSize(): unexpected counters tag (%u)", elem->tag);
+      sflError(receiver, errm);
+      return -1;
+    }
+    break;
+  }
+  return (int)elemSiz;
+}
+
+/*_________________-----------------------------__________________
+  _________________ computeCountersSampleSize   __________________
+  -----------------_____________________________------------------
+*/
+
+static int computeCountersSampleSize(SFLReceiver *receiver, SFL_COUNTERS_SAMPLE_TYPE *cs, SFLStaticCountersCache *hit)
+{
+  SFLCounters_sample_element *elem;
+  int elemSiz;
+
+#ifdef SFL_USE_32BIT_INDEX
+  uint siz = 24; /* tag, length, sequence_number, ds_class, ds_index, number of elements */
+#else
+  uint32_t siz = 20; /* tag, length, sequence_number, source_id, number of elements */
+#endif
+
+  cs->num_elements = 0; /* we're going to count them again even if this was set by the client */
+  if(hit) siz += hit->len; /* already encoded, including tag and length */
+  for( elem = cs->elements; elem != NULL; elem = elem->nxt) {
+    cs->num_elements++;
+    if(hit && isStaticElement(elem->tag)) continue;
+    siz += 8; /* tag, length */
+    if((elemSiz = countersElementSize(receiver, elem)) == -1)
+      return -1;
+    // cache the element size, and accumulate it into the overall FlowSample size
+    elem->length = elemSiz;
+    siz += elemSiz;
+  }
+  return siz;
+}
+
+/*_________________-----------------------------__________________
+  _________________ putCountersElement_ref      __________________
+  -----------------_____________________________------------------
+*/
+
+static int putCountersElement_ref(SFLReceiver *receiver, SFLCounters_sample_element *elem)
+{
+  putNet32(receiver, elem->tag);
+  putNet32(receiver, elem->length); // length cached in computeCountersSampleSize()
+
+  switch(elem->tag) {
+  case SFLCOUNTERS_GENERIC:
+    putGenericCounters(receiver, &(elem->counterBlock.generic));
+    break;
+  case SFLCOUNTERS_ETHERNET:
+    // all these counters are 32-bit
+    putNet32_run_scalar(receiver, &elem->counterBlock.ethernet, sizeof(elem->counterBlock.ethernet) / 4);
+    break;
+  case SFLCOUNTERS_TOKENRING:
+    // all these counters are 32-bit
+    putNet32_run_scalar(receiver, &elem->counterBlock.tokenring, sizeof(elem->counterBlock.tokenring) / 4);
+    break;
+  case SFLCOUNTERS_VG:
+    putNet32(receiver, elem->counterBlock.vg.dot12InHighPriorityFrames);
+    putNet64(receiver, elem->counterBlock.vg.dot12InHighPriorityOctets);
+    putNet32(receiver, elem->counterBlock.vg.dot12InNormPriorityFrames);
+    putNet64(receiver, elem->counterBlock.vg.dot12InNormPriorityOctets);
+    putNet32(receiver, elem->counterBlock.vg.dot12InIPMErrors);
+    putNet32(receiver, elem->counterBlock.vg.dot12InOversizeFrameErrors);
+    putNet32(receiver, elem->counterBlock.vg.dot12InDataErrors);
+    putNet32(receiver, elem->counterBlock.vg.dot12InNullAddressedFrames);
+    putNet32(receiver, elem->counterBlock.vg.dot12OutHighPriorityFrames);
+    putNet64(receiver, elem->counterBlock.vg.dot12OutHighPriorityOctets);
+    putNet32(receiver, elem->counterBlock.vg.dot12TransitionIntoTrainings);
+    putNet64(receiver, elem->counterBlock.vg.dot12HCInHighPriorityOctets);
+    putNet64(receiver, elem->counterBlock.vg.dot12HCInNormPriorityOctets);
+    putNet64(receiver, elem->counterBlock.vg.dot12HCOutHighPriorityOctets);
+    break;
+  case SFLCOUNTERS_VLAN:
+    putNet32(receiver, elem->counterBlock.vlan.vlan_id);
+    putNet64(receiver, elem->counterBlock.vlan.octets);
+    putNet32(receiver, elem->counterBlock.vlan.ucastPkts);
+    putNet32(receiver, elem->counterBlock.vlan.multicastPkts);
+    putNet32(receiver, elem->counterBlock.vlan.broadcastPkts);
+    putNet32(receiver, elem->counterBlock.vlan.discards);
+    break;
+  case SFLCOUNTERS_LACP:
+    putMACAddress(receiver, elem->counterBlock.lacp.actorSystemID);
+    putMACAddress(receiver, elem->counterBlock.lacp.partnerSystemID);
+    putNet32(receiver, elem->counterBlock.lacp.attachedAggID);
+    putNet32(receiver, elem->counterBlock.lacp.portState.all);
+    putNet32(receiver, elem->counterBlock.lacp.LACPDUsRx);
+    putNet32(receiver, elem->counterBlock.lacp.markerPDUsRx);
+    putNet32(receiver, elem->counterBlock.lacp.markerResponsePDUsRx);
+    putNet32(receiver, elem->counterBlock.lacp.unknownRx);
+    putNet32(receiver, elem->counterBlock.lacp.illegalRx);
+    putNet32(receiver, elem->counterBlock.lacp.LACPDUsTx);
+    putNet32(receiver, elem->counterBlock.lacp.markerPDUsTx);
+    putNet32(receiver, elem->counterBlock.lacp.markerResponsePDUsTx);
+    break;
+  case SFLCOUNTERS_SFP:
+    putSFP(receiver, &elem->counterBlock.sfp);
+    break;
+  case SFLCOUNTERS_PROCESSOR:
+    putNet32(receiver, elem->counterBlock.processor.five_sec_cpu);
+    putNet32(receiver, elem->counterBlock.processor.one_min_cpu);
+    putNet32(receiver, elem->counterBlock.processor.five_min_cpu);
+    putNet64(receiver, elem->counterBlock.processor.total_memory);
+    putNet64(receiver, elem->counterBlock.processor.free_memory);
+    break;
+  case SFLCOUNTERS_HOST_HID:
+    putString(receiver, &elem->counterBlock.host_hid.hostname);
+    put128(receiver, elem->counterBlock.host_hid.uuid);
+    putNet32(receiver, elem->counterBlock.host_hid.machine_type);
+    putNet32(receiver, elem->counterBlock.host_hid.os_name);
+    putString(receiver, &elem->counterBlock.host_hid.os_release);
+    break;
+  case SFLCOUNTERS_HOST_PAR:
+    putNet32(receiver, elem->counterBlock.host_par.dsClass);
+    putNet32(receiver, elem->counterBlock.host_par.dsIndex);
+    break;
+  case SFLCOUNTERS_ADAPTORS:
+    putAdaptorList(receiver, elem->counterBlock.adaptors);
+    break;
+  case SFLCOUNTERS_HOST_CPU:
+    putNetFloat(receiver, elem->counterBlock.host_cpu.load_one);
+    putNetFloat(receiver, elem->counterBlock.host_cpu.load_five);
+    putNetFloat(receiver, elem->counterBlock.host_cpu.load_fifteen);
+    putNet32(receiver, elem->counterBlock.host_cpu.proc_run);
+    putNet32(receiver, elem->counterBlock.host_cpu.proc_total);
+    putNet32(receiver, elem->counterBlock.host_cpu.cpu_num);
+    putNet32(receiver, elem->counterBlock.host_cpu.cpu_speed);
+    putNet32(receiver, elem->counterBlock.host_cpu.uptime);
+    putNet32(receiver, elem->counterBlock.host_cpu.cpu_user);
+    putNet32(receiver, elem->counterBlock.host_cpu.cpu_nice);
+    putNet32(receiver, elem->counterBlock.host_cpu.cpu_system);
+    putNet32(receiver, elem->counterBlock.host_cpu.cpu_idle);
+    putNet32(receiver, elem->counterBlock.host_cpu.cpu_wio);
+    putNet32(receiver, elem->counterBlock.host_cpu.cpu_intr);
+    putNet32(receiver, elem->counterBlock.host_cpu.cpu_sintr);
+    putNet32(receiver, elem->counterBlock.host_cpu.interrupts);
+    putNet32(receiver, elem->counterBlock.host_cpu.contexts);
+    putNet32(receiver, elem->counterBlock.host_cpu.cpu_steal);
+    putNet32(receiver, elem->counterBlock.host_cpu.cpu_guest);
+    putNet32(receiver, elem->counterBlock.host_cpu.cpu_guest_nice);
+    break;
+  case SFLCOUNTERS_HOST_MEM:
+    putNet64(receiver, elem->counterBlock.host_mem.mem_total);
+    putNet64(receiver, elem->counterBlock.host_mem.mem_free);
+    putNet64(receiver, elem->counterBlock.host_mem.mem_shared);
+    putNet64(receiver, elem->counterBlock.host_mem.mem_buffers);
+    putNet64(receiver, elem->counterBlock.host_mem.mem_cached);
+    putNet64(receiver, elem->counterBlock.host_mem.swap_total);
+    putNet64(receiver, elem->counterBlock.host_mem.swap_free);
+    putNet32(receiver, elem->counterBlock.host_mem.page_in);
+    putNet32(receiver, elem->counterBlock.host_mem.page_out);
+    putNet32(receiver, elem->counterBlock.host_mem.swap_in);
+    putNet32(receiver, elem->counterBlock.host_mem.swap_out);
+    break;
+  case SFLCOUNTERS_HOST_DSK:
+    putNet64(receiver, elem->counterBlock.host_dsk.disk_total);
+    putNet64(receiver, elem->counterBlock.host_dsk.disk_free);
+    putNet32(receiver, elem->counterBlock.host_dsk.part_max_used);
+    putNet32(receiver, elem->counterBlock.host_dsk.reads);
+    putNet64(receiver, elem->counterBlock.host_dsk.bytes_read);
+    putNet32(receiver, elem->counterBlock.host_dsk.read_time);
+    putNet32(receiver, elem->counterBlock.host_dsk.writes);
+    putNet64(receiver, elem->counterBlock.host_dsk.bytes_written);
+    putNet32(receiver, elem->counterBlock.host_dsk.write_time);
+    break;
+  case SFLCOUNTERS_HOST_NIO:
+    putNet64(receiver, elem->counterBlock.host_nio.bytes_in);
+    putNet32(receiver, elem->counterBlock.host_nio.pkts_in);
+    putNet32(receiver, elem->counterBlock.host_nio.errs_in);
+    putNet32(receiver, elem->counterBlock.host_nio.drops_in);
+    putNet64(receiver, elem->counterBlock.host_nio.bytes_out);
+    putNet32(receiver, elem->counterBlock.host_nio.pkts_out);
+    putNet32(receiver, elem->counterBlock.host_nio.errs_out);
+    putNet32(receiver, elem->counterBlock.host_nio.drops_out);
+    break;
+  case SFLCOUNTERS_HOST_VRT_NODE:
+    putNet32(receiver, elem->counterBlock.host_vrt_node.mhz);
+    putNet32(receiver, elem->counterBlock.host_vrt_node.cpus);
+    putNet64(receiver, elem->counterBlock.host_vrt_node.memory);
+    putNet64(receiver, elem->counterBlock.host_vrt_node.memory_free);
+    putNet32(receiver, elem->counterBlock.host_vrt_node.num_domains);
+    break;
+  case SFLCOUNTERS_HOST_VRT_CPU:
+    putNet32(receiver, elem->counterBlock.host_vrt_cpu.state);
+    putNet32(receiver, elem->counterBlock.host_vrt_cpu.cpuTime);
+    putNet32(receiver, elem->counterBlock.host_vrt_cpu.nrVirtCpu);
+    break;
+  case SFLCOUNTERS_HOST_VRT_MEM:
+    putNet64(receiver, elem->counterBlock.host_vrt_mem.memory);
+    putNet64(receiver, elem->counterBlock.host_vrt_mem.maxMemory);
+    break;
+  case SFLCOUNTERS_HOST_VRT_DSK:
+    putNet64(receiver, elem->counterBlock.host_vrt_dsk.capacity);
+    putNet64(receiver, elem->counterBlock.host_vrt_dsk.allocation);
+    putNet64(receiver, elem->counterBlock.host_vrt_dsk.available);
+    putNet32(receiver, elem->counterBlock.host_vrt_dsk.rd_req);
+    putNet64(receiver, elem->counterBlock.host_vrt_dsk.rd_bytes);
+    putNet32(receiver, elem->counterBlock.host_vrt_dsk.wr_req);
+    putNet64(receiver, elem->counterBlock.host_vrt_dsk.wr_bytes);
+    putNet32(receiver, elem->counterBlock.host_vrt_dsk.errs);
+    break;
+  case SFLCOUNTERS_HOST_VRT_NIO:
+    putNet64(receiver, elem->counterBlock.host_vrt_nio.bytes_in);
+    putNet32(receiver, elem->counterBlock.host_vrt_nio.pkts_in);
+    putNet32(receiver, elem->counterBlock.host_vrt_nio.errs_in);
+    putNet32(receiver, elem->counterBlock.host_vrt_nio.drops_in);
+    putNet64(receiver, elem->counterBlock.host_vrt_nio.bytes_out);
+    putNet32(receiver, elem->counterBlock.host_vrt_nio.pkts_out);
+    putNet32(receiver, elem->counterBlock.host_vrt_nio.errs_out);
+    putNet32(receiver, elem->counterBlock.host_vrt_nio.drops_out);
+    break; 
+  case SFLCOUNTERS_HOST_GPU_NVML:
+    putNet32(receiver, elem->counterBlock.host_gpu_nvml.device_count);
+    putNet32(receiver, elem->counterBlock.host_gpu_nvml.processes);
+    putNet32(receiver, elem->counterBlock.host_gpu_nvml.gpu_time);
+    putNet32(receiver, elem->counterBlock.host_gpu_nvml.mem_time);
+    putNet64(receiver, elem->counterBlock.host_gpu_nvml.mem_total);
+    putNet64(receiver, elem->counterBlock.host_gpu_nvml.mem_free);
+    putNet32(receiver, elem->counterBlock.host_gpu_nvml.ecc_errors);
+    putNet32(receiver, elem->counterBlock.host_gpu_nvml.energy);
+    putNet32(receiver, elem->counterBlock.host_gpu_nvml.temperature);
+    putNet32(receiver, elem->counterBlock.host_gpu_nvml.fan_speed);
+    break;
+
+  case SFLCOUNTERS_HOST_IP:
+    putNet32_run_scalar(receiver, &elem->counterBlock.host_ip, XDRSIZ_IP_COUNTERS / 4);
+    break;
+  case SFLCOUNTERS_HOST_ICMP:
+    putNet32_run_scalar(receiver, &elem->counterBlock.host_icmp, XDRSIZ_ICMP_COUNTERS / 4);
+    break;
+  case SFLCOUNTERS_HOST_TCP:
+    putNet32_run_scalar(receiver, &elem->counterBlock.host_tcp, XDRSIZ_TCP_COUNTERS / 4);
+    break;
+  case SFLCOUNTERS_HOST_UDP:
+    putNet32_run_scalar(receiver, &elem->counterBlock.host_udp, XDRSIZ_UDP_COUNTERS / 4);
+    break;
+
+  case SFLCOUNTERS_APP:
+    putString(receiver, &elem->counterBlock.app.application);
+    putNet32(receiver, elem->counterBlock.app.status_OK);
+    putNet32(receiver, elem->counterBlock.app.errors_OTHER);
+    putNet32(receiver, elem->counterBlock.app.errors_TIMEOUT);
+    putNet32(receiver, elem->counterBlock.app.errors_INTERNAL_ERROR);
+    putNet32(receiver, elem->counterBlock.app.errors_BAD_REQUEST);
+    putNet32(receiver, elem->counterBlock.app.errors_FORBIDDEN);
+    putNet32(receiver, elem->counterBlock.app.errors_TOO_LARGE);
+    putNet32(receiver, elem->counterBlock.app.errors_NOT_IMPLEMENTED);
+    putNet32(receiver, elem->counterBlock.app.errors_NOT_FOUND);
+    putNet32(receiver, elem->counterBlock.app.errors_UNAVAILABLE);
+    putNet32(receiver, elem->counterBlock.app.errors_UNAUTHORIZED);
+    break; 
+  case SFLCOUNTERS_APP_RESOURCES:
+    putNet32(receiver, elem->counterBlock.appResources.user_time);
+    putNet32(receiver, elem->counterBlock.appResources.system_time);
+    putNet64(receiver, elem->counterBlock.appResources.mem_used);
+    putNet64(receiver, elem->counterBlock.appResources.mem_max);
+    putNet32(receiver, elem->counterBlock.appResources.fd_open);
+    putNet32(receiver, elem->counterBlock.appResources.fd_max);
+    putNet32(receiver, elem->counterBlock.appResources.conn_open);
+    putNet32(receiver, elem->counterBlock.appResources.conn_max);
+    break;
+  case SFLCOUNTERS_APP_WORKERS:
+    putNet32(receiver, elem->counterBlock.appWorkers.workers_active);
+    putNet32(receiver, elem->counterBlock.appWorkers.workers_idle);
+    putNet32(receiver, elem->counterBlock.appWorkers.workers_max);
+    putNet32(receiver, elem->counterBlock.appWorkers.req_delayed);
+    putNet32(receiver, elem->counterBlock.appWorkers.req_dropped);
+    break;
+  case SFLCOUNTERS_PORTNAME: 
+    putString(receiver, &elem->counterBlock.portName.portName);
+    break;
+  case SFLCOUNTERS_BCM_TABLES:
+    putNet32_run_scalar(receiver, &elem->counterBlock.bcm_tables, XDRSIZ_BCM_TABLES / 4);
+    break;
+
+  default:
+    {
+      char errm[128];
+      sprintf(errm, "unexpected counters tag (%u)", elem->tag);
+      sflError(receiver, errm);
+      return -1;
+    }
+    break;
+  }
+  return 0;
+}
+
+int sfl_receiver_writeCountersSampleCached_ref(SFLReceiver *receiver, SFL_COUNTERS_SAMPLE_TYPE *cs, SFLStaticCountersCache *cache, uint32_t revision)
+{
+  int packedSize;
+  SFLCounters_sample_element *elem;
+  SFLStaticCountersCache *hit = NULL;
+  int staticFirst;
+
+  if(cs == NULL) return -1;
+  if(cache && revision) {
+    if(staticCacheHit(cache, cs, revision))
+      hit = cache;
+  }
+  else cache = NULL;
+  staticFirst = (cache != NULL);
+
+  // if the sample pkt is full enough so that this sample might put
+  // it over the limit, then we should send it now.
+  if((packedSize = computeCountersSampleSize(receiver, cs, hit)) == -1) return -1;
+  
+  // check in case this one sample alone is too big for the datagram
+  // in fact - if it is even half as big then we should ditch it. Very
+  // important to avoid overruning the packet buffer.
+  if(packedSize > (int)(receiver->sFlowRcvrMaximumDatagramSize)) {
+    sflError(receiver, "counters sample too big for datagram");
+    return -1;
+  }
+  
+  if((receiver->sampleCollector.pktlen + packedSize) >= receiver->sFlowRcvrMaximumDatagramSize)
+    sendSample(receiver);
+  
+  receiver->sampleCollector.numSamples++;
+  
+#ifdef SFL_USE_32BIT_INDEX
+  putNet32(receiver, SFLCOUNTERS_SAMPLE_EXPANDED);
+#else
+  putNet32(receiver, SFLCOUNTERS_SAMPLE);
+#endif
+
+  putNet32(receiver, packedSize - 8); // tag and length not included
+  putNet32(receiver, cs->sequence_number);
+
+#ifdef SFL_USE_32BIT_INDEX
+  putNet32(receiver, cs->ds_class);
+  putNet32(receiver, cs->ds_index);
+#else
+  putNet32(receiver, cs->source_id);
+#endif
+
+  putNet32(receiver, cs->num_elements);
+
+  if(hit) {
+    // splice in the pre-encoded static elements
+    memcpy(receiver->sampleCollector.datap, hit->xdr, hit->len);
+    receiver->sampleCollector.datap += (hit->len / 4);
+  }
+  else if(cache) {
+    // encode the static elements here,  and remember the result
+    uint32_t *start = receiver->sampleCollector.datap;
+    uint32_t tags[SFL_STATIC_CACHE_MAX_ELEMENTS];
+    uint32_t n = 0;
+    for(elem = cs->elements; elem != NULL; elem = elem->nxt) {
+      if(!isStaticElement(elem->tag)) continue;
+      if(n == SFL_STATIC_CACHE_MAX_ELEMENTS) {
+	/* too many to remember - don't cache this one */
+	cache = NULL;
+	break;
+      }
+      tags[n++] = elem->tag;
+      putCountersElement_ref(receiver, elem);
+    }
+    if(cache) {
+      uint32_t len = (uint32_t)((u_char *)receiver->sampleCollector.datap - (u_char *)start);
+      if(sfl_agent_staticCacheAlloc(receiver->agent, cache, len)) {
+	memcpy(cache->xdr, start, len);
+	memcpy(cache->tags, tags, n * sizeof(uint32_t));
+	cache->len = len;
+	cache->num_elements = n;
+	cache->revision = revision;
+      }
+    }
+    else {
+      /* write the rest of the static elements normally */
+      for(; elem != NULL; elem = elem->nxt)
+	if(isStaticElement(elem->tag)) putCountersElement_ref(receiver, elem);
+    }
+  }
+
+  for(elem = cs->elements; elem != NULL; elem = elem->nxt) {
+    if(staticFirst && isStaticElement(elem->tag)) continue;
+    if(putCountersElement_ref(receiver, elem) == -1) return -1;
+  }
+  // sanity check
+  assert(((u_char *)receiver->sampleCollector.datap
+	  - (u_char *)receiver->sampleCollector.data
+	  - receiver->sampleCollector.pktlen)  == (uint32_t)packedSize);
+
+  // update the pktlen
+  receiver->sampleCollector.pktlen = (uint32_t)((u_char *)receiver->sampleCollector.datap - (u_char *)receiver->sampleCollector.data);
+  return packedSize;
+}
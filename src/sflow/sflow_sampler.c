@@ -135,11 +135,21 @@ void sfl_sampler_tick(SFLSampler *sampler, time_t now)
 */
 
 void sfl_sampler_writeFlowSample(SFLSampler *sampler, SFL_FLOW_SAMPLE_TYPE *fs)
+{
+  sfl_sampler_writeFlowSampleTo(sampler, sampler->myReceiver, fs);
+}
+
+/*_________________--------------------------------__________________
+  _________________ sfl_sampler_writeFlowSampleTo  __________________
+  -----------------________________________________------------------
+*/
+
+void sfl_sampler_writeFlowSampleTo(SFLSampler *sampler, SFLReceiver *receiver, SFL_FLOW_SAMPLE_TYPE *fs)
 {
   if(fs == NULL) return;
-  sampler->samplesThisTick++;
+  __atomic_add_fetch(&sampler->samplesThisTick, 1, __ATOMIC_RELAXED);
   /* increment the sequence number */
-  fs->sequence_number = ++sampler->flowSampleSeqNo;
+  fs->sequence_number = __atomic_add_fetch(&sampler->flowSampleSeqNo, 1, __ATOMIC_RELAXED);
   /* copy the other header fields in */
 #ifdef SFL_USE_32BIT_INDEX
   fs->ds_class = SFL_DS_CLASS(sampler->dsi);
@@ -151,8 +161,8 @@ void sfl_sampler_writeFlowSample(SFLSampler *sampler, SFL_FLOW_SAMPLE_TYPE *fs)
   if(fs->sampling_rate == 0) fs->sampling_rate = sampler->sFlowFsPacketSamplingRate;
   /* the samplePool may be maintained upstream too. */
   if( fs->sample_pool == 0) fs->sample_pool = sampler->samplePool;
-  /* sent to my receiver */
-  if(sampler->myReceiver) sfl_receiver_writeFlowSample(sampler->myReceiver, fs);
+  /* send to the receiver,  unless this sampler has been disabled */
+  if(receiver && sampler->myReceiver) sfl_receiver_writeFlowSample(receiver, fs);
 }
 
 /*_________________---------------------------__________________
@@ -0,0 +1,629 @@
+/* This software is distributed under the following license:
+ * http://sflow.net/license.html
+ */
+
+/* Equivalence tests and microbenchmark for the XDR sample encoder.
+
+   Every sample is written twice,  once with the one-pass encoder in
+   libsflow and once with the original two-pass encoder (built from
+   sflow_receiver_ref.c),  each into its own receiver.  The datagrams
+   that come out must be identical byte-for-byte - including where the
+   datagram boundaries fall.  The few elements whose encoding was
+   corrected on purpose are checked against the spec instead (see
+   wireLengths[]).  Then the common sample shapes are timed with both
+   encoders.
+
+   make test    - equivalence tests only (-t)
+   make bench   - tests,  then timings as one JSON object on stdout
+*/
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include <time.h>
+#include "sflow_api.h"
+
+int sfl_receiver_writeFlowSample_ref(SFLReceiver *receiver, SFL_FLOW_SAMPLE_TYPE *fs);
+int sfl_receiver_writeCountersSampleCached_ref(SFLReceiver *receiver, SFL_COUNTERS_SAMPLE_TYPE *cs, SFLStaticCountersCache *cache, uint32_t revision);
+
+#define XB_MAX_ELEMENTS 16
+#define XB_MAX_ADAPTORS 64
+#define XB_HOST_ADAPTORS 4
+#define XB_MAX_LANES 4
+#define XB_HEADER_BYTES 128
+#define XB_STR_BYTES 64
+
+typedef enum {
+  XB_SHAPE_FLOW = 0,    /* sampled header */
+  XB_SHAPE_FLOW_TCP,    /* sampled header + socket4 + tcp_info (mod_tcp) */
+  XB_SHAPE_HOST,        /* host counters,  as from the main poller */
+  XB_SHAPE_INTERFACE,   /* interface counters */
+  XB_SHAPE_FLOW_EXTRA,  /* every other flow element we can compare */
+  XB_SHAPE_CTRS_EXTRA,  /* every other counter block we can compare */
+  XB_NUM_MIXED_SHAPES,
+  /* host counters from a hypervisor with XB_MAX_ADAPTORS adaptors.  Left
+     out of the mixed runs,  where it would share a cache revision with
+     XB_SHAPE_HOST. */
+  XB_SHAPE_HOST_BIG = XB_NUM_MIXED_SHAPES,
+  XB_NUM_SHAPES
+} EnumXBShape;
+
+static const char *shapeNames[XB_NUM_SHAPES] = {
+  "flow", "flow_tcp", "host", "interface", "flow_extra", "counters_extra", "host_big"
+};
+
+typedef struct _XBCapture {
+  u_char *buf;
+  size_t len;
+  size_t capacity;
+  uint32_t datagrams;
+  int keep;
+} XBCapture;
+
+typedef struct _XBSample {
+  int isFlow;
+  SFL_FLOW_SAMPLE_TYPE fs;
+  SFL_COUNTERS_SAMPLE_TYPE cs;
+  SFLFlow_sample_element fe[XB_MAX_ELEMENTS];
+  SFLCounters_sample_element ce[XB_MAX_ELEMENTS];
+  uint32_t numElements;
+  u_char header[XB_HEADER_BYTES];
+  char strings[8][XB_STR_BYTES];
+  SFLAdaptor *adaptors[XB_MAX_ADAPTORS];
+  SFLAdaptorList adaptorList;
+  SFLLane lanes[XB_MAX_LANES];
+} XBSample;
+
+/*_________________---------------------------__________________
+  _________________    agent callbacks        __________________
+  -----------------___________________________------------------
+*/
+
+static void *xbAlloc(void *magic, SFLAgent *agent, size_t bytes) {
+  return calloc(1, bytes);
+}
+
+static int xbFree(void *magic, SFLAgent *agent, void *obj) {
+  free(obj);
+  return 0;
+}
+
+static void xbError(void *magic, SFLAgent *agent, char *msg) {
+  /* both encoders report the same errors,  and the tests provoke some */
+}
+
+static void xbSend(void *magic, SFLAgent *agent, SFLReceiver *receiver, u_char *pkt, uint32_t pktLen) {
+  XBCapture *cap = (XBCapture *)magic;
+  cap->datagrams++;
+  if(!cap->keep)
+    return;
+  if(cap->len + pktLen > cap->capacity) {
+    cap->capacity = (cap->capacity + pktLen) * 2;
+    cap->buf = realloc(cap->buf, cap->capacity);
+  }
+  memcpy(cap->buf + cap->len, pkt, pktLen);
+  cap->len += pktLen;
+}
+
+typedef struct _XBEncoder {
+  SFLAgent agent;
+  SFLReceiver receiver;
+  SFLStaticCountersCache cache;
+  XBCapture cap;
+} XBEncoder;
+
+static void encoderInit(XBEncoder *enc, uint32_t datagramSize) {
+  SFLAddress myIP;
+  memset(enc, 0, sizeof(*enc));
+  memset(&myIP, 0, sizeof(myIP));
+  myIP.type = SFLADDRESSTYPE_IP_V4;
+  myIP.address.ip_v4.addr = htonl(0x0A000001);
+  enc->cap.keep = 1;
+  sfl_agent_init(&enc->agent, &myIP, 0, 1000, 1000, &enc->cap, xbAlloc, xbFree, xbError, xbSend);
+  // a shard receiver stamps datagrams with the time we give it, not the clock
+  sfl_receiver_init_shard(&enc->receiver, &enc->agent, 1);
+  sfl_receiver_set_now(&enc->receiver, 2000, 0);
+  sfl_receiver_set_sFlowRcvrMaximumDatagramSize(&enc->receiver, datagramSize);
+}
+
+static void encoderFree(XBEncoder *enc) {
+  sfl_agent_staticCacheFree(&enc->agent, &enc->cache);
+  free(enc->cap.buf);
+}
+
+/*_________________---------------------------__________________
+  _________________     sample shapes         __________________
+  -----------------___________________________------------------
+*/
+
+static uint64_t rnd_state = 88172645463325252ULL;
+
+static uint64_t rnd(void) {
+  rnd_state ^= rnd_state << 13;
+  rnd_state ^= rnd_state >> 7;
+  rnd_state ^= rnd_state << 17;
+  return rnd_state;
+}
+
+static void rndFill(void *obj, size_t len) {
+  u_char *p = (u_char *)obj;
+  size_t ii;
+  for(ii = 0; ii < len; ii++)
+    p[ii] = (u_char)rnd();
+}
+
+static void rndString(XBSample *smp, int idx, SFLString *str) {
+  uint32_t ii, len = rnd() % (XB_STR_BYTES - 1);
+  for(ii = 0; ii < len; ii++)
+    smp->strings[idx][ii] = 'a' + (rnd() % 26);
+  str->str = smp->strings[idx];
+  str->len = len;
+}
+
+static void rndAddress(SFLAddress *addr) {
+  memset(addr, 0, sizeof(*addr));
+  if(rnd() & 1) {
+    addr->type = SFLADDRESSTYPE_IP_V6;
+    rndFill(&addr->address.ip_v6, 16);
+  }
+  else {
+    addr->type = SFLADDRESSTYPE_IP_V4;
+    rndFill(&addr->address.ip_v4, 4);
+  }
+}
+
+static SFLFlow_sample_element *addFlow(XBSample *smp, uint32_t tag) {
+  SFLFlow_sample_element *elem = &smp->fe[smp->numElements++];
+  rndFill(elem, sizeof(*elem));
+  elem->tag = tag;
+  elem->nxt = NULL;
+  if(smp->numElements > 1)
+    smp->fe[smp->numElements - 2].nxt = elem;
+  else
+    smp->fs.elements = elem;
+  return elem;
+}
+
+/* The static elements (host id,  adaptors,  port name) are only allowed
+   to change when the cache revision does,  so their contents come from
+   a generator seeded with the revision. */
+static uint64_t staticSeed = 1;
+
+static uint64_t rndStaticBegin(uint32_t tag) {
+  uint64_t saved = rnd_state;
+  rnd_state = (staticSeed * 0x9E3779B97F4A7C15ULL) ^ tag;
+  if(rnd_state == 0) rnd_state = 1;
+  return saved;
+}
+
+static SFLCounters_sample_element *addCounters(XBSample *smp, uint32_t tag) {
+  SFLCounters_sample_element *elem = &smp->ce[smp->numElements++];
+  rndFill(elem, sizeof(*elem));
+  elem->tag = tag;
+  elem->nxt = NULL;
+  if(smp->numElements > 1)
+    smp->ce[smp->numElements - 2].nxt = elem;
+  else
+    smp->cs.elements = elem;
+  return elem;
+}
+
+static void addHeader(XBSample *smp, uint32_t headerLen) {
+  SFLFlow_sample_element *elem = addFlow(smp, SFLFLOW_HEADER);
+  rndFill(smp->header, sizeof(smp->header));
+  elem->flowType.header.header_protocol = SFLHEADER_ETHERNET_ISO8023;
+  elem->flowType.header.header_length = headerLen;
+  elem->flowType.header.header_bytes = smp->header;
+}
+
+static void buildSample(XBSample *smp, EnumXBShape shape, int vary) {
+  SFLFlow_sample_element *fe;
+  SFLCounters_sample_element *ce;
+  uint64_t saved;
+  uint32_t ii;
+  // vary: odd header and string lengths,  otherwise the typical shape
+  uint32_t headerLen = vary ? (rnd() % (XB_HEADER_BYTES + 1)) : XB_HEADER_BYTES;
+
+  memset(smp, 0, sizeof(*smp));
+  smp->isFlow = (shape == XB_SHAPE_FLOW
+		 || shape == XB_SHAPE_FLOW_TCP
+		 || shape == XB_SHAPE_FLOW_EXTRA);
+  if(smp->isFlow) {
+    rndFill(&smp->fs, sizeof(smp->fs));
+    smp->fs.elements = NULL;
+  }
+  else {
+    rndFill(&smp->cs, sizeof(smp->cs));
+    smp->cs.elements = NULL;
+  }
+
+  switch(shape) {
+  case XB_SHAPE_FLOW:
+    addHeader(smp, headerLen);
+    break;
+  case XB_SHAPE_FLOW_TCP:
+    addHeader(smp, headerLen);
+    addFlow(smp, SFLFLOW_EX_SOCKET4);
+    addFlow(smp, SFLFLOW_EX_TCP_INFO);
+    break;
+  case XB_SHAPE_FLOW_EXTRA:
+    /* not the IPv6 tunnel elements: the reference encoder has no
+       size for them (see checkWireLengths) */
+    addHeader(smp, headerLen);
+    addFlow(smp, SFLFLOW_ETHERNET);
+    addFlow(smp, SFLFLOW_IPV4);
+    addFlow(smp, SFLFLOW_IPV6);
+    addFlow(smp, SFLFLOW_EX_SWITCH);
+    fe = addFlow(smp, SFLFLOW_EX_ROUTER);
+    rndAddress(&fe->flowType.router.nexthop);
+    fe = addFlow(smp, SFLFLOW_EX_USER);
+    rndString(smp, 0, &fe->flowType.user.src_user);
+    rndString(smp, 1, &fe->flowType.user.dst_user);
+    fe = addFlow(smp, SFLFLOW_EX_URL);
+    rndString(smp, 2, &fe->flowType.url.url);
+    rndString(smp, 3, &fe->flowType.url.host);
+    fe = addFlow(smp, SFLFLOW_EX_NAT);
+    rndAddress(&fe->flowType.nat.src);
+    rndAddress(&fe->flowType.nat.dst);
+    addFlow(smp, SFLFLOW_EX_L2_TUNNEL_EGRESS);
+    addFlow(smp, SFLFLOW_EX_IPV4_TUNNEL_INGRESS);
+    addFlow(smp, SFLFLOW_EX_DECAP_INGRESS);
+    addFlow(smp, SFLFLOW_EX_VNI_EGRESS);
+    addFlow(smp, SFLFLOW_EX_PROXY_SOCKET6);
+    fe = addFlow(smp, SFLFLOW_APP_ACTOR_INIT);
+    rndString(smp, 4, &fe->flowType.actor.actor);
+    break;
+  case XB_SHAPE_HOST:
+  case XB_SHAPE_HOST_BIG:
+    saved = rndStaticBegin(SFLCOUNTERS_HOST_HID);
+    ce = addCounters(smp, SFLCOUNTERS_HOST_HID);
+    rndString(smp, 0, &ce->counterBlock.host_hid.hostname);
+    rndString(smp, 1, &ce->counterBlock.host_hid.os_release);
+    addCounters(smp, SFLCOUNTERS_HOST_PAR);
+    ce = addCounters(smp, SFLCOUNTERS_ADAPTORS);
+    smp->adaptorList.num_adaptors = (shape == XB_SHAPE_HOST_BIG) ? XB_MAX_ADAPTORS : XB_HOST_ADAPTORS;
+    smp->adaptorList.adaptors = smp->adaptors;
+    for(ii = 0; ii < smp->adaptorList.num_adaptors; ii++) {
+      static SFLAdaptor ads[XB_MAX_ADAPTORS];
+      rndFill(&ads[ii], sizeof(SFLAdaptor));
+      ads[ii].num_macs = 1;
+      smp->adaptors[ii] = &ads[ii];
+    }
+    ce->counterBlock.adaptors = &smp->adaptorList;
+    rnd_state = saved;
+    addCounters(smp, SFLCOUNTERS_HOST_CPU);
+    addCounters(smp, SFLCOUNTERS_HOST_MEM);
+    addCounters(smp, SFLCOUNTERS_HOST_DSK);
+    addCounters(smp, SFLCOUNTERS_HOST_NIO);
+    addCounters(smp, SFLCOUNTERS_HOST_IP);
+    addCounters(smp, SFLCOUNTERS_HOST_ICMP);
+    addCounters(smp, SFLCOUNTERS_HOST_TCP);
+    addCounters(smp, SFLCOUNTERS_HOST_UDP);
+    break;
+  case XB_SHAPE_INTERFACE:
+    addCounters(smp, SFLCOUNTERS_GENERIC);
+    addCounters(smp, SFLCOUNTERS_ETHERNET);
+    addCounters(smp, SFLCOUNTERS_LACP);
+    ce = addCounters(smp, SFLCOUNTERS_SFP);
+    rndFill(smp->lanes, sizeof(smp->lanes));
+    ce->counterBlock.sfp.num_lanes = vary ? (rnd() % (XB_MAX_LANES + 1)) : 1;
+    ce->counterBlock.sfp.lanes = smp->lanes;
+    saved = rndStaticBegin(SFLCOUNTERS_PORTNAME);
+    ce = addCounters(smp, SFLCOUNTERS_PORTNAME);
+    rndString(smp, 0, &ce->counterBlock.portName.portName);
+    rnd_state = saved;
+    break;
+  case XB_SHAPE_CTRS_EXTRA:
+    /* not VG,  VLAN or PROCESSOR: the reference encoder declares
+       sizeof() for those,  which includes struct padding (see
+       checkWireLengths) */
+    addCounters(smp, SFLCOUNTERS_TOKENRING);
+    addCounters(smp, SFLCOUNTERS_HOST_VRT_NODE);
+    addCounters(smp, SFLCOUNTERS_HOST_VRT_CPU);
+    addCounters(smp, SFLCOUNTERS_HOST_VRT_MEM);
+    addCounters(smp, SFLCOUNTERS_HOST_VRT_DSK);
+    addCounters(smp, SFLCOUNTERS_HOST_VRT_NIO);
+    addCounters(smp, SFLCOUNTERS_HOST_GPU_NVML);
+    addCounters(smp, SFLCOUNTERS_BCM_TABLES);
+    ce = addCounters(smp, SFLCOUNTERS_APP);
+    rndString(smp, 0, &ce->counterBlock.app.application);
+    addCounters(smp, SFLCOUNTERS_APP_RESOURCES);
+    addCounters(smp, SFLCOUNTERS_APP_WORKERS);
+    break;
+  default:
+    break;
+  }
+}
+
+static int writeSample(XBEncoder *enc, XBSample *smp, int ref, uint32_t revision) {
+  if(smp->isFlow)
+    return ref
+      ? sfl_receiver_writeFlowSample_ref(&enc->receiver, &smp->fs)
+      : sfl_receiver_writeFlowSample(&enc->receiver, &smp->fs);
+  return ref
+    ? sfl_receiver_writeCountersSampleCached_ref(&enc->receiver, &smp->cs, &enc->cache, revision)
+    : sfl_receiver_writeCountersSampleCached(&enc->receiver, &smp->cs, &enc->cache, revision);
+}
+
+/*_________________---------------------------__________________
+  _________________   equivalence tests       __________________
+  -----------------___________________________------------------
+*/
+
+static int compareRun(const char *test, uint32_t datagramSize, uint32_t samples, int cached) {
+  XBEncoder *enc = calloc(1, sizeof(XBEncoder));
+  XBEncoder *ref = calloc(1, sizeof(XBEncoder));
+  XBSample *smp = calloc(1, sizeof(XBSample));
+  uint32_t ii, revision = 0;
+  int ok = 1;
+
+  encoderInit(enc, datagramSize);
+  encoderInit(ref, datagramSize);
+  for(ii = 0; ii < samples && ok; ii++) {
+    EnumXBShape shape = rnd() % XB_NUM_MIXED_SHAPES;
+    int len_enc, len_ref;
+    buildSample(smp, shape, 1);
+    // the static elements change now and again
+    if(cached && (ii % 50) == 0)
+      revision++;
+    staticSeed = cached ? revision : rnd();
+    len_enc = writeSample(enc, smp, 0, revision);
+    len_ref = writeSample(ref, smp, 1, revision);
+    if(len_enc != len_ref) {
+      fprintf(stderr, "%s: sample %u (%s) encoded as %d bytes,  reference %d\n",
+	      test, ii, shapeNames[shape], len_enc, len_ref);
+      ok = 0;
+    }
+  }
+  sfl_receiver_flush(&enc->receiver);
+  sfl_receiver_flush(&ref->receiver);
+  if(ok
+     && (enc->cap.len != ref->cap.len
+	 || enc->cap.datagrams != ref->cap.datagrams
+	 || memcmp(enc->cap.buf, ref->cap.buf, enc->cap.len) != 0)) {
+    fprintf(stderr, "%s: datagrams differ (%u datagrams/%zu bytes,  reference %u/%zu)\n",
+	    test, enc->cap.datagrams, enc->cap.len, ref->cap.datagrams, ref->cap.len);
+    ok = 0;
+  }
+  encoderFree(enc);
+  encoderFree(ref);
+  free(enc);
+  free(ref);
+  free(smp);
+  return ok;
+}
+
+static int checkTooBig(void) {
+  // a sample bigger than the datagram is dropped,  along with the datagram so far
+  XBEncoder *enc = calloc(1, sizeof(XBEncoder));
+  XBEncoder *ref = calloc(1, sizeof(XBEncoder));
+  XBSample *smp = calloc(1, sizeof(XBSample));
+  int ok = 1;
+  encoderInit(enc, SFL_MIN_DATAGRAM_SIZE);
+  encoderInit(ref, SFL_MIN_DATAGRAM_SIZE);
+  buildSample(smp, XB_SHAPE_FLOW_EXTRA, 0);
+  if(writeSample(enc, smp, 0, 0) != -1
+     || writeSample(ref, smp, 1, 0) != -1)
+    ok = 0;
+  buildSample(smp, XB_SHAPE_FLOW, 0);
+  writeSample(enc, smp, 0, 0);
+  writeSample(ref, smp, 1, 0);
+  sfl_receiver_flush(&enc->receiver);
+  sfl_receiver_flush(&ref->receiver);
+  if(enc->cap.len != ref->cap.len
+     || memcmp(enc->cap.buf, ref->cap.buf, enc->cap.len) != 0)
+    ok = 0;
+  if(!ok)
+    fprintf(stderr, "too_big: encoders disagree\n");
+  encoderFree(enc);
+  encoderFree(ref);
+  free(enc);
+  free(ref);
+  free(smp);
+  return ok;
+}
+
+static int checkStaticCache(void) {
+  // the cache must remember which static elements it holds,  or it never hits
+  static const uint32_t tags[] = { SFLCOUNTERS_HOST_HID, SFLCOUNTERS_HOST_PAR, SFLCOUNTERS_ADAPTORS };
+  XBEncoder *enc = calloc(1, sizeof(XBEncoder));
+  XBEncoder *ref = calloc(1, sizeof(XBEncoder));
+  XBSample *smp = calloc(1, sizeof(XBSample));
+  uint32_t ii, nTags = sizeof(tags) / sizeof(tags[0]);
+  int ok = 1;
+  encoderInit(enc, SFL_DEFAULT_DATAGRAM_SIZE);
+  encoderInit(ref, SFL_DEFAULT_DATAGRAM_SIZE);
+  staticSeed = 1;
+  buildSample(smp, XB_SHAPE_HOST, 0);
+  writeSample(enc, smp, 0, 1);
+  writeSample(ref, smp, 1, 1);
+  if(enc->cache.num_elements != nTags
+     || ref->cache.num_elements != nTags)
+    ok = 0;
+  for(ii = 0; ok && ii < nTags; ii++) {
+    if(enc->cache.tags[ii] != tags[ii]
+       || ref->cache.tags[ii] != tags[ii])
+      ok = 0;
+  }
+  if(!ok)
+    fprintf(stderr, "static_cache: tags not remembered (%u elements,  reference %u)\n",
+	    enc->cache.num_elements, ref->cache.num_elements);
+  encoderFree(enc);
+  encoderFree(ref);
+  free(enc);
+  free(ref);
+  free(smp);
+  return ok;
+}
+
+/* Elements where the one-pass encoder deliberately differs from the
+   reference: it writes the XDR lengths from the sFlow spec,  where the
+   reference declared sizeof() of a padded struct (VG,  VLAN,  PROCESSOR)
+   or had no case at all (IPv6 tunnel).  These are checked against the
+   spec instead of against the reference. */
+static const struct {
+  const char *name;
+  int isFlow;
+  uint32_t tag;
+  uint32_t xdrLen;  /* element body,  without tag and length */
+} wireLengths[] = {
+  { "vg", 0, SFLCOUNTERS_VG, 80 },
+  { "vlan", 0, SFLCOUNTERS_VLAN, 28 },
+  { "processor", 0, SFLCOUNTERS_PROCESSOR, 28 },
+  { "ipv6_tunnel_egress", 1, SFLFLOW_EX_IPV6_TUNNEL_EGRESS, 56 },
+  { "ipv6_tunnel_ingress", 1, SFLFLOW_EX_IPV6_TUNNEL_INGRESS, 56 },
+};
+
+static int checkWireLengths(void) {
+  XBEncoder *enc = calloc(1, sizeof(XBEncoder));
+  XBSample *smp = calloc(1, sizeof(XBSample));
+  uint32_t ii, nCases = sizeof(wireLengths) / sizeof(wireLengths[0]);
+  int ok = 1;
+  encoderInit(enc, SFL_DEFAULT_DATAGRAM_SIZE);
+  for(ii = 0; ii < nCases; ii++) {
+    int empty, len;
+    // the same sample with and without the element
+    memset(smp, 0, sizeof(*smp));
+    smp->isFlow = wireLengths[ii].isFlow;
+    empty = writeSample(enc, smp, 0, 0);
+    if(smp->isFlow)
+      addFlow(smp, wireLengths[ii].tag);
+    else
+      addCounters(smp, wireLengths[ii].tag);
+    len = writeSample(enc, smp, 0, 0);
+    if(empty < 0
+       || len != (int)(empty + 8 + wireLengths[ii].xdrLen)) {
+      fprintf(stderr, "wire_length: %s encoded as %d bytes,  expected %u\n",
+	      wireLengths[ii].name, len - empty - 8, wireLengths[ii].xdrLen);
+      ok = 0;
+    }
+  }
+  encoderFree(enc);
+  free(enc);
+  free(smp);
+  return ok;
+}
+
+static int runTests(void) {
+  static const uint32_t sizes[] = { SFL_MIN_DATAGRAM_SIZE, SFL_DEFAULT_DATAGRAM_SIZE, 1500, SFL_MAX_DATAGRAM_SIZE };
+  uint32_t ii;
+  int ok = 1;
+  for(ii = 0; ii < sizeof(sizes) / sizeof(sizes[0]); ii++) {
+    char test[64];
+    snprintf(test, sizeof(test), "mixed_%u", sizes[ii]);
+    ok &= compareRun(test, sizes[ii], 5000, 0);
+    snprintf(test, sizeof(test), "mixed_cached_%u", sizes[ii]);
+    ok &= compareRun(test, sizes[ii], 5000, 1);
+  }
+  ok &= checkTooBig();
+  ok &= checkStaticCache();
+  ok &= checkWireLengths();
+  return ok;
+}
+
+/*_________________---------------------------__________________
+  _________________     microbenchmark        __________________
+  -----------------___________________________------------------
+*/
+
+static uint64_t nowNS(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static double timeShape(XBSample *smp, int ref, uint32_t revision, uint32_t datagramSize, uint32_t iterations, int *bytes) {
+  XBEncoder *enc = calloc(1, sizeof(XBEncoder));
+  uint64_t t0;
+  uint32_t ii;
+  double nS;
+  encoderInit(enc, datagramSize);
+  enc->cap.keep = 0;
+  *bytes = writeSample(enc, smp, ref, revision);
+  t0 = nowNS();
+  for(ii = 0; ii < iterations; ii++)
+    writeSample(enc, smp, ref, revision);
+  nS = (double)(nowNS() - t0) / iterations;
+  encoderFree(enc);
+  free(enc);
+  return nS;
+}
+
+static const char *swapName(void) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(SFL_XDR_NO_SIMD)
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")) return "avx2";
+  if(__builtin_cpu_supports("ssse3")) return "ssse3";
+#endif
+  return "scalar";
+}
+
+static void runBench(uint32_t iterations) {
+  // 64 adaptors do not fit in the default datagram
+  static const struct { const char *name; EnumXBShape shape; uint32_t revision; uint32_t datagramSize; } cases[] = {
+    { "flow", XB_SHAPE_FLOW, 0, SFL_DEFAULT_DATAGRAM_SIZE },
+    { "flow_tcp", XB_SHAPE_FLOW_TCP, 0, SFL_DEFAULT_DATAGRAM_SIZE },
+    { "host", XB_SHAPE_HOST, 0, SFL_DEFAULT_DATAGRAM_SIZE },
+    { "host_cached", XB_SHAPE_HOST, 1, SFL_DEFAULT_DATAGRAM_SIZE },
+    { "host_64_adaptors", XB_SHAPE_HOST_BIG, 0, SFL_MAX_DATAGRAM_SIZE },
+    { "host_64_adaptors_cached", XB_SHAPE_HOST_BIG, 1, SFL_MAX_DATAGRAM_SIZE },
+    { "interface", XB_SHAPE_INTERFACE, 0, SFL_DEFAULT_DATAGRAM_SIZE },
+    { "interface_cached", XB_SHAPE_INTERFACE, 1, SFL_DEFAULT_DATAGRAM_SIZE },
+  };
+  XBSample *smp = calloc(1, sizeof(XBSample));
+  uint32_t ii;
+  printf("{\"swap\":\"%s\",\"iterations\":%u,\"ns_per_sample\":{", swapName(), iterations);
+  for(ii = 0; ii < sizeof(cases) / sizeof(cases[0]); ii++) {
+    int bytes, bytes_ref;
+    double nS, nS_ref;
+    buildSample(smp, cases[ii].shape, 0);
+    nS_ref = timeShape(smp, 1, cases[ii].revision, cases[ii].datagramSize, iterations, &bytes_ref);
+    nS = timeShape(smp, 0, cases[ii].revision, cases[ii].datagramSize, iterations, &bytes);
+    printf("%s\"%s\":{\"bytes\":%d,\"onepass\":%.1f,\"reference\":%.1f,\"speedup\":%.2f}",
+	   ii ? "," : "",
+	   cases[ii].name,
+	   bytes,
+	   nS,
+	   nS_ref,
+	   nS ? (nS_ref / nS) : 0.0);
+  }
+  printf("}}\n");
+  free(smp);
+}
+
+/*_________________---------------------------__________________
+  _________________         main              __________________
+  -----------------___________________________------------------
+*/
+
+int main(int argc, char *argv[]) {
+  uint32_t iterations = 1000000;
+  int testOnly = 0;
+  int in;
+  while((in = getopt(argc, argv, "tn:")) != -1) {
+    switch(in) {
+    case 't': testOnly = 1; break;
+    case 'n': iterations = strtoul(optarg, NULL, 0); break;
+    default:
+      fprintf(stderr, "Usage: %s [-t] [-n iterations]\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if(!runTests()) {
+    fprintf(stderr, "XDR encoder equivalence tests FAILED\n");
+    exit(EXIT_FAILURE);
+  }
+  if(testOnly) {
+    fprintf(stderr, "XDR encoder equivalence tests passed\n");
+    exit(EXIT_SUCCESS);
+  }
+  if(iterations == 0)
+    iterations = 1;
+  runBench(iterations);
+  return EXIT_SUCCESS;
+}
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif